@@ -621,6 +621,8 @@
                                                                 @"AllowLocalNetworks": [self->defaults_ valueForKey: @"AllowLocalNetworks"],
                                                                 @"EvaluateCommonSubdomains": [self->defaults_ valueForKey: @"EvaluateCommonSubdomains"],
                                                                 @"IncludeLinkedDomains": [self->defaults_ valueForKey: @"IncludeLinkedDomains"],
+                                                                @"CompactHostsFile": [self->defaults_ valueForKey: @"CompactHostsFile"],
+                                                                @"DNSSinkholeEnabled": [self->defaults_ valueForKey: @"DNSSinkholeEnabled"],
                                                                 @"BlockSoundShouldPlay": [self->defaults_ valueForKey: @"BlockSoundShouldPlay"],
                                                                 @"BlockSound": [self->defaults_ valueForKey: @"BlockSound"],
                                                                 @"EnableErrorReporting": [self->defaults_ valueForKey: @"EnableErrorReporting"]
@@ -755,7 +757,8 @@
 }
 
 - (BOOL)openSavedBlockFileAtURL:(NSURL*)fileURL {
-    NSDictionary* settingsFromFile = [SCBlockFileReaderWriter readBlocklistFromFile: fileURL];
+    NSError* readErr = nil;
+    NSDictionary* settingsFromFile = [SCBlockFileReaderWriter readBlocklistFromFile: fileURL error: &readErr];
     
     if (settingsFromFile != nil) {
         [defaults_ setObject: settingsFromFile[@"Blocklist"] forKey: @"Blocklist"];
@@ -763,6 +766,11 @@
         [SCSentry addBreadcrumb: @"Opened blocklist from file" category:@"app"];
     } else {
         NSLog(@"WARNING: Could not read a valid blocklist from file - ignoring.");
+        // i.e. a damaged file, or one saved by a newer version (SCErr 107)
+        if (readErr != nil) {
+            NSBeep();
+            [SCUIUtilities presentError: readErr];
+        }
         return NO;
     }
 
@@ -23,12 +23,18 @@
 #import <Foundation/Foundation.h>
 #import "PacketFilter.h"
 #import "NSString+IPAddress.h"
+#import "SCDNSResolver.h"
 
 @class SCBlockEntry;
 @class HostFileBlockerSet;
+@class SCDNSCache;
+@class SCBlockWorkScheduler;
+@class SCShardedSet;
 
 @interface BlockManager : NSObject {
-	NSOperationQueue* opQueue;
+	SCBlockWorkScheduler* scheduler;
+	// all parse/expand/emit work submitted by this instance
+	dispatch_group_t workGroup;
 	PacketFilter* pf;
 	HostFileBlockerSet* hostBlockerSet;
 	BOOL hostsBlockingEnabled;
@@ -36,18 +42,50 @@
 	BOOL allowLocal;
 	BOOL includeCommonSubdomains;
 	BOOL includeLinkedDomains;
-    NSMutableSet* addedBlockEntries;
+	BOOL appendMode;
+	SCShardedSet* addedBlockEntries;
+	// if set, every file we read or write (and pfctl) lives under this path instead of /
+	NSString* rootPathPrefix;
+	// compile mode: render everything under rootPathPrefix, and never run pfctl
+	BOOL isCompiling;
+	NSMutableDictionary<NSString*, SCDNSResolution*>* compiledResolutions;
+	id<SCDomainResolving> resolver;
+	dispatch_group_t resolutionGroup;
+	SCDNSCache* dnsCache;
+	// when this block's work started, and the (shared) scheduler's statistics at that point
+	NSDate* workStartDate;
+	NSDictionary* schedulerSnapshot;
+	// set once finalizeBlock/finishAppending start writing the rules out
+	BOOL rulesWritten;
 }
 
+// write hosts rules several names to a line (CompactHostsFile setting). Set before adding entries.
+@property (nonatomic) BOOL compactHostsRules;
+
+// Expired cache entries are still blocked right away, and refreshed in the background. If a refresh
+// turns up new addresses before the block's rules are written, they go in with everything else;
+// after that, its resolution is handed here (on a background queue) to get them into the live block.
+@property (class, nullable, copy) SCDNSResolutionHandler liveBlockRefreshHandler;
+
 - (BlockManager*)initAsAllowlist:(BOOL)allowlist;
 - (BlockManager*)initAsAllowlist:(BOOL)allowlist allowLocal:(BOOL)local;
 - (BlockManager*)initAsAllowlist:(BOOL)allowlist allowLocal:(BOOL)local includeCommonSubdomains:(BOOL)blockCommon;
 - (BlockManager*)initAsAllowlist:(BOOL)allowlist allowLocal:(BOOL)local includeCommonSubdomains:(BOOL)blockCommon includeLinkedDomains:(BOOL)includeLinked;
+// Runs against a copy of the system under rootPath (hosts files, pf.conf, anchor, and
+// <rootPath>/sbin/pfctl), resolving through the given resolver (nil = the system's DNS)
+- (BlockManager*)initAsAllowlist:(BOOL)allowlist allowLocal:(BOOL)local includeCommonSubdomains:(BOOL)blockCommon includeLinkedDomains:(BOOL)includeLinked rootPath:(NSString*)rootPath resolver:(id<SCDomainResolving>)customResolver;
+// Offline mode: runs the whole pipeline, but resolves addresses only through the given
+// resolver (nil = resolve nothing) and writes output under rootPath instead of installing it.
+// Still macOS-only: the CLI and this class are built by the Xcode project, against Cocoa
+- (BlockManager*)initForCompilingToRootPath:(NSString*)rootPath resolver:(id<SCDomainResolving>)compileResolver asAllowlist:(BOOL)allowlist allowLocal:(BOOL)local includeCommonSubdomains:(BOOL)blockCommon includeLinkedDomains:(BOOL)includeLinked;
 
 - (void)enterAppendMode;
 - (void)finishAppending;
 - (void)prepareToAddBlock;
 - (void)finalizeBlock;
+// Compile mode's version of finalizeBlock: writes <root>/etc/hosts, <root>/etc/pf.anchors/org.eyebeam,
+// <root>/hosts.fragment (just the SelfControl section) and <root>/manifest.json, and returns the manifest
+- (NSDictionary*)compileBlock:(NSError**)errPtr;
 - (void)addBlockEntryFromString:(NSString*)entry;
 - (void)addBlockEntry:(SCBlockEntry*)entry;
 - (void)addBlockEntriesFromStrings:(NSArray<NSString*>*)blockList;
@@ -56,7 +94,9 @@
 - (BOOL)blockIsActive;
 
 - (NSArray*)commonSubdomainsForHostName:(NSString*)hostName;
++ (NSArray*)commonSubdomainsForHostName:(NSString*)hostName;
 + (NSArray*)ipAddressesForDomainName:(NSString*)domainName;
 - (BOOL)domainIsGoogle:(NSString*)domainName;
++ (BOOL)domainIsGoogle:(NSString*)domainName;
 
 @end
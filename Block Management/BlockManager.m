@@ -26,10 +26,31 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #import "HostFileBlockerSet.h"
+#import "SCDNSResolver.h"
+#import "SCStaticResolver.h"
+#import "SCDNSCache.h"
+#import "SCBlockWorkScheduler.h"
+#import "SCShardedCollections.h"
+#import "SCSpanRecorder.h"
+
+// the most time we'll spend waiting on DNS for the whole block, after all entries are queued.
+// anything that hasn't resolved by then just gets blocked via the hosts file only.
+static NSTimeInterval const kBlockResolutionDeadline = 30.0;
+
+static SCDNSResolutionHandler liveBlockRefreshHandler = nil;
 
 @implementation BlockManager
 
-BOOL appendMode = NO;
++ (SCDNSResolutionHandler)liveBlockRefreshHandler {
+    @synchronized ([BlockManager class]) {
+        return liveBlockRefreshHandler;
+    }
+}
++ (void)setLiveBlockRefreshHandler:(SCDNSResolutionHandler)handler {
+    @synchronized ([BlockManager class]) {
+        liveBlockRefreshHandler = [handler copy];
+    }
+}
 
 - (BlockManager*)init {
 	return [self initAsAllowlist: NO allowLocal: YES includeCommonSubdomains: YES];
@@ -47,25 +68,75 @@ BOOL appendMode = NO;
 }
 
 - (BlockManager*)initAsAllowlist:(BOOL)allowlist allowLocal:(BOOL)local includeCommonSubdomains:(BOOL)blockCommon includeLinkedDomains:(BOOL)includeLinked {
-	if(self = [super init]) {
-		opQueue = [[NSOperationQueue alloc] init];
-		[opQueue setMaxConcurrentOperationCount: 35];
+	return [self initAsAllowlist: allowlist allowLocal: local includeCommonSubdomains: blockCommon includeLinkedDomains: includeLinked rootPath: nil resolver: nil];
+}
+
+- (BlockManager*)initForCompilingToRootPath:(NSString*)rootPath resolver:(id<SCDomainResolving>)compileResolver asAllowlist:(BOOL)allowlist allowLocal:(BOOL)local includeCommonSubdomains:(BOOL)blockCommon includeLinkedDomains:(BOOL)includeLinked {
+	// with no resolver at all, nothing gets blocked by IP (but everything still goes in the hosts file)
+	if (compileResolver == nil) compileResolver = [SCStaticResolver new];
+	if (self = [self initAsAllowlist: allowlist allowLocal: local includeCommonSubdomains: blockCommon includeLinkedDomains: includeLinked rootPath: rootPath resolver: compileResolver]) {
+		isCompiling = YES;
+		compiledResolutions = [NSMutableDictionary dictionary];
+	}
+	return self;
+}
 
-		pf = [[PacketFilter alloc] initAsAllowlist: allowlist];
-		hostBlockerSet = [[HostFileBlockerSet alloc] init];
+- (void)setCompactHostsRules:(BOOL)compact {
+	_compactHostsRules = compact;
+	hostBlockerSet.compactRules = compact;
+}
+
+- (BlockManager*)initAsAllowlist:(BOOL)allowlist allowLocal:(BOOL)local includeCommonSubdomains:(BOOL)blockCommon includeLinkedDomains:(BOOL)includeLinked rootPath:(NSString*)rootPath resolver:(id<SCDomainResolving>)customResolver {
+	if(self = [super init]) {
+		// shared between instances, and sized to the machine rather than a fixed width
+		scheduler = [SCBlockWorkScheduler sharedScheduler];
+		workGroup = dispatch_group_create();
+
+		isCompiling = NO;
+		rootPathPrefix = rootPath;
+		pf = [[PacketFilter alloc] initAsAllowlist: allowlist rootPath: rootPath];
+		hostBlockerSet = [[HostFileBlockerSet alloc] initWithRootPath: rootPath];
 		hostsBlockingEnabled = NO;
 
 		isAllowlist = allowlist;
 		allowLocal = local;
 		includeCommonSubdomains = blockCommon;
 		includeLinkedDomains = includeLinked;
-        addedBlockEntries = [NSMutableSet set];
+		appendMode = NO;
+		addedBlockEntries = [SCShardedSet new];
+
+		if (customResolver != nil) {
+			resolver = customResolver;
+		} else {
+			SCDNSResolver* dnsResolver = [[SCDNSResolver alloc] init];
+			if (dnsResolver.nameservers.count == 0) {
+				// no usable nameservers in /etc/resolv.conf (odd network setup?), so fall back to
+				// the system resolver via ipAddressesForDomainName:
+				NSLog(@"BlockManager: Warning: couldn't find any nameservers, falling back to synchronous resolution");
+				[dnsResolver invalidate];
+			} else {
+				resolver = dnsResolver;
+			}
+		}
+		resolutionGroup = dispatch_group_create();
+
+		// with a root path we don't touch anything outside it, and that includes
+		// the shared DNS cache (which lives in /usr/local/etc)
+		if (rootPath == nil) {
+			dnsCache = [SCDNSCache sharedCache];
+		}
 	}
 
 	return self;
 }
 
 - (void)prepareToAddBlock {
+    schedulerSnapshot = [scheduler statistics];
+    workStartDate = [NSDate date];
+    @synchronized (self) {
+        rulesWritten = NO;
+    }
+
     for (HostFileBlocker* blocker in hostBlockerSet.blockers) {
         if([blocker containsSelfControlBlock]) {
             [blocker removeSelfControlBlock];
@@ -74,7 +145,9 @@ BOOL appendMode = NO;
     }
 
 	if(!isAllowlist && ![hostBlockerSet.defaultBlocker containsSelfControlBlock]) {
-        [hostBlockerSet createBackupHostsFile];
+        if (!isCompiling) {
+            [hostBlockerSet createBackupHostsFile];
+        }
 		[hostBlockerSet addSelfControlBlockHeader];
 		hostsBlockingEnabled = YES;
 	} else {
@@ -94,29 +167,27 @@ BOOL appendMode = NO;
     
     hostsBlockingEnabled = YES;
     appendMode = YES;
+    schedulerSnapshot = [scheduler statistics];
+    workStartDate = [NSDate date];
+    @synchronized (self) {
+        rulesWritten = NO;
+    }
     [pf enterAppendMode];
 }
 - (void)finishAppending {
-    NSLog(@"BlockManager: About to run operation queue for appending...");
-    NSDate* startedRunning  = [NSDate date];
-    [opQueue waitUntilAllOperationsAreFinished];
-    NSDate* finishedRunning  = [NSDate date];
-    NSTimeInterval runTime = [finishedRunning timeIntervalSinceDate: startedRunning];
-    NSLog(@"BlockManager: Operation queue ran in %f seconds!", runTime);
+    [self waitForPendingWork];
+    [dnsCache synchronize];
+    [self markRulesWritten];
 
     [hostBlockerSet writeNewFileContents];
     [pf finishAppending];
-    [pf refreshPFRules];
     appendMode = NO;
 }
 
 - (void)finalizeBlock {
-    NSLog(@"BlockManager: About to run operation queue...");
-    NSDate* startedRunning  = [NSDate date];
-	[opQueue waitUntilAllOperationsAreFinished];
-    NSDate* finishedRunning  = [NSDate date];
-    NSTimeInterval runTime = [finishedRunning timeIntervalSinceDate: startedRunning];
-    NSLog(@"BlockManager: Operation queue ran in %f seconds!", runTime);
+    [self waitForPendingWork];
+    [dnsCache synchronize];
+    [self markRulesWritten];
 
 	if(hostsBlockingEnabled) {
 		[hostBlockerSet addSelfControlBlockFooter];
@@ -126,24 +197,166 @@ BOOL appendMode = NO;
 	[pf startBlock];
 }
 
+- (NSDictionary*)compileBlock:(NSError**)errPtr {
+    if (!isCompiling) {
+        NSLog(@"ERROR: compileBlock called on a BlockManager that isn't in compile mode");
+        if (errPtr != nil) *errPtr = [SCErr errorWithCode: 210];
+        return nil;
+    }
+
+    [self waitForPendingWork];
+
+    // mirror the system layout under the root, so the output can be diffed (or copied) file-for-file
+    NSFileManager* fileMan = [NSFileManager defaultManager];
+    NSString* hostsPath = [rootPathPrefix stringByAppendingPathComponent: @"/etc/hosts"];
+    NSString* fragmentPath = [rootPathPrefix stringByAppendingPathComponent: @"hosts.fragment"];
+    NSString* manifestPath = [rootPathPrefix stringByAppendingPathComponent: @"manifest.json"];
+    for (NSString* dir in @[[hostsPath stringByDeletingLastPathComponent], [pf.anchorPath stringByDeletingLastPathComponent]]) {
+        NSError* dirErr;
+        if (![fileMan createDirectoryAtPath: dir withIntermediateDirectories: YES attributes: nil error: &dirErr]) {
+            if (errPtr != nil) *errPtr = [SCErr errorWithCode: 211 subDescription: dirErr.localizedDescription];
+            return nil;
+        }
+    }
+
+    NSString* hostsFragment = @"";
+    if (hostsBlockingEnabled) {
+        [hostBlockerSet addSelfControlBlockFooter];
+        [hostBlockerSet writeNewFileContents];
+        hostsFragment = [hostBlockerSet.defaultBlocker selfControlBlockSection] ?: @"";
+    }
+    [pf writeConfiguration];
+
+    NSError* writeErr;
+    if (![hostsFragment writeToFile: fragmentPath atomically: YES encoding: NSUTF8StringEncoding error: &writeErr]) {
+        if (errPtr != nil) *errPtr = [SCErr errorWithCode: 211 subDescription: writeErr.localizedDescription];
+        return nil;
+    }
+
+    NSMutableDictionary<NSString*, NSArray<NSString*>*>* resolutions = [NSMutableDictionary dictionary];
+    NSMutableArray<NSString*>* unresolvedDomains = [NSMutableArray array];
+    @synchronized (compiledResolutions) {
+        for (NSString* domain in compiledResolutions) {
+            NSArray<NSString*>* addresses = compiledResolutions[domain].addresses;
+            if (addresses.count > 0) {
+                resolutions[domain] = [addresses sortedArrayUsingSelector: @selector(compare:)];
+            } else {
+                [unresolvedDomains addObject: domain];
+            }
+        }
+    }
+
+    NSString* rootPrefix = [rootPathPrefix stringByAppendingString: @"/"];
+    NSDictionary* manifest = @{
+        @"FormatVersion": @1,
+        @"SelfControlVersion": SELFCONTROL_VERSION_STRING,
+        @"IsAllowlist": @(isAllowlist),
+        @"AllowLocalNetworks": @(allowLocal),
+        @"EvaluateCommonSubdomains": @(includeCommonSubdomains),
+        @"IncludeLinkedDomains": @(includeLinkedDomains),
+        @"CompactHostsFile": @(self.compactHostsRules),
+        @"EntryCount": @(addedBlockEntries.count),
+        @"Files": @{
+            @"Hosts": [hostsPath stringByReplacingOccurrencesOfString: rootPrefix withString: @""],
+            @"HostsFragment": [fragmentPath stringByReplacingOccurrencesOfString: rootPrefix withString: @""],
+            @"PFAnchor": [pf.anchorPath stringByReplacingOccurrencesOfString: rootPrefix withString: @""]
+        },
+        @"PFTableAddressCount": @(pf.tableAddressCount),
+        @"PFEliminatedAddressCount": @(pf.eliminatedAddressCount),
+        @"Resolutions": resolutions,
+        @"UnresolvedDomains": [unresolvedDomains sortedArrayUsingSelector: @selector(compare:)]
+    };
+
+    // sorted keys, so manifests from two runs diff cleanly
+    NSData* manifestData = [NSJSONSerialization dataWithJSONObject: manifest options: NSJSONWritingPrettyPrinted | NSJSONWritingSortedKeys error: &writeErr];
+    if (manifestData == nil || ![manifestData writeToFile: manifestPath options: NSDataWritingAtomic error: &writeErr]) {
+        if (errPtr != nil) *errPtr = [SCErr errorWithCode: 211 subDescription: writeErr.localizedDescription];
+        return nil;
+    }
+
+    return manifest;
+}
+
+- (void)waitForPendingWork {
+    NSLog(@"BlockManager: Waiting on %lu queued work items...", (unsigned long)scheduler.queueDepth);
+    NSDate* startedRunning = [NSDate date];
+    SCSpan* workSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"entries.wait" attributes: @{ @"QueueDepth": @(scheduler.queueDepth) }];
+    // expansion work can queue more entries, but it always does that before it finishes,
+    // so once the group is empty nothing else is coming
+    dispatch_group_wait(workGroup, DISPATCH_TIME_FOREVER);
+    [workSpan endWithAttributes: @{ @"EntryCount": @(addedBlockEntries.count) }];
+    NSLog(@"BlockManager: Block entries processed in %f seconds", [[NSDate date] timeIntervalSinceDate: startedRunning]);
+    [self waitForPendingResolutions];
+    [self logSchedulerStatistics];
+    NSLog(@"BlockManager: Workers spent %f seconds waiting on shared rule/entry locks", pf.ruleLockWaitTime + addedBlockEntries.lockWaitTime);
+}
+
+// Individual entries are far too many to each get a span, so every stage gets one span
+// instead, whose duration is the time spent on that stage summed over all workers
+// (so it can be longer than the wall-clock time the block took).
++ (NSString*)spanNameForStage:(SCBlockWorkStage)stage {
+    switch (stage) {
+        case SCBlockWorkStageParse: return @"entries.clean"; // cleaning + common subdomains
+        case SCBlockWorkStageExpand: return @"entries.scrape";
+        case SCBlockWorkStageResolve: return @"dns.resolve";
+        case SCBlockWorkStageEmit: return @"entries.emit";
+        default: return @"entries.unknown";
+    }
+}
+
+- (void)logSchedulerStatistics {
+    // other blocks (i.e. a refresh) may be sharing the scheduler, so only count what happened since we started
+    NSDictionary* stats = [scheduler statisticsSinceSnapshot: schedulerSnapshot ?: @{}];
+    NSDictionary* stages = stats[@"Stages"];
+    for (NSInteger stage = 0; stage < SCBlockWorkStageCount; stage++) {
+        NSDictionary* stageStats = stages[[SCBlockWorkScheduler nameForStage: stage]];
+        if ([stageStats[@"Completed"] unsignedIntegerValue] == 0) continue;
+        [[SCSpanRecorder sharedRecorder] recordSpan: [BlockManager spanNameForStage: stage]
+                                          startDate: workStartDate ?: [NSDate date]
+                                           duration: [stageStats[@"TotalSecs"] doubleValue]
+                                         attributes: @{
+            @"Count": stageStats[@"Completed"],
+            @"MeanSecs": stageStats[@"MeanSecs"],
+            @"TotalWaitSecs": stageStats[@"TotalWaitSecs"]
+        }];
+        NSLog(@"BlockManager: %@ stage: %@ items, mean %.3fs, %.3fs total queued",
+              [SCBlockWorkScheduler nameForStage: stage],
+              stageStats[@"Completed"],
+              [stageStats[@"MeanSecs"] doubleValue],
+              [stageStats[@"TotalWaitSecs"] doubleValue]);
+    }
+    NSLog(@"BlockManager: Scheduler ran with %@ CPU slots and %@ I/O slots", stats[@"CPUConcurrency"], stats[@"IOConcurrency"]);
+}
+
+- (void)waitForPendingResolutions {
+    if (resolver == nil) return;
+
+    NSDate* startedWaiting = [NSDate date];
+    SCSpan* dnsSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"dns.wait" attributes: @{ @"PendingLookups": @(resolver.pendingLookupCount) }];
+    long timedOut = dispatch_group_wait(resolutionGroup, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kBlockResolutionDeadline * NSEC_PER_SEC)));
+    if (timedOut) {
+        NSLog(@"BlockManager: Warning: %lu DNS lookups still pending after %f seconds, cancelling them", (unsigned long)resolver.pendingLookupCount, kBlockResolutionDeadline);
+        [resolver cancelAllQueries];
+        // cancelled lookups still call their handlers (with whatever addresses they got), so this won't take long
+        dispatch_group_wait(resolutionGroup, DISPATCH_TIME_FOREVER);
+    }
+    [dnsSpan endWithAttributes: @{ @"TimedOut": @(timedOut != 0) }];
+    NSLog(@"BlockManager: Finished waiting on DNS resolution in %f seconds", [[NSDate date] timeIntervalSinceDate: startedWaiting]);
+}
+
 - (void)enqueueBlockEntry:(SCBlockEntry*)entry {
-	NSBlockOperation* op = [NSBlockOperation blockOperationWithBlock:^{
+    [scheduler performCPUWorkForStage: SCBlockWorkStageEmit group: workGroup block:^{
         [self addBlockEntry: entry];
-	}];
-	[opQueue addOperation: op];
+    }];
 }
 
 - (void)addBlockEntry:(SCBlockEntry*)entry {
     // nil entries = something didn't parse right
     if (entry == nil) return;
     
-    // NSMutableSet is NOT thread-safe
-    @synchronized (addedBlockEntries) {
-        // don't try to block the same thing twice
-        if ([addedBlockEntries containsObject: entry]) {
-            return;
-        }
-        [addedBlockEntries addObject: entry];
+    // don't try to block the same thing twice
+    if (![addedBlockEntries addObject: entry]) {
+        return;
     }
 
 	BOOL isIP = [entry.hostname isValidIPAddress];
@@ -166,12 +379,41 @@ BOOL appendMode = NO;
             // rely on the domain-level blocking instead
         } else {
             // non-Google domains just get looked up and blocked by IP
-            NSArray* addresses = [BlockManager ipAddressesForDomainName: entry.hostname];
-
-            for(NSUInteger i = 0; i < [addresses count]; i++) {
-                NSString* ip = addresses[i];
-
-                [pf addRuleWithIP: ip port: entry.port maskLen: entry.maskLen];
+            SCDNSCacheEntry* cachedEntry = [dnsCache entryForDomain: entry.hostname];
+            if (cachedEntry != nil) {
+                // we've seen this domain recently, so don't hold up the block on the network.
+                // if the entry's expired we still use it, but get fresh results for next time.
+                for (NSString* ip in cachedEntry.addresses) {
+                    [pf addRuleWithIP: ip port: entry.port maskLen: entry.maskLen];
+                }
+                if (cachedEntry.expired) {
+                    [self refreshCachedEntry: cachedEntry forBlockEntry: entry];
+                }
+            } else if (resolver != nil) {
+                // resolve in the background so slow domains don't hold up everything else.
+                // finalizeBlock/finishAppending wait on resolutionGroup before we write the rules.
+                dispatch_group_enter(resolutionGroup);
+                NSDate* startedResolving = [scheduler beginAsyncWorkForStage: SCBlockWorkStageResolve];
+                [resolver resolveDomain: entry.hostname completion:^(SCDNSResolution* resolution) {
+                    [self addRulesForResolution: resolution entry: entry];
+                    [self->scheduler endAsyncWorkForStage: SCBlockWorkStageResolve startDate: startedResolving];
+                    dispatch_group_leave(self->resolutionGroup);
+                }];
+            } else {
+                // CFHost blocks, so keep it off the CPU pool
+                [scheduler performBlockingIOWorkForStage: SCBlockWorkStageResolve group: workGroup block:^{
+                    NSArray* addresses = [BlockManager ipAddressesForDomainName: entry.hostname];
+                    // CFHost doesn't tell us the TTL, so just cache for the minimum
+                    if (addresses.count > 0) {
+                        [self->dnsCache recordAddresses: addresses forDomain: entry.hostname ttl: 0];
+                    }
+
+                    for(NSUInteger i = 0; i < [addresses count]; i++) {
+                        NSString* ip = addresses[i];
+
+                        [self->pf addRuleWithIP: ip port: entry.port maskLen: entry.maskLen];
+                    }
+                }];
             }
         }
 	}
@@ -185,6 +427,69 @@ BOOL appendMode = NO;
 	}
 }
 
+- (void)addRulesForResolution:(SCDNSResolution*)resolution entry:(SCBlockEntry*)entry {
+    if (resolution.status == SCDNSResolutionStatusTimedOut || resolution.status == SCDNSResolutionStatusServerFailure || resolution.status == SCDNSResolutionStatusCancelled) {
+        NSLog(@"BlockManager: Warning: failed to resolve addresses for %@ (%@), got %lu addresses", entry.hostname, [SCDNSResolution descriptionForStatus: resolution.status], (unsigned long)resolution.addresses.count);
+    } else if (resolution.duration > 2.5) {
+        NSLog(@"BlockManager: Warning: took %f seconds to resolve %@", resolution.duration, entry.hostname);
+    }
+
+    [dnsCache recordResolution: resolution];
+    if (isCompiling) {
+        @synchronized (compiledResolutions) {
+            compiledResolutions[entry.hostname] = resolution;
+        }
+    }
+
+    for (NSString* ip in resolution.addresses) {
+        [pf addRuleWithIP: ip port: entry.port maskLen: entry.maskLen];
+    }
+}
+
+- (void)refreshCachedEntry:(SCDNSCacheEntry*)cachedEntry forBlockEntry:(SCBlockEntry*)entry {
+    if (resolver == nil) return;
+
+    // the block holds on to the resolver (and cache) until the lookup finishes, so the
+    // refresh still completes even if this BlockManager is long gone by then
+    id<SCDomainResolving> refreshResolver = resolver;
+    SCDNSCache* cache = dnsCache;
+    NSArray<NSString*>* cachedAddresses = cachedEntry.addresses;
+    __weak BlockManager* weakSelf = self;
+    [refreshResolver resolveDomain: entry.hostname completion:^(SCDNSResolution* resolution) {
+        [cache recordResolution: resolution];
+        (void)refreshResolver;
+
+        NSMutableArray<NSString*>* newAddresses = [resolution.addresses mutableCopy];
+        [newAddresses removeObjectsInArray: cachedAddresses];
+        if (resolution.status != SCDNSResolutionStatusSuccess || newAddresses.count == 0) return;
+
+        BlockManager* strongSelf = weakSelf;
+        if (strongSelf != nil && [strongSelf addRulesForRefreshedAddresses: newAddresses entry: entry]) return;
+
+        // the rules were already written, so only the live block can take them now
+        SCDNSResolutionHandler handler = BlockManager.liveBlockRefreshHandler;
+        if (handler != nil) handler(resolution);
+    }];
+}
+
+// NO if it's too late, because the rules have already been written
+- (BOOL)addRulesForRefreshedAddresses:(NSArray<NSString*>*)addresses entry:(SCBlockEntry*)entry {
+    @synchronized (self) {
+        if (rulesWritten) return NO;
+        for (NSString* ip in addresses) {
+            [pf addRuleWithIP: ip port: entry.port maskLen: entry.maskLen];
+        }
+        return YES;
+    }
+}
+
+- (void)markRulesWritten {
+    // any refresh that finishes after this has to go to the live block instead
+    @synchronized (self) {
+        rulesWritten = YES;
+    }
+}
+
 - (void)addBlockEntryFromString:(NSString*)entryString {
     SCBlockEntry* entry = [SCBlockEntry entryFromString: entryString];
 
@@ -192,9 +497,16 @@ BOOL appendMode = NO;
     if (entry == nil) return;
 
     // enqueue new entries _before_ running this one, so they can happen in parallel
-    NSArray<SCBlockEntry*>* relatedEntries = [self relatedBlockEntriesForEntry: entry];
-    for (SCBlockEntry* relatedEntry in relatedEntries) {
-        [self enqueueBlockEntry: relatedEntry];
+    if ([self shouldScrapeLinkedDomainsForEntry: entry]) {
+        // scraping is blocking HTTP, so it goes to the I/O pool and queues what it finds from there
+        [scheduler performBlockingIOWorkForStage: SCBlockWorkStageExpand group: workGroup block:^{
+            for (SCBlockEntry* scrapedEntry in [self scrapedBlockEntriesForEntry: entry]) {
+                [self enqueueBlockEntry: scrapedEntry];
+            }
+        }];
+    }
+    for (SCBlockEntry* subdomainEntry in [self commonSubdomainEntriesForEntry: entry]) {
+        [self enqueueBlockEntry: subdomainEntry];
     }
 
     [self addBlockEntry: entry];
@@ -202,10 +514,10 @@ BOOL appendMode = NO;
 
 - (void)addBlockEntriesFromStrings:(NSArray<NSString*>*)blockList {
 	for(NSUInteger i = 0; i < [blockList count]; i++) {
-		NSBlockOperation* op = [NSBlockOperation blockOperationWithBlock:^{
-			[self addBlockEntryFromString: blockList[i]];
+		NSString* entryString = blockList[i];
+		[scheduler performCPUWorkForStage: SCBlockWorkStageParse group: workGroup block:^{
+			[self addBlockEntryFromString: entryString];
 		}];
-		[opQueue addOperation: op];
 	}
 }
 
@@ -294,6 +606,9 @@ BOOL appendMode = NO;
 }
 
 - (NSArray*)commonSubdomainsForHostName:(NSString*)hostName {
+	return [BlockManager commonSubdomainsForHostName: hostName];
+}
++ (NSArray*)commonSubdomainsForHostName:(NSString*)hostName {
 	NSMutableSet* newHosts = [NSMutableSet set];
 
 	// If the domain ends in facebook.com...  Special case for Facebook because
@@ -361,7 +676,8 @@ BOOL appendMode = NO;
 	NSDate* startedResolving = [NSDate date];
     CFHostRef cfHost = CFHostCreateWithName(kCFAllocatorDefault, (__bridge CFStringRef)domainName);
     CFStreamError streamErr;
-    // TODO: call CFHostsScheduleWithRunLoop to put this on a background thread, so we can cancel/timeout early
+    // NOTE: this blocks with no timeout. BlockManager normally uses SCDNSResolver instead,
+    // this is only the fallback for when we can't find any nameservers to talk to directly
     CFHostStartInfoResolution(cfHost, kCFHostAddresses, &streamErr);
     if (streamErr.error) {
         NSLog(@"BlockManager: Warning: failed to resolve addresses for %@ with stream error", domainName);
@@ -413,39 +729,45 @@ BOOL appendMode = NO;
     return pred;
 }
 - (BOOL)domainIsGoogle:(NSString*)domainName {
+	return [BlockManager domainIsGoogle: domainName];
+}
++ (BOOL)domainIsGoogle:(NSString*)domainName {
 	return [[BlockManager googleTesterPredicate] evaluateWithObject: domainName];
 }
 
-- (NSArray<SCBlockEntry*>*)relatedBlockEntriesForEntry:(SCBlockEntry*)entry {
-    // nil means that we don't have anything valid to block in this entry, therefore no related entries either
-    if (entry == nil) return @[];
-    
-    NSMutableArray<SCBlockEntry*>* relatedEntries = [NSMutableArray array];
+- (BOOL)shouldScrapeLinkedDomainsForEntry:(SCBlockEntry*)entry {
+    return entry != nil && isAllowlist && includeLinkedDomains && ![entry.hostname isValidIPAddress];
+}
 
-    if (isAllowlist && includeLinkedDomains && ![entry.hostname isValidIPAddress]) {
-        NSDate* startedScraping  = [NSDate date];
-        NSArray<SCBlockEntry*>* scrapedEntries = [[AllowlistScraper relatedBlockEntries: entry.hostname] allObjects];
-        NSDate* finishedScraping  = [NSDate date];
-        NSTimeInterval resolutionTime = [finishedScraping timeIntervalSinceDate: startedScraping];
-        if (resolutionTime > 5.0) {
-            NSLog(@"BlockManager: Warning: allowlist scraper took %f seconds on %@", resolutionTime, entry.hostname);
-        }
-        [relatedEntries addObjectsFromArray: scrapedEntries];
+- (NSArray<SCBlockEntry*>*)scrapedBlockEntriesForEntry:(SCBlockEntry*)entry {
+    if (![self shouldScrapeLinkedDomainsForEntry: entry]) return @[];
+
+    NSDate* startedScraping  = [NSDate date];
+    NSArray<SCBlockEntry*>* scrapedEntries = [[AllowlistScraper relatedBlockEntries: entry.hostname] allObjects];
+    NSDate* finishedScraping  = [NSDate date];
+    NSTimeInterval resolutionTime = [finishedScraping timeIntervalSinceDate: startedScraping];
+    if (resolutionTime > 5.0) {
+        NSLog(@"BlockManager: Warning: allowlist scraper took %f seconds on %@", resolutionTime, entry.hostname);
     }
+    return scrapedEntries;
+}
 
-    if(![entry.hostname isValidIPAddress] && includeCommonSubdomains) {
-        NSArray<NSString*>* commonSubdomains = [self commonSubdomainsForHostName: entry.hostname];
+- (NSArray<SCBlockEntry*>*)commonSubdomainEntriesForEntry:(SCBlockEntry*)entry {
+    // nil means that we don't have anything valid to block in this entry, therefore no related entries either
+    if (entry == nil || [entry.hostname isValidIPAddress] || !includeCommonSubdomains) return @[];
 
-        for (NSString* subdomain in commonSubdomains) {
-            // we do not pull port, we leave the port number the same as we got it
-            SCBlockEntry* subdomainEntry = [SCBlockEntry entryFromString: subdomain];
+    NSMutableArray<SCBlockEntry*>* relatedEntries = [NSMutableArray array];
+    NSArray<NSString*>* commonSubdomains = [self commonSubdomainsForHostName: entry.hostname];
 
-            if (subdomainEntry == nil) continue;
-            
-            [relatedEntries addObject: subdomainEntry];
-        }
+    for (NSString* subdomain in commonSubdomains) {
+        // we do not pull port, we leave the port number the same as we got it
+        SCBlockEntry* subdomainEntry = [SCBlockEntry entryFromString: subdomain];
+
+        if (subdomainEntry == nil) continue;
+
+        [relatedEntries addObject: subdomainEntry];
     }
-    
+
     return relatedEntries;
 }
 
@@ -453,14 +775,9 @@ BOOL appendMode = NO;
     [pf addRuleWithIP: @"8.8.4.0" port: 0 maskLen: 24];
     [pf addRuleWithIP: @"8.34.208.0" port: 0 maskLen: 20];
     [pf addRuleWithIP: @"8.35.192.0" port: 0 maskLen: 20];
-    [pf addRuleWithIP: @"23.236.48.0" port: 0 maskLen: 240];
+    [pf addRuleWithIP: @"23.236.48.0" port: 0 maskLen: 20];
     [pf addRuleWithIP: @"23.251.128.0" port: 0 maskLen: 19];
     [pf addRuleWithIP: @"34.64.0.0" port: 0 maskLen: 10];
-    [pf addRuleWithIP: @"8.8.4.0" port: 0 maskLen: 24];
-    [pf addRuleWithIP: @"8.8.4.0" port: 0 maskLen: 24];
-    [pf addRuleWithIP: @"8.8.4.0" port: 0 maskLen: 24];
-    [pf addRuleWithIP: @"8.8.4.0" port: 0 maskLen: 24];
-    [pf addRuleWithIP: @"8.8.4.0" port: 0 maskLen: 24];
     [pf addRuleWithIP: @"34.128.0.0" port: 0 maskLen: 10];
     [pf addRuleWithIP: @"35.184.0.0" port: 0 maskLen: 13];
     [pf addRuleWithIP: @"35.192.0.0" port: 0 maskLen: 14];
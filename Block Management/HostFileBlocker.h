@@ -22,6 +22,14 @@
 
 #import <Cocoa/Cocoa.h>
 
+@class SCWorkerBuffer;
+@class SCHostsDocument;
+
+extern NSString* const kHostFileBlockerSelfControlHeader;
+extern NSString* const kHostFileBlockerSelfControlFooter;
+// what we put back if the hosts file goes missing
+extern NSString* const kDefaultHostsFileContents;
+
 @protocol HostFileBlocker
 
 - (BOOL)deleteBackupHostsFile;
@@ -52,13 +60,32 @@
     NSString* hostFilePath;
     
     NSLock* strLock;
-    NSMutableString* newFileContents;
+    // the new file contents, only rendered out when we write.
+    // nil until something needs it, so files we never touch are never read
+    SCHostsDocument* document;
+    // domains from addRuleBlockingDomain:/appendExistingBlockWithRuleForDomain:, which
+    // are only added to the document the next time anything else touches it
+    SCWorkerBuffer* pendingDomains;
     NSStringEncoding stringEnc;
     NSFileManager* fileMan;
 }
 
+// write rules several names to a line (see +[SCHostsDocument ruleDataBlockingDomains:compact:]).
+// Only affects rules added from here on; existing lines are left in whatever format they're in.
+@property BOOL compactRules;
+
 - (instancetype)initWithPath:(NSString*)path;
 
+// the hosts file this blocker reads and writes
+- (NSString*)path;
+
 + (BOOL)blockFoundInHostsFile;
 
+// just the SelfControl block (header through footer) from the new file contents, or nil if there isn't one
+- (NSString*)selfControlBlockSection;
+
+// adds rules rendered by +[SCHostsDocument ruleDataBlockingDomains:], sharing the data
+// rather than copying it (so HostFileBlockerSet only has to render its rules once)
+- (void)appendBlockRuleData:(NSData*)ruleData;
+
 @end
@@ -21,6 +21,9 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #import "HostFileBlocker.h"
+#import "SCShardedCollections.h"
+#import "SCSpanRecorder.h"
+#import "SCHostsDocument.h"
 
 NSString* const kHostFileBlockerPath = @"/etc/hosts";
 NSString* const kHostFileBlockerSelfControlHeader = @"# BEGIN SELFCONTROL BLOCK";
@@ -46,16 +49,17 @@ NSString* const kDefaultHostsFileContents = @"##\n"
         hostFilePath = path;
 		fileMan = [[NSFileManager alloc] init];
 		strLock = [[NSLock alloc] init];
-		newFileContents = [NSMutableString stringWithContentsOfFile: hostFilePath usedEncoding: &stringEnc error: NULL];
-		if(!newFileContents) {
-			// if we lost our hosts file, replace it with the OS X default
-			newFileContents = [NSMutableString stringWithString: kDefaultHostsFileContents];
-		}
+		pendingDomains = [SCWorkerBuffer new];
+		// the file itself isn't read until something needs it
 	}
 
 	return self;
 }
 
+- (NSString*)path {
+	return hostFilePath;
+}
+
 + (BOOL)blockFoundInHostsFile {
     // last try if we can't find a block anywhere: check the host file, and see if a block is in there
     NSString* hostFileContents = [NSString stringWithContentsOfFile: kHostFileBlockerPath encoding: NSUTF8StringEncoding error: NULL];
@@ -66,23 +70,41 @@ NSString* const kDefaultHostsFileContents = @"##\n"
     return NO;
 }
 
+// must be called with strLock held
+- (SCHostsDocument*)loadedDocument {
+	if (document != nil) return document;
+
+	NSString* contents = [NSString stringWithContentsOfFile: hostFilePath usedEncoding: &stringEnc error: NULL];
+	if(!contents) {
+		// if we lost our hosts file, replace it with the OS X default
+		contents = kDefaultHostsFileContents;
+		stringEnc = NSUTF8StringEncoding;
+	}
+	document = [[SCHostsDocument alloc] initWithString: contents];
+	return document;
+}
+
 - (void)revertFileContentsToDisk {
 	[strLock lock];
 
-	newFileContents = [NSMutableString stringWithContentsOfFile: hostFilePath usedEncoding: &stringEnc error: NULL];
-	if(!newFileContents) {
-		newFileContents = [NSMutableString stringWithString: kDefaultHostsFileContents];
-	}
+	// anything we hadn't written yet goes away along with the rest of our changes,
+	// and we'll re-read the file the next time we need it
+	[pendingDomains drainObjects];
+	document = nil;
 
 	[strLock unlock];
 }
 
 - (BOOL)writeNewFileContents {
+	SCSpan* writeSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"hosts.write" attributes: @{ @"Path": hostFilePath }];
 	[strLock lock];
+	[self flushPendingRules];
 
-	BOOL ret = [newFileContents writeToFile: hostFilePath atomically: YES encoding: stringEnc error: NULL];
+	SCHostsDocument* doc = [self loadedDocument];
+	BOOL ret = [doc writeToFile: hostFilePath encoding: stringEnc];
 
 	[strLock unlock];
+	[writeSpan endWithAttributes: @{ @"BodyLength": @(doc.bodyLength), @"Success": @(ret) }];
 	return ret;
 }
 
@@ -124,109 +146,75 @@ NSString* const kDefaultHostsFileContents = @"##\n"
 
 - (void)addSelfControlBlockHeader {
 	[strLock lock];
-	[newFileContents appendString: @"\n"];
-	[newFileContents appendString: kHostFileBlockerSelfControlHeader];
-	[newFileContents appendString: @"\n"];
+	[self flushPendingRules];
+	[[self loadedDocument] addBlockHeader];
 	[strLock unlock];
 }
 
 - (void)addSelfControlBlockFooter {
 	[strLock lock];
-	[newFileContents appendString: kHostFileBlockerSelfControlFooter];
-	[newFileContents appendString: @"\n"];
+	[self flushPendingRules];
+	[[self loadedDocument] addBlockFooter];
 	[strLock unlock];
 }
 
-- (NSArray<NSString*>*)ruleStringsToBlockDomain:(NSString*)domainName {
-    return @[
-        [NSString stringWithFormat: @"0.0.0.0\t%@\n", domainName],
-        [NSString stringWithFormat: @"::\t%@\n", domainName]
-    ];
-}
-
+// these get called for every domain from all the block workers at once, so they
+// only buffer the domain; flushPendingRules does the real work in one go.
+// The document always puts rules inside the block, so for us appending to a
+// live block is exactly the same as adding to a new one.
 - (void)addRuleBlockingDomain:(NSString*)domainName {
-	[strLock lock];
-    NSArray<NSString*>* ruleStrings = [self ruleStringsToBlockDomain: domainName];
-    for (NSString* ruleString in ruleStrings) {
-        [newFileContents appendString: ruleString];
-    }
-	[strLock unlock];
+    [pendingDomains addObject: domainName];
 }
 
 - (void)appendExistingBlockWithRuleForDomain:(NSString*)domainName {
+    [pendingDomains addObject: domainName];
+}
+
+- (void)appendBlockRuleData:(NSData*)ruleData {
     [strLock lock];
-    NSRange footerLocation = [newFileContents rangeOfString: kHostFileBlockerSelfControlFooter];
-    if (footerLocation.location == NSNotFound) {
-        // we can't append if a block isn't in the file already!
-        NSLog(@"WARNING: can't append to host block because footer can't be found");
-    } else {
-        // combine the rule strings and insert em all at once to make the math easier
-        NSArray<NSString*>* ruleStrings = [self ruleStringsToBlockDomain: domainName];
-
-        NSMutableString* combinedRuleString = [NSMutableString string];
-        for (NSString* ruleString in ruleStrings) {
-            [combinedRuleString appendString: ruleString];
-        }
-                
-        [newFileContents insertString: combinedRuleString atIndex: footerLocation.location];
-    }
+    [self flushPendingRules];
+    [[self loadedDocument] appendRuleData: ruleData];
     [strLock unlock];
 }
 
+// must be called with strLock held
+- (void)flushPendingRules {
+    SCSpan* renderSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"hosts.render" attributes: @{ @"Path": hostFilePath }];
+
+    // sorted so the same blocklist always produces the same file, whichever workers added what
+    NSArray<NSString*>* domains = [[pendingDomains drainObjects] sortedArrayUsingSelector: @selector(compare:)];
+    // most flushes (i.e. from containsSelfControlBlock) have nothing to do, and aren't worth a span
+    if (domains.count < 1) return;
+
+    [[self loadedDocument] appendRuleData: [SCHostsDocument ruleDataBlockingDomains: domains compact: self.compactRules]];
+    [renderSpan endWithAttributes: @{ @"DomainCount": @(domains.count), @"Compact": @(self.compactRules) }];
+}
+
 - (BOOL)containsSelfControlBlock {
 	[strLock lock];
+	[self flushPendingRules];
 
-    BOOL ret = ([newFileContents rangeOfString: kHostFileBlockerSelfControlHeader].location != NSNotFound);
+	BOOL ret = [self loadedDocument].hasBlock;
 
 	[strLock unlock];
 	return ret;
 }
 
-- (void)removeSelfControlBlock {
-	if(![self containsSelfControlBlock])
-		return;
-
+- (NSString*)selfControlBlockSection {
 	[strLock lock];
+	[self flushPendingRules];
 
-	NSRange startRange = [newFileContents rangeOfString: kHostFileBlockerSelfControlHeader];
-	NSRange endRange = [newFileContents rangeOfString: kHostFileBlockerSelfControlFooter];
-
-    // generate a delete range that properly removes the block from the hosts file
-    NSUInteger deleteRangeStart = startRange.location;
-    NSUInteger deleteRangeLength;
-
-    // there are usually newlines placed before/after the header/footer
-    // we should remove them if possible to keep the hosts file looking tidy
-    // only remove the previous character if we aren't at the start of the file (or we'll crash)
-    if (deleteRangeStart > 0) {
-        unichar prevChar = [newFileContents characterAtIndex: deleteRangeStart - 1];
-        // if the previous character isn't a newline, don't delete it
-        if ([[NSCharacterSet newlineCharacterSet] characterIsMember: prevChar]) {
-            deleteRangeStart--;
-        }
-    }
-        
-    NSUInteger maxDeleteLength = [newFileContents length] - deleteRangeStart;
-    // if we lost the block footer somehow... well, crap, just delete everything below the header
-    // this isn't ideal and we might bork other stuff, but it's better than leaving the block on
-    if (endRange.location == NSNotFound) {
-        deleteRangeLength = maxDeleteLength;
-    } else {
-        deleteRangeLength = MIN(maxDeleteLength, (endRange.location + endRange.length) - deleteRangeStart);
-        
-        // as above, look at removing the excess newline if possible
-        if (deleteRangeLength < maxDeleteLength) {
-            unichar nextChar = [newFileContents characterAtIndex: deleteRangeStart + deleteRangeLength];
-            // if the next character isn't a newline, don't delete it
-            if ([[NSCharacterSet newlineCharacterSet] characterIsMember: nextChar]) {
-                deleteRangeLength++;
-            }
-        }
-    }
+	NSString* section = [[self loadedDocument] blockSection];
 
-	NSRange deleteRange = NSMakeRange(deleteRangeStart, deleteRangeLength);
+	[strLock unlock];
+	return section;
+}
+
+- (void)removeSelfControlBlock {
+	[strLock lock];
+	[self flushPendingRules];
 
-	[newFileContents deleteCharactersInRange: deleteRange];
+	[[self loadedDocument] removeBlock];
 
 	[strLock unlock];
 }
@@ -14,6 +14,15 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property (readonly) NSArray<HostFileBlocker*>* blockers;
 @property (readonly) HostFileBlocker* defaultBlocker;
+// passed on to every blocker (see -[HostFileBlocker compactRules])
+@property (nonatomic) BOOL compactRules;
+
+// the VPN hosts files we block too, if they exist (they come and go with the VPN client)
+@property (class, readonly) NSArray<NSString*>* commonBackupHostFilePaths;
+
+// looks for /etc/hosts and the VPN hosts files under rootPath instead of /
+// (nil = the real files)
+- (instancetype)initWithRootPath:(nullable NSString*)rootPath;
 
 @end
 
@@ -6,31 +6,57 @@
 //
 
 #import "HostFileBlockerSet.h"
+#import "SCHostsDocument.h"
+#import "SCShardedCollections.h"
+#import "SCSpanRecorder.h"
+
+@interface HostFileBlockerSet () {
+    // rules for every file get buffered here once (instead of once per file), then
+    // rendered once and shared between all the blockers' documents
+    SCWorkerBuffer* pendingDomains;
+}
+
+@end
 
 @implementation HostFileBlockerSet
 
-- (instancetype)init {
-    return [self initWithCommonFiles];
-}
-- (instancetype)initWithCommonFiles {
-    NSFileManager* fileMan = [NSFileManager defaultManager];
-    NSArray<NSString*>* commonBackupHostFilePaths = @[
++ (NSArray<NSString*>*)commonBackupHostFilePaths {
+    return @[
         // Juniper Pulse
         @"/etc/pulse-hosts.bak",
         @"/etc/jnpr-pulse-hosts.bak",
         @"/etc/pulse.hosts.bak",
         @"/etc/jnpr-nc-hosts.bak",
-        
+
         // Cisco AnyConnect
         @"/etc/hosts.ac"
     ];
+}
+
+- (instancetype)init {
+    return [self initWithCommonFiles];
+}
+- (instancetype)initWithCommonFiles {
+    return [self initWithRootPath: nil];
+}
+- (instancetype)initWithRootPath:(NSString*)rootPath {
+    if (!(self = [super init])) return nil;
+
+    NSFileManager* fileMan = [NSFileManager defaultManager];
+    pendingDomains = [SCWorkerBuffer new];
+    NSArray<NSString*>* commonBackupHostFilePaths = HostFileBlockerSet.commonBackupHostFilePaths;
     
     NSMutableArray* hostFileBlockers = [NSMutableArray arrayWithCapacity: commonBackupHostFilePaths.count + 1];
     
-    _defaultBlocker = [HostFileBlocker new];
+    if (rootPath == nil) {
+        _defaultBlocker = [HostFileBlocker new];
+    } else {
+        _defaultBlocker = [[HostFileBlocker alloc] initWithPath: [rootPath stringByAppendingPathComponent: @"/etc/hosts"]];
+    }
     [hostFileBlockers addObject: _defaultBlocker];
     
-    for (NSString* path in commonBackupHostFilePaths) {
+    for (NSString* commonPath in commonBackupHostFilePaths) {
+        NSString* path = (rootPath == nil) ? commonPath : [rootPath stringByAppendingPathComponent: commonPath];
         if ([fileMan isReadableFileAtPath: path]) {
             NSLog(@"INFO: found backup VPN host file at %@", path);
             HostFileBlocker* blocker = [[HostFileBlocker alloc] initWithPath: path];
@@ -43,6 +69,34 @@
     return self;
 }
 
+// anyone reaching into our blockers directly should see all the rules added so far
+- (NSArray<HostFileBlocker*>*)blockers {
+    [self flushPendingRules];
+    return _blockers;
+}
+- (HostFileBlocker*)defaultBlocker {
+    [self flushPendingRules];
+    return _defaultBlocker;
+}
+
+- (void)setCompactRules:(BOOL)compactRules {
+    _compactRules = compactRules;
+    for (HostFileBlocker* blocker in _blockers) {
+        blocker.compactRules = compactRules;
+    }
+}
+
+- (void)flushPendingRules {
+    // sorted so the same blocklist always produces the same files, whichever workers added what
+    NSArray<NSString*>* domains = [[pendingDomains drainObjects] sortedArrayUsingSelector: @selector(compare:)];
+    if (domains.count < 1) return;
+
+    NSData* ruleData = [SCHostsDocument ruleDataBlockingDomains: domains compact: self.compactRules];
+    for (HostFileBlocker* blocker in _blockers) {
+        [blocker appendBlockRuleData: ruleData];
+    }
+}
+
 - (BOOL)deleteBackupHostsFile {
     BOOL ret = YES;
     for (HostFileBlocker* blocker in self.blockers) {
@@ -52,16 +106,28 @@
 }
 
 - (void)revertFileContentsToDisk {
-    for (HostFileBlocker* blocker in self.blockers) {
+    [pendingDomains drainObjects];
+    for (HostFileBlocker* blocker in _blockers) {
         [blocker revertFileContentsToDisk];
     }
 }
 
 - (BOOL)writeNewFileContents {
-    BOOL ret = YES;
-    for (HostFileBlocker* blocker in self.blockers) {
-        ret = ret && [blocker writeNewFileContents];
-    }
+    NSArray<HostFileBlocker*>* blockers = self.blockers;
+    __block BOOL ret = YES;
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
+    SCSpan* operation = [recorder currentOperation];
+    // the files are independent, so write them all at once (and don't let one failure
+    // stop the rest from being written)
+    dispatch_apply(blockers.count, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        [recorder performInOperation: operation block:^{
+            if (![blockers[i] writeNewFileContents]) {
+                @synchronized (blockers) {
+                    ret = NO;
+                }
+            }
+        }];
+    });
     return ret;
 }
 
@@ -93,15 +159,12 @@
     return ret;
 }
 
+// like HostFileBlocker, adding and appending are the same thing once it's in a document
 - (void)addRuleBlockingDomain:(NSString*)domainName {
-    for (HostFileBlocker* blocker in self.blockers) {
-        [blocker addRuleBlockingDomain: domainName];
-    }
+    [pendingDomains addObject: domainName];
 }
 - (void)appendExistingBlockWithRuleForDomain:(NSString*)domainName {
-    for (HostFileBlocker* blocker in self.blockers) {
-        [blocker appendExistingBlockWithRuleForDomain: domainName];
-    }
+    [pendingDomains addObject: domainName];
 }
 
 - (BOOL)containsSelfControlBlock {
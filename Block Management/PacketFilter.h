@@ -9,25 +9,70 @@
 #import <Foundation/Foundation.h>
 
 @class SCBlockEntry;
+@class SCWorkerBuffer;
+
+extern NSString* const kPFBlockTableName;
+extern NSString* const kPFAllowTableName;
+extern NSString* const kPFAnchorName;
 
 @interface PacketFilter : NSObject {
 	NSMutableString* rules;
 	BOOL isAllowlist;
+	// addresses (with optional /mask) that go into pf tables instead of individual rules,
+	// keyed by port (0 = any port)
+	NSMutableDictionary<NSNumber*, NSMutableSet<NSString*>*>* tableAddresses;
+	BOOL isAppending;
+	// rules added from worker threads, which only get sorted into rules/tableAddresses
+	// when we need the full configuration
+	SCWorkerBuffer* pendingRules;
 }
 
+// when YES (the default), addresses are collected into pf tables and matched by a single
+// rule per protocol & port, instead of getting a pair of rules each
+@property BOOL useTables;
+
+// stats from the last time we rendered the tables: how many unique addresses went in,
+// and how many of those were merged away by CIDR aggregation
+@property (readonly) NSUInteger tableAddressCount;
+@property (readonly) NSUInteger eliminatedAddressCount;
+
+// total time addRuleWithIP: callers have spent waiting on each other
+@property (readonly) NSTimeInterval ruleLockWaitTime;
+
+// overridable so tests can point us at a stand-in pfctl and a scratch anchor file
+@property (copy) NSString* pfctlPath;
+@property (copy) NSString* anchorPath;
+@property (copy) NSString* pfConfPath;
+@property (copy) NSString* pfTokenPath;
+
 + (BOOL)blockFoundInPF;
 
 - (PacketFilter*)initAsAllowlist: (BOOL)allowlist;
+// rootPath (if non-nil) is prepended to every path we use, pfctl included, i.e. to render
+// a block into a scratch directory or run against a stand-in pfctl instead of the real system
+- (PacketFilter*)initAsAllowlist: (BOOL)allowlist rootPath:(NSString*)rootPath;
 - (void)addBlockHeader:(NSMutableString*)configText;
 - (void)addAllowlistFooter:(NSMutableString*)configText;
+// safe to call from many threads at once; rules just go into a per-thread buffer
 - (void)addRuleWithIP:(NSString*)ip port:(NSInteger)port maskLen:(NSInteger)maskLen;
+// name of the pf table that addresses with this port (0 = any port) go into
+- (NSString*)tableNameForPort:(NSInteger)port;
+// table name -> entries, as currently written in the anchor file
+- (NSDictionary<NSString*, NSArray<NSString*>*>*)installedTableAddresses;
+- (NSString*)configurationString;
 - (void)writeConfiguration;
 - (int)startBlock;
 - (int)stopBlock:(BOOL)force;
 - (void)addSelfControlConfig;
 - (BOOL)containsSelfControlBlock;
+// Append mode adds rules to a running block. Where possible, new addresses are added
+// straight into the live pf tables (pfctl -T add) instead of reloading any rules,
+// and the anchor file is rewritten to match.
 - (void)enterAppendMode;
-- (void)finishAppending;
+- (int)finishAppending;
+// reloads just the org.eyebeam anchor from anchorPath, without flushing any states
 - (int)refreshPFRules;
+// reloads pf.conf (i.e. after putting our anchor lines back), without flushing any states
+- (int)reloadMainConfiguration;
 
 @end
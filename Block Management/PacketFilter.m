@@ -7,15 +7,35 @@
 //
 
 #import "PacketFilter.h"
+#import "SCIPPrefixSet.h"
+#import "SCShardedCollections.h"
+#import "SCSpanRecorder.h"
 
 NSString* const kPfctlExecutablePath = @"/sbin/pfctl";
 NSString* const kPFConfPath = @"/etc/pf.conf";
 NSString* const kPFAnchorCommand = @"anchor \"org.eyebeam\"";
+NSString* const kPFBlockTableName = @"org.eyebeam.block";
+NSString* const kPFAllowTableName = @"org.eyebeam.allow";
+NSString* const kPFAnchorName = @"org.eyebeam";
+NSString* const kPFAnchorPath = @"/etc/pf.anchors/org.eyebeam";
+NSString* const kPFTokenPath = @"/etc/SelfControlPFToken";
+
+// how many addresses we hand to a single `pfctl -T add` invocation
+static NSUInteger const kPfctlTableAddBatchSize = 1000;
+// past this many new addresses, we stop killing existing connections one address at a time
+static NSUInteger const kMaxTargetedStateKills = 256;
+
+// a rule as passed to addRuleWithIP:, before it's been formatted or put in a table
+@interface SCPendingPFRule : NSObject
+@property (copy) NSString* ip;
+@property NSInteger port;
+@property NSInteger maskLen;
+@end
+@implementation SCPendingPFRule
+@end
 
 @implementation PacketFilter
 
-NSFileHandle* appendFileHandle;
-
 + (BOOL)blockFoundInPF {
     // last try if we can't find a block anywhere: check the host file, and see if a block is in there
     NSString* pfConfContents = [NSString stringWithContentsOfFile: kPFConfPath encoding: NSUTF8StringEncoding error: NULL];
@@ -27,9 +47,26 @@ NSFileHandle* appendFileHandle;
 }
 
 - (PacketFilter*)initAsAllowlist: (BOOL)allowlist {
+	return [self initAsAllowlist: allowlist rootPath: nil];
+}
+
+- (PacketFilter*)initAsAllowlist: (BOOL)allowlist rootPath:(NSString*)rootPath {
 	if (self = [super init]) {
 		isAllowlist = allowlist;
 		rules = [NSMutableString stringWithCapacity: 1000];
+		tableAddresses = [NSMutableDictionary dictionary];
+		pendingRules = [SCWorkerBuffer new];
+		_useTables = YES;
+		_pfctlPath = kPfctlExecutablePath;
+		_anchorPath = kPFAnchorPath;
+		_pfConfPath = kPFConfPath;
+		_pfTokenPath = kPFTokenPath;
+		if (rootPath != nil) {
+			_pfctlPath = [rootPath stringByAppendingPathComponent: kPfctlExecutablePath];
+			_anchorPath = [rootPath stringByAppendingPathComponent: kPFAnchorPath];
+			_pfConfPath = [rootPath stringByAppendingPathComponent: kPFConfPath];
+			_pfTokenPath = [rootPath stringByAppendingPathComponent: kPFTokenPath];
+		}
 	}
 	return self;
 }
@@ -93,29 +130,125 @@ NSFileHandle* appendFileHandle;
     }
 }
 - (void)addRuleWithIP:(NSString*)ip port:(NSInteger)port maskLen:(NSInteger)maskLen {
-    @synchronized(self) {
-        NSArray<NSString*>* ruleStrings = [self ruleStringsForIP: ip port: port maskLen: maskLen];
-        for (NSString* ruleString in ruleStrings) {
-            if (appendFileHandle) {
-                [appendFileHandle writeData: [ruleString dataUsingEncoding:NSUTF8StringEncoding]];
-            } else {
-                [rules appendString: ruleString];
+    // this gets called for every address of every entry, from all the block workers at once,
+    // so don't do any formatting (or take any shared lock) here
+    SCPendingPFRule* rule = [SCPendingPFRule new];
+    rule.ip = ip;
+    rule.port = port;
+    rule.maskLen = maskLen;
+    [pendingRules addObject: rule];
+}
+
+- (NSTimeInterval)ruleLockWaitTime {
+    return pendingRules.lockWaitTime;
+}
+
+// must be called while synchronized on self
+- (void)mergePendingRules {
+    for (SCPendingPFRule* rule in [pendingRules drainObjects]) {
+        // "any" can't go in a table
+        if (self.useTables && rule.ip != nil) {
+            NSString* address = rule.maskLen ? [NSString stringWithFormat: @"%@/%ld", rule.ip, (long)rule.maskLen] : rule.ip;
+            NSMutableSet<NSString*>* addresses = tableAddresses[@(rule.port)];
+            if (addresses == nil) {
+                addresses = [NSMutableSet set];
+                tableAddresses[@(rule.port)] = addresses;
             }
+            [addresses addObject: address];
+            continue;
+        }
+
+        NSArray<NSString*>* ruleStrings = [self ruleStringsForIP: rule.ip port: rule.port maskLen: rule.maskLen];
+        for (NSString* ruleString in ruleStrings) {
+            [rules appendString: ruleString];
         }
     }
 }
 
-- (void)writeConfiguration {
+- (NSString*)tableNameForPort:(NSInteger)port {
+    NSString* baseName = isAllowlist ? kPFAllowTableName : kPFBlockTableName;
+    if (port) {
+        return [NSString stringWithFormat: @"%@.p%ld", baseName, (long)port];
+    }
+    return baseName;
+}
+
+- (void)addTableDefinition:(NSString*)tableName addresses:(NSArray<NSString*>*)addresses toConfig:(NSMutableString*)configText {
+    [configText appendFormat: @"table <%@> persist { \\\n", tableName];
+    for (NSString* address in addresses) {
+        [configText appendFormat: @"\t%@ \\\n", address];
+    }
+    [configText appendString: @"}\n"];
+}
+
+- (void)addTableRulesForPort:(NSInteger)port toConfig:(NSMutableString*)configText {
+    NSString* destination = [NSString stringWithFormat: @"<%@>", [self tableNameForPort: port]];
+    if (port) {
+        destination = [destination stringByAppendingFormat: @" port %ld", (long)port];
+    }
+    NSString* action = isAllowlist ? @"pass out" : @"block return out";
+    [configText appendFormat: @"%@ proto tcp from any to %@\n", action, destination];
+    [configText appendFormat: @"%@ proto udp from any to %@\n", action, destination];
+}
+
+// Merges duplicates, drops addresses covered by broader prefixes and collapses adjacent
+// prefixes, then sorts so the output is stable (entries get added from many threads at once)
+- (NSArray<NSString*>*)aggregatedAddresses:(id<NSFastEnumeration>)addresses {
+    SCIPPrefixSet* prefixSet = [SCIPPrefixSet new];
+    for (NSString* address in addresses) {
+        [prefixSet addPrefixString: address];
+    }
+    return [[prefixSet minimalPrefixStrings] sortedArrayUsingSelector: @selector(compare:)];
+}
+
+- (void)addTables:(NSMutableString*)configText {
+    NSArray<NSNumber*>* ports = [tableAddresses.allKeys sortedArrayUsingSelector: @selector(compare:)];
+
+    NSUInteger inputCount = 0, outputCount = 0;
+    for (NSNumber* port in ports) {
+        NSArray<NSString*>* addresses = [self aggregatedAddresses: tableAddresses[port]];
+        inputCount += tableAddresses[port].count;
+        outputCount += addresses.count;
+        [self addTableDefinition: [self tableNameForPort: port.integerValue] addresses: addresses toConfig: configText];
+    }
+    _tableAddressCount = inputCount;
+    _eliminatedAddressCount = inputCount - outputCount;
+
+    for (NSNumber* port in ports) {
+        [self addTableRulesForPort: port.integerValue toConfig: configText];
+    }
+}
+
+- (NSString*)configurationString {
 	NSMutableString* filterConfiguration = [NSMutableString stringWithCapacity: 1000];
 
-	[self addBlockHeader: filterConfiguration];
-	[filterConfiguration appendString: rules];
+	@synchronized(self) {
+		[self mergePendingRules];
+		[self addBlockHeader: filterConfiguration];
+		[self addTables: filterConfiguration];
+		[filterConfiguration appendString: rules];
+	}
 
 	if (isAllowlist) {
 		[self addAllowlistFooter: filterConfiguration];
 	}
 
-	[filterConfiguration writeToFile: @"/etc/pf.anchors/org.eyebeam" atomically: true encoding: NSUTF8StringEncoding error: nil];
+	return filterConfiguration;
+}
+
+- (void)writeConfiguration {
+	SCSpan* writeSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"pf.anchor.write" attributes: @{ @"Path": self.anchorPath }];
+	NSString* configuration = [self configurationString];
+	BOOL success = [configuration writeToFile: self.anchorPath atomically: true encoding: NSUTF8StringEncoding error: nil];
+	[writeSpan endWithAttributes: @{
+		@"Length": @(configuration.length),
+		@"TableAddressCount": @(self.tableAddressCount),
+		@"Success": @(success)
+	}];
+
+	if (self.tableAddressCount > 0) {
+		NSLog(@"PacketFilter: aggregated %lu unique addresses into %lu table entries (%lu eliminated)", (unsigned long)self.tableAddressCount, (unsigned long)(self.tableAddressCount - self.eliminatedAddressCount), (unsigned long)self.eliminatedAddressCount);
+	}
 }
 
 - (void)enterAppendMode {
@@ -124,18 +257,180 @@ NSFileHandle* appendFileHandle;
         return;
     }
 
-    // open the file and prepare to write to the very bottom (no footer since it's not an allowlist)
-    appendFileHandle = [NSFileHandle fileHandleForWritingAtPath: @"/etc/pf.anchors/org.eyebeam"];
-    if (!appendFileHandle) {
-        NSLog(@"ERROR: Failed to get handle for pf.anchors file while attempting to append rules");
-        return;
+    // new rules just collect in memory until finishAppending, where we figure out
+    // how to get them into the running block with as little disruption as possible
+    isAppending = YES;
+}
+- (int)finishAppending {
+    if (!isAppending) return 0;
+    isAppending = NO;
+
+    NSString* existingAnchor = [NSString stringWithContentsOfFile: self.anchorPath encoding: NSUTF8StringEncoding error: nil];
+    if (existingAnchor == nil) {
+        NSLog(@"ERROR: Failed to read pf anchor file at %@ while attempting to append rules", self.anchorPath);
+        return -1;
+    }
+
+    NSMutableDictionary<NSString*, NSArray<NSString*>*>* addedTableAddresses = [NSMutableDictionary dictionary];
+    BOOL needsReload = NO;
+    NSString* newAnchor;
+    @synchronized (self) {
+        [self mergePendingRules];
+        newAnchor = [self anchorByMergingAppendedRulesIntoAnchor: existingAnchor
+                                             addedTableAddresses: addedTableAddresses
+                                                     needsReload: &needsReload];
+    }
+
+    // the anchor file always gets the full picture, so integrity checks
+    // (and any later full reload) see exactly what's live
+    NSError* writeErr;
+    if (![newAnchor writeToFile: self.anchorPath atomically: YES encoding: NSUTF8StringEncoding error: &writeErr]) {
+        NSLog(@"ERROR: Failed to write pf anchor file with appended rules: %@", writeErr);
+        return -1;
+    }
+
+    int status = 0;
+    if (needsReload) {
+        // new rules (not just new table entries) mean the anchor's ruleset has to be reloaded
+        status = [self refreshPFRules];
+    } else {
+        for (NSString* tableName in [addedTableAddresses.allKeys sortedArrayUsingSelector: @selector(compare:)]) {
+            NSArray<NSString*>* addresses = addedTableAddresses[tableName];
+            for (NSUInteger i = 0; i < addresses.count; i += kPfctlTableAddBatchSize) {
+                NSArray<NSString*>* batch = [addresses subarrayWithRange: NSMakeRange(i, MIN(kPfctlTableAddBatchSize, addresses.count - i))];
+                NSArray<NSString*>* args = [@[@"-a", kPFAnchorName, @"-t", tableName, @"-T", @"add"] arrayByAddingObjectsFromArray: batch];
+                status = [self runPfctlWithArguments: args output: nil];
+                if (status != 0) break;
+            }
+            if (status != 0) {
+                NSLog(@"WARNING: Failed to add addresses to pf table %@ (status %d), reloading anchor instead", tableName, status);
+                status = [self refreshPFRules];
+                break;
+            }
+        }
     }
 
-    [appendFileHandle seekToEndOfFile];
+    // only cut existing connections once the rules are actually live - otherwise
+    // they'd just reconnect, and we'd have interrupted the user for nothing
+    if (status != 0) {
+        NSLog(@"ERROR: Failed to install appended pf rules (status %d), leaving existing connections alone", status);
+        return status;
+    }
+
+    NSMutableArray<NSString*>* newAddresses = [NSMutableArray array];
+    for (NSArray<NSString*>* addresses in addedTableAddresses.allValues) {
+        [newAddresses addObjectsFromArray: addresses];
+    }
+    [self killStatesToAddresses: [newAddresses sortedArrayUsingSelector: @selector(compare:)]];
+
+    return status;
+}
+
+// returns the table name if this line opens one of our table definitions, otherwise nil
+- (NSString*)tableNameInDefinitionLine:(NSString*)line {
+    if (![line hasPrefix: @"table <"]) return nil;
+    NSRange closeRange = [line rangeOfString: @"> persist {"];
+    if (closeRange.location == NSNotFound) return nil;
+    return [line substringWithRange: NSMakeRange(7, closeRange.location - 7)];
+}
+
+- (NSDictionary<NSString*, NSArray<NSString*>*>*)installedTableAddresses {
+    NSString* anchor = [NSString stringWithContentsOfFile: self.anchorPath encoding: NSUTF8StringEncoding error: nil];
+    if (anchor == nil) return @{};
+
+    NSMutableDictionary<NSString*, NSArray<NSString*>*>* installedAddresses = [NSMutableDictionary dictionary];
+    NSCharacterSet* trimSet = [NSCharacterSet characterSetWithCharactersInString: @" \t\\,"];
+    NSArray<NSString*>* lines = [anchor componentsSeparatedByString: @"\n"];
+    for (NSUInteger i = 0; i < lines.count; i++) {
+        NSString* tableName = [self tableNameInDefinitionLine: lines[i]];
+        if (tableName == nil) continue;
+
+        NSMutableArray<NSString*>* addresses = [NSMutableArray array];
+        for (i++; i < lines.count && ![lines[i] hasPrefix: @"}"]; i++) {
+            NSString* address = [lines[i] stringByTrimmingCharactersInSet: trimSet];
+            if (address.length > 0) [addresses addObject: address];
+        }
+        installedAddresses[tableName] = addresses;
+    }
+
+    return installedAddresses;
+}
+
+// must be called while synchronized on self
+- (NSString*)anchorByMergingAppendedRulesIntoAnchor:(NSString*)anchor addedTableAddresses:(NSMutableDictionary<NSString*, NSArray<NSString*>*>*)addedTableAddresses needsReload:(BOOL*)needsReload {
+    NSMutableDictionary<NSString*, NSNumber*>* pendingTablePorts = [NSMutableDictionary dictionary];
+    for (NSNumber* port in tableAddresses) {
+        pendingTablePorts[[self tableNameForPort: port.integerValue]] = port;
+    }
+
+    NSMutableString* newAnchor = [NSMutableString stringWithCapacity: anchor.length];
+    NSMutableSet<NSString*>* existingTables = [NSMutableSet set];
+    NSCharacterSet* trimSet = [NSCharacterSet characterSetWithCharactersInString: @" \t\\,"];
+
+    NSArray<NSString*>* lines = [anchor componentsSeparatedByString: @"\n"];
+    for (NSUInteger i = 0; i < lines.count; i++) {
+        NSString* line = lines[i];
+        NSString* tableName = [self tableNameInDefinitionLine: line];
+        if (tableName == nil) {
+            if (i < lines.count - 1 || line.length > 0) {
+                [newAnchor appendFormat: @"%@\n", line];
+            }
+            continue;
+        }
+
+        NSMutableSet<NSString*>* addresses = [NSMutableSet set];
+        for (i++; i < lines.count && ![lines[i] hasPrefix: @"}"]; i++) {
+            NSString* address = [lines[i] stringByTrimmingCharactersInSet: trimSet];
+            if (address.length > 0) [addresses addObject: address];
+        }
+
+        NSArray<NSString*>* mergedAddresses = [addresses.allObjects sortedArrayUsingSelector: @selector(compare:)];
+        NSNumber* port = pendingTablePorts[tableName];
+        if (port != nil) {
+            // anything already covered by what's in the table just disappears here
+            mergedAddresses = [self aggregatedAddresses: [addresses setByAddingObjectsFromSet: tableAddresses[port]]];
+            NSMutableArray<NSString*>* added = [mergedAddresses mutableCopy];
+            [added removeObjectsInArray: addresses.allObjects];
+            if (added.count > 0) {
+                addedTableAddresses[tableName] = added;
+            }
+        }
+        [existingTables addObject: tableName];
+
+        [self addTableDefinition: tableName addresses: mergedAddresses toConfig: newAnchor];
+    }
+
+    // tables that aren't in the anchor yet (e.g. the first entry for a new port) need
+    // a definition plus rules, and so do any standalone rules
+    *needsReload = (rules.length > 0);
+    for (NSNumber* port in [tableAddresses.allKeys sortedArrayUsingSelector: @selector(compare:)]) {
+        NSString* tableName = [self tableNameForPort: port.integerValue];
+        if ([existingTables containsObject: tableName]) continue;
+
+        NSArray<NSString*>* addresses = [self aggregatedAddresses: tableAddresses[port]];
+        addedTableAddresses[tableName] = addresses;
+        [self addTableDefinition: tableName addresses: addresses toConfig: newAnchor];
+        [self addTableRulesForPort: port.integerValue toConfig: newAnchor];
+        *needsReload = YES;
+    }
+    [newAnchor appendString: rules];
+
+    return newAnchor;
 }
-- (void)finishAppending {
-    [appendFileHandle closeFile];
-    appendFileHandle = nil;
+
+// Table entries only affect new connections, so we kill any existing states to the newly
+// blocked addresses (and only those - we don't want to drop every connection on the machine)
+- (void)killStatesToAddresses:(NSArray<NSString*>*)addresses {
+    if (isAllowlist) return;
+    if (addresses.count > kMaxTargetedStateKills) {
+        NSLog(@"WARNING: Not killing existing connections to %lu newly blocked addresses (too many)", (unsigned long)addresses.count);
+        return;
+    }
+
+    for (NSString* address in addresses) {
+        NSString* source = [address rangeOfString: @":"].location == NSNotFound ? @"0.0.0.0/0" : @"::/0";
+        [self runPfctlWithArguments: @[@"-k", source, @"-k", address] output: nil];
+    }
 }
 
 - (void)appendRulesToCurrentBlockConfiguration:(NSArray<NSDictionary*>*)newEntryDicts {
@@ -148,7 +443,7 @@ NSFileHandle* appendFileHandle;
     // open the file and prepare to write to the very bottom (no footer since it's not an allowlist)
     // NOTE FOR FUTURE: NSFileHandle can't append lines to the middle of the file anyway,
     // would need to read in the whole thing + write out again
-    NSFileHandle* fileHandle = [NSFileHandle fileHandleForWritingAtPath: @"/etc/pf.anchors/org.eyebeam"];
+    NSFileHandle* fileHandle = [NSFileHandle fileHandleForWritingAtPath: self.anchorPath];
     if (!fileHandle) {
         NSLog(@"ERROR: Failed to get handle for pf.anchors file while attempting to append rules");
         return;
@@ -168,14 +463,38 @@ NSFileHandle* appendFileHandle;
     [fileHandle closeFile];
 }
 
-- (int)startBlock {
-	[self addSelfControlConfig];
-	[self writeConfiguration];
+// Spans are handed to anyone who asks for block timings, so they only get the flags (i.e. "-a -t -T add")
+// and how many addresses went in. The full arguments can include our pf token and the blocked addresses.
+- (NSDictionary<NSString*, id>*)spanAttributesForPfctlArguments:(NSArray<NSString*>*)args {
+	NSMutableArray<NSString*>* command = [NSMutableArray array];
+	NSUInteger addressCount = 0;
+	BOOL inTableCommand = NO;
+	for (NSUInteger i = 0; i < args.count; i++) {
+		NSString* arg = args[i];
+		if (![arg hasPrefix: @"-"]) {
+			// everything after -T's command is an address
+			if (inTableCommand) addressCount++;
+			continue;
+		}
 
-	NSArray* args = [@"-E -f /etc/pf.conf -F states" componentsSeparatedByString: @" "];
+		[command addObject: arg];
+		// -T and -F take a fixed word ("add", "states") that's worth keeping
+		if (([arg isEqualToString: @"-T"] || [arg isEqualToString: @"-F"]) && i + 1 < args.count) {
+			[command addObject: args[++i]];
+			inTableCommand = [arg isEqualToString: @"-T"];
+		}
+	}
 
+	return @{
+		@"Command": [command componentsJoinedByString: @" "],
+		@"AddressCount": @(addressCount)
+	};
+}
+
+- (int)runPfctlWithArguments:(NSArray<NSString*>*)args output:(NSString**)output {
+	SCSpan* pfctlSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"pfctl" attributes: [self spanAttributesForPfctlArguments: args]];
 	NSTask* task = [[NSTask alloc] init];
-	[task setLaunchPath: kPfctlExecutablePath];
+	[task setLaunchPath: self.pfctlPath];
 	[task setArguments: args];
 
 	NSPipe* inPipe = [[NSPipe alloc] init];
@@ -183,10 +502,28 @@ NSFileHandle* appendFileHandle;
 	[task setStandardOutput: inPipe];
 	[task setStandardError: inPipe];
 
-	[task launch];
+	@try {
+		[task launch];
+	} @catch (NSException* exception) {
+		NSLog(@"ERROR: Failed to launch pfctl at %@: %@", self.pfctlPath, exception);
+		[pfctlSpan endWithAttributes: @{ @"ExitStatus": @(-1) }];
+		return -1;
+	}
 	NSString* pfctlOutput = [[NSString alloc] initWithData: [readHandle readDataToEndOfFile] encoding: NSUTF8StringEncoding];
 	[readHandle closeFile];
 	[task waitUntilExit];
+	[pfctlSpan endWithAttributes: @{ @"ExitStatus": @([task terminationStatus]) }];
+
+	if (output != nil) *output = pfctlOutput;
+	return [task terminationStatus];
+}
+
+- (int)startBlock {
+	[self addSelfControlConfig];
+	[self writeConfiguration];
+
+	NSString* pfctlOutput;
+	int status = [self runPfctlWithArguments: @[@"-E", @"-f", self.pfConfPath, @"-F", @"states"] output: &pfctlOutput];
 
 	NSArray* lines = [pfctlOutput componentsSeparatedByString: @"\n"];
 	for (NSString* line in lines) {
@@ -196,33 +533,31 @@ NSFileHandle* appendFileHandle;
 		}
 	}
 
-	return [task terminationStatus];
+	return status;
 }
 - (int)refreshPFRules {
-    NSArray* args = [@"-f /etc/pf.conf -F states" componentsSeparatedByString: @" "];
-
-    NSTask* task = [[NSTask alloc] init];
-    [task setLaunchPath: kPfctlExecutablePath];
-    [task setArguments: args];
-    [task launch];
-    [task waitUntilExit];
+    // only reload our own anchor - reloading all of pf.conf (and flushing states)
+    // would drop every open connection on the machine
+    return [self runPfctlWithArguments: @[@"-a", kPFAnchorName, @"-f", self.anchorPath] output: nil];
+}
 
-    return [task terminationStatus];
+- (int)reloadMainConfiguration {
+    return [self runPfctlWithArguments: @[@"-f", self.pfConfPath] output: nil];
 }
 
 - (void)writePFToken:(NSString*)token error:(NSError**)error {
-	[token writeToFile: @"/etc/SelfControlPFToken" atomically: YES encoding: NSUTF8StringEncoding error: error];
+	[token writeToFile: self.pfTokenPath atomically: YES encoding: NSUTF8StringEncoding error: error];
 }
 - (NSString*)readPFToken:(NSError**)error {
-	return [NSString stringWithContentsOfFile: @"/etc/SelfControlPFToken" encoding: NSUTF8StringEncoding error: error];
+	return [NSString stringWithContentsOfFile: self.pfTokenPath encoding: NSUTF8StringEncoding error: error];
 }
 
 - (int)stopBlock:(BOOL)force {
 	NSError* err;
 	NSString* token = [self readPFToken: &err];
 
-	[@"" writeToFile: @"/etc/pf.anchors/org.eyebeam" atomically: true encoding: NSUTF8StringEncoding error: nil];
-	NSString* mainConf = [NSString stringWithContentsOfFile: @"/etc/pf.conf" encoding: NSUTF8StringEncoding error: nil];
+	[@"" writeToFile: self.anchorPath atomically: true encoding: NSUTF8StringEncoding error: nil];
+	NSString* mainConf = [NSString stringWithContentsOfFile: self.pfConfPath encoding: NSUTF8StringEncoding error: nil];
 	NSArray* lines = [mainConf componentsSeparatedByString: @"\n"];
 	NSMutableString* newConf = [NSMutableString stringWithCapacity: [mainConf length]];
 	for (NSString* line in lines) {
@@ -232,23 +567,20 @@ NSFileHandle* appendFileHandle;
 	}
 	newConf = [[newConf stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceAndNewlineCharacterSet]] mutableCopy];
 	[newConf appendString: @"\n"];
-	[newConf writeToFile: @"/etc/pf.conf" atomically: true encoding: NSUTF8StringEncoding error: nil];
+	[newConf writeToFile: self.pfConfPath atomically: true encoding: NSUTF8StringEncoding error: nil];
 
-	NSString* commandString;
+	NSArray* args;
 	if ([token length] && !force) {
-		commandString = [NSString stringWithFormat: @"-X %@ -f /etc/pf.conf", token];
+		args = @[@"-X", token, @"-f", self.pfConfPath];
 	} else {
-		commandString = @"-d -f /etc/pf.conf";
+		args = @[@"-d", @"-f", self.pfConfPath];
 	}
-	NSArray* args = [commandString componentsSeparatedByString: @" "];
 
-	NSTask* task = [NSTask launchedTaskWithLaunchPath: kPfctlExecutablePath arguments: args];
-	[task waitUntilExit];
-	return [task terminationStatus];
+	return [self runPfctlWithArguments: args output: nil];
 }
 
 - (void)addSelfControlConfig {
-	NSMutableString* pfConf = [NSMutableString stringWithContentsOfFile: @"/etc/pf.conf" encoding: NSUTF8StringEncoding error: nil];
+	NSMutableString* pfConf = [NSMutableString stringWithContentsOfFile: self.pfConfPath encoding: NSUTF8StringEncoding error: nil];
 
 	if ([pfConf rangeOfString: @"/etc/pf.anchors/org.eyebeam"].location == NSNotFound) {
 		[pfConf appendString: @"\n"
@@ -256,11 +588,11 @@ NSFileHandle* appendFileHandle;
 		 "load anchor \"org.eyebeam\" from \"/etc/pf.anchors/org.eyebeam\"\n"];
 	}
 
-	[pfConf writeToFile: @"/etc/pf.conf" atomically: true encoding: NSUTF8StringEncoding error: nil];
+	[pfConf writeToFile: self.pfConfPath atomically: true encoding: NSUTF8StringEncoding error: nil];
 }
 
 - (BOOL)containsSelfControlBlock {
-	NSString* mainConf = [NSString stringWithContentsOfFile: @"/etc/pf.conf" encoding: NSUTF8StringEncoding error: nil];
+	NSString* mainConf = [NSString stringWithContentsOfFile: self.pfConfPath encoding: NSUTF8StringEncoding error: nil];
 	return mainConf != nil && [mainConf rangeOfString: @"org.eyebeam"].location != NSNotFound;
 }
 
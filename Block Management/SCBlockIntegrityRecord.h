@@ -0,0 +1,61 @@
+//
+//  SCBlockIntegrityRecord.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+@class HostFileBlockerSet;
+@class PacketFilter;
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_OPTIONS(NSUInteger, SCBlockComponent) {
+    SCBlockComponentNone = 0,
+    // the SelfControl section of /etc/hosts (or any of the VPN hosts files)
+    SCBlockComponentHostsFile = 1 << 0,
+    // the org.eyebeam anchor file
+    SCBlockComponentPFAnchor = 1 << 1,
+    // the lines in pf.conf that load our anchor
+    SCBlockComponentPFConf = 1 << 2,
+
+    SCBlockComponentAll = SCBlockComponentHostsFile | SCBlockComponentPFAnchor | SCBlockComponentPFConf
+};
+
+// A snapshot of the block as installed: the SelfControl section of each hosts file and
+// the whole pf anchor, kept as bytes plus a SHA-256 digest, along with each file's
+// size/mtime/inode. Checking it only stats the files; a file is read and hashed only if
+// that changed, and only the parts we own are compared, so the user editing the rest of
+// /etc/hosts or pf.conf doesn't count as damage.
+// Repairs put back just the damaged component from the recorded bytes - no resolving,
+// no re-rendering, and nothing else gets touched.
+@interface SCBlockIntegrityRecord : NSObject
+
+// which components the block actually has (i.e. allowlists have no hosts section)
+@property (readonly) SCBlockComponent recordedComponents;
+@property (readonly) NSDate* recordedDate;
+// the hosts files that were there when we recorded (so we can tell when a new one turns up)
+@property (readonly) NSArray<NSString*>* hostsPaths;
+
+// Records the block as it's currently installed in the given files
++ (instancetype)recordWithHostFileBlockerSet:(HostFileBlockerSet*)hostFileBlockerSet packetFilter:(PacketFilter*)pf;
+
+- (SCBlockComponent)damagedComponents;
+// Same, but only looks at the given components
+- (SCBlockComponent)damagedComponentsAmong:(SCBlockComponent)components;
+
+// Takes a fresh snapshot of just the given components, for when we've legitimately
+// changed them ourselves (i.e. the refresher appending to the anchor)
+- (void)rerecordComponents:(SCBlockComponent)components;
+
+// Rewrites the given components from the recorded bytes, and has pf reload whatever
+// pf files were rewritten. Returns the components that couldn't be repaired.
+- (SCBlockComponent)repairComponents:(SCBlockComponent)components;
+
++ (NSString*)descriptionForComponents:(SCBlockComponent)components;
+
+@end
+
+NS_ASSUME_NONNULL_END
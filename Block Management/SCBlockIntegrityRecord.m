@@ -0,0 +1,273 @@
+//
+//  SCBlockIntegrityRecord.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCBlockIntegrityRecord.h"
+#import "HostFileBlocker.h"
+#import "HostFileBlockerSet.h"
+#import "PacketFilter.h"
+#import "SCHostsDocument.h"
+#import <CommonCrypto/CommonCrypto.h>
+
+// one file we own (part of), as it was when we recorded it
+@interface SCRecordedFile : NSObject
+
+@property (copy) NSString* path;
+// size, mtime and inode - if these haven't changed, neither has the file
+@property (strong) NSDictionary* fileSignature;
+@property (strong) NSData* digest;
+// just the part of the file that's ours
+@property (strong) NSData* contents;
+
+@end
+
+@implementation SCRecordedFile
+@end
+
+static NSData* SCSHA256Digest(NSData* data) {
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(data.bytes, (CC_LONG)data.length, digest);
+    return [NSData dataWithBytes: digest length: sizeof(digest)];
+}
+
+@implementation SCBlockIntegrityRecord {
+    PacketFilter* _pf;
+    NSArray<SCRecordedFile*>* _hostsFiles;
+    SCRecordedFile* _anchorFile;
+    // only the signature is used: pf.conf is the user's, we just need our lines in it
+    SCRecordedFile* _pfConfFile;
+}
+
++ (instancetype)recordWithHostFileBlockerSet:(HostFileBlockerSet*)hostFileBlockerSet packetFilter:(PacketFilter*)pf {
+    SCBlockIntegrityRecord* record = [SCBlockIntegrityRecord new];
+    record->_pf = pf;
+
+    NSMutableArray<NSString*>* hostsPaths = [NSMutableArray array];
+    for (HostFileBlocker* blocker in hostFileBlockerSet.blockers) {
+        [hostsPaths addObject: blocker.path];
+    }
+    record->_hostsPaths = hostsPaths;
+
+    [record rerecordComponents: SCBlockComponentAll];
+    return record;
+}
+
+- (void)rerecordComponents:(SCBlockComponent)components {
+    if (components & SCBlockComponentHostsFile) {
+        NSMutableArray<SCRecordedFile*>* hostsFiles = [NSMutableArray array];
+        for (NSString* hostsPath in _hostsPaths) {
+            SCRecordedFile* file = [SCBlockIntegrityRecord recordFileAtPath: hostsPath reader:^NSData*(NSString* path) {
+                return [SCBlockIntegrityRecord hostsSectionAtPath: path];
+            }];
+            if (file != nil) [hostsFiles addObject: file];
+        }
+        _hostsFiles = hostsFiles;
+    }
+    if (components & SCBlockComponentPFAnchor) {
+        _anchorFile = [SCBlockIntegrityRecord recordFileAtPath: _pf.anchorPath reader:^NSData*(NSString* path) {
+            return [NSData dataWithContentsOfFile: path];
+        }];
+    }
+    if (components & SCBlockComponentPFConf) {
+        _pfConfFile = [SCBlockIntegrityRecord recordFileAtPath: _pf.pfConfPath reader:^NSData*(NSString* path) {
+            return [SCBlockIntegrityRecord anchorLinesAtPath: path];
+        }];
+    }
+
+    SCBlockComponent recorded = SCBlockComponentNone;
+    if (_hostsFiles.count > 0) recorded |= SCBlockComponentHostsFile;
+    if (_anchorFile != nil) recorded |= SCBlockComponentPFAnchor;
+    if (_pfConfFile != nil) recorded |= SCBlockComponentPFConf;
+    _recordedComponents = recorded;
+    _recordedDate = [NSDate date];
+}
+
++ (NSString*)descriptionForComponents:(SCBlockComponent)components {
+    NSMutableArray<NSString*>* names = [NSMutableArray array];
+    if (components & SCBlockComponentHostsFile) [names addObject: @"hosts"];
+    if (components & SCBlockComponentPFAnchor) [names addObject: @"pf anchor"];
+    if (components & SCBlockComponentPFConf) [names addObject: @"pf.conf"];
+    return (names.count > 0) ? [names componentsJoinedByString: @", "] : @"none";
+}
+
+#pragma mark - Files
+
++ (nullable NSDictionary*)signatureForFileAtPath:(NSString*)path {
+    NSDictionary* attributes = [[NSFileManager defaultManager] attributesOfItemAtPath: path error: nil];
+    if (attributes == nil) return nil;
+
+    return @{
+        NSFileSize: attributes[NSFileSize] ?: @0,
+        NSFileModificationDate: attributes[NSFileModificationDate] ?: [NSDate distantPast],
+        NSFileSystemFileNumber: attributes[NSFileSystemFileNumber] ?: @0
+    };
+}
+
+// the SelfControl section (header through footer) of a hosts file, or nil if there isn't a complete one
++ (nullable NSData*)hostsSectionAtPath:(NSString*)path {
+    NSString* contents = [NSString stringWithContentsOfFile: path usedEncoding: NULL error: NULL];
+    if (contents == nil) return nil;
+    return [[[SCHostsDocument alloc] initWithString: contents].blockSection dataUsingEncoding: NSUTF8StringEncoding];
+}
+
+// our lines from pf.conf, or nil if they aren't there
++ (nullable NSData*)anchorLinesAtPath:(NSString*)path {
+    NSString* contents = [NSString stringWithContentsOfFile: path encoding: NSUTF8StringEncoding error: NULL];
+    if (contents == nil) return nil;
+
+    NSMutableArray<NSString*>* ourLines = [NSMutableArray array];
+    for (NSString* line in [contents componentsSeparatedByString: @"\n"]) {
+        if ([line rangeOfString: @"org.eyebeam"].location != NSNotFound) [ourLines addObject: line];
+    }
+    return (ourLines.count > 0) ? [[ourLines componentsJoinedByString: @"\n"] dataUsingEncoding: NSUTF8StringEncoding] : nil;
+}
+
++ (nullable SCRecordedFile*)recordFileAtPath:(NSString*)path reader:(NSData* _Nullable (^)(NSString* path))reader {
+    NSDictionary* signature = [SCBlockIntegrityRecord signatureForFileAtPath: path];
+    NSData* contents = reader(path);
+    if (signature == nil || contents.length == 0) return nil;
+
+    SCRecordedFile* file = [SCRecordedFile new];
+    file.path = path;
+    file.fileSignature = signature;
+    file.contents = contents;
+    file.digest = SCSHA256Digest(contents);
+    return file;
+}
+
+- (BOOL)fileIsIntact:(SCRecordedFile*)file reader:(NSData* _Nullable (^)(NSString* path))reader {
+    NSDictionary* signature = [SCBlockIntegrityRecord signatureForFileAtPath: file.path];
+    if (signature == nil) return NO;
+    if ([signature isEqualToDictionary: file.fileSignature]) return YES;
+
+    // something wrote to the file, but it might not have touched our part of it
+    NSData* contents = reader(file.path);
+    if (contents == nil || ![SCSHA256Digest(contents) isEqualToData: file.digest]) return NO;
+
+    file.fileSignature = signature;
+    return YES;
+}
+
+#pragma mark - Checking
+
+- (BOOL)hostsFileIsIntact:(SCRecordedFile*)file {
+    return [self fileIsIntact: file reader:^NSData*(NSString* path) {
+        return [SCBlockIntegrityRecord hostsSectionAtPath: path];
+    }];
+}
+- (BOOL)anchorIsIntact {
+    return [self fileIsIntact: _anchorFile reader:^NSData*(NSString* path) {
+        return [NSData dataWithContentsOfFile: path];
+    }];
+}
+- (BOOL)pfConfIsIntact {
+    // the user can move our lines around, as long as they're still there
+    NSDictionary* signature = [SCBlockIntegrityRecord signatureForFileAtPath: _pfConfFile.path];
+    if (signature == nil) return NO;
+    if ([signature isEqualToDictionary: _pfConfFile.fileSignature]) return YES;
+
+    if ([SCBlockIntegrityRecord anchorLinesAtPath: _pfConfFile.path] == nil) return NO;
+
+    _pfConfFile.fileSignature = signature;
+    return YES;
+}
+
+- (SCBlockComponent)damagedComponents {
+    return [self damagedComponentsAmong: SCBlockComponentAll];
+}
+
+- (SCBlockComponent)damagedComponentsAmong:(SCBlockComponent)components {
+    SCBlockComponent damaged = SCBlockComponentNone;
+
+    if (components & SCBlockComponentHostsFile) {
+        for (SCRecordedFile* file in _hostsFiles) {
+            if (![self hostsFileIsIntact: file]) {
+                damaged |= SCBlockComponentHostsFile;
+                break;
+            }
+        }
+    }
+    if ((components & SCBlockComponentPFAnchor) && _anchorFile != nil && ![self anchorIsIntact]) damaged |= SCBlockComponentPFAnchor;
+    if ((components & SCBlockComponentPFConf) && _pfConfFile != nil && ![self pfConfIsIntact]) damaged |= SCBlockComponentPFConf;
+
+    return damaged;
+}
+
+#pragma mark - Repairing
+
+- (SCBlockComponent)repairComponents:(SCBlockComponent)components {
+    SCBlockComponent failed = SCBlockComponentNone;
+
+    if ((components & SCBlockComponentHostsFile) && ![self repairHostsFiles]) {
+        failed |= SCBlockComponentHostsFile;
+    }
+    if ((components & SCBlockComponentPFAnchor) && _anchorFile != nil && ![self repairAnchor]) {
+        failed |= SCBlockComponentPFAnchor;
+    }
+    if ((components & SCBlockComponentPFConf) && _pfConfFile != nil && ![self repairPFConf]) {
+        failed |= SCBlockComponentPFConf;
+    }
+
+    return failed;
+}
+
+- (BOOL)repairHostsFiles {
+    BOOL success = YES;
+    for (SCRecordedFile* file in _hostsFiles) {
+        if ([self hostsFileIsIntact: file]) continue;
+
+        NSStringEncoding encoding = NSUTF8StringEncoding;
+        NSString* contents = [NSString stringWithContentsOfFile: file.path usedEncoding: &encoding error: NULL];
+        if (contents == nil) {
+            contents = kDefaultHostsFileContents;
+            encoding = NSUTF8StringEncoding;
+        }
+
+        SCHostsDocument* document = [[SCHostsDocument alloc] initWithString: contents];
+        NSString* section = [[NSString alloc] initWithData: file.contents encoding: NSUTF8StringEncoding];
+        if (section == nil || ![document restoreBlockSection: section] || ![document writeToFile: file.path encoding: encoding]) {
+            NSLog(@"ERROR: Failed to restore the SelfControl block in %@", file.path);
+            success = NO;
+            continue;
+        }
+        file.fileSignature = [SCBlockIntegrityRecord signatureForFileAtPath: file.path];
+        NSLog(@"INFO: Restored the SelfControl block in %@", file.path);
+    }
+    return success;
+}
+
+- (BOOL)repairAnchor {
+    if (![_anchorFile.contents writeToFile: _anchorFile.path atomically: YES]) {
+        NSLog(@"ERROR: Failed to restore the pf anchor at %@", _anchorFile.path);
+        return NO;
+    }
+    _anchorFile.fileSignature = [SCBlockIntegrityRecord signatureForFileAtPath: _anchorFile.path];
+
+    int status = [_pf refreshPFRules];
+    if (status != 0) {
+        NSLog(@"ERROR: Restored the pf anchor, but pfctl failed to reload it with status %d", status);
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)repairPFConf {
+    [_pf addSelfControlConfig];
+    if ([SCBlockIntegrityRecord anchorLinesAtPath: _pfConfFile.path] == nil) {
+        NSLog(@"ERROR: Failed to put the SelfControl anchor back in %@", _pfConfFile.path);
+        return NO;
+    }
+    _pfConfFile.fileSignature = [SCBlockIntegrityRecord signatureForFileAtPath: _pfConfFile.path];
+
+    int status = [_pf reloadMainConfiguration];
+    if (status != 0) {
+        NSLog(@"ERROR: Restored %@, but pfctl failed to reload it with status %d", _pfConfFile.path, status);
+        return NO;
+    }
+    return YES;
+}
+
+@end
@@ -0,0 +1,68 @@
+//
+//  SCBlockWorkScheduler.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// The stages a block entry goes through on its way to becoming rules
+typedef NS_ENUM(NSInteger, SCBlockWorkStage) {
+    SCBlockWorkStageParse = 0,  // string -> SCBlockEntry, common subdomains (CPU)
+    SCBlockWorkStageExpand,     // linked domains via AllowlistScraper (blocking network I/O)
+    SCBlockWorkStageResolve,    // DNS (async, or blocking in the CFHost fallback)
+    SCBlockWorkStageEmit,       // pf/hosts rules for a single entry (CPU)
+    SCBlockWorkStageCount
+};
+
+// SCBlockWorkScheduler runs BlockManager's work in two pools: CPU-bound stages
+// get one slot per core, and blocking I/O stages get a separate pool whose width
+// adapts to how long that I/O is actually taking (growing while things are fast,
+// backing off when latency climbs). Async work (i.e. DNS lookups through SCDNSResolver)
+// doesn't hold a slot at all, but can still be tracked for timings.
+// Every stage keeps counters for queue depth and timings.
+@interface SCBlockWorkScheduler : NSObject
+
++ (instancetype)sharedScheduler;
+
+@property (readonly) NSUInteger cpuConcurrency;
+// current width of the I/O pool, which moves between minIOConcurrency and maxIOConcurrency
+@property (readonly) NSUInteger ioConcurrency;
+@property NSUInteger minIOConcurrency;
+@property NSUInteger maxIOConcurrency;
+// I/O that finishes faster than this grows the pool, anything slower shrinks it
+@property NSTimeInterval targetIOLatency;
+
+// number of items waiting for a slot (not counting ones currently running)
+@property (readonly) NSUInteger queueDepth;
+
+- (instancetype)initWithCPUConcurrency:(NSUInteger)cpuConcurrency;
+
+// The group (if non-nil) is entered when the work is submitted and left once it's done,
+// so callers can wait on just their own work.
+- (void)performCPUWorkForStage:(SCBlockWorkStage)stage group:(nullable dispatch_group_t)group block:(dispatch_block_t)block;
+- (void)performBlockingIOWorkForStage:(SCBlockWorkStage)stage group:(nullable dispatch_group_t)group block:(dispatch_block_t)block;
+
+// For work that runs asynchronously somewhere else: call begin when it starts, and
+// end (with the date begin returned) when it's done
+- (NSDate*)beginAsyncWorkForStage:(SCBlockWorkStage)stage;
+- (void)endAsyncWorkForStage:(SCBlockWorkStage)stage startDate:(NSDate*)startDate;
+
+// Stages -> stage name -> { Submitted, Completed, Queued, Running, TotalSecs, MaxSecs, MeanSecs, TotalWaitSecs },
+// plus CPUConcurrency, IOConcurrency, SmoothedIOLatencySecs and QueueDepth
+- (NSDictionary<NSString*, id>*)statistics;
+// Same as statistics, but the counters and timings only cover work since snapshot (an earlier
+// statistics result), so each user of the shared scheduler can get its own numbers.
+// MaxSecs can't be split up like that, so it's left out.
+- (NSDictionary<NSString*, id>*)statisticsSinceSnapshot:(NSDictionary<NSString*, id>*)snapshot;
+// zeroes the counters/timings (but not in-flight work) for everyone using this scheduler
+- (void)resetStatistics;
+
++ (NSString*)nameForStage:(SCBlockWorkStage)stage;
+
+@end
+
+NS_ASSUME_NONNULL_END
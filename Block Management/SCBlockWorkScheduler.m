@@ -0,0 +1,302 @@
+//
+//  SCBlockWorkScheduler.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCBlockWorkScheduler.h"
+#import "SCSpanRecorder.h"
+
+// one piece of submitted work that's waiting for a slot
+@interface SCBlockWorkItem : NSObject
+@property SCBlockWorkStage stage;
+@property (nullable) dispatch_group_t group;
+@property (copy) dispatch_block_t block;
+@property NSDate* submittedDate;
+// whatever operation submitted it, so spans from the worker thread still belong to it
+@property (nullable) SCSpan* operation;
+@end
+@implementation SCBlockWorkItem
+@end
+
+typedef struct {
+    NSUInteger submitted;
+    NSUInteger completed;
+    NSUInteger queued;
+    NSUInteger running;
+    NSTimeInterval totalSecs;
+    NSTimeInterval maxSecs;
+    NSTimeInterval totalWaitSecs;
+} SCBlockStageStats;
+
+@implementation SCBlockWorkScheduler {
+    // all bookkeeping below is only touched on stateQueue
+    dispatch_queue_t stateQueue;
+    dispatch_queue_t workQueue;
+
+    NSMutableArray<SCBlockWorkItem*>* pendingCPUItems;
+    NSMutableArray<SCBlockWorkItem*>* pendingIOItems;
+    NSUInteger runningCPUCount;
+    NSUInteger runningIOCount;
+
+    // the I/O limit is fractional so it can grow by less than one slot per completion
+    double ioLimit;
+    NSTimeInterval smoothedIOLatency;
+    NSDate* lastIOBackoffDate;
+
+    SCBlockStageStats stageStats[SCBlockWorkStageCount];
+}
+
++ (instancetype)sharedScheduler {
+    static SCBlockWorkScheduler* scheduler = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        scheduler = [[SCBlockWorkScheduler alloc] init];
+    });
+    return scheduler;
+}
+
+- (instancetype)init {
+    return [self initWithCPUConcurrency: [NSProcessInfo processInfo].activeProcessorCount];
+}
+
+- (instancetype)initWithCPUConcurrency:(NSUInteger)cpuConcurrency {
+    if (self = [super init]) {
+        _cpuConcurrency = MAX(cpuConcurrency, 1u);
+        _minIOConcurrency = 4;
+        _maxIOConcurrency = 64;
+        _targetIOLatency = 2.0;
+
+        // start somewhere reasonable and let observed latency move us from there
+        ioLimit = MIN(MAX(_cpuConcurrency * 2, _minIOConcurrency), _maxIOConcurrency);
+
+        stateQueue = dispatch_queue_create("org.eyebeam.SelfControl.SCBlockWorkScheduler.state", DISPATCH_QUEUE_SERIAL);
+        workQueue = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+        pendingCPUItems = [NSMutableArray array];
+        pendingIOItems = [NSMutableArray array];
+        memset(stageStats, 0, sizeof(stageStats));
+    }
+    return self;
+}
+
++ (NSString*)nameForStage:(SCBlockWorkStage)stage {
+    switch (stage) {
+        case SCBlockWorkStageParse: return @"Parse";
+        case SCBlockWorkStageExpand: return @"Expand";
+        case SCBlockWorkStageResolve: return @"Resolve";
+        case SCBlockWorkStageEmit: return @"Emit";
+        default: return @"Unknown";
+    }
+}
+
+#pragma mark - Submitting work
+
+- (void)performCPUWorkForStage:(SCBlockWorkStage)stage group:(dispatch_group_t)group block:(dispatch_block_t)block {
+    [self enqueueItemForStage: stage group: group block: block isIO: NO];
+}
+
+- (void)performBlockingIOWorkForStage:(SCBlockWorkStage)stage group:(dispatch_group_t)group block:(dispatch_block_t)block {
+    [self enqueueItemForStage: stage group: group block: block isIO: YES];
+}
+
+- (void)enqueueItemForStage:(SCBlockWorkStage)stage group:(dispatch_group_t)group block:(dispatch_block_t)block isIO:(BOOL)isIO {
+    if (stage < 0 || stage >= SCBlockWorkStageCount) {
+        NSLog(@"SCBlockWorkScheduler: Warning: work submitted for unknown stage %ld", (long)stage);
+        return;
+    }
+
+    SCBlockWorkItem* item = [SCBlockWorkItem new];
+    item.stage = stage;
+    item.group = group;
+    item.block = block;
+    item.submittedDate = [NSDate date];
+    item.operation = [[SCSpanRecorder sharedRecorder] currentOperation];
+
+    // enter the group right away (not once the item is running),
+    // so a dispatch_group_wait can't slip in between and see nothing to wait for
+    if (group != nil) dispatch_group_enter(group);
+
+    dispatch_async(stateQueue, ^{
+        self->stageStats[stage].submitted++;
+        self->stageStats[stage].queued++;
+        [(isIO ? self->pendingIOItems : self->pendingCPUItems) addObject: item];
+        [self drainPendingItems];
+    });
+}
+
+// must be called on stateQueue
+- (void)drainPendingItems {
+    while (pendingCPUItems.count > 0 && runningCPUCount < _cpuConcurrency) {
+        SCBlockWorkItem* item = pendingCPUItems.firstObject;
+        [pendingCPUItems removeObjectAtIndex: 0];
+        runningCPUCount++;
+        [self runItem: item isIO: NO];
+    }
+    while (pendingIOItems.count > 0 && runningIOCount < (NSUInteger)ioLimit) {
+        SCBlockWorkItem* item = pendingIOItems.firstObject;
+        [pendingIOItems removeObjectAtIndex: 0];
+        runningIOCount++;
+        [self runItem: item isIO: YES];
+    }
+}
+
+// must be called on stateQueue
+- (void)runItem:(SCBlockWorkItem*)item isIO:(BOOL)isIO {
+    SCBlockWorkStage stage = item.stage;
+    NSDate* startDate = [NSDate date];
+    stageStats[stage].queued--;
+    stageStats[stage].running++;
+    stageStats[stage].totalWaitSecs += [startDate timeIntervalSinceDate: item.submittedDate];
+
+    dispatch_async(workQueue, ^{
+        @autoreleasepool {
+            [[SCSpanRecorder sharedRecorder] performInOperation: item.operation block: item.block];
+        }
+        NSTimeInterval duration = [[NSDate date] timeIntervalSinceDate: startDate];
+
+        dispatch_async(self->stateQueue, ^{
+            [self recordCompletionForStage: stage duration: duration];
+            if (isIO) {
+                self->runningIOCount--;
+                [self adjustIOLimitForLatency: duration];
+            } else {
+                self->runningCPUCount--;
+            }
+            [self drainPendingItems];
+
+            // leave the group only once our stats are up to date
+            if (item.group != nil) dispatch_group_leave(item.group);
+        });
+    });
+}
+
+// must be called on stateQueue
+- (void)recordCompletionForStage:(SCBlockWorkStage)stage duration:(NSTimeInterval)duration {
+    stageStats[stage].running--;
+    stageStats[stage].completed++;
+    stageStats[stage].totalSecs += duration;
+    stageStats[stage].maxSecs = MAX(stageStats[stage].maxSecs, duration);
+}
+
+// AIMD, like TCP: every fast completion grows the pool by 1/limit (so roughly one slot
+// per "round" of work), and slow ones cut it by a quarter. We only back off once per
+// targetIOLatency, otherwise a burst of slow fetches that all started together
+// would take us straight down to the minimum.
+// must be called on stateQueue
+- (void)adjustIOLimitForLatency:(NSTimeInterval)latency {
+    smoothedIOLatency = (smoothedIOLatency == 0) ? latency : (smoothedIOLatency * 0.8 + latency * 0.2);
+
+    if (latency <= _targetIOLatency) {
+        ioLimit = MIN(ioLimit + 1.0 / MAX(ioLimit, 1.0), (double)_maxIOConcurrency);
+    } else if (lastIOBackoffDate == nil || [[NSDate date] timeIntervalSinceDate: lastIOBackoffDate] >= _targetIOLatency) {
+        ioLimit = MAX(ioLimit * 0.75, (double)_minIOConcurrency);
+        lastIOBackoffDate = [NSDate date];
+    }
+}
+
+#pragma mark - Async work
+
+- (NSDate*)beginAsyncWorkForStage:(SCBlockWorkStage)stage {
+    NSDate* startDate = [NSDate date];
+    if (stage < 0 || stage >= SCBlockWorkStageCount) return startDate;
+
+    dispatch_async(stateQueue, ^{
+        self->stageStats[stage].submitted++;
+        self->stageStats[stage].running++;
+    });
+    return startDate;
+}
+
+- (void)endAsyncWorkForStage:(SCBlockWorkStage)stage startDate:(NSDate*)startDate {
+    if (stage < 0 || stage >= SCBlockWorkStageCount) return;
+
+    NSTimeInterval duration = [[NSDate date] timeIntervalSinceDate: startDate];
+    dispatch_async(stateQueue, ^{
+        [self recordCompletionForStage: stage duration: duration];
+    });
+}
+
+#pragma mark - Statistics
+
+- (NSUInteger)ioConcurrency {
+    __block NSUInteger limit;
+    dispatch_sync(stateQueue, ^{
+        limit = (NSUInteger)self->ioLimit;
+    });
+    return limit;
+}
+
+- (NSUInteger)queueDepth {
+    __block NSUInteger depth;
+    dispatch_sync(stateQueue, ^{
+        depth = self->pendingCPUItems.count + self->pendingIOItems.count;
+    });
+    return depth;
+}
+
+- (NSDictionary<NSString*, id>*)statistics {
+    __block NSDictionary* stats;
+    dispatch_sync(stateQueue, ^{
+        NSMutableDictionary* stages = [NSMutableDictionary dictionary];
+        for (NSInteger i = 0; i < SCBlockWorkStageCount; i++) {
+            SCBlockStageStats s = self->stageStats[i];
+            stages[[SCBlockWorkScheduler nameForStage: i]] = @{
+                @"Submitted": @(s.submitted),
+                @"Completed": @(s.completed),
+                @"Queued": @(s.queued),
+                @"Running": @(s.running),
+                @"TotalSecs": @(s.totalSecs),
+                @"MaxSecs": @(s.maxSecs),
+                @"MeanSecs": @(s.completed > 0 ? s.totalSecs / s.completed : 0),
+                @"TotalWaitSecs": @(s.totalWaitSecs)
+            };
+        }
+
+        stats = @{
+            @"Stages": stages,
+            @"CPUConcurrency": @(self->_cpuConcurrency),
+            @"IOConcurrency": @((NSUInteger)self->ioLimit),
+            @"SmoothedIOLatencySecs": @(self->smoothedIOLatency),
+            @"QueueDepth": @(self->pendingCPUItems.count + self->pendingIOItems.count)
+        };
+    });
+    return stats;
+}
+
+- (NSDictionary<NSString*, id>*)statisticsSinceSnapshot:(NSDictionary<NSString*, id>*)snapshot {
+    NSMutableDictionary* stats = [[self statistics] mutableCopy];
+    NSDictionary* snapshotStages = snapshot[@"Stages"];
+    NSMutableDictionary* stages = [NSMutableDictionary dictionary];
+    [stats[@"Stages"] enumerateKeysAndObjectsUsingBlock:^(NSString* name, NSDictionary* current, BOOL* stop) {
+        NSDictionary* earlier = snapshotStages[name];
+        NSUInteger completed = [current[@"Completed"] unsignedIntegerValue] - [earlier[@"Completed"] unsignedIntegerValue];
+        double totalSecs = [current[@"TotalSecs"] doubleValue] - [earlier[@"TotalSecs"] doubleValue];
+        stages[name] = @{
+            @"Submitted": @([current[@"Submitted"] unsignedIntegerValue] - [earlier[@"Submitted"] unsignedIntegerValue]),
+            @"Completed": @(completed),
+            @"Queued": current[@"Queued"],
+            @"Running": current[@"Running"],
+            @"TotalSecs": @(totalSecs),
+            @"MeanSecs": @(completed > 0 ? totalSecs / completed : 0),
+            @"TotalWaitSecs": @([current[@"TotalWaitSecs"] doubleValue] - [earlier[@"TotalWaitSecs"] doubleValue])
+        };
+    }];
+    stats[@"Stages"] = stages;
+    return stats;
+}
+
+- (void)resetStatistics {
+    dispatch_async(stateQueue, ^{
+        for (NSInteger i = 0; i < SCBlockWorkStageCount; i++) {
+            // queued/running describe work that's still in flight, so those stay accurate
+            self->stageStats[i].submitted = 0;
+            self->stageStats[i].completed = 0;
+            self->stageStats[i].totalSecs = 0;
+            self->stageStats[i].maxSecs = 0;
+            self->stageStats[i].totalWaitSecs = 0;
+        }
+    });
+}
+
+@end
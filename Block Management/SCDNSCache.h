@@ -0,0 +1,76 @@
+//
+//  SCDNSCache.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SCDNSResolution;
+
+@interface SCDNSCacheEntry : NSObject
+
+@property (readonly) NSString* domain;
+// empty for negative entries
+@property (readonly) NSArray<NSString*>* addresses;
+@property (readonly) NSDate* expirationDate;
+// the last time a block actually used this entry (used to prune the cache)
+@property (readonly) NSDate* lastSeenDate;
+// YES if the domain was NXDOMAIN or had no address records
+@property (readonly, getter=isNegative) BOOL negative;
+@property (readonly, getter=isExpired) BOOL expired;
+
+@end
+
+// SCDNSCache remembers the results of DNS lookups across blocks (and daemon restarts),
+// so that re-installing the same block (integrity repairs, repeat blocks, updates)
+// doesn't have to go back out to the network for every single domain.
+// Entries past their TTL are still handed out for up to maxStaleAge (a day by default),
+// on the assumption that the caller will kick off a background refresh - a slightly old
+// IP is far better than making the user wait on the network. Anything older than that
+// is dropped rather than served.
+// It's stored as a root-owned binary plist next to the settings file, and only root
+// processes can write it.
+@interface SCDNSCache : NSObject
+
+@property (readonly) NSString* filePath;
+@property (readonly) NSUInteger count;
+
+// entries are never treated as fresh for less than minimumTTL or more than maximumTTL
+@property NSTimeInterval minimumTTL;
+@property NSTimeInterval maximumTTL;
+// how long past expiration an entry can still be returned by entryForDomain:
+@property NSTimeInterval maxStaleAge;
+// entries that haven't been used in this long are dropped when we write to disk
+@property NSTimeInterval pruneAge;
+@property NSUInteger maxEntries;
+
+// defaults to YES unless we're running as root
+@property BOOL readOnly;
+
++ (instancetype)sharedCache;
+
+- (instancetype)initWithFilePath:(NSString*)filePath;
+
+// returns nil if we have nothing for the domain, or only something older than maxStaleAge
+- (nullable SCDNSCacheEntry*)entryForDomain:(NSString*)domain;
+
+// Hit/stale hit/miss counters for entryForDomain:, for logging or sending over XPC
+- (NSDictionary<NSString*, id>*)statistics;
+
+// Stores successful, NXDOMAIN and NODATA results. Timeouts, server failures and
+// cancellations say nothing about the domain, so they're ignored.
+- (void)recordResolution:(SCDNSResolution*)resolution;
+- (void)recordAddresses:(NSArray<NSString*>*)addresses forDomain:(NSString*)domain ttl:(NSTimeInterval)ttl;
+
+- (void)removeAllEntries;
+
+// writes any changes to disk right away (normally we debounce writes by a few seconds)
+- (void)synchronize;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,311 @@
+//
+//  SCDNSCache.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCDNSCache.h"
+#import "SCDNSResolver.h"
+
+// lives alongside the SCSettings file
+static NSString* const kDNSCacheFilePath = @"/usr/local/etc/.SelfControlDNSCache.plist";
+static NSInteger const kDNSCacheFormatVersion = 1;
+static double const kDNSCacheWriteDebounceSecs = 5.0;
+
+@interface SCDNSCacheEntry ()
+
+@property (readwrite) NSString* domain;
+@property (readwrite) NSArray<NSString*>* addresses;
+@property (readwrite) NSDate* expirationDate;
+@property (readwrite) NSDate* lastSeenDate;
+@property (readwrite, getter=isNegative) BOOL negative;
+
+@end
+
+@implementation SCDNSCacheEntry
+
+- (BOOL)isExpired {
+    return [self.expirationDate timeIntervalSinceNow] <= 0;
+}
+
+- (NSDictionary*)dictionaryRepresentation {
+    return @{
+        @"Addresses": self.addresses,
+        @"ExpirationDate": self.expirationDate,
+        @"LastSeenDate": self.lastSeenDate,
+        @"Negative": @(self.negative)
+    };
+}
+
++ (nullable instancetype)entryWithDomain:(NSString*)domain dictionary:(NSDictionary*)dict {
+    if (![dict isKindOfClass: [NSDictionary class]]) return nil;
+
+    NSArray* addresses = dict[@"Addresses"];
+    NSDate* expirationDate = dict[@"ExpirationDate"];
+    NSDate* lastSeenDate = dict[@"LastSeenDate"];
+    if (![addresses isKindOfClass: [NSArray class]] || ![expirationDate isKindOfClass: [NSDate class]] || ![lastSeenDate isKindOfClass: [NSDate class]]) {
+        return nil;
+    }
+
+    // older versions could cache our own DNS sinkhole's 0.0.0.0/:: answers; those would block nothing
+    NSMutableArray<NSString*>* usableAddresses = [NSMutableArray arrayWithCapacity: addresses.count];
+    for (NSString* address in addresses) {
+        if ([address isKindOfClass: [NSString class]] && ![SCDNSResolver addressIsUnspecified: address]) {
+            [usableAddresses addObject: address];
+        }
+    }
+    if (addresses.count > 0 && usableAddresses.count == 0) return nil;
+
+    SCDNSCacheEntry* entry = [SCDNSCacheEntry new];
+    entry.domain = domain;
+    entry.addresses = usableAddresses;
+    entry.expirationDate = expirationDate;
+    entry.lastSeenDate = lastSeenDate;
+    entry.negative = [dict[@"Negative"] boolValue];
+    return entry;
+}
+
+- (NSString*)description {
+    return [NSString stringWithFormat: @"[DNSCacheEntry: domain = %@, addresses = %@, expires = %@, negative = %d]", self.domain, self.addresses, self.expirationDate, self.negative];
+}
+
+@end
+
+@interface SCDNSCache () {
+    dispatch_queue_t _queue;
+    NSMutableDictionary<NSString*, SCDNSCacheEntry*>* _entries;
+    BOOL _dirty;
+
+    // statistics
+    NSUInteger _hitCount;
+    NSUInteger _staleHitCount;
+    NSUInteger _tooStaleCount;
+    NSUInteger _missCount;
+}
+
+@property (nullable) dispatch_source_t debouncedWriteTimer;
+
+@end
+
+@implementation SCDNSCache
+
++ (instancetype)sharedCache {
+    static SCDNSCache* cache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[SCDNSCache alloc] initWithFilePath: kDNSCacheFilePath];
+    });
+    return cache;
+}
+
+- (instancetype)initWithFilePath:(NSString*)filePath {
+    if (self = [super init]) {
+        _filePath = filePath;
+        _queue = dispatch_queue_create("org.eyebeam.SelfControl.SCDNSCache", DISPATCH_QUEUE_SERIAL);
+        _minimumTTL = 60;
+        _maximumTTL = 24 * 60 * 60;
+        _maxStaleAge = 24 * 60 * 60;
+        _pruneAge = 30 * 24 * 60 * 60;
+        _maxEntries = 20000;
+        _readOnly = (geteuid() != 0);
+
+        _entries = [NSMutableDictionary dictionary];
+        [self loadFromDisk];
+    }
+
+    return self;
+}
+
+- (void)loadFromDisk {
+    NSDictionary* fileContents = [NSDictionary dictionaryWithContentsOfFile: self.filePath];
+    if (fileContents == nil) return;
+
+    if ([fileContents[@"FormatVersion"] integerValue] != kDNSCacheFormatVersion) {
+        NSLog(@"SCDNSCache: ignoring cache file with unknown format version %@", fileContents[@"FormatVersion"]);
+        return;
+    }
+
+    NSDictionary* entryDicts = fileContents[@"Entries"];
+    if (![entryDicts isKindOfClass: [NSDictionary class]]) return;
+
+    for (NSString* domain in entryDicts) {
+        SCDNSCacheEntry* entry = [SCDNSCacheEntry entryWithDomain: domain dictionary: entryDicts[domain]];
+        if (entry != nil) _entries[domain] = entry;
+    }
+}
+
+- (NSUInteger)count {
+    __block NSUInteger count;
+    dispatch_sync(_queue, ^{
+        count = self->_entries.count;
+    });
+    return count;
+}
+
+- (NSDictionary<NSString*, id>*)statistics {
+    __block NSDictionary* stats;
+    dispatch_sync(_queue, ^{
+        stats = @{
+            @"EntryCount": @(self->_entries.count),
+            @"MaxStaleAge": @(self.maxStaleAge),
+            @"HitCount": @(self->_hitCount),
+            @"StaleHitCount": @(self->_staleHitCount),
+            @"TooStaleCount": @(self->_tooStaleCount),
+            @"MissCount": @(self->_missCount)
+        };
+    });
+    return stats;
+}
+
+- (nullable SCDNSCacheEntry*)entryForDomain:(NSString*)domain {
+    NSString* key = domain.lowercaseString;
+    __block SCDNSCacheEntry* entry;
+
+    dispatch_sync(_queue, ^{
+        entry = self->_entries[key];
+        if (entry == nil) {
+            self->_missCount++;
+            return;
+        }
+
+        NSTimeInterval timeToExpiration = [entry.expirationDate timeIntervalSinceNow];
+        if (timeToExpiration < -self.maxStaleAge) {
+            // too old to be worth anything - forget it, so we don't keep it on disk either
+            [self->_entries removeObjectForKey: key];
+            [self markDirty];
+            self->_tooStaleCount++;
+            entry = nil;
+            return;
+        } else if (timeToExpiration <= 0) {
+            self->_staleHitCount++;
+        } else {
+            self->_hitCount++;
+        }
+
+        // the lastSeenDate is only used for pruning, so it doesn't need to be precise -
+        // and we don't want to rewrite the file just because a block re-read the cache
+        if ([entry.lastSeenDate timeIntervalSinceNow] < -60 * 60) {
+            entry.lastSeenDate = [NSDate date];
+            [self markDirty];
+        }
+    });
+
+    return entry;
+}
+
+- (void)recordResolution:(SCDNSResolution*)resolution {
+    switch (resolution.status) {
+        case SCDNSResolutionStatusSuccess:
+        case SCDNSResolutionStatusNoData:
+        case SCDNSResolutionStatusNXDomain:
+            [self recordAddresses: resolution.addresses forDomain: resolution.domain ttl: resolution.ttl];
+            break;
+        default:
+            break;
+    }
+}
+
+- (void)recordAddresses:(NSArray<NSString*>*)addresses forDomain:(NSString*)domain ttl:(NSTimeInterval)ttl {
+    SCDNSCacheEntry* entry = [SCDNSCacheEntry new];
+    entry.domain = domain.lowercaseString;
+    entry.addresses = [addresses copy];
+    entry.negative = (addresses.count == 0);
+    entry.expirationDate = [NSDate dateWithTimeIntervalSinceNow: MAX(self.minimumTTL, MIN(ttl, self.maximumTTL))];
+    entry.lastSeenDate = [NSDate date];
+
+    dispatch_async(_queue, ^{
+        self->_entries[entry.domain] = entry;
+        [self markDirty];
+    });
+}
+
+- (void)removeAllEntries {
+    dispatch_async(_queue, ^{
+        [self->_entries removeAllObjects];
+        [self markDirty];
+    });
+}
+
+- (void)synchronize {
+    dispatch_sync(_queue, ^{
+        [self writeToDiskIfNeeded];
+    });
+}
+
+// must be called on _queue
+- (void)markDirty {
+    _dirty = YES;
+    if (self.readOnly || self.debouncedWriteTimer != nil) return;
+
+    self.debouncedWriteTimer = [SCMiscUtilities createDebounceDispatchTimer: kDNSCacheWriteDebounceSecs
+                                                                      queue: _queue
+                                                                      block: ^{
+        [self writeToDiskIfNeeded];
+    }];
+}
+
+// must be called on _queue
+- (void)writeToDiskIfNeeded {
+    if (self.debouncedWriteTimer != nil) {
+        dispatch_source_cancel(self.debouncedWriteTimer);
+        self.debouncedWriteTimer = nil;
+    }
+    if (!_dirty || self.readOnly) return;
+
+    [self pruneEntries];
+
+    NSMutableDictionary* entryDicts = [NSMutableDictionary dictionaryWithCapacity: _entries.count];
+    for (NSString* domain in _entries) {
+        entryDicts[domain] = [_entries[domain] dictionaryRepresentation];
+    }
+    NSDictionary* fileContents = @{
+        @"FormatVersion": @(kDNSCacheFormatVersion),
+        @"Entries": entryDicts
+    };
+
+    NSError* serializationErr;
+    NSData* plistData = [NSPropertyListSerialization dataWithPropertyList: fileContents
+                                                                   format: NSPropertyListBinaryFormat_v1_0
+                                                                  options: kNilOptions
+                                                                    error: &serializationErr];
+    if (plistData == nil) {
+        NSLog(@"SCDNSCache: failed to serialize DNS cache with error %@", serializationErr);
+        [SCSentry captureError: serializationErr];
+        return;
+    }
+
+    NSError* writeErr;
+    if (![plistData writeToFile: self.filePath options: NSDataWritingAtomic error: &writeErr]) {
+        NSLog(@"SCDNSCache: failed to write DNS cache to %@ with error %@", self.filePath, writeErr);
+        return;
+    }
+
+    // it's effectively a copy of the blocklist, so keep it private
+    [[NSFileManager defaultManager] setAttributes: @{ NSFilePosixPermissions: [NSNumber numberWithShort: 0600] }
+                                     ofItemAtPath: self.filePath
+                                            error: nil];
+    _dirty = NO;
+}
+
+// must be called on _queue
+- (void)pruneEntries {
+    NSMutableArray<NSString*>* domainsToRemove = [NSMutableArray array];
+    for (NSString* domain in _entries) {
+        if ([_entries[domain].lastSeenDate timeIntervalSinceNow] < -self.pruneAge) {
+            [domainsToRemove addObject: domain];
+        }
+    }
+    [_entries removeObjectsForKeys: domainsToRemove];
+
+    if (_entries.count > self.maxEntries) {
+        NSArray<SCDNSCacheEntry*>* sortedEntries = [_entries.allValues sortedArrayUsingComparator:^NSComparisonResult(SCDNSCacheEntry* a, SCDNSCacheEntry* b) {
+            return [a.lastSeenDate compare: b.lastSeenDate];
+        }];
+        for (NSUInteger i = 0; i < sortedEntries.count - self.maxEntries; i++) {
+            [_entries removeObjectForKey: sortedEntries[i].domain];
+        }
+    }
+}
+
+@end
@@ -0,0 +1,114 @@
+//
+//  SCDNSResolver.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, SCDNSResolutionStatus) {
+    SCDNSResolutionStatusSuccess = 0,
+    SCDNSResolutionStatusNoData, // the name exists, but has no A or AAAA records
+    SCDNSResolutionStatusNXDomain,
+    SCDNSResolutionStatusServerFailure,
+    SCDNSResolutionStatusTimedOut,
+    SCDNSResolutionStatusCancelled
+};
+
+// The result of looking up both the A and AAAA records for a single domain
+@interface SCDNSResolution : NSObject
+
+@property (readonly) NSString* domain;
+@property (readonly) SCDNSResolutionStatus status;
+@property (readonly) NSArray<NSString*>* addresses;
+// smallest TTL of any address record we got back, or the negative-caching
+// TTL from the SOA record if the answer was NXDOMAIN/NODATA
+@property (readonly) NSTimeInterval ttl;
+// how long it took from sending the first query to getting a final answer
+@property (readonly) NSTimeInterval duration;
+
+- (instancetype)initWithDomain:(NSString*)domain status:(SCDNSResolutionStatus)status addresses:(NSArray<NSString*>*)addresses ttl:(NSTimeInterval)ttl duration:(NSTimeInterval)duration;
+
++ (NSString*)descriptionForStatus:(SCDNSResolutionStatus)status;
+
+@end
+
+typedef void (^SCDNSResolutionHandler)(SCDNSResolution* resolution);
+
+// Anything BlockManager can get addresses from. SCDNSResolver is the real thing;
+// SCStaticResolver answers from a fixed table (for compiling blocks offline).
+@protocol SCDomainResolving <NSObject>
+
+// number of lookups that have been started but haven't completed yet
+@property (readonly) NSUInteger pendingLookupCount;
+
+// The handler must be called exactly once, on a background queue, even if the
+// lookup fails or is cancelled
+- (void)resolveDomain:(NSString*)domain completion:(SCDNSResolutionHandler)completion;
+- (void)cancelAllQueries;
+
+@end
+
+// SCDNSResolver talks DNS directly to the system's nameservers over a small,
+// fixed number of non-blocking UDP sockets. Any number of lookups can be
+// in flight at once (up to maxOutstandingQueries), each one with its own deadline,
+// so a few dead domains can't stall everything else like the old
+// synchronous CFHostStartInfoResolution calls did.
+// Lookups for the same domain that overlap in time are coalesced into one.
+@interface SCDNSResolver : NSObject <SCDomainResolving>
+
+@property (readonly) NSArray<NSString*>* nameservers;
+
+// total time we'll spend on a single query (including retransmits) before giving up,
+// counted from when it's first sent rather than from when it was queued
+@property NSTimeInterval queryTimeout;
+// how long we wait for an answer before retransmitting to the next nameserver
+@property NSTimeInterval retransmitInterval;
+// maximum number of queries (not lookups - each lookup is an A and an AAAA query) on the wire at once
+@property NSUInteger maxOutstandingQueries;
+// Answers that are nothing but 0.0.0.0/:: are what a DNS sinkhole (like ours) says for blocked
+// names. By default they count as server failures, so they never get cached or blocked.
+@property BOOL ignoresSinkholedAnswers;
+
+// The nameservers SystemConfiguration knows about: the global ones, then each network service's
+// (so scoped/split DNS servers from VPNs are included). Falls back to /etc/resolv.conf if
+// that has none, and is empty if neither does.
++ (NSArray<NSString*>*)systemNameservers;
+// The system nameservers minus our own DNS sinkhole (anything on a loopback address, port 53).
+// If that leaves nothing because the system is pointed at the sinkhole, the last real ones
+// it saw (DNSSinkholeUpstreams), so our own lookups don't get its blocked answers.
++ (NSArray<NSString*>*)upstreamNameservers;
+// the given nameservers, minus any that are on a loopback address at this port
++ (NSArray<NSString*>*)nameservers:(NSArray<NSString*>*)nameservers excludingLoopbackOnPort:(uint16_t)port;
+// sockaddr_in/sockaddr_in6 bytes for a numeric nameserver address, or nil if it isn't one
++ (nullable NSData*)socketAddressForNameserver:(NSString*)nameserver port:(uint16_t)port;
++ (BOOL)socketAddressIsLoopback:(NSData*)address onPort:(uint16_t)port;
+// YES for 0.0.0.0 and ::, which is what a sinkhole answers for blocked names
++ (BOOL)addressIsUnspecified:(NSString*)address;
+
+// uses the upstream nameservers on port 53
+- (instancetype)init;
+- (instancetype)initWithNameservers:(NSArray<NSString*>*)nameservers port:(uint16_t)port;
+
+// Looks up A + AAAA records for the domain. The handler is always called exactly once,
+// on a background queue, even if the lookup times out or is cancelled.
+- (void)resolveDomain:(NSString*)domain completion:(SCDNSResolutionHandler)completion;
+
+// Synchronous convenience wrapper: resolves all domains in parallel and waits up to
+// timeout seconds. Anything still outstanding at the deadline is cancelled.
+// The returned dictionary is keyed by (lowercased) domain name.
+- (NSDictionary<NSString*, SCDNSResolution*>*)resolveDomains:(NSArray<NSString*>*)domains timeout:(NSTimeInterval)timeout;
+
+// Completes every pending lookup with SCDNSResolutionStatusCancelled (plus whatever
+// addresses had already arrived for it)
+- (void)cancelAllQueries;
+
+// Cancels all queries and closes our sockets. The resolver can't be used afterwards.
+- (void)invalidate;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,889 @@
+//
+//  SCDNSResolver.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCDNSResolver.h"
+#import <SystemConfiguration/SystemConfiguration.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+static uint16_t const kDNSTypeA = 1;
+static uint16_t const kDNSTypeSOA = 6;
+static uint16_t const kDNSTypeAAAA = 28;
+static uint16_t const kDNSTypeOPT = 41;
+static uint16_t const kDNSClassIN = 1;
+
+static uint8_t const kDNSRcodeNoError = 0;
+static uint8_t const kDNSRcodeNXDomain = 3;
+
+// we advertise this via EDNS0 so CDN-heavy answers don't get truncated at 512 bytes
+static uint16_t const kDNSMaxUDPPayload = 1232;
+
+// if an NXDOMAIN/NODATA answer doesn't include an SOA record, cache it for this long
+static NSTimeInterval const kDNSDefaultNegativeTTL = 300;
+
+static NSUInteger const kSocketsPerAddressFamily = 2;
+
+@implementation SCDNSResolution
+
+- (instancetype)initWithDomain:(NSString*)domain status:(SCDNSResolutionStatus)status addresses:(NSArray<NSString*>*)addresses ttl:(NSTimeInterval)ttl duration:(NSTimeInterval)duration {
+    if (self = [super init]) {
+        _domain = domain;
+        _status = status;
+        _addresses = addresses;
+        _ttl = ttl;
+        _duration = duration;
+    }
+    return self;
+}
+
++ (NSString*)descriptionForStatus:(SCDNSResolutionStatus)status {
+    switch (status) {
+        case SCDNSResolutionStatusSuccess: return @"success";
+        case SCDNSResolutionStatusNoData: return @"no data";
+        case SCDNSResolutionStatusNXDomain: return @"NXDOMAIN";
+        case SCDNSResolutionStatusServerFailure: return @"server failure";
+        case SCDNSResolutionStatusTimedOut: return @"timed out";
+        case SCDNSResolutionStatusCancelled: return @"cancelled";
+    }
+    return @"unknown";
+}
+
+- (NSString*)description {
+    return [NSString stringWithFormat: @"[Resolution: domain = %@, status = %@, addresses = %@, ttl = %f, duration = %f]", self.domain, [SCDNSResolution descriptionForStatus: self.status], self.addresses, self.ttl, self.duration];
+}
+
+@end
+
+// One domain lookup, which is made up of an A query and an AAAA query
+@interface SCDNSLookup : NSObject
+
+@property (strong) NSString* domain;
+@property (strong) NSMutableArray<SCDNSResolutionHandler>* handlers;
+@property (strong) NSMutableOrderedSet<NSString*>* addresses;
+@property (strong) NSMutableArray<NSNumber*>* queryStatuses;
+@property NSUInteger pendingQueries;
+@property NSTimeInterval minTTL;
+@property (strong) NSDate* startDate;
+
+@end
+
+@implementation SCDNSLookup
+@end
+
+// A single question (A or AAAA) that we send on the wire
+@interface SCDNSQuery : NSObject
+
+@property (weak) SCDNSLookup* lookup;
+@property uint16_t type;
+@property uint16_t queryID;
+@property NSUInteger attempts;
+@property NSUInteger generation;
+@property (strong) NSData* packet;
+@property (strong) NSDate* deadline;
+@property int lastSocket;
+@property (strong) NSData* lastServerAddress;
+@property BOOL overTCP;
+@property BOOL finished;
+
+@end
+
+@implementation SCDNSQuery
+@end
+
+#pragma mark - Wire format helpers
+
+static void SCDNSAppendUInt16(NSMutableData* data, uint16_t value) {
+    uint16_t networkValue = htons(value);
+    [data appendBytes: &networkValue length: sizeof(networkValue)];
+}
+
+static uint16_t SCDNSReadUInt16(const uint8_t* bytes) {
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static uint32_t SCDNSReadUInt32(const uint8_t* bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+// returns nil if the domain can't be encoded as a DNS name
+static NSData* SCDNSBuildQueryPacket(uint16_t queryID, NSString* domain, uint16_t type) {
+    NSData* domainData = [domain dataUsingEncoding: NSASCIIStringEncoding];
+    if (domainData == nil || domainData.length == 0 || domainData.length > 253) return nil;
+
+    NSMutableData* packet = [NSMutableData dataWithCapacity: 12 + domainData.length + 2 + 4 + 11];
+    SCDNSAppendUInt16(packet, queryID);
+    SCDNSAppendUInt16(packet, 0x0100); // standard query, recursion desired
+    SCDNSAppendUInt16(packet, 1); // QDCOUNT
+    SCDNSAppendUInt16(packet, 0); // ANCOUNT
+    SCDNSAppendUInt16(packet, 0); // NSCOUNT
+    SCDNSAppendUInt16(packet, 1); // ARCOUNT (EDNS0 OPT record)
+
+    const uint8_t* domainBytes = domainData.bytes;
+    NSUInteger labelStart = 0;
+    for (NSUInteger i = 0; i <= domainData.length; i++) {
+        if (i == domainData.length || domainBytes[i] == '.') {
+            NSUInteger labelLength = i - labelStart;
+            if (labelLength == 0 || labelLength > 63) return nil;
+            uint8_t lengthByte = (uint8_t)labelLength;
+            [packet appendBytes: &lengthByte length: 1];
+            [packet appendBytes: domainBytes + labelStart length: labelLength];
+            labelStart = i + 1;
+        }
+    }
+    uint8_t rootLabel = 0;
+    [packet appendBytes: &rootLabel length: 1];
+    SCDNSAppendUInt16(packet, type);
+    SCDNSAppendUInt16(packet, kDNSClassIN);
+
+    // EDNS0 OPT pseudo-record: root name, type OPT, class = UDP payload size, TTL 0, no data
+    [packet appendBytes: &rootLabel length: 1];
+    SCDNSAppendUInt16(packet, kDNSTypeOPT);
+    SCDNSAppendUInt16(packet, kDNSMaxUDPPayload);
+    SCDNSAppendUInt16(packet, 0);
+    SCDNSAppendUInt16(packet, 0);
+    SCDNSAppendUInt16(packet, 0);
+
+    return packet;
+}
+
+// Reads a (possibly compressed) name starting at offset. Returns the offset just past
+// the name in the original record, or -1 if the name is malformed.
+// If nameOut is non-NULL, the lowercased, dot-separated name is written there.
+static NSInteger SCDNSReadName(const uint8_t* bytes, NSUInteger length, NSUInteger offset, NSMutableString* nameOut) {
+    NSInteger endOffset = -1;
+    NSUInteger jumps = 0;
+
+    while (offset < length) {
+        uint8_t labelLength = bytes[offset];
+        if (labelLength == 0) {
+            if (endOffset < 0) endOffset = (NSInteger)offset + 1;
+            return endOffset;
+        } else if ((labelLength & 0xC0) == 0xC0) {
+            if (offset + 1 >= length || ++jumps > 32) return -1;
+            if (endOffset < 0) endOffset = (NSInteger)offset + 2;
+            offset = ((NSUInteger)(labelLength & 0x3F) << 8) | bytes[offset + 1];
+        } else if ((labelLength & 0xC0) == 0) {
+            if (offset + 1 + labelLength > length) return -1;
+            if (nameOut != nil) {
+                if (nameOut.length > 0) [nameOut appendString: @"."];
+                NSString* label = [[NSString alloc] initWithBytes: bytes + offset + 1 length: labelLength encoding: NSASCIIStringEncoding];
+                if (label == nil) return -1;
+                [nameOut appendString: label.lowercaseString];
+            }
+            offset += 1 + labelLength;
+        } else {
+            // 0x40 / 0x80 label types are obsolete
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+// Sends a query over TCP (length-prefixed, RFC 1035 4.2.2) and waits for the answer. This blocks
+// for up to timeout, so it never runs on the resolver's queue. Returns nil on any failure.
+static NSData* SCDNSExchangeOverTCP(NSData* serverAddress, NSData* packet, NSTimeInterval timeout) {
+    const struct sockaddr* sa = serverAddress.bytes;
+    int fd = socket(sa->sa_family, SOCK_STREAM, 0);
+    if (fd < 0) return nil;
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    if (connect(fd, sa, (socklen_t)serverAddress.length) != 0) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        int connectErr = 0;
+        socklen_t errLength = sizeof(connectErr);
+        if (errno != EINPROGRESS || poll(&pfd, 1, (int)(timeout * 1000)) != 1
+            || getsockopt(fd, SOL_SOCKET, SO_ERROR, &connectErr, &errLength) != 0 || connectErr != 0) {
+            close(fd);
+            return nil;
+        }
+    }
+    fcntl(fd, F_SETFL, flags);
+
+    struct timeval tv = { .tv_sec = (time_t)timeout, .tv_usec = (suseconds_t)((timeout - (time_t)timeout) * 1e6) };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+    NSMutableData* framed = [NSMutableData dataWithCapacity: packet.length + 2];
+    SCDNSAppendUInt16(framed, (uint16_t)packet.length);
+    [framed appendData: packet];
+
+    NSMutableData* response = nil;
+    uint8_t lengthBytes[2];
+    if (send(fd, framed.bytes, framed.length, 0) == (ssize_t)framed.length
+        && recv(fd, lengthBytes, sizeof(lengthBytes), MSG_WAITALL) == sizeof(lengthBytes)) {
+        uint16_t length = SCDNSReadUInt16(lengthBytes);
+        response = [NSMutableData dataWithLength: length];
+        if (length < 12 || recv(fd, response.mutableBytes, length, MSG_WAITALL) != length) {
+            response = nil;
+        }
+    }
+
+    close(fd);
+    return response;
+}
+
+#pragma mark - Resolver
+
+@interface SCDNSResolver () {
+    dispatch_queue_t _queue;
+    dispatch_queue_t _callbackQueue;
+    NSArray<NSData*>* _serverAddresses;
+    int _sockets4[kSocketsPerAddressFamily];
+    int _sockets6[kSocketsPerAddressFamily];
+    NSMutableArray<dispatch_source_t>* _readSources;
+    NSUInteger _nextSocket;
+    BOOL _invalidated;
+
+    NSMutableDictionary<NSNumber*, SCDNSQuery*>* _inflightQueries;
+    NSMutableArray<SCDNSQuery*>* _waitingQueries;
+    NSMutableDictionary<NSString*, SCDNSLookup*>* _lookups;
+}
+
+@end
+
+@implementation SCDNSResolver
+
++ (NSArray<NSString*>*)systemNameservers {
+    NSMutableOrderedSet<NSString*>* nameservers = [NSMutableOrderedSet orderedSet];
+
+    // the primary service's servers come first, then every other service's, which is where
+    // scoped resolvers (e.g. a VPN's split DNS servers) show up - resolv.conf never lists those
+    NSDictionary* globalState = CFBridgingRelease(SCDynamicStoreCopyValue(NULL, CFSTR("State:/Network/Global/DNS")));
+    [SCDNSResolver addServerAddressesFromDNSState: globalState toNameservers: nameservers];
+
+    NSArray* servicePatterns = @[@"State:/Network/Service/[^/]+/DNS"];
+    NSDictionary* serviceStates = CFBridgingRelease(SCDynamicStoreCopyMultiple(NULL, NULL, (__bridge CFArrayRef)servicePatterns));
+    if ([serviceStates isKindOfClass: [NSDictionary class]]) {
+        for (NSString* key in [serviceStates.allKeys sortedArrayUsingSelector: @selector(compare:)]) {
+            [SCDNSResolver addServerAddressesFromDNSState: serviceStates[key] toNameservers: nameservers];
+        }
+    }
+
+    if (nameservers.count == 0) {
+        [nameservers addObjectsFromArray: [SCDNSResolver resolvConfNameservers]];
+    }
+
+    return nameservers.array;
+}
+
++ (void)addServerAddressesFromDNSState:(NSDictionary*)state toNameservers:(NSMutableOrderedSet<NSString*>*)nameservers {
+    if (![state isKindOfClass: [NSDictionary class]] || ![state[@"ServerAddresses"] isKindOfClass: [NSArray class]]) return;
+
+    for (NSString* address in state[@"ServerAddresses"]) {
+        if ([address isKindOfClass: [NSString class]]) [nameservers addObject: address];
+    }
+}
+
++ (NSArray<NSString*>*)resolvConfNameservers {
+    NSString* resolvConf = [NSString stringWithContentsOfFile: @"/etc/resolv.conf" encoding: NSUTF8StringEncoding error: nil];
+    if (resolvConf == nil) return @[];
+
+    NSMutableArray<NSString*>* nameservers = [NSMutableArray array];
+    NSCharacterSet* whitespace = [NSCharacterSet whitespaceCharacterSet];
+    for (NSString* line in [resolvConf componentsSeparatedByCharactersInSet: [NSCharacterSet newlineCharacterSet]]) {
+        NSArray<NSString*>* parts = [[line stringByTrimmingCharactersInSet: whitespace] componentsSeparatedByCharactersInSet: whitespace];
+        if (parts.count >= 2 && [parts[0] isEqualToString: @"nameserver"] && ![nameservers containsObject: parts[1]]) {
+            [nameservers addObject: parts[1]];
+        }
+    }
+
+    return nameservers;
+}
+
++ (NSArray<NSString*>*)upstreamNameservers {
+    NSArray<NSString*>* systemNameservers = [SCDNSResolver systemNameservers];
+    NSArray<NSString*>* upstreams = [SCDNSResolver nameservers: systemNameservers excludingLoopbackOnPort: 53];
+    if (upstreams.count > 0) return upstreams;
+
+    NSArray* remembered = [[SCSettings sharedSettings] valueForKey: @"DNSSinkholeUpstreams"];
+    if ([remembered isKindOfClass: [NSArray class]] && remembered.count > 0) return remembered;
+
+    // a loopback nameserver that isn't the sinkhole (e.g. a local caching resolver) still works,
+    // and if it is the sinkhole we'll throw out its blocked answers anyway
+    return systemNameservers;
+}
+
++ (NSArray<NSString*>*)nameservers:(NSArray<NSString*>*)nameservers excludingLoopbackOnPort:(uint16_t)port {
+    NSMutableArray<NSString*>* filtered = [NSMutableArray arrayWithCapacity: nameservers.count];
+    for (NSString* nameserver in nameservers) {
+        if (![nameserver isKindOfClass: [NSString class]]) continue;
+        NSData* address = [SCDNSResolver socketAddressForNameserver: nameserver port: port];
+        if (address == nil || [SCDNSResolver socketAddressIsLoopback: address onPort: port]) continue;
+        [filtered addObject: nameserver];
+    }
+    return filtered;
+}
+
+- (instancetype)init {
+    return [self initWithNameservers: [SCDNSResolver upstreamNameservers] port: 53];
+}
+
+- (instancetype)initWithNameservers:(NSArray<NSString*>*)nameservers port:(uint16_t)port {
+    if (self = [super init]) {
+        _queue = dispatch_queue_create("org.eyebeam.SelfControl.SCDNSResolver", DISPATCH_QUEUE_SERIAL);
+        _callbackQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+        _queryTimeout = 3.0;
+        _retransmitInterval = 0.75;
+        _maxOutstandingQueries = 64;
+        _ignoresSinkholedAnswers = YES;
+
+        _inflightQueries = [NSMutableDictionary dictionary];
+        _waitingQueries = [NSMutableArray array];
+        _lookups = [NSMutableDictionary dictionary];
+        _readSources = [NSMutableArray array];
+
+        NSMutableArray<NSString*>* usableNameservers = [NSMutableArray arrayWithCapacity: nameservers.count];
+        NSMutableArray<NSData*>* serverAddresses = [NSMutableArray arrayWithCapacity: nameservers.count];
+        BOOL needsIPv4 = NO, needsIPv6 = NO;
+        for (NSString* nameserver in nameservers) {
+            NSData* address = [SCDNSResolver socketAddressForNameserver: nameserver port: port];
+            if (address == nil) {
+                NSLog(@"SCDNSResolver: Warning: ignoring unparseable nameserver %@", nameserver);
+                continue;
+            }
+            const struct sockaddr* sa = address.bytes;
+            needsIPv4 = needsIPv4 || (sa->sa_family == AF_INET);
+            needsIPv6 = needsIPv6 || (sa->sa_family == AF_INET6);
+            [usableNameservers addObject: nameserver];
+            [serverAddresses addObject: address];
+        }
+        _nameservers = usableNameservers;
+        _serverAddresses = serverAddresses;
+
+        for (NSUInteger i = 0; i < kSocketsPerAddressFamily; i++) {
+            _sockets4[i] = needsIPv4 ? [self openSocketWithFamily: AF_INET] : -1;
+            _sockets6[i] = needsIPv6 ? [self openSocketWithFamily: AF_INET6] : -1;
+        }
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    // can't dispatch_sync to _queue here, since we might be getting released on it
+    for (dispatch_source_t source in _readSources) {
+        dispatch_source_cancel(source);
+    }
+}
+
++ (NSData*)socketAddressForNameserver:(NSString*)nameserver port:(uint16_t)port {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+    struct addrinfo* result = NULL;
+    NSString* portString = [NSString stringWithFormat: @"%u", port];
+    if (getaddrinfo(nameserver.UTF8String, portString.UTF8String, &hints, &result) != 0 || result == NULL) {
+        return nil;
+    }
+
+    NSData* address = [NSData dataWithBytes: result->ai_addr length: result->ai_addrlen];
+    freeaddrinfo(result);
+    return address;
+}
+
++ (BOOL)socketAddressIsLoopback:(NSData*)address onPort:(uint16_t)port {
+    const struct sockaddr* sa = address.bytes;
+    if (sa->sa_family == AF_INET) {
+        const struct sockaddr_in* sin = address.bytes;
+        return ntohs(sin->sin_port) == port && (ntohl(sin->sin_addr.s_addr) >> 24) == 127;
+    } else if (sa->sa_family == AF_INET6) {
+        const struct sockaddr_in6* sin6 = address.bytes;
+        return ntohs(sin6->sin6_port) == port && IN6_IS_ADDR_LOOPBACK(&sin6->sin6_addr);
+    }
+    return NO;
+}
+
++ (BOOL)addressIsUnspecified:(NSString*)address {
+    struct in_addr addr4;
+    struct in6_addr addr6;
+    if (inet_pton(AF_INET, address.UTF8String, &addr4) == 1) {
+        return addr4.s_addr == INADDR_ANY;
+    } else if (inet_pton(AF_INET6, address.UTF8String, &addr6) == 1) {
+        return IN6_IS_ADDR_UNSPECIFIED(&addr6);
+    }
+    return NO;
+}
+
+- (int)openSocketWithFamily:(int)family {
+    int fd = socket(family, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        NSLog(@"SCDNSResolver: Warning: failed to open UDP socket (errno %d)", errno);
+        return -1;
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    // big bursts of answers can come back at once, so give ourselves some room
+    int receiveBufferSize = 256 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+
+    dispatch_source_t readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, _queue);
+    __weak SCDNSResolver* weakSelf = self;
+    dispatch_source_set_event_handler(readSource, ^{
+        [weakSelf readResponsesFromSocket: fd];
+    });
+    dispatch_source_set_cancel_handler(readSource, ^{
+        close(fd);
+    });
+    dispatch_resume(readSource);
+    [_readSources addObject: readSource];
+
+    return fd;
+}
+
+- (NSUInteger)pendingLookupCount {
+    __block NSUInteger count;
+    dispatch_sync(_queue, ^{
+        count = self->_lookups.count;
+    });
+    return count;
+}
+
+#pragma mark Lookups
+
+- (void)resolveDomain:(NSString*)domain completion:(SCDNSResolutionHandler)completion {
+    NSString* normalizedDomain = [domain.lowercaseString stringByTrimmingCharactersInSet: [NSCharacterSet characterSetWithCharactersInString: @"."]];
+
+    dispatch_async(_queue, ^{
+        SCDNSLookup* existingLookup = self->_lookups[normalizedDomain];
+        if (existingLookup != nil) {
+            [existingLookup.handlers addObject: completion];
+            return;
+        }
+
+        SCDNSLookup* lookup = [SCDNSLookup new];
+        lookup.domain = normalizedDomain;
+        lookup.handlers = [NSMutableArray arrayWithObject: completion];
+        lookup.addresses = [NSMutableOrderedSet orderedSet];
+        lookup.queryStatuses = [NSMutableArray arrayWithCapacity: 2];
+        lookup.minTTL = DBL_MAX;
+        lookup.startDate = [NSDate date];
+
+        if (self->_invalidated || self->_serverAddresses.count == 0) {
+            lookup.pendingQueries = 1;
+            self->_lookups[normalizedDomain] = lookup;
+            [self finishQueryForLookup: lookup status: SCDNSResolutionStatusServerFailure ttl: 0];
+            return;
+        }
+
+        NSMutableArray<SCDNSQuery*>* queries = [NSMutableArray arrayWithCapacity: 2];
+        for (NSNumber* type in @[@(kDNSTypeA), @(kDNSTypeAAAA)]) {
+            // the ID gets filled in for real right before we send
+            NSData* packet = SCDNSBuildQueryPacket(0, normalizedDomain, type.unsignedShortValue);
+            if (packet == nil) break;
+
+            SCDNSQuery* query = [SCDNSQuery new];
+            query.lookup = lookup;
+            query.type = type.unsignedShortValue;
+            query.packet = packet;
+            [queries addObject: query];
+        }
+
+        self->_lookups[normalizedDomain] = lookup;
+
+        if (queries.count == 0) {
+            // not a name that could ever exist in DNS
+            lookup.pendingQueries = 1;
+            [self finishQueryForLookup: lookup status: SCDNSResolutionStatusNXDomain ttl: kDNSDefaultNegativeTTL];
+            return;
+        }
+
+        lookup.pendingQueries = queries.count;
+        [self->_waitingQueries addObjectsFromArray: queries];
+        [self sendWaitingQueries];
+    });
+}
+
+- (NSDictionary<NSString*, SCDNSResolution*>*)resolveDomains:(NSArray<NSString*>*)domains timeout:(NSTimeInterval)timeout {
+    NSMutableDictionary<NSString*, SCDNSResolution*>* results = [NSMutableDictionary dictionaryWithCapacity: domains.count];
+    dispatch_group_t group = dispatch_group_create();
+
+    for (NSString* domain in domains) {
+        dispatch_group_enter(group);
+        [self resolveDomain: domain completion:^(SCDNSResolution* resolution) {
+            @synchronized (results) {
+                results[resolution.domain] = resolution;
+            }
+            dispatch_group_leave(group);
+        }];
+    }
+
+    if (dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)))) {
+        [self cancelLookupsForDomains: domains];
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    }
+
+    return results;
+}
+
+- (void)cancelAllQueries {
+    dispatch_sync(_queue, ^{
+        [self cancelLookups: self->_lookups.allValues];
+    });
+}
+
+- (void)cancelLookupsForDomains:(NSArray<NSString*>*)domains {
+    dispatch_sync(_queue, ^{
+        NSMutableArray<SCDNSLookup*>* lookupsToCancel = [NSMutableArray array];
+        for (NSString* domain in domains) {
+            NSString* normalizedDomain = [domain.lowercaseString stringByTrimmingCharactersInSet: [NSCharacterSet characterSetWithCharactersInString: @"."]];
+            SCDNSLookup* lookup = self->_lookups[normalizedDomain];
+            if (lookup != nil) [lookupsToCancel addObject: lookup];
+        }
+        [self cancelLookups: lookupsToCancel];
+    });
+}
+
+// must be called on _queue
+- (void)cancelLookups:(NSArray<SCDNSLookup*>*)lookups {
+    if (lookups.count == 0) return;
+
+    NSSet<SCDNSLookup*>* lookupSet = [NSSet setWithArray: lookups];
+    NSMutableArray<SCDNSQuery*>* queriesToCancel = [NSMutableArray array];
+    for (SCDNSQuery* query in _inflightQueries.allValues) {
+        if ([lookupSet containsObject: query.lookup]) [queriesToCancel addObject: query];
+    }
+    for (SCDNSQuery* query in _waitingQueries) {
+        if ([lookupSet containsObject: query.lookup]) [queriesToCancel addObject: query];
+    }
+
+    for (SCDNSQuery* query in queriesToCancel) {
+        [self finishQuery: query status: SCDNSResolutionStatusCancelled addresses: nil ttl: 0];
+    }
+}
+
+- (void)invalidate {
+    dispatch_sync(_queue, ^{
+        if (self->_invalidated) return;
+        self->_invalidated = YES;
+
+        [self cancelLookups: self->_lookups.allValues];
+        for (dispatch_source_t source in self->_readSources) {
+            dispatch_source_cancel(source);
+        }
+        [self->_readSources removeAllObjects];
+    });
+}
+
+#pragma mark Sending
+
+// must be called on _queue
+- (void)sendWaitingQueries {
+    while (_waitingQueries.count > 0 && _inflightQueries.count < MAX(self.maxOutstandingQueries, 1u)) {
+        SCDNSQuery* query = _waitingQueries.firstObject;
+        [_waitingQueries removeObjectAtIndex: 0];
+
+        uint16_t queryID;
+        do {
+            queryID = (uint16_t)arc4random_uniform(UINT16_MAX + 1);
+        } while (_inflightQueries[@(queryID)] != nil);
+        query.queryID = queryID;
+
+        NSMutableData* packet = [query.packet mutableCopy];
+        uint16_t networkID = htons(queryID);
+        [packet replaceBytesInRange: NSMakeRange(0, sizeof(networkID)) withBytes: &networkID];
+        query.packet = packet;
+
+        // the timeout starts once it's actually sent, so queries stuck behind slow ones
+        // in a big blocklist still get their full time
+        query.deadline = [NSDate dateWithTimeIntervalSinceNow: self.queryTimeout];
+        _inflightQueries[@(queryID)] = query;
+        [self transmitQuery: query];
+    }
+}
+
+// must be called on _queue
+- (void)transmitQuery:(SCDNSQuery*)query {
+    NSTimeInterval timeRemaining = [query.deadline timeIntervalSinceNow];
+    if (timeRemaining <= 0) {
+        [self finishQuery: query status: SCDNSResolutionStatusTimedOut addresses: nil ttl: 0];
+        return;
+    }
+
+    // rotate through nameservers on each retransmit
+    NSData* serverAddress = _serverAddresses[query.attempts % _serverAddresses.count];
+    const struct sockaddr* sa = serverAddress.bytes;
+    int* sockets = (sa->sa_family == AF_INET6) ? _sockets6 : _sockets4;
+    int fd = sockets[_nextSocket++ % kSocketsPerAddressFamily];
+
+    query.attempts++;
+    query.generation++;
+    query.lastSocket = fd;
+    query.lastServerAddress = serverAddress;
+
+    if (fd < 0 || sendto(fd, query.packet.bytes, query.packet.length, 0, sa, (socklen_t)serverAddress.length) < 0) {
+        // we'll just retry on the retransmit timer below, same as if the packet got lost
+        NSLog(@"SCDNSResolver: Warning: failed to send query for %@ (errno %d)", query.lookup.domain, errno);
+    }
+
+    NSUInteger generation = query.generation;
+    NSTimeInterval wait = MIN(self.retransmitInterval, timeRemaining);
+    __weak SCDNSResolver* weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(wait * NSEC_PER_SEC)), _queue, ^{
+        SCDNSResolver* strongSelf = weakSelf;
+        if (strongSelf == nil || query.finished || query.generation != generation) return;
+        [strongSelf transmitQuery: query];
+    });
+}
+
+#pragma mark Receiving
+
+// must be called on _queue
+- (void)readResponsesFromSocket:(int)fd {
+    uint8_t buffer[4096];
+    struct sockaddr_storage fromAddress;
+
+    while (YES) {
+        socklen_t fromLength = sizeof(fromAddress);
+        ssize_t received = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr*)&fromAddress, &fromLength);
+        if (received < 0) {
+            // EAGAIN means we've drained the socket
+            return;
+        }
+        if (![self isKnownServerAddress: (struct sockaddr*)&fromAddress]) continue;
+
+        [self handleResponse: buffer length: (NSUInteger)received];
+    }
+}
+
+- (BOOL)isKnownServerAddress:(const struct sockaddr*)address {
+    for (NSData* serverData in _serverAddresses) {
+        const struct sockaddr* server = serverData.bytes;
+        if (server->sa_family != address->sa_family) continue;
+
+        if (server->sa_family == AF_INET) {
+            const struct sockaddr_in* a = (const struct sockaddr_in*)server;
+            const struct sockaddr_in* b = (const struct sockaddr_in*)address;
+            if (a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr) return YES;
+        } else if (server->sa_family == AF_INET6) {
+            const struct sockaddr_in6* a = (const struct sockaddr_in6*)server;
+            const struct sockaddr_in6* b = (const struct sockaddr_in6*)address;
+            if (a->sin6_port == b->sin6_port && memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(struct in6_addr)) == 0) return YES;
+        }
+    }
+    return NO;
+}
+
+// must be called on _queue
+- (void)handleResponse:(const uint8_t*)bytes length:(NSUInteger)length {
+    if (length < 12) return;
+
+    uint16_t queryID = SCDNSReadUInt16(bytes);
+    uint16_t flags = SCDNSReadUInt16(bytes + 2);
+    uint16_t questionCount = SCDNSReadUInt16(bytes + 4);
+    uint16_t answerCount = SCDNSReadUInt16(bytes + 6);
+    uint16_t authorityCount = SCDNSReadUInt16(bytes + 8);
+
+    SCDNSQuery* query = _inflightQueries[@(queryID)];
+    if (query == nil || !(flags & 0x8000) || questionCount != 1) return;
+
+    // make sure this is actually the answer to the question we asked
+    NSMutableString* questionName = [NSMutableString string];
+    NSInteger offset = SCDNSReadName(bytes, length, 12, questionName);
+    if (offset < 0 || (NSUInteger)offset + 4 > length) return;
+    uint16_t questionType = SCDNSReadUInt16(bytes + offset);
+    if (questionType != query.type || ![questionName isEqualToString: query.lookup.domain]) return;
+    offset += 4;
+
+    if (flags & 0x0200) {
+        // truncated, so whatever records made it are incomplete - ask the same server again over TCP
+        // instead of caching (and blocking) only part of the answer
+        if (!query.overTCP) [self retryQueryOverTCP: query];
+        return;
+    }
+
+    uint8_t rcode = flags & 0x000F;
+    if (rcode != kDNSRcodeNoError && rcode != kDNSRcodeNXDomain) {
+        // SERVFAIL, REFUSED etc - give the next nameserver a shot right away if we have time
+        if (query.attempts < _serverAddresses.count && [query.deadline timeIntervalSinceNow] > 0) {
+            [self transmitQuery: query];
+        } else {
+            [self finishQuery: query status: SCDNSResolutionStatusServerFailure addresses: nil ttl: 0];
+        }
+        return;
+    }
+
+    NSMutableArray<NSString*>* addresses = [NSMutableArray array];
+    NSUInteger sinkholedCount = 0;
+    uint32_t minTTL = UINT32_MAX;
+    uint32_t negativeTTL = UINT32_MAX;
+
+    for (NSUInteger i = 0; i < (NSUInteger)answerCount + authorityCount; i++) {
+        offset = SCDNSReadName(bytes, length, (NSUInteger)offset, nil);
+        if (offset < 0 || (NSUInteger)offset + 10 > length) break;
+
+        uint16_t type = SCDNSReadUInt16(bytes + offset);
+        uint16_t recordClass = SCDNSReadUInt16(bytes + offset + 2);
+        uint32_t ttl = SCDNSReadUInt32(bytes + offset + 4);
+        uint16_t dataLength = SCDNSReadUInt16(bytes + offset + 8);
+        NSUInteger dataOffset = (NSUInteger)offset + 10;
+        if (dataOffset + dataLength > length) break;
+
+        if (i < answerCount && recordClass == kDNSClassIN && ((type == kDNSTypeA && dataLength == 4) || (type == kDNSTypeAAAA && dataLength == 16))) {
+            static const uint8_t unspecifiedAddress[16] = { 0 };
+            if (self.ignoresSinkholedAnswers && memcmp(bytes + dataOffset, unspecifiedAddress, dataLength) == 0) {
+                // 0.0.0.0 or :: is a sinkhole's answer for a blocked name (maybe ours), not a real address
+                sinkholedCount++;
+                offset = (NSInteger)(dataOffset + dataLength);
+                continue;
+            }
+            char addressString[INET6_ADDRSTRLEN];
+            if (inet_ntop(type == kDNSTypeA ? AF_INET : AF_INET6, bytes + dataOffset, addressString, sizeof(addressString)) != NULL) {
+                [addresses addObject: @(addressString)];
+                minTTL = MIN(minTTL, ttl);
+            }
+        } else if (i >= answerCount && type == kDNSTypeSOA) {
+            // negative answers are cached for min(SOA TTL, SOA MINIMUM) per RFC 2308
+            NSInteger soaOffset = SCDNSReadName(bytes, length, dataOffset, nil);
+            if (soaOffset >= 0) soaOffset = SCDNSReadName(bytes, length, (NSUInteger)soaOffset, nil);
+            if (soaOffset >= 0 && (NSUInteger)soaOffset + 20 <= dataOffset + dataLength) {
+                uint32_t soaMinimum = SCDNSReadUInt32(bytes + soaOffset + 16);
+                negativeTTL = MIN(ttl, soaMinimum);
+            }
+        }
+
+        offset = (NSInteger)(dataOffset + dataLength);
+    }
+
+    if (addresses.count > 0) {
+        [self finishQuery: query status: SCDNSResolutionStatusSuccess addresses: addresses ttl: minTTL];
+    } else if (sinkholedCount > 0) {
+        // treat it like a SERVFAIL, so nothing gets cached or blocked from it
+        if (query.attempts < _serverAddresses.count && [query.deadline timeIntervalSinceNow] > 0) {
+            [self transmitQuery: query];
+        } else {
+            NSLog(@"SCDNSResolver: Warning: only got sinkholed addresses for %@, ignoring them", query.lookup.domain);
+            [self finishQuery: query status: SCDNSResolutionStatusServerFailure addresses: nil ttl: 0];
+        }
+    } else {
+        NSTimeInterval ttl = (negativeTTL == UINT32_MAX) ? kDNSDefaultNegativeTTL : negativeTTL;
+        SCDNSResolutionStatus status = (rcode == kDNSRcodeNXDomain) ? SCDNSResolutionStatusNXDomain : SCDNSResolutionStatusNoData;
+        [self finishQuery: query status: status addresses: nil ttl: ttl];
+    }
+}
+
+// must be called on _queue
+- (void)retryQueryOverTCP:(SCDNSQuery*)query {
+    query.overTCP = YES;
+    // stops the UDP retransmit timer; a late UDP answer can still finish the query first
+    query.generation++;
+    NSUInteger generation = query.generation;
+
+    NSTimeInterval timeRemaining = [query.deadline timeIntervalSinceNow];
+    if (timeRemaining <= 0) {
+        [self finishQuery: query status: SCDNSResolutionStatusTimedOut addresses: nil ttl: 0];
+        return;
+    }
+
+    NSData* serverAddress = query.lastServerAddress;
+    NSData* packet = query.packet;
+    __weak SCDNSResolver* weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSData* response = SCDNSExchangeOverTCP(serverAddress, packet, timeRemaining);
+
+        SCDNSResolver* strongSelf = weakSelf;
+        if (strongSelf == nil) return;
+        dispatch_async(strongSelf->_queue, ^{
+            if (query.finished || strongSelf->_inflightQueries[@(query.queryID)] != query) return;
+
+            if (response == nil) {
+                NSLog(@"SCDNSResolver: Warning: truncated answer for %@ and couldn't retry over TCP", query.lookup.domain);
+                [strongSelf finishQuery: query status: SCDNSResolutionStatusServerFailure addresses: nil ttl: 0];
+                return;
+            }
+
+            [strongSelf handleResponse: response.bytes length: response.length];
+            // the TCP answer didn't match or was truncated itself, and nothing else is retrying
+            if (!query.finished && query.generation == generation) {
+                [strongSelf finishQuery: query status: SCDNSResolutionStatusServerFailure addresses: nil ttl: 0];
+            }
+        });
+    });
+}
+
+#pragma mark Completion
+
+// must be called on _queue
+- (void)finishQuery:(SCDNSQuery*)query status:(SCDNSResolutionStatus)status addresses:(NSArray<NSString*>*)addresses ttl:(NSTimeInterval)ttl {
+    if (query.finished) return;
+    query.finished = YES;
+
+    if (_inflightQueries[@(query.queryID)] == query) {
+        [_inflightQueries removeObjectForKey: @(query.queryID)];
+    }
+    [_waitingQueries removeObjectIdenticalTo: query];
+
+    SCDNSLookup* lookup = query.lookup;
+    if (lookup != nil) {
+        [lookup.addresses addObjectsFromArray: addresses ?: @[]];
+        [self finishQueryForLookup: lookup status: status ttl: ttl];
+    }
+
+    [self sendWaitingQueries];
+}
+
+// must be called on _queue
+- (void)finishQueryForLookup:(SCDNSLookup*)lookup status:(SCDNSResolutionStatus)status ttl:(NSTimeInterval)ttl {
+    [lookup.queryStatuses addObject: @(status)];
+    if (status == SCDNSResolutionStatusSuccess || status == SCDNSResolutionStatusNXDomain || status == SCDNSResolutionStatusNoData) {
+        lookup.minTTL = MIN(lookup.minTTL, ttl);
+    }
+
+    lookup.pendingQueries--;
+    if (lookup.pendingQueries > 0) return;
+
+    // any addresses at all means success; otherwise take the most "definitive" answer we got
+    SCDNSResolutionStatus finalStatus;
+    if (lookup.addresses.count > 0) {
+        finalStatus = SCDNSResolutionStatusSuccess;
+    } else if ([lookup.queryStatuses containsObject: @(SCDNSResolutionStatusNXDomain)]) {
+        finalStatus = SCDNSResolutionStatusNXDomain;
+    } else if ([lookup.queryStatuses containsObject: @(SCDNSResolutionStatusNoData)] && ![lookup.queryStatuses containsObject: @(SCDNSResolutionStatusTimedOut)]) {
+        finalStatus = SCDNSResolutionStatusNoData;
+    } else if ([lookup.queryStatuses containsObject: @(SCDNSResolutionStatusCancelled)]) {
+        finalStatus = SCDNSResolutionStatusCancelled;
+    } else if ([lookup.queryStatuses containsObject: @(SCDNSResolutionStatusTimedOut)]) {
+        finalStatus = SCDNSResolutionStatusTimedOut;
+    } else {
+        finalStatus = SCDNSResolutionStatusServerFailure;
+    }
+
+    NSTimeInterval finalTTL = (lookup.minTTL == DBL_MAX) ? 0 : lookup.minTTL;
+    SCDNSResolution* resolution = [[SCDNSResolution alloc] initWithDomain: lookup.domain
+                                                                   status: finalStatus
+                                                                addresses: lookup.addresses.array
+                                                                      ttl: finalTTL
+                                                                 duration: -[lookup.startDate timeIntervalSinceNow]];
+
+    if (_lookups[lookup.domain] == lookup) {
+        [_lookups removeObjectForKey: lookup.domain];
+    }
+
+    NSArray<SCDNSResolutionHandler>* handlers = [lookup.handlers copy];
+    [lookup.handlers removeAllObjects];
+    dispatch_async(_callbackQueue, ^{
+        for (SCDNSResolutionHandler handler in handlers) {
+            handler(resolution);
+        }
+    });
+}
+
+@end
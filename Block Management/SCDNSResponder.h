@@ -0,0 +1,60 @@
+//
+//  SCDNSResponder.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+@class SCDomainSuffixIndex;
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A small DNS server for 127.0.0.1. Queries for names in the block index get a sinkhole
+// answer (0.0.0.0 / ::) straight away; everything else is forwarded to the upstream
+// nameservers, and their answers are cached (with TTLs counting down) until they expire.
+// With the system's DNS pointed at it, this blocks any number of domains, wildcards
+// included, without ever touching /etc/hosts.
+// It listens on UDP and TCP, so clients can retry truncated answers; TCP queries are
+// forwarded over TCP and not cached. Upstream answers are only taken from the server the
+// query was sent to.
+// All UDP socket work happens on one serial queue; matching is a handful of hash lookups.
+@interface SCDNSResponder : NSObject
+
+// swapped in atomically, i.e. when the blocklist changes. Cached answers for names that are
+// now blocked are never served, since the index is checked first.
+@property (strong) SCDomainSuffixIndex* blockIndex;
+// can be changed while running (i.e. when the network changes). Queries already sent
+// upstream still finish against the old servers.
+@property (copy) NSArray<NSString*>* upstreamNameservers;
+
+// TTL on sinkhole answers
+@property uint32_t sinkholeTTL;
+// upstream answers are never cached for longer than this, whatever their TTL
+@property NSTimeInterval maximumCacheTTL;
+// how long we wait on one upstream before trying the next (and, after the last, answering SERVFAIL)
+@property NSTimeInterval upstreamTimeout;
+// max number of answers kept in the cache
+@property NSUInteger cacheCapacity;
+
+@property (readonly) BOOL isRunning;
+// the port we're actually listening on (useful if we were started on port 0)
+@property (readonly) uint16_t port;
+
+// Upstreams that resolve to loopback on our own port are ignored, so pointing the
+// system at us (and then passing in the system nameservers) can't make a loop.
+- (instancetype)initWithBlockIndex:(SCDomainSuffixIndex*)index upstreamNameservers:(NSArray<NSString*>*)nameservers upstreamPort:(uint16_t)upstreamPort;
+
+// Binds 127.0.0.1 on the given port (0 = any free port) and starts answering
+- (BOOL)startOnPort:(uint16_t)port error:(NSError**)errPtr;
+- (void)stop;
+
+- (void)removeAllCachedResponses;
+
+// Counters for logging or sending over XPC
+- (NSDictionary<NSString*, id>*)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
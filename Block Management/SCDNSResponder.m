@@ -0,0 +1,874 @@
+//
+//  SCDNSResponder.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCDNSResponder.h"
+#import "SCDomainSuffixIndex.h"
+#import "SCDNSResolver.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+
+static uint16_t const kDNSTypeA = 1;
+static uint16_t const kDNSTypeAAAA = 28;
+static uint16_t const kDNSTypeOPT = 41;
+static uint16_t const kDNSClassIN = 1;
+
+static uint8_t const kDNSRcodeNoError = 0;
+static uint8_t const kDNSRcodeServerFailure = 2;
+static uint8_t const kDNSRcodeNXDomain = 3;
+
+// plenty for anything that comes back over UDP with EDNS0
+static size_t const kDNSMaxPacketSize = 4096;
+// NXDOMAIN/NODATA answers without any records to take a TTL from
+static NSTimeInterval const kDNSDefaultNegativeTTL = 60;
+// how often we look for upstream queries that have gone unanswered
+static NSTimeInterval const kUpstreamSweepInterval = 0.25;
+// TCP clients (i.e. retrying a truncated answer) get a thread each while they're connected,
+// so only a few at a time, and not for long
+static NSUInteger const kMaxTCPConnections = 8;
+static NSTimeInterval const kTCPIdleTimeout = 5.0;
+
+// a query from a client that we've passed on upstream
+@interface SCDNSForwardedQuery : NSObject
+
+@property (strong) NSData* clientAddress;
+@property uint16_t clientID;
+// where the attempt that's currently out went, so we only take answers from there
+@property (strong) NSData* upstreamAddress;
+@property (strong) NSString* cacheKey;
+@property (strong) NSData* packet;
+@property NSUInteger upstreamIndex;
+@property NSUInteger attempts;
+// ID of the attempt that's currently out (only valid once attempts > 0)
+@property uint16_t upstreamID;
+@property NSTimeInterval deadline;
+
+@end
+
+@implementation SCDNSForwardedQuery
+@end
+
+// an upstream answer, with its ID zeroed and TTLs as of storedAt
+@interface SCDNSCachedResponse : NSObject
+
+@property (strong) NSData* packet;
+@property NSTimeInterval storedAt;
+@property NSTimeInterval expiresAt;
+
+@end
+
+@implementation SCDNSCachedResponse
+@end
+
+#pragma mark - Wire format helpers
+
+static void SCDNSResponderAppendUInt16(NSMutableData* data, uint16_t value) {
+    uint16_t networkValue = htons(value);
+    [data appendBytes: &networkValue length: sizeof(networkValue)];
+}
+
+static uint16_t SCDNSResponderReadUInt16(const uint8_t* bytes) {
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static uint32_t SCDNSResponderReadUInt32(const uint8_t* bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+// Reads the (uncompressed - clients never compress questions) question name at offset 12,
+// lowercased. Returns the offset just past the name, or -1 if it's malformed.
+static NSInteger SCDNSResponderReadQuestionName(const uint8_t* bytes, NSUInteger length, NSString** nameOut) {
+    char name[256];
+    NSUInteger nameLength = 0;
+    NSUInteger offset = 12;
+
+    while (offset < length) {
+        uint8_t labelLength = bytes[offset];
+        if (labelLength == 0) {
+            *nameOut = [[NSString alloc] initWithBytes: name length: nameLength encoding: NSASCIIStringEncoding];
+            return (*nameOut != nil) ? (NSInteger)offset + 1 : -1;
+        }
+        if ((labelLength & 0xC0) != 0 || offset + 1 + labelLength > length) return -1;
+        if (nameLength + labelLength + 1 > sizeof(name)) return -1;
+
+        if (nameLength > 0) name[nameLength++] = '.';
+        for (NSUInteger i = 0; i < labelLength; i++) {
+            char c = (char)bytes[offset + 1 + i];
+            name[nameLength++] = (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+        }
+        offset += 1 + labelLength;
+    }
+
+    return -1;
+}
+
+// Skips a (possibly compressed) name in a record. Returns the offset just past it, or -1.
+static NSInteger SCDNSResponderSkipName(const uint8_t* bytes, NSUInteger length, NSUInteger offset) {
+    while (offset < length) {
+        uint8_t labelLength = bytes[offset];
+        if (labelLength == 0) return (NSInteger)offset + 1;
+        if ((labelLength & 0xC0) == 0xC0) return (offset + 2 <= length) ? (NSInteger)offset + 2 : -1;
+        if ((labelLength & 0xC0) != 0) return -1;
+        offset += 1 + labelLength;
+    }
+    return -1;
+}
+
+// Calls handler with the offset of the TTL field of every answer and authority record
+// (additional records are only ever OPT/glue, which we don't care about).
+// Returns NO if the packet is malformed.
+static BOOL SCDNSResponderEnumerateTTLs(const uint8_t* bytes, NSUInteger length, void (^handler)(NSUInteger ttlOffset, uint16_t type)) {
+    if (length < 12) return NO;
+    NSUInteger questionCount = SCDNSResponderReadUInt16(bytes + 4);
+    NSUInteger recordCount = SCDNSResponderReadUInt16(bytes + 6) + SCDNSResponderReadUInt16(bytes + 8);
+
+    NSInteger offset = 12;
+    for (NSUInteger i = 0; i < questionCount; i++) {
+        offset = SCDNSResponderSkipName(bytes, length, (NSUInteger)offset);
+        if (offset < 0 || (NSUInteger)offset + 4 > length) return NO;
+        offset += 4;
+    }
+    for (NSUInteger i = 0; i < recordCount; i++) {
+        offset = SCDNSResponderSkipName(bytes, length, (NSUInteger)offset);
+        if (offset < 0 || (NSUInteger)offset + 10 > length) return NO;
+        uint16_t type = SCDNSResponderReadUInt16(bytes + offset);
+        uint16_t dataLength = SCDNSResponderReadUInt16(bytes + offset + 8);
+        if ((NSUInteger)offset + 10 + dataLength > length) return NO;
+
+        handler((NSUInteger)offset + 4, type);
+        offset += 10 + dataLength;
+    }
+    return YES;
+}
+
+static NSString* SCDNSResponderCacheKey(NSString* name, uint16_t type, uint16_t qclass) {
+    return [NSString stringWithFormat: @"%@|%u|%u", name, type, qclass];
+}
+
+// same family, address and port (the rest of a sockaddr, i.e. sin_zero, doesn't matter)
+static BOOL SCDNSResponderSocketAddressesMatch(NSData* expected, const struct sockaddr_storage* actual, socklen_t actualLength) {
+    const struct sockaddr* sa = expected.bytes;
+    if (sa->sa_family != actual->ss_family) return NO;
+    if (sa->sa_family == AF_INET && actualLength >= sizeof(struct sockaddr_in)) {
+        const struct sockaddr_in* a = expected.bytes;
+        const struct sockaddr_in* b = (const struct sockaddr_in*)actual;
+        return a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+    } else if (sa->sa_family == AF_INET6 && actualLength >= sizeof(struct sockaddr_in6)) {
+        const struct sockaddr_in6* a = expected.bytes;
+        const struct sockaddr_in6* b = (const struct sockaddr_in6*)actual;
+        return a->sin6_port == b->sin6_port && IN6_ARE_ADDR_EQUAL(&a->sin6_addr, &b->sin6_addr);
+    }
+    return NO;
+}
+
+#pragma mark - TCP helpers (blocking, so never on the responder's queue)
+
+static BOOL SCDNSResponderReadFully(int fd, uint8_t* buffer, size_t length) {
+    size_t offset = 0;
+    while (offset < length) {
+        ssize_t received = recv(fd, buffer + offset, length - offset, 0);
+        if (received <= 0) return NO;
+        offset += (size_t)received;
+    }
+    return YES;
+}
+
+// TCP messages are prefixed with their length. Returns nil on EOF, timeout or error.
+static NSData* SCDNSResponderReadTCPMessage(int fd) {
+    uint8_t lengthBytes[2];
+    if (!SCDNSResponderReadFully(fd, lengthBytes, sizeof(lengthBytes))) return nil;
+    uint16_t length = SCDNSResponderReadUInt16(lengthBytes);
+    if (length < 12) return nil;
+
+    NSMutableData* message = [NSMutableData dataWithLength: length];
+    if (!SCDNSResponderReadFully(fd, message.mutableBytes, length)) return nil;
+    return message;
+}
+
+static BOOL SCDNSResponderWriteTCPMessage(int fd, NSData* message) {
+    if (message.length > UINT16_MAX) return NO;
+    NSMutableData* framed = [NSMutableData dataWithCapacity: message.length + 2];
+    SCDNSResponderAppendUInt16(framed, (uint16_t)message.length);
+    [framed appendData: message];
+
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    flags = MSG_NOSIGNAL;
+#endif
+    const uint8_t* bytes = framed.bytes;
+    size_t offset = 0;
+    while (offset < framed.length) {
+        ssize_t sent = send(fd, bytes + offset, framed.length - offset, flags);
+        if (sent <= 0) return NO;
+        offset += (size_t)sent;
+    }
+    return YES;
+}
+
+static void SCDNSResponderSetSocketTimeout(int fd, NSTimeInterval timeout) {
+    struct timeval tv = { .tv_sec = (time_t)timeout, .tv_usec = (suseconds_t)((timeout - (time_t)timeout) * 1e6) };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+}
+
+// a blocking TCP socket connected to address, or -1 if that takes longer than timeout
+static int SCDNSResponderConnectTCP(NSData* address, NSTimeInterval timeout) {
+    const struct sockaddr* sa = address.bytes;
+    int fd = socket(sa->sa_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    if (connect(fd, sa, (socklen_t)address.length) != 0) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        int connectErr = 0;
+        socklen_t errLength = sizeof(connectErr);
+        if (errno != EINPROGRESS || poll(&pfd, 1, (int)(timeout * 1000)) != 1
+            || getsockopt(fd, SOL_SOCKET, SO_ERROR, &connectErr, &errLength) != 0 || connectErr != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    fcntl(fd, F_SETFL, flags);
+    SCDNSResponderSetSocketTimeout(fd, timeout);
+    return fd;
+}
+
+#pragma mark - Responder
+
+@interface SCDNSResponder () {
+    dispatch_queue_t _queue;
+    NSArray<NSString*>* _upstreamNameservers;
+    NSArray<NSData*>* _upstreamAddresses;
+    uint16_t _upstreamPort;
+
+    int _listenSocket;
+    int _tcpListenSocket;
+    NSUInteger _tcpConnectionCount;
+    int _upstreamSocket4;
+    int _upstreamSocket6;
+    NSMutableArray<dispatch_source_t>* _sources;
+
+    NSMutableDictionary<NSNumber*, SCDNSForwardedQuery*>* _forwardedQueries;
+    NSCache<NSString*, SCDNSCachedResponse*>* _cache;
+
+    // statistics
+    NSUInteger _queryCount;
+    NSUInteger _blockedCount;
+    NSUInteger _cacheHitCount;
+    NSUInteger _forwardedCount;
+    NSUInteger _upstreamFailureCount;
+    NSUInteger _malformedCount;
+    NSUInteger _tcpQueryCount;
+    NSUInteger _unexpectedSourceCount;
+}
+
+@end
+
+@implementation SCDNSResponder
+
+- (instancetype)initWithBlockIndex:(SCDomainSuffixIndex*)index upstreamNameservers:(NSArray<NSString*>*)nameservers upstreamPort:(uint16_t)upstreamPort {
+    if (self = [super init]) {
+        _queue = dispatch_queue_create("org.eyebeam.SelfControl.SCDNSResponder", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_queue, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0));
+        _blockIndex = index;
+        _upstreamNameservers = [nameservers copy];
+        _upstreamPort = upstreamPort;
+        _sinkholeTTL = 60;
+        _maximumCacheTTL = 5 * 60;
+        _upstreamTimeout = 1.5;
+        _cacheCapacity = 4096;
+
+        _listenSocket = -1;
+        _tcpListenSocket = -1;
+        _upstreamSocket4 = -1;
+        _upstreamSocket6 = -1;
+        _sources = [NSMutableArray array];
+        _forwardedQueries = [NSMutableDictionary dictionary];
+        _cache = [NSCache new];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (dispatch_source_t source in _sources) {
+        dispatch_source_cancel(source);
+    }
+}
+
+- (NSArray<NSString*>*)upstreamNameservers {
+    __block NSArray<NSString*>* nameservers;
+    dispatch_sync(_queue, ^{
+        nameservers = self->_upstreamNameservers;
+    });
+    return nameservers;
+}
+
+- (void)setUpstreamNameservers:(NSArray<NSString*>*)nameservers {
+    NSArray<NSString*>* nameserversCopy = [nameservers copy];
+    dispatch_sync(_queue, ^{
+        self->_upstreamNameservers = nameserversCopy;
+        // queries already out keep going to where they were sent
+        if (self->_isRunning) [self loadUpstreamAddresses];
+    });
+}
+
+// must be called on _queue, once we know our own port
+- (void)loadUpstreamAddresses {
+    // drop any upstream that's really just us
+    NSMutableArray<NSData*>* upstreamAddresses = [NSMutableArray arrayWithCapacity: _upstreamNameservers.count];
+    for (NSString* nameserver in _upstreamNameservers) {
+        NSData* upstreamAddress = [SCDNSResolver socketAddressForNameserver: nameserver port: _upstreamPort];
+        if (upstreamAddress == nil || [SCDNSResolver socketAddressIsLoopback: upstreamAddress onPort: _port]) {
+            NSLog(@"SCDNSResponder: Warning: ignoring upstream nameserver %@", nameserver);
+            continue;
+        }
+        const struct sockaddr* sa = upstreamAddress.bytes;
+        if (sa->sa_family == AF_INET && _upstreamSocket4 < 0) _upstreamSocket4 = [self openUpstreamSocketWithFamily: AF_INET];
+        if (sa->sa_family == AF_INET6 && _upstreamSocket6 < 0) _upstreamSocket6 = [self openUpstreamSocketWithFamily: AF_INET6];
+        [upstreamAddresses addObject: upstreamAddress];
+    }
+    _upstreamAddresses = upstreamAddresses;
+    if (upstreamAddresses.count == 0) {
+        NSLog(@"SCDNSResponder: Warning: no usable upstream nameservers, unblocked names will get SERVFAIL");
+    }
+}
+
+- (int)openUpstreamSocketWithFamily:(int)family {
+    int fd = socket(family, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        NSLog(@"SCDNSResponder: Warning: failed to open upstream socket (errno %d)", errno);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    [self addReadSourceForSocket: fd handler:^(SCDNSResponder* responder) {
+        [responder readUpstreamAnswersFromSocket: fd];
+    }];
+    return fd;
+}
+
+- (void)addReadSourceForSocket:(int)fd handler:(void (^)(SCDNSResponder* responder))handler {
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, _queue);
+    __weak SCDNSResponder* weakSelf = self;
+    dispatch_source_set_event_handler(source, ^{
+        SCDNSResponder* strongSelf = weakSelf;
+        if (strongSelf != nil) handler(strongSelf);
+    });
+    dispatch_source_set_cancel_handler(source, ^{
+        close(fd);
+    });
+    [_sources addObject: source];
+    dispatch_resume(source);
+}
+
+- (BOOL)startOnPort:(uint16_t)port error:(NSError**)errPtr {
+    __block NSError* startErr = nil;
+    dispatch_sync(_queue, ^{
+        if (self->_isRunning) return;
+
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            startErr = [SCErr errorWithCode: 312 subDescription: [NSString stringWithFormat: @"couldn't open a socket (errno %d)", errno]];
+            return;
+        }
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+#ifdef __APPLE__
+        address.sin_len = sizeof(address);
+#endif
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+            startErr = [SCErr errorWithCode: 312 subDescription: [NSString stringWithFormat: @"couldn't listen on 127.0.0.1 port %u (errno %d)", port, errno]];
+            close(fd);
+            return;
+        }
+        socklen_t addressLength = sizeof(address);
+        getsockname(fd, (struct sockaddr*)&address, &addressLength);
+        self->_port = ntohs(address.sin_port);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        self->_listenSocket = fd;
+
+        self->_cache.countLimit = self.cacheCapacity;
+        [self addReadSourceForSocket: fd handler:^(SCDNSResponder* responder) {
+            [responder readClientQueries];
+        }];
+        [self loadUpstreamAddresses];
+
+        // clients retry over TCP when an answer comes back truncated. If we can't take
+        // those, big answers just fail, but everything else still works
+        self->_tcpListenSocket = [self openTCPListenSocketOnPort: self->_port];
+        if (self->_tcpListenSocket >= 0) {
+            [self addReadSourceForSocket: self->_tcpListenSocket handler:^(SCDNSResponder* responder) {
+                [responder acceptTCPConnections];
+            }];
+        } else {
+            NSLog(@"SCDNSResponder: Warning: couldn't listen for TCP on 127.0.0.1 port %u (errno %d), truncated answers can't be retried", self->_port, errno);
+        }
+
+        dispatch_source_t sweepTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self->_queue);
+        dispatch_source_set_timer(sweepTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kUpstreamSweepInterval * NSEC_PER_SEC)), (uint64_t)(kUpstreamSweepInterval * NSEC_PER_SEC), (uint64_t)(0.05 * NSEC_PER_SEC));
+        __weak SCDNSResponder* weakSelf = self;
+        dispatch_source_set_event_handler(sweepTimer, ^{
+            [weakSelf sweepForwardedQueries];
+        });
+        [self->_sources addObject: sweepTimer];
+        dispatch_resume(sweepTimer);
+
+        self->_isRunning = YES;
+    });
+
+    if (startErr != nil) {
+        NSLog(@"SCDNSResponder: ERROR: %@", startErr);
+        if (errPtr != nil) *errPtr = startErr;
+        return NO;
+    }
+    return YES;
+}
+
+- (void)stop {
+    dispatch_sync(_queue, ^{
+        if (!self->_isRunning) return;
+        self->_isRunning = NO;
+
+        // the cancel handlers close the sockets
+        for (dispatch_source_t source in self->_sources) {
+            dispatch_source_cancel(source);
+        }
+        [self->_sources removeAllObjects];
+        self->_listenSocket = -1;
+        self->_tcpListenSocket = -1;
+        self->_upstreamSocket4 = -1;
+        self->_upstreamSocket6 = -1;
+        [self->_forwardedQueries removeAllObjects];
+    });
+}
+
+- (void)removeAllCachedResponses {
+    [_cache removeAllObjects];
+}
+
+- (NSDictionary<NSString*, id>*)statistics {
+    __block NSDictionary* stats;
+    dispatch_sync(_queue, ^{
+        stats = @{
+            @"IsRunning": @(self->_isRunning),
+            @"Port": @(self->_port),
+            @"BlockRuleCount": @(self.blockIndex.count),
+            @"QueryCount": @(self->_queryCount),
+            @"BlockedCount": @(self->_blockedCount),
+            @"CacheHitCount": @(self->_cacheHitCount),
+            @"ForwardedCount": @(self->_forwardedCount),
+            @"UpstreamFailureCount": @(self->_upstreamFailureCount),
+            @"MalformedCount": @(self->_malformedCount),
+            @"TCPQueryCount": @(self->_tcpQueryCount),
+            @"UnexpectedSourceCount": @(self->_unexpectedSourceCount),
+            @"PendingUpstreamCount": @(self->_forwardedQueries.count)
+        };
+    });
+    return stats;
+}
+
+#pragma mark - Client side
+
+- (void)readClientQueries {
+    uint8_t buffer[kDNSMaxPacketSize];
+    struct sockaddr_storage from;
+
+    while (YES) {
+        socklen_t fromLength = sizeof(from);
+        ssize_t received = recvfrom(_listenSocket, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &fromLength);
+        if (received < 0) return;
+
+        _queryCount++;
+        [self handleQuery: [NSData dataWithBytes: buffer length: (NSUInteger)received] from: [NSData dataWithBytes: &from length: fromLength]];
+    }
+}
+
+- (void)sendPacket:(NSData*)packet toClient:(NSData*)clientAddress {
+    sendto(_listenSocket, packet.bytes, packet.length, 0, clientAddress.bytes, (socklen_t)clientAddress.length);
+}
+
+// The answer to query if we can give it without going upstream (blocked, cached, or there's
+// no upstream to ask). Otherwise returns nil, with the key to cache the upstream answer under
+// in cacheKeyOut - or leaves that nil too if the query's malformed and shouldn't be answered.
+- (nullable NSData*)localAnswerForQuery:(NSData*)query cacheKey:(NSString* _Nullable * _Nonnull)cacheKeyOut {
+    const uint8_t* bytes = query.bytes;
+    NSUInteger length = query.length;
+    *cacheKeyOut = nil;
+
+    // only standard queries (QR = 0, opcode 0) with exactly one question
+    if (length < 12 || (bytes[2] & 0xF8) != 0 || SCDNSResponderReadUInt16(bytes + 4) != 1) {
+        _malformedCount++;
+        return nil;
+    }
+
+    NSString* name = nil;
+    NSInteger nameEnd = SCDNSResponderReadQuestionName(bytes, length, &name);
+    if (nameEnd < 0 || (NSUInteger)nameEnd + 4 > length) {
+        _malformedCount++;
+        return nil;
+    }
+    uint16_t type = SCDNSResponderReadUInt16(bytes + nameEnd);
+    uint16_t qclass = SCDNSResponderReadUInt16(bytes + nameEnd + 2);
+    NSUInteger questionEnd = (NSUInteger)nameEnd + 4;
+
+    if ([self.blockIndex matchesDomain: name]) {
+        _blockedCount++;
+        return [self sinkholeAnswerForQuery: bytes questionEnd: questionEnd type: type qclass: qclass];
+    }
+
+    NSString* cacheKey = SCDNSResponderCacheKey(name, type, qclass);
+    NSData* cachedAnswer = [self cachedAnswerForKey: cacheKey queryID: SCDNSResponderReadUInt16(bytes)];
+    if (cachedAnswer != nil) {
+        _cacheHitCount++;
+        return cachedAnswer;
+    }
+
+    if (_upstreamAddresses.count == 0) {
+        return [self failureAnswerForQuery: bytes questionEnd: questionEnd];
+    }
+
+    *cacheKeyOut = cacheKey;
+    return nil;
+}
+
+- (void)handleQuery:(NSData*)query from:(NSData*)clientAddress {
+    NSString* cacheKey = nil;
+    NSData* answer = [self localAnswerForQuery: query cacheKey: &cacheKey];
+    if (answer != nil) {
+        [self sendPacket: answer toClient: clientAddress];
+        return;
+    }
+    if (cacheKey == nil) return;
+
+    SCDNSForwardedQuery* forwarded = [SCDNSForwardedQuery new];
+    forwarded.clientAddress = clientAddress;
+    forwarded.clientID = SCDNSResponderReadUInt16(query.bytes);
+    forwarded.cacheKey = cacheKey;
+    forwarded.packet = query;
+    forwarded.upstreamIndex = 0;
+    [self sendForwardedQuery: forwarded];
+    _forwardedCount++;
+}
+
+#pragma mark - TCP clients
+
+- (int)openTCPListenSocketOnPort:(uint16_t)port {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+#ifdef __APPLE__
+    address.sin_len = sizeof(address);
+#endif
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, (int)kMaxTCPConnections) != 0) {
+        int bindErrno = errno;
+        close(fd);
+        errno = bindErrno;
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+- (void)acceptTCPConnections {
+    while (YES) {
+        int fd = accept(_tcpListenSocket, NULL, NULL);
+        if (fd < 0) return;
+
+        if (_tcpConnectionCount >= kMaxTCPConnections) {
+            close(fd);
+            continue;
+        }
+        _tcpConnectionCount++;
+
+        // accepted sockets can inherit O_NONBLOCK, and we want to block (with a timeout)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+        SCDNSResponderSetSocketTimeout(fd, kTCPIdleTimeout);
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            [self serveTCPConnection: fd];
+            close(fd);
+            dispatch_async(self->_queue, ^{
+                self->_tcpConnectionCount--;
+            });
+        });
+    }
+}
+
+// runs on its own thread, since everything here blocks
+- (void)serveTCPConnection:(int)fd {
+    while (YES) {
+        NSData* query = SCDNSResponderReadTCPMessage(fd);
+        if (query == nil) return;
+
+        __block BOOL running;
+        __block NSData* answer;
+        __block NSString* cacheKey;
+        __block NSArray<NSData*>* upstreamAddresses;
+        dispatch_sync(_queue, ^{
+            running = self->_isRunning;
+            if (!running) return;
+            self->_queryCount++;
+            self->_tcpQueryCount++;
+            NSString* key = nil;
+            answer = [self localAnswerForQuery: query cacheKey: &key];
+            cacheKey = key;
+            upstreamAddresses = self->_upstreamAddresses;
+        });
+        if (!running || (answer == nil && cacheKey == nil)) return;
+
+        if (answer == nil) {
+            answer = [self answerFromUpstreams: upstreamAddresses overTCPForQuery: query cacheKey: cacheKey];
+            BOOL failed = (answer == nil);
+            dispatch_async(_queue, ^{
+                self->_forwardedCount++;
+                if (failed) self->_upstreamFailureCount++;
+            });
+            if (failed) {
+                NSString* name = nil;
+                NSInteger nameEnd = SCDNSResponderReadQuestionName(query.bytes, query.length, &name);
+                answer = [self failureAnswerForQuery: query.bytes questionEnd: (NSUInteger)nameEnd + 4];
+            }
+        }
+
+        if (!SCDNSResponderWriteTCPMessage(fd, answer)) return;
+    }
+}
+
+// Asks each upstream in turn over TCP. Answers that needed TCP are usually too big for
+// UDP clients, so they aren't cached.
+- (nullable NSData*)answerFromUpstreams:(NSArray<NSData*>*)upstreamAddresses overTCPForQuery:(NSData*)query cacheKey:(NSString*)cacheKey {
+    uint16_t queryID = SCDNSResponderReadUInt16(query.bytes);
+    for (NSData* upstreamAddress in upstreamAddresses) {
+        int fd = SCDNSResponderConnectTCP(upstreamAddress, self.upstreamTimeout);
+        if (fd < 0) continue;
+
+        NSData* answer = nil;
+        if (SCDNSResponderWriteTCPMessage(fd, query)) {
+            answer = SCDNSResponderReadTCPMessage(fd);
+        }
+        close(fd);
+        if (answer == nil) continue;
+
+        // make sure it's actually the answer to the question we asked
+        const uint8_t* bytes = answer.bytes;
+        NSString* name = nil;
+        NSInteger nameEnd = SCDNSResponderReadQuestionName(bytes, answer.length, &name);
+        if ((bytes[2] & 0x80) == 0 || SCDNSResponderReadUInt16(bytes) != queryID
+            || nameEnd < 0 || (NSUInteger)nameEnd + 4 > answer.length) continue;
+        if (![SCDNSResponderCacheKey(name, SCDNSResponderReadUInt16(bytes + nameEnd), SCDNSResponderReadUInt16(bytes + nameEnd + 2)) isEqualToString: cacheKey]) continue;
+
+        return answer;
+    }
+    return nil;
+}
+
+- (NSData*)sinkholeAnswerForQuery:(const uint8_t*)query questionEnd:(NSUInteger)questionEnd type:(uint16_t)type qclass:(uint16_t)qclass {
+    BOOL hasAnswer = (qclass == kDNSClassIN) && (type == kDNSTypeA || type == kDNSTypeAAAA);
+
+    NSMutableData* answer = [NSMutableData dataWithCapacity: questionEnd + 28];
+    [answer appendBytes: query length: 2];
+    // response, authoritative, recursion desired (echoed) + available, NOERROR
+    SCDNSResponderAppendUInt16(answer, 0x8400 | (query[2] & 0x01) << 8 | 0x0080 | kDNSRcodeNoError);
+    SCDNSResponderAppendUInt16(answer, 1);
+    SCDNSResponderAppendUInt16(answer, hasAnswer ? 1 : 0);
+    SCDNSResponderAppendUInt16(answer, 0);
+    SCDNSResponderAppendUInt16(answer, 0);
+    [answer appendBytes: query + 12 length: questionEnd - 12];
+
+    if (hasAnswer) {
+        uint8_t zeroes[16] = { 0 };
+        uint16_t dataLength = (type == kDNSTypeA) ? 4 : 16;
+        SCDNSResponderAppendUInt16(answer, 0xC00C); // pointer to the question name
+        SCDNSResponderAppendUInt16(answer, type);
+        SCDNSResponderAppendUInt16(answer, kDNSClassIN);
+        uint32_t ttl = htonl(self.sinkholeTTL);
+        [answer appendBytes: &ttl length: sizeof(ttl)];
+        SCDNSResponderAppendUInt16(answer, dataLength);
+        [answer appendBytes: zeroes length: dataLength];
+    }
+
+    return answer;
+}
+
+- (NSData*)failureAnswerForQuery:(const uint8_t*)query questionEnd:(NSUInteger)questionEnd {
+    NSMutableData* answer = [NSMutableData dataWithCapacity: questionEnd];
+    [answer appendBytes: query length: 2];
+    SCDNSResponderAppendUInt16(answer, 0x8000 | (query[2] & 0x01) << 8 | 0x0080 | kDNSRcodeServerFailure);
+    SCDNSResponderAppendUInt16(answer, 1);
+    SCDNSResponderAppendUInt16(answer, 0);
+    SCDNSResponderAppendUInt16(answer, 0);
+    SCDNSResponderAppendUInt16(answer, 0);
+    [answer appendBytes: query + 12 length: questionEnd - 12];
+    return answer;
+}
+
+#pragma mark - Cache
+
+- (nullable NSData*)cachedAnswerForKey:(NSString*)cacheKey queryID:(uint16_t)queryID {
+    SCDNSCachedResponse* cached = [_cache objectForKey: cacheKey];
+    if (cached == nil) return nil;
+
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    if (now >= cached.expiresAt) {
+        [_cache removeObjectForKey: cacheKey];
+        return nil;
+    }
+
+    // same answer, but with the time it's spent in our cache taken off every TTL
+    NSMutableData* answer = [cached.packet mutableCopy];
+    uint8_t* bytes = answer.mutableBytes;
+    uint16_t networkID = htons(queryID);
+    memcpy(bytes, &networkID, sizeof(networkID));
+    uint32_t elapsed = (uint32_t)(now - cached.storedAt);
+    SCDNSResponderEnumerateTTLs(bytes, answer.length, ^(NSUInteger ttlOffset, uint16_t type) {
+        if (type == kDNSTypeOPT) return;
+        uint32_t ttl = SCDNSResponderReadUInt32(bytes + ttlOffset);
+        uint32_t remaining = htonl(ttl > elapsed ? ttl - elapsed : 0);
+        memcpy(bytes + ttlOffset, &remaining, sizeof(remaining));
+    });
+    return answer;
+}
+
+- (void)cacheAnswer:(NSData*)packet forKey:(NSString*)cacheKey {
+    const uint8_t* bytes = packet.bytes;
+    uint8_t rcode = bytes[3] & 0x0F;
+    BOOL truncated = (bytes[2] & 0x02) != 0;
+    if (truncated || (rcode != kDNSRcodeNoError && rcode != kDNSRcodeNXDomain)) return;
+
+    __block NSTimeInterval ttl = -1;
+    BOOL wellFormed = SCDNSResponderEnumerateTTLs(bytes, packet.length, ^(NSUInteger ttlOffset, uint16_t type) {
+        if (type == kDNSTypeOPT) return;
+        NSTimeInterval recordTTL = SCDNSResponderReadUInt32(bytes + ttlOffset);
+        if (ttl < 0 || recordTTL < ttl) ttl = recordTTL;
+    });
+    if (!wellFormed) return;
+    if (ttl < 0) ttl = kDNSDefaultNegativeTTL;
+    ttl = MIN(ttl, self.maximumCacheTTL);
+    if (ttl <= 0) return;
+
+    SCDNSCachedResponse* cached = [SCDNSCachedResponse new];
+    cached.packet = packet;
+    cached.storedAt = [NSProcessInfo processInfo].systemUptime;
+    cached.expiresAt = cached.storedAt + ttl;
+    [_cache setObject: cached forKey: cacheKey];
+}
+
+#pragma mark - Upstream side
+
+- (void)sendForwardedQuery:(SCDNSForwardedQuery*)forwarded {
+    if (forwarded.attempts > 0) [_forwardedQueries removeObjectForKey: @(forwarded.upstreamID)];
+
+    // fresh, unpredictable ID for every attempt, so a late answer to an old attempt can't be
+    // mistaken for this one, and an off-path spoofer can't guess it
+    uint16_t upstreamID;
+    NSUInteger tries = 0;
+    do {
+        upstreamID = (uint16_t)arc4random_uniform(UINT16_MAX + 1);
+    } while (_forwardedQueries[@(upstreamID)] != nil && ++tries < UINT16_MAX);
+
+    NSMutableData* packet = [forwarded.packet mutableCopy];
+    uint16_t networkID = htons(upstreamID);
+    memcpy(packet.mutableBytes, &networkID, sizeof(networkID));
+
+    NSData* upstreamAddress = _upstreamAddresses[forwarded.upstreamIndex % _upstreamAddresses.count];
+    const struct sockaddr* sa = upstreamAddress.bytes;
+    int fd = (sa->sa_family == AF_INET6) ? _upstreamSocket6 : _upstreamSocket4;
+
+    forwarded.attempts++;
+    forwarded.upstreamID = upstreamID;
+    forwarded.upstreamAddress = upstreamAddress;
+    forwarded.deadline = [NSProcessInfo processInfo].systemUptime + self.upstreamTimeout;
+    _forwardedQueries[@(upstreamID)] = forwarded;
+    if (fd >= 0) {
+        sendto(fd, packet.bytes, packet.length, 0, sa, (socklen_t)upstreamAddress.length);
+    }
+}
+
+- (void)readUpstreamAnswersFromSocket:(int)fd {
+    uint8_t buffer[kDNSMaxPacketSize];
+    struct sockaddr_storage from;
+
+    while (YES) {
+        socklen_t fromLength = sizeof(from);
+        ssize_t received = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &fromLength);
+        if (received < 0) return;
+        if (received < 12 || (buffer[2] & 0x80) == 0) continue;
+
+        NSNumber* upstreamID = @(SCDNSResponderReadUInt16(buffer));
+        SCDNSForwardedQuery* forwarded = _forwardedQueries[upstreamID];
+        if (forwarded == nil) continue;
+
+        // anyone can send us packets, but only the server we asked gets to answer
+        if (!SCDNSResponderSocketAddressesMatch(forwarded.upstreamAddress, &from, fromLength)) {
+            _unexpectedSourceCount++;
+            continue;
+        }
+
+        // make sure it's actually the answer to the question we asked
+        NSString* name = nil;
+        NSInteger nameEnd = SCDNSResponderReadQuestionName(buffer, (NSUInteger)received, &name);
+        if (nameEnd < 0 || (NSUInteger)nameEnd + 4 > (NSUInteger)received) continue;
+        NSString* cacheKey = SCDNSResponderCacheKey(name, SCDNSResponderReadUInt16(buffer + nameEnd), SCDNSResponderReadUInt16(buffer + nameEnd + 2));
+        if (![cacheKey isEqualToString: forwarded.cacheKey]) continue;
+
+        [_forwardedQueries removeObjectForKey: upstreamID];
+
+        NSMutableData* answer = [NSMutableData dataWithBytes: buffer length: (NSUInteger)received];
+        memset(answer.mutableBytes, 0, 2);
+        [self cacheAnswer: [answer copy] forKey: cacheKey];
+
+        uint16_t clientID = htons(forwarded.clientID);
+        memcpy(answer.mutableBytes, &clientID, sizeof(clientID));
+        [self sendPacket: answer toClient: forwarded.clientAddress];
+    }
+}
+
+- (void)sweepForwardedQueries {
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    NSMutableArray<SCDNSForwardedQuery*>* expired = [NSMutableArray array];
+    [_forwardedQueries enumerateKeysAndObjectsUsingBlock:^(NSNumber* key, SCDNSForwardedQuery* forwarded, BOOL* stop) {
+        if (forwarded.deadline <= now) [expired addObject: forwarded];
+    }];
+
+    for (SCDNSForwardedQuery* forwarded in expired) {
+        if (forwarded.attempts < _upstreamAddresses.count) {
+            forwarded.upstreamIndex++;
+            [self sendForwardedQuery: forwarded];
+            continue;
+        }
+
+        // every upstream has had its chance
+        [_forwardedQueries removeObjectForKey: @(forwarded.upstreamID)];
+        _upstreamFailureCount++;
+        const uint8_t* query = forwarded.packet.bytes;
+        NSString* name = nil;
+        NSInteger nameEnd = SCDNSResponderReadQuestionName(query, forwarded.packet.length, &name);
+        if (nameEnd < 0) continue;
+        [self sendPacket: [self failureAnswerForQuery: query questionEnd: (NSUInteger)nameEnd + 4] toClient: forwarded.clientAddress];
+    }
+}
+
+@end
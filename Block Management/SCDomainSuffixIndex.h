@@ -0,0 +1,33 @@
+//
+//  SCDomainSuffixIndex.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// An immutable set of domain rules, compiled for fast lookups by SCDNSResponder.
+// Each rule is either a plain name ("example.com"), which only matches that exact name,
+// or a wildcard ("*.example.com"), which matches every name below it but not the name itself.
+// A lookup costs one hash probe per label in the name, however many rules there are.
+@interface SCDomainSuffixIndex : NSObject
+
+// number of distinct rules (exact + wildcard) in the index
+@property (readonly) NSUInteger count;
+
+// Blocklist entries that aren't domain names (IPs, CIDR ranges, anything with a port)
+// are skipped, since there's nothing for DNS to answer for them. With includeSubdomains,
+// every plain domain also gets a wildcard rule (DNS's answer to EvaluateCommonSubdomains).
++ (instancetype)indexWithBlocklist:(NSArray<NSString*>*)blocklist includeSubdomains:(BOOL)includeSubdomains;
+
+- (instancetype)initWithRules:(NSArray<NSString*>*)rules;
+
+// case-insensitive, and a trailing dot (fully qualified name) is ignored
+- (BOOL)matchesDomain:(NSString*)domain;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,91 @@
+//
+//  SCDomainSuffixIndex.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCDomainSuffixIndex.h"
+#import "SCBlockEntry.h"
+#import "NSString+IPAddress.h"
+
+@implementation SCDomainSuffixIndex {
+    NSSet<NSString*>* _exactNames;
+    // "example.com" for the rule "*.example.com"
+    NSSet<NSString*>* _wildcardSuffixes;
+}
+
++ (instancetype)indexWithBlocklist:(NSArray<NSString*>*)blocklist includeSubdomains:(BOOL)includeSubdomains {
+    NSMutableArray<NSString*>* rules = [NSMutableArray arrayWithCapacity: blocklist.count * (includeSubdomains ? 2 : 1)];
+    for (NSString* entryString in blocklist) {
+        SCBlockEntry* entry = [SCBlockEntry entryFromString: entryString];
+        if (entry == nil || entry.port != 0 || entry.maskLen != 0) continue;
+        if ([entry.hostname isEqualToString: @"*"] || entry.hostname.isValidIPAddress) continue;
+
+        [rules addObject: entry.hostname];
+        if (includeSubdomains && ![entry.hostname hasPrefix: @"*."]) {
+            [rules addObject: [@"*." stringByAppendingString: entry.hostname]];
+        }
+    }
+    return [[SCDomainSuffixIndex alloc] initWithRules: rules];
+}
+
++ (nullable NSString*)normalizedName:(NSString*)name {
+    name = name.lowercaseString;
+    if ([name hasSuffix: @"."]) name = [name substringToIndex: name.length - 1];
+    return (name.length > 0) ? name : nil;
+}
+
+- (instancetype)init {
+    return [self initWithRules: @[]];
+}
+
+- (instancetype)initWithRules:(NSArray<NSString*>*)rules {
+    if (self = [super init]) {
+        NSMutableSet<NSString*>* exactNames = [NSMutableSet setWithCapacity: rules.count];
+        NSMutableSet<NSString*>* wildcardSuffixes = [NSMutableSet set];
+
+        for (NSString* rule in rules) {
+            NSString* trimmed = [rule stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceAndNewlineCharacterSet]];
+            if ([trimmed hasPrefix: @"*."]) {
+                NSString* suffix = [SCDomainSuffixIndex normalizedName: [trimmed substringFromIndex: 2]];
+                if (suffix != nil) [wildcardSuffixes addObject: suffix];
+            } else {
+                NSString* name = [SCDomainSuffixIndex normalizedName: trimmed];
+                if (name != nil) [exactNames addObject: name];
+            }
+        }
+
+        _exactNames = [exactNames copy];
+        _wildcardSuffixes = [wildcardSuffixes copy];
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return _exactNames.count + _wildcardSuffixes.count;
+}
+
+- (BOOL)matchesDomain:(NSString*)domain {
+    NSString* name = [SCDomainSuffixIndex normalizedName: domain];
+    if (name == nil) return NO;
+
+    if ([_exactNames containsObject: name]) return YES;
+    if (_wildcardSuffixes.count == 0) return NO;
+
+    // walk up through each parent: a.b.example.com -> b.example.com -> example.com -> com
+    NSUInteger length = name.length;
+    NSRange searchRange = NSMakeRange(0, length);
+    while (YES) {
+        NSRange dot = [name rangeOfString: @"." options: NSLiteralSearch range: searchRange];
+        if (dot.location == NSNotFound) return NO;
+
+        NSUInteger parentStart = NSMaxRange(dot);
+        if (parentStart >= length) return NO;
+        if ([_wildcardSuffixes containsObject: [name substringFromIndex: parentStart]]) return YES;
+
+        searchRange = NSMakeRange(parentStart, length - parentStart);
+    }
+}
+
+@end
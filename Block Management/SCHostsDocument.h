@@ -0,0 +1,65 @@
+//
+//  SCHostsDocument.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A hosts file, split up into the three parts SelfControl cares about: whatever comes
+// before our block (prefix), the block's rules (body) and whatever comes after it (suffix).
+// Rules only ever get appended to the body, which is a list of immutable UTF-8 chunks, so
+// adding a rule costs the same whether the file is empty or huge and the block is new or
+// already live. Chunks can be shared between documents, so the same rules going into
+// several hosts files only get rendered (and stored) once. Nothing gets stitched back
+// together until the document is rendered or written.
+@interface SCHostsDocument : NSObject
+
+// 0.0.0.0 and :: rules for each domain, in order, ready for appendRuleData:
++ (NSData*)ruleDataBlockingDomains:(NSArray<NSString*>*)domains;
+// Compact rules pack several names onto each line (one 0.0.0.0 and one :: line per group),
+// staying under the per-line limits of the hosts parsers we care about. Far fewer lines
+// for the resolver to chew through on a big block, same result.
++ (NSData*)ruleDataBlockingDomains:(NSArray<NSString*>*)domains compact:(BOOL)compact;
+
+// has a SelfControl block header, and (separately) a footer closing it
+@property (readonly) BOOL hasBlock;
+@property (readonly) BOOL hasBlockFooter;
+// size of the block's rules in bytes
+@property (readonly) NSUInteger bodyLength;
+
+- (instancetype)initWithString:(NSString*)contents;
+
+// start a new block at the end of the file (no-op if there's one already)
+- (void)addBlockHeader;
+// close the current block (no-op if there's no open block)
+- (void)addBlockFooter;
+// Adds 0.0.0.0 and :: rules for each domain, in order. With a block these always go
+// inside it (before the footer, if there is one); without one, at the end of the file.
+- (void)appendRulesBlockingDomains:(NSArray<NSString*>*)domains;
+// same, for rules that were already rendered by ruleDataBlockingDomains: (the data is kept, not copied)
+- (void)appendRuleData:(NSData*)ruleData;
+// takes out the block (and the newlines around it that we added), leaving everything else alone
+- (void)removeBlock;
+// Replaces whatever block there is (if any) with a section from blockSection, i.e. to put back
+// a block someone tampered with, without touching the rest of the file. NO if it isn't a complete section.
+- (BOOL)restoreBlockSection:(NSString*)section;
+
+// header through footer (plus the footer's newline), or nil if there isn't a complete block
+- (nullable NSString*)blockSection;
+// every name blocked in the block, in order and without duplicates, whichever format its lines are in
+- (NSArray<NSString*>*)blockedDomains;
+
+- (NSString*)renderedString;
+// nil if the contents can't be represented in the given encoding
+- (nullable NSData*)renderedDataUsingEncoding:(NSStringEncoding)encoding;
+// Atomically replaces the file at path with the rendered document. UTF-8 documents are
+// streamed out chunk by chunk, without ever rendering the whole file in memory.
+- (BOOL)writeToFile:(NSString*)path encoding:(NSStringEncoding)encoding;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,352 @@
+//
+//  SCHostsDocument.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCHostsDocument.h"
+#import "HostFileBlocker.h"
+
+static const char kIPv4RulePrefix[] = "0.0.0.0\t";
+static const char kIPv6RulePrefix[] = "::\t";
+
+// BSD's gethostent (which libinfo's hosts parsing is descended from) keeps at most 35
+// aliases per line and reads lines into a 1024-byte buffer, and other parsers (i.e. Windows,
+// for hosts files shared with VMs) stop after 9 names. Stay under all of them.
+static NSUInteger const kCompactHostsMaxNamesPerLine = 9;
+static NSUInteger const kCompactHostsMaxLineLength = 1000;
+
+@implementation SCHostsDocument {
+    // when there's no block, the whole file lives in _prefix
+    NSMutableString* _prefix;
+    // everything between the header and the footer, newlines included, in order.
+    // Chunks are never mutated once they're in here, since other documents may share them.
+    NSMutableArray<NSData*>* _bodyChunks;
+    NSUInteger _bodyLength;
+    NSString* _suffix;
+}
+
++ (NSData*)ruleDataBlockingDomains:(NSArray<NSString*>*)domains {
+    return [self ruleDataBlockingDomains: domains compact: NO];
+}
+
++ (NSData*)ruleDataBlockingDomains:(NSArray<NSString*>*)domains compact:(BOOL)compact {
+    if (compact) return [self compactRuleDataBlockingDomains: domains];
+
+    NSMutableData* ruleData = [NSMutableData dataWithCapacity: domains.count * 48];
+
+    // straight into the byte buffer - no format strings or intermediate NSStrings per domain
+    @autoreleasepool {
+        for (NSString* domain in domains) {
+            const char* domainBytes = domain.UTF8String;
+            if (domainBytes == NULL) continue;
+            size_t domainLength = strlen(domainBytes);
+
+            [ruleData appendBytes: kIPv4RulePrefix length: sizeof(kIPv4RulePrefix) - 1];
+            [ruleData appendBytes: domainBytes length: domainLength];
+            [ruleData appendBytes: "\n" length: 1];
+            [ruleData appendBytes: kIPv6RulePrefix length: sizeof(kIPv6RulePrefix) - 1];
+            [ruleData appendBytes: domainBytes length: domainLength];
+            [ruleData appendBytes: "\n" length: 1];
+        }
+    }
+
+    return [ruleData copy];
+}
+
++ (NSData*)compactRuleDataBlockingDomains:(NSArray<NSString*>*)domains {
+    NSMutableData* ruleData = [NSMutableData dataWithCapacity: domains.count * 20];
+    // the names for the line we're building, separated by spaces
+    NSMutableData* names = [NSMutableData dataWithCapacity: kCompactHostsMaxLineLength];
+    __block NSUInteger nameCount = 0;
+
+    void (^flushLine)(void) = ^{
+        if (nameCount == 0) return;
+        [ruleData appendBytes: kIPv4RulePrefix length: sizeof(kIPv4RulePrefix) - 1];
+        [ruleData appendData: names];
+        [ruleData appendBytes: "\n" length: 1];
+        [ruleData appendBytes: kIPv6RulePrefix length: sizeof(kIPv6RulePrefix) - 1];
+        [ruleData appendData: names];
+        [ruleData appendBytes: "\n" length: 1];
+        [names setLength: 0];
+        nameCount = 0;
+    };
+
+    @autoreleasepool {
+        for (NSString* domain in domains) {
+            const char* domainBytes = domain.UTF8String;
+            if (domainBytes == NULL) continue;
+            size_t domainLength = strlen(domainBytes);
+
+            // the longer (IPv4) prefix, the names so far, a space and this one, plus the newline
+            NSUInteger lineLengthWithName = (sizeof(kIPv4RulePrefix) - 1) + names.length + 1 + domainLength + 1;
+            if (nameCount >= kCompactHostsMaxNamesPerLine || (nameCount > 0 && lineLengthWithName > kCompactHostsMaxLineLength)) {
+                flushLine();
+            }
+
+            if (nameCount > 0) [names appendBytes: " " length: 1];
+            [names appendBytes: domainBytes length: domainLength];
+            nameCount++;
+        }
+        flushLine();
+    }
+
+    return [ruleData copy];
+}
+
+- (instancetype)init {
+    return [self initWithString: @""];
+}
+
+- (instancetype)initWithString:(NSString*)contents {
+    if (self = [super init]) {
+        _bodyChunks = [NSMutableArray array];
+        _suffix = @"";
+
+        NSRange headerRange = [contents rangeOfString: kHostFileBlockerSelfControlHeader];
+        if (headerRange.location == NSNotFound) {
+            _prefix = [contents mutableCopy];
+            return self;
+        }
+
+        _hasBlock = YES;
+        _prefix = [[contents substringToIndex: headerRange.location] mutableCopy];
+
+        NSUInteger bodyStart = NSMaxRange(headerRange);
+        NSRange footerRange = [contents rangeOfString: kHostFileBlockerSelfControlFooter options: 0 range: NSMakeRange(bodyStart, contents.length - bodyStart)];
+        if (footerRange.location == NSNotFound) {
+            // no footer = the block runs to the end of the file
+            [self appendBodyChunk: [[contents substringFromIndex: bodyStart] dataUsingEncoding: NSUTF8StringEncoding]];
+        } else {
+            _hasBlockFooter = YES;
+            [self appendBodyChunk: [[contents substringWithRange: NSMakeRange(bodyStart, footerRange.location - bodyStart)] dataUsingEncoding: NSUTF8StringEncoding]];
+            _suffix = [contents substringFromIndex: NSMaxRange(footerRange)];
+        }
+    }
+    return self;
+}
+
+- (NSUInteger)bodyLength {
+    return _bodyLength;
+}
+
+- (void)appendBodyChunk:(NSData*)chunk {
+    if (chunk.length < 1) return;
+    [_bodyChunks addObject: chunk];
+    _bodyLength += chunk.length;
+}
+
+- (void)addBlockHeader {
+    if (self.hasBlock) {
+        NSLog(@"WARNING: hosts file already has a SelfControl block, not adding another header");
+        return;
+    }
+
+    [_prefix appendString: @"\n"];
+    [_bodyChunks removeAllObjects];
+    _bodyLength = 0;
+    [self appendBodyChunk: [@"\n" dataUsingEncoding: NSUTF8StringEncoding]];
+    _suffix = @"";
+    _hasBlock = YES;
+    _hasBlockFooter = NO;
+}
+
+- (void)addBlockFooter {
+    if (!self.hasBlock || self.hasBlockFooter) {
+        NSLog(@"WARNING: hosts file has no open SelfControl block, not adding a footer");
+        return;
+    }
+
+    // an open block always runs to the end of the file, so there's nothing after it yet
+    _suffix = @"\n";
+    _hasBlockFooter = YES;
+}
+
+- (void)appendRulesBlockingDomains:(NSArray<NSString*>*)domains {
+    [self appendRuleData: [SCHostsDocument ruleDataBlockingDomains: domains]];
+}
+
+- (void)appendRuleData:(NSData*)ruleData {
+    if (!self.hasBlock) {
+        [_prefix appendString: [[NSString alloc] initWithData: ruleData encoding: NSUTF8StringEncoding] ?: @""];
+        return;
+    }
+
+    [self appendBodyChunk: [ruleData copy]];
+}
+
+- (void)removeBlock {
+    if (!self.hasBlock) return;
+
+    NSCharacterSet* newlines = [NSCharacterSet newlineCharacterSet];
+
+    // we put a newline before the header and after the footer, so take those out too
+    if (_prefix.length > 0 && [newlines characterIsMember: [_prefix characterAtIndex: _prefix.length - 1]]) {
+        [_prefix deleteCharactersInRange: NSMakeRange(_prefix.length - 1, 1)];
+    }
+    // if we lost the footer somehow, everything below the header goes. Not ideal,
+    // but better than leaving the block on
+    if (self.hasBlockFooter) {
+        NSString* suffix = _suffix;
+        if (suffix.length > 0 && [newlines characterIsMember: [suffix characterAtIndex: 0]]) {
+            suffix = [suffix substringFromIndex: 1];
+        }
+        [_prefix appendString: suffix];
+    }
+
+    [_bodyChunks removeAllObjects];
+    _bodyLength = 0;
+    _suffix = @"";
+    _hasBlock = NO;
+    _hasBlockFooter = NO;
+}
+
+- (BOOL)restoreBlockSection:(NSString*)section {
+    if (![section hasPrefix: kHostFileBlockerSelfControlHeader]) return NO;
+    BOOL hasTrailingNewline = [section hasSuffix: @"\n"];
+    NSString* sectionWithoutNewline = hasTrailingNewline ? [section substringToIndex: section.length - 1] : section;
+    if (![sectionWithoutNewline hasSuffix: kHostFileBlockerSelfControlFooter]) return NO;
+
+    NSUInteger bodyStart = kHostFileBlockerSelfControlHeader.length;
+    NSUInteger bodyEnd = sectionWithoutNewline.length - kHostFileBlockerSelfControlFooter.length;
+    if (bodyEnd < bodyStart) return NO;
+
+    // same layout addBlockHeader/addBlockFooter would give it
+    [self removeBlock];
+    [self addBlockHeader];
+    [_bodyChunks removeAllObjects];
+    _bodyLength = 0;
+    [self appendBodyChunk: [[section substringWithRange: NSMakeRange(bodyStart, bodyEnd - bodyStart)] dataUsingEncoding: NSUTF8StringEncoding]];
+    _suffix = hasTrailingNewline ? @"\n" : @"";
+    _hasBlockFooter = YES;
+    return YES;
+}
+
+- (NSString*)bodyString {
+    NSMutableData* body = [NSMutableData dataWithCapacity: _bodyLength];
+    for (NSData* chunk in _bodyChunks) {
+        [body appendData: chunk];
+    }
+    return [[NSString alloc] initWithData: body encoding: NSUTF8StringEncoding] ?: @"";
+}
+
+- (nullable NSString*)blockSection {
+    if (!self.hasBlock || !self.hasBlockFooter) return nil;
+
+    NSMutableString* section = [NSMutableString stringWithCapacity: _bodyLength + 64];
+    [section appendString: kHostFileBlockerSelfControlHeader];
+    [section appendString: [self bodyString]];
+    [section appendString: kHostFileBlockerSelfControlFooter];
+    if ([_suffix hasPrefix: @"\n"]) {
+        [section appendString: @"\n"];
+    }
+    return section;
+}
+
+- (NSArray<NSString*>*)blockedDomains {
+    if (!self.hasBlock) return @[];
+
+    NSMutableOrderedSet<NSString*>* domains = [NSMutableOrderedSet orderedSet];
+    NSCharacterSet* whitespace = [NSCharacterSet whitespaceCharacterSet];
+    [[self bodyString] enumerateLinesUsingBlock:^(NSString* line, BOOL* stop) {
+        NSRange commentRange = [line rangeOfString: @"#"];
+        if (commentRange.location != NSNotFound) line = [line substringToIndex: commentRange.location];
+
+        // address, then one or more names
+        NSArray<NSString*>* fields = [line componentsSeparatedByCharactersInSet: whitespace];
+        BOOL sawAddress = NO;
+        for (NSString* field in fields) {
+            if (field.length < 1) continue;
+            if (!sawAddress) {
+                sawAddress = YES;
+                continue;
+            }
+            [domains addObject: field];
+        }
+    }];
+
+    return domains.array;
+}
+
+- (NSString*)renderedString {
+    if (!self.hasBlock) return [_prefix copy];
+
+    NSMutableString* rendered = [NSMutableString stringWithCapacity: _prefix.length + _bodyLength + _suffix.length + 64];
+    [rendered appendString: _prefix];
+    [rendered appendString: kHostFileBlockerSelfControlHeader];
+    [rendered appendString: [self bodyString]];
+    if (self.hasBlockFooter) {
+        [rendered appendString: kHostFileBlockerSelfControlFooter];
+    }
+    [rendered appendString: _suffix];
+    return rendered;
+}
+
+// the document as UTF-8 pieces, in order
+- (NSArray<NSData*>*)renderedUTF8Pieces {
+    NSMutableArray<NSData*>* pieces = [NSMutableArray arrayWithCapacity: _bodyChunks.count + 4];
+    [pieces addObject: [_prefix dataUsingEncoding: NSUTF8StringEncoding]];
+    if (!self.hasBlock) return pieces;
+
+    [pieces addObject: [kHostFileBlockerSelfControlHeader dataUsingEncoding: NSUTF8StringEncoding]];
+    [pieces addObjectsFromArray: _bodyChunks];
+    if (self.hasBlockFooter) {
+        [pieces addObject: [kHostFileBlockerSelfControlFooter dataUsingEncoding: NSUTF8StringEncoding]];
+    }
+    [pieces addObject: [_suffix dataUsingEncoding: NSUTF8StringEncoding]];
+    return pieces;
+}
+
+- (nullable NSData*)renderedDataUsingEncoding:(NSStringEncoding)encoding {
+    if (encoding != NSUTF8StringEncoding) {
+        return [[self renderedString] dataUsingEncoding: encoding];
+    }
+
+    // UTF-8 (i.e. almost always): the body's already in the right format, so just splice the bytes
+    NSMutableData* rendered = [NSMutableData dataWithCapacity: _prefix.length + _bodyLength + _suffix.length + 64];
+    for (NSData* piece in [self renderedUTF8Pieces]) {
+        [rendered appendData: piece];
+    }
+    return rendered;
+}
+
+- (BOOL)writeToFile:(NSString*)path encoding:(NSStringEncoding)encoding {
+    if (encoding != NSUTF8StringEncoding) {
+        NSData* renderedData = [self renderedDataUsingEncoding: encoding];
+        return renderedData != nil && [renderedData writeToFile: path atomically: YES];
+    }
+
+    // write to a temp file next to the real one, then rename it over, same as an atomic NSData write
+    NSString* tempPath = [[path stringByDeletingLastPathComponent] stringByAppendingPathComponent: [NSString stringWithFormat: @".%@.%@", path.lastPathComponent, [NSUUID UUID].UUIDString]];
+    NSFileManager* fileMan = [NSFileManager defaultManager];
+    if (![fileMan createFileAtPath: tempPath contents: nil attributes: nil]) {
+        return NO;
+    }
+
+    NSFileHandle* handle = [NSFileHandle fileHandleForWritingAtPath: tempPath];
+    BOOL success = (handle != nil);
+    @try {
+        for (NSData* piece in [self renderedUTF8Pieces]) {
+            if (!success) break;
+            [handle writeData: piece];
+        }
+        [handle synchronizeFile];
+    } @catch (NSException* exception) {
+        NSLog(@"ERROR: Failed to write hosts file to %@: %@", tempPath, exception);
+        success = NO;
+    }
+    [handle closeFile];
+
+    if (success && rename(tempPath.fileSystemRepresentation, path.fileSystemRepresentation) != 0) {
+        NSLog(@"ERROR: Failed to move new hosts file into place at %@ (errno %d)", path, errno);
+        success = NO;
+    }
+    if (!success) {
+        [fileMan removeItemAtPath: tempPath error: nil];
+    }
+
+    return success;
+}
+
+@end
@@ -0,0 +1,39 @@
+//
+//  SCIPPrefixSet.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A set of IPv4 and IPv6 prefixes, stored as a binary trie per address family.
+// Adding a prefix that's already covered by a broader one is a no-op, adding a broader
+// prefix swallows any narrower ones underneath it, and sibling prefixes
+// (e.g. 10.0.0.0/25 + 10.0.0.128/25) collapse into their parent.
+// Used to boil lots of resolved addresses down to the fewest pf entries that cover them.
+@interface SCIPPrefixSet : NSObject
+
+// number of add calls so far (including duplicates and unparseable strings)
+@property (readonly) NSUInteger inputCount;
+// inputCount minus the number of entries in minimalPrefixStrings
+@property (readonly) NSUInteger eliminatedCount;
+
+// Accepts a bare address ("10.0.0.1", "2001:db8::1") or a CIDR prefix ("10.0.0.0/8").
+// Strings that can't be parsed are kept exactly as given (and returned as-is
+// from minimalPrefixStrings); the return value is NO in that case.
+- (BOOL)addPrefixString:(NSString*)prefixString;
+- (BOOL)addAddress:(NSString*)address maskLen:(NSInteger)maskLen;
+
+// YES if the address (or whole prefix) falls within something in the set
+- (BOOL)containsPrefixString:(NSString*)prefixString;
+
+// The smallest set of prefixes covering exactly the same addresses as everything added.
+// Full-length prefixes are written as bare addresses; IPv4 comes before IPv6, each in address order.
+- (NSArray<NSString*>*)minimalPrefixStrings;
+
+@end
+
+NS_ASSUME_NONNULL_END
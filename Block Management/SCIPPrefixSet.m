@@ -0,0 +1,213 @@
+//
+//  SCIPPrefixSet.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCIPPrefixSet.h"
+#include <arpa/inet.h>
+
+typedef struct {
+    uint32_t children[2]; // 0 = no child (the root can never be anyone's child)
+    BOOL terminal; // everything under this node is in the set
+} SCPrefixTrieNode;
+
+typedef struct {
+    SCPrefixTrieNode* nodes;
+    NSUInteger count;
+    NSUInteger capacity;
+} SCPrefixTrie;
+
+static void SCPrefixTrieInit(SCPrefixTrie* trie) {
+    trie->capacity = 64;
+    trie->count = 1;
+    trie->nodes = calloc(trie->capacity, sizeof(SCPrefixTrieNode));
+}
+
+static uint32_t SCPrefixTrieNewNode(SCPrefixTrie* trie) {
+    if (trie->count == trie->capacity) {
+        trie->capacity *= 2;
+        trie->nodes = realloc(trie->nodes, trie->capacity * sizeof(SCPrefixTrieNode));
+    }
+    memset(&trie->nodes[trie->count], 0, sizeof(SCPrefixTrieNode));
+    return (uint32_t)trie->count++;
+}
+
+static inline int SCPrefixBit(const uint8_t* bytes, NSUInteger index) {
+    return (bytes[index / 8] >> (7 - (index % 8))) & 1;
+}
+
+static void SCPrefixTrieInsert(SCPrefixTrie* trie, const uint8_t* bytes, NSUInteger prefixLen) {
+    // remember the path so we can collapse siblings on the way back up
+    uint32_t path[129];
+    uint32_t node = 0;
+
+    for (NSUInteger depth = 0; depth < prefixLen; depth++) {
+        // already covered by a broader prefix
+        if (trie->nodes[node].terminal) return;
+
+        path[depth] = node;
+        int bit = SCPrefixBit(bytes, depth);
+        uint32_t child = trie->nodes[node].children[bit];
+        if (child == 0) {
+            child = SCPrefixTrieNewNode(trie);
+            trie->nodes[node].children[bit] = child;
+        }
+        node = child;
+    }
+
+    // this prefix swallows anything narrower that was underneath it
+    // (the orphaned nodes just stay allocated until we're done)
+    trie->nodes[node].terminal = YES;
+    trie->nodes[node].children[0] = trie->nodes[node].children[1] = 0;
+
+    for (NSUInteger depth = prefixLen; depth > 0; depth--) {
+        SCPrefixTrieNode* parent = &trie->nodes[path[depth - 1]];
+        uint32_t left = parent->children[0], right = parent->children[1];
+        if (left == 0 || right == 0 || !trie->nodes[left].terminal || !trie->nodes[right].terminal) break;
+
+        parent->terminal = YES;
+        parent->children[0] = parent->children[1] = 0;
+    }
+}
+
+static BOOL SCPrefixTrieContains(SCPrefixTrie* trie, const uint8_t* bytes, NSUInteger prefixLen) {
+    uint32_t node = 0;
+    for (NSUInteger depth = 0; depth < prefixLen; depth++) {
+        if (trie->nodes[node].terminal) return YES;
+        node = trie->nodes[node].children[SCPrefixBit(bytes, depth)];
+        if (node == 0) return NO;
+    }
+    return trie->nodes[node].terminal;
+}
+
+static void SCPrefixTrieCollect(SCPrefixTrie* trie, uint32_t node, uint8_t* bytes, NSUInteger depth, int family, NSUInteger maxLen, NSMutableArray<NSString*>* output) {
+    if (trie->nodes[node].terminal) {
+        char addressString[INET6_ADDRSTRLEN];
+        inet_ntop(family, bytes, addressString, sizeof(addressString));
+        if (depth == maxLen) {
+            [output addObject: @(addressString)];
+        } else {
+            [output addObject: [NSString stringWithFormat: @"%s/%lu", addressString, (unsigned long)depth]];
+        }
+        return;
+    }
+
+    for (int bit = 0; bit <= 1; bit++) {
+        uint32_t child = trie->nodes[node].children[bit];
+        if (child == 0) continue;
+
+        if (bit) bytes[depth / 8] |= (uint8_t)(1 << (7 - (depth % 8)));
+        SCPrefixTrieCollect(trie, child, bytes, depth + 1, family, maxLen, output);
+        if (bit) bytes[depth / 8] &= (uint8_t)~(1 << (7 - (depth % 8)));
+    }
+}
+
+@interface SCIPPrefixSet () {
+    SCPrefixTrie _trie4;
+    SCPrefixTrie _trie6;
+    NSMutableOrderedSet<NSString*>* _unparseable;
+}
+
+@end
+
+@implementation SCIPPrefixSet
+
+- (instancetype)init {
+    if (self = [super init]) {
+        SCPrefixTrieInit(&_trie4);
+        SCPrefixTrieInit(&_trie6);
+        _unparseable = [NSMutableOrderedSet orderedSet];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_trie4.nodes);
+    free(_trie6.nodes);
+}
+
+// fills in bytes/family/prefixLen, with the host bits zeroed out
+- (BOOL)parsePrefixString:(NSString*)prefixString bytes:(uint8_t*)bytes family:(int*)family prefixLen:(NSUInteger*)prefixLen {
+    NSArray<NSString*>* parts = [prefixString componentsSeparatedByString: @"/"];
+    if (parts.count > 2) return NO;
+
+    memset(bytes, 0, 16);
+    NSUInteger maxLen;
+    if (inet_pton(AF_INET, parts[0].UTF8String, bytes) == 1) {
+        *family = AF_INET;
+        maxLen = 32;
+    } else if (inet_pton(AF_INET6, parts[0].UTF8String, bytes) == 1) {
+        *family = AF_INET6;
+        maxLen = 128;
+    } else {
+        return NO;
+    }
+
+    *prefixLen = maxLen;
+    if (parts.count == 2) {
+        NSScanner* scanner = [NSScanner scannerWithString: parts[1]];
+        NSInteger len;
+        if (![scanner scanInteger: &len] || !scanner.atEnd || len < 0 || (NSUInteger)len > maxLen) return NO;
+        *prefixLen = (NSUInteger)len;
+    }
+
+    for (NSUInteger bit = *prefixLen; bit < maxLen; bit++) {
+        bytes[bit / 8] &= (uint8_t)~(1 << (7 - (bit % 8)));
+    }
+
+    return YES;
+}
+
+- (BOOL)addPrefixString:(NSString*)prefixString {
+    _inputCount++;
+
+    uint8_t bytes[16];
+    int family;
+    NSUInteger prefixLen;
+    if (![self parsePrefixString: prefixString bytes: bytes family: &family prefixLen: &prefixLen]) {
+        [_unparseable addObject: prefixString];
+        return NO;
+    }
+
+    SCPrefixTrieInsert(family == AF_INET ? &_trie4 : &_trie6, bytes, prefixLen);
+    return YES;
+}
+
+- (BOOL)addAddress:(NSString*)address maskLen:(NSInteger)maskLen {
+    // like everywhere else in BlockManager, a maskLen of 0 means "just this address"
+    if (maskLen) {
+        return [self addPrefixString: [NSString stringWithFormat: @"%@/%ld", address, (long)maskLen]];
+    }
+    return [self addPrefixString: address];
+}
+
+- (BOOL)containsPrefixString:(NSString*)prefixString {
+    uint8_t bytes[16];
+    int family;
+    NSUInteger prefixLen;
+    if (![self parsePrefixString: prefixString bytes: bytes family: &family prefixLen: &prefixLen]) {
+        return [_unparseable containsObject: prefixString];
+    }
+
+    return SCPrefixTrieContains(family == AF_INET ? &_trie4 : &_trie6, bytes, prefixLen);
+}
+
+- (NSArray<NSString*>*)minimalPrefixStrings {
+    NSMutableArray<NSString*>* prefixes = [NSMutableArray array];
+    uint8_t bytes[16] = { 0 };
+
+    SCPrefixTrieCollect(&_trie4, 0, bytes, 0, AF_INET, 32, prefixes);
+    memset(bytes, 0, sizeof(bytes));
+    SCPrefixTrieCollect(&_trie6, 0, bytes, 0, AF_INET6, 128, prefixes);
+    [prefixes addObjectsFromArray: _unparseable.array];
+
+    return prefixes;
+}
+
+- (NSUInteger)eliminatedCount {
+    return self.inputCount - [self minimalPrefixStrings].count;
+}
+
+@end
@@ -0,0 +1,57 @@
+//
+//  SCShardedCollections.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Collections that get hammered from many block-building workers at once.
+// Instead of one lock around everything, they're split into shards that each have their
+// own (very cheap) lock, so two workers only ever wait on each other if they happen
+// to land on the same shard. Both keep track of how long they spent waiting, so
+// we can check that's actually working.
+@interface SCShardedCollection : NSObject
+
+@property (readonly) NSUInteger shardCount;
+// how many times a caller found its shard's lock already taken, and how long they waited in total
+@property (readonly) uint64_t contendedLockCount;
+@property (readonly) NSTimeInterval lockWaitTime;
+
+// defaults to a few shards per core
+- (instancetype)init;
+- (instancetype)initWithShardCount:(NSUInteger)shardCount;
+
+- (void)resetLockStatistics;
+
+@end
+
+// An unordered set, sharded by object hash. Used for dedupe.
+@interface SCShardedSet<ObjectType> : SCShardedCollection
+
+// returns YES if the object wasn't in the set already
+- (BOOL)addObject:(ObjectType)object;
+- (BOOL)containsObject:(ObjectType)object;
+- (NSUInteger)count;
+- (NSSet<ObjectType>*)allObjects;
+- (void)removeAllObjects;
+
+@end
+
+// An append-only buffer, sharded by calling thread - effectively a buffer per worker.
+// Objects from the same thread come out in the order they went in, but there's no
+// ordering between threads. Drain it once everyone's done adding.
+@interface SCWorkerBuffer<ObjectType> : SCShardedCollection
+
+- (void)addObject:(ObjectType)object;
+// number of objects currently buffered (not cheap - takes every shard's lock)
+- (NSUInteger)count;
+// returns everything buffered so far, and empties the buffer
+- (NSArray<ObjectType>*)drainObjects;
+
+@end
+
+NS_ASSUME_NONNULL_END
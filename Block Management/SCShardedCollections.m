@@ -0,0 +1,202 @@
+//
+//  SCShardedCollections.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCShardedCollections.h"
+#import <os/lock.h>
+#import <pthread.h>
+#import <stdatomic.h>
+#import <mach/mach_time.h>
+
+@interface SCCollectionShard : NSObject {
+    @public
+    os_unfair_lock lock;
+    id container;
+}
+@end
+@implementation SCCollectionShard
+@end
+
+// in an extension (not the @implementation) so the subclasses below can get at the shards
+@interface SCShardedCollection () {
+    @protected
+    NSArray<SCCollectionShard*>* shards;
+    _Atomic uint64_t contendedCount;
+    _Atomic uint64_t waitTicks;
+}
+- (void)lockShard:(SCCollectionShard*)shard;
+- (void)unlockShard:(SCCollectionShard*)shard;
+@end
+
+@implementation SCShardedCollection
+
+- (instancetype)init {
+    // more shards than workers, so threads rarely have to share one
+    NSUInteger shardCount = 16;
+    while (shardCount < [NSProcessInfo processInfo].activeProcessorCount * 4) shardCount *= 2;
+    return [self initWithShardCount: shardCount];
+}
+
+- (instancetype)initWithShardCount:(NSUInteger)shardCount {
+    if (self = [super init]) {
+        _shardCount = MAX(shardCount, 1u);
+        NSMutableArray* newShards = [NSMutableArray arrayWithCapacity: _shardCount];
+        for (NSUInteger i = 0; i < _shardCount; i++) {
+            SCCollectionShard* shard = [SCCollectionShard new];
+            shard->lock = OS_UNFAIR_LOCK_INIT;
+            shard->container = [self newShardContainer];
+            [newShards addObject: shard];
+        }
+        shards = newShards;
+    }
+    return self;
+}
+
+- (id)newShardContainer {
+    return [NSMutableArray array];
+}
+
+- (void)lockShard:(SCCollectionShard*)shard {
+    if (os_unfair_lock_trylock(&shard->lock)) return;
+
+    uint64_t startedWaiting = mach_absolute_time();
+    os_unfair_lock_lock(&shard->lock);
+    atomic_fetch_add_explicit(&waitTicks, mach_absolute_time() - startedWaiting, memory_order_relaxed);
+    atomic_fetch_add_explicit(&contendedCount, 1, memory_order_relaxed);
+}
+
+- (void)unlockShard:(SCCollectionShard*)shard {
+    os_unfair_lock_unlock(&shard->lock);
+}
+
+- (uint64_t)contendedLockCount {
+    return atomic_load_explicit(&contendedCount, memory_order_relaxed);
+}
+
+- (NSTimeInterval)lockWaitTime {
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+
+    uint64_t ticks = atomic_load_explicit(&waitTicks, memory_order_relaxed);
+    return (double)ticks * timebase.numer / timebase.denom / NSEC_PER_SEC;
+}
+
+- (void)resetLockStatistics {
+    atomic_store(&contendedCount, 0);
+    atomic_store(&waitTicks, 0);
+}
+
+@end
+
+@implementation SCShardedSet
+
+- (id)newShardContainer {
+    return [NSMutableSet set];
+}
+
+- (SCCollectionShard*)shardForObject:(id)object {
+    // mix the hash a bit, since plenty of -hash implementations leave the low bits similar
+    NSUInteger hash = [object hash];
+    hash ^= hash >> 17;
+    hash *= 0xed5ad4bb;
+    hash ^= hash >> 11;
+    return shards[hash % shards.count];
+}
+
+- (BOOL)addObject:(id)object {
+    SCCollectionShard* shard = [self shardForObject: object];
+    NSMutableSet* set = shard->container;
+
+    [self lockShard: shard];
+    BOOL isNew = ![set containsObject: object];
+    if (isNew) [set addObject: object];
+    [self unlockShard: shard];
+
+    return isNew;
+}
+
+- (BOOL)containsObject:(id)object {
+    SCCollectionShard* shard = [self shardForObject: object];
+
+    [self lockShard: shard];
+    BOOL contains = [shard->container containsObject: object];
+    [self unlockShard: shard];
+
+    return contains;
+}
+
+- (NSUInteger)count {
+    NSUInteger count = 0;
+    for (SCCollectionShard* shard in shards) {
+        [self lockShard: shard];
+        count += [shard->container count];
+        [self unlockShard: shard];
+    }
+    return count;
+}
+
+- (NSSet*)allObjects {
+    NSMutableSet* allObjects = [NSMutableSet set];
+    for (SCCollectionShard* shard in shards) {
+        [self lockShard: shard];
+        [allObjects unionSet: shard->container];
+        [self unlockShard: shard];
+    }
+    return allObjects;
+}
+
+- (void)removeAllObjects {
+    for (SCCollectionShard* shard in shards) {
+        [self lockShard: shard];
+        [shard->container removeAllObjects];
+        [self unlockShard: shard];
+    }
+}
+
+@end
+
+@implementation SCWorkerBuffer
+
+- (SCCollectionShard*)shardForCurrentThread {
+    // mach thread ports are small, stable per-thread numbers,
+    // so each worker thread keeps landing on the same shard
+    mach_port_t thread = pthread_mach_thread_np(pthread_self());
+    return shards[thread % shards.count];
+}
+
+- (void)addObject:(id)object {
+    SCCollectionShard* shard = [self shardForCurrentThread];
+
+    [self lockShard: shard];
+    [shard->container addObject: object];
+    [self unlockShard: shard];
+}
+
+- (NSUInteger)count {
+    NSUInteger count = 0;
+    for (SCCollectionShard* shard in shards) {
+        [self lockShard: shard];
+        count += [shard->container count];
+        [self unlockShard: shard];
+    }
+    return count;
+}
+
+- (NSArray*)drainObjects {
+    NSMutableArray* drained = [NSMutableArray array];
+    for (SCCollectionShard* shard in shards) {
+        [self lockShard: shard];
+        [drained addObjectsFromArray: shard->container];
+        shard->container = [NSMutableArray array];
+        [self unlockShard: shard];
+    }
+    return drained;
+}
+
+@end
@@ -0,0 +1,34 @@
+//
+//  SCStaticResolver.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+#import "SCDNSResolver.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Answers lookups from a fixed table instead of the network, so a block can be
+// compiled offline (and come out the same every time). Domains that aren't in
+// the table resolve as NXDOMAIN, so they only end up blocked via the hosts file.
+@interface SCStaticResolver : NSObject <SCDomainResolving>
+
+// TTL reported on every answer (default 300)
+@property NSTimeInterval ttl;
+// total lookups answered so far
+@property (readonly) NSUInteger lookupCount;
+
+// an empty table: nothing resolves
+- (instancetype)init;
+// domain -> addresses; domains are matched case-insensitively
+- (instancetype)initWithAddressTable:(NSDictionary<NSString*, NSArray<NSString*>*>*)table;
+
+// Reads either a JSON object of domain -> [addresses], or a hosts-format file
+// ("address domain [domain ...]" per line, # for comments)
++ (nullable instancetype)resolverWithContentsOfFile:(NSString*)path error:(NSError* _Nullable *)errPtr;
+
+@end
+
+NS_ASSUME_NONNULL_END
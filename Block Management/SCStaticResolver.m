@@ -0,0 +1,104 @@
+//
+//  SCStaticResolver.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCStaticResolver.h"
+#import "NSString+IPAddress.h"
+
+@implementation SCStaticResolver {
+    NSDictionary<NSString*, NSArray<NSString*>*>* addressTable;
+    _Atomic NSUInteger lookups;
+}
+
+- (instancetype)init {
+    return [self initWithAddressTable: @{}];
+}
+
+- (instancetype)initWithAddressTable:(NSDictionary<NSString*, NSArray<NSString*>*>*)table {
+    if (self = [super init]) {
+        NSMutableDictionary* lowercasedTable = [NSMutableDictionary dictionaryWithCapacity: table.count];
+        for (NSString* domain in table) {
+            NSString* key = domain.lowercaseString;
+            NSArray* existing = lowercasedTable[key] ?: @[];
+            lowercasedTable[key] = [existing arrayByAddingObjectsFromArray: table[domain]];
+        }
+        addressTable = lowercasedTable;
+        _ttl = 300;
+    }
+    return self;
+}
+
++ (instancetype)resolverWithContentsOfFile:(NSString*)path error:(NSError**)errPtr {
+    NSData* data = [NSData dataWithContentsOfFile: path options: 0 error: errPtr];
+    if (data == nil) return nil;
+
+    // JSON first, since a hosts file will never parse as a JSON object
+    id json = [NSJSONSerialization JSONObjectWithData: data options: 0 error: nil];
+    if ([json isKindOfClass: [NSDictionary class]]) {
+        NSMutableDictionary* table = [NSMutableDictionary dictionary];
+        for (id domain in json) {
+            id addresses = json[domain];
+            if (![domain isKindOfClass: [NSString class]]) continue;
+            if ([addresses isKindOfClass: [NSString class]]) addresses = @[addresses];
+            if (![addresses isKindOfClass: [NSArray class]]) continue;
+            table[domain] = [addresses filteredArrayUsingPredicate: [NSPredicate predicateWithFormat: @"self isKindOfClass: %@", [NSString class]]];
+        }
+        return [[SCStaticResolver alloc] initWithAddressTable: table];
+    }
+
+    NSString* contents = [[NSString alloc] initWithData: data encoding: NSUTF8StringEncoding];
+    if (contents == nil) {
+        if (errPtr != nil) *errPtr = [SCErr errorWithCode: 212 subDescription: path];
+        return nil;
+    }
+
+    NSMutableDictionary<NSString*, NSMutableArray*>* table = [NSMutableDictionary dictionary];
+    NSCharacterSet* whitespace = [NSCharacterSet whitespaceCharacterSet];
+    for (NSString* rawLine in [contents componentsSeparatedByCharactersInSet: [NSCharacterSet newlineCharacterSet]]) {
+        NSString* line = rawLine;
+        NSRange commentRange = [line rangeOfString: @"#"];
+        if (commentRange.location != NSNotFound) line = [line substringToIndex: commentRange.location];
+
+        NSArray<NSString*>* fields = [[line componentsSeparatedByCharactersInSet: whitespace] filteredArrayUsingPredicate: [NSPredicate predicateWithFormat: @"length > 0"]];
+        if (fields.count < 2 || ![fields[0] isValidIPAddress]) continue;
+
+        for (NSString* domain in [fields subarrayWithRange: NSMakeRange(1, fields.count - 1)]) {
+            if (table[domain] == nil) table[domain] = [NSMutableArray array];
+            [table[domain] addObject: fields[0]];
+        }
+    }
+    return [[SCStaticResolver alloc] initWithAddressTable: table];
+}
+
+- (NSUInteger)pendingLookupCount {
+    // we answer everything immediately
+    return 0;
+}
+
+- (NSUInteger)lookupCount {
+    return lookups;
+}
+
+- (void)resolveDomain:(NSString*)domain completion:(SCDNSResolutionHandler)completion {
+    lookups++;
+    NSArray<NSString*>* addresses = addressTable[domain.lowercaseString];
+    SCDNSResolution* resolution = [[SCDNSResolution alloc] initWithDomain: domain
+                                                                   status: addresses.count > 0 ? SCDNSResolutionStatusSuccess : SCDNSResolutionStatusNXDomain
+                                                                addresses: addresses ?: @[]
+                                                                      ttl: self.ttl
+                                                                 duration: 0];
+
+    // same contract as SCDNSResolver: always on a background queue, never inline
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        completion(resolution);
+    });
+}
+
+- (void)cancelAllQueries {
+    // nothing is ever outstanding
+}
+
+@end
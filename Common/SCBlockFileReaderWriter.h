@@ -14,13 +14,15 @@ NS_ASSUME_NONNULL_BEGIN
 
 // Writes out a saved .selfcontrol blocklist file to the file system
 // containing the block info (blocklist + whitelist setting) defined
-// in blockInfo.
+// in blockInfo, in the streaming format from SCBlockFileStream.h.
 + (BOOL)writeBlocklistToFileURL:(NSURL*)targetFileURL blockInfo:(NSDictionary*)blockInfo error:(NSError*_Nullable*_Nullable)errRef;
 
 // reads in a saved .selfcontrol blocklist file and returns
 // an NSDictionary with the block settings contained
-// (properties are Blocklist and BlockAsWhitelist)
-+ (NSDictionary*)readBlocklistFromFile:(NSURL*)fileURL;
+// (properties are Blocklist and BlockAsWhitelist), or nil with SCErr 107
+// if it's damaged/too new, or the file system's error if it can't be read.
+// This loads the whole list - use SCBlockFileReader to stream huge files instead.
++ (nullable NSDictionary*)readBlocklistFromFile:(NSURL*)fileURL error:(NSError*_Nullable*_Nullable)errRef;
 
 @end
 
@@ -6,21 +6,20 @@
 //
 
 #import "SCBlockFileReaderWriter.h"
+#import "SCBlockFileStream.h"
 
 @implementation SCBlockFileReaderWriter
 
 + (BOOL)writeBlocklistToFileURL:(NSURL*)targetFileURL blockInfo:(NSDictionary*)blockInfo error:(NSError**)errRef {
-    NSDictionary* saveDict = @{@"HostBlacklist": [blockInfo objectForKey: @"Blocklist"],
-                               @"BlockAsWhitelist": [blockInfo objectForKey: @"BlockAsWhitelist"]};
-
-    NSData* saveData = [NSPropertyListSerialization dataWithPropertyList: saveDict format: NSPropertyListBinaryFormat_v1_0 options: 0 error: errRef];
-    if (*errRef != nil) {
-        return NO;
-    }
-
-    if (![saveData writeToURL: targetFileURL atomically: YES]) {
-        NSLog(@"ERROR: Failed to write blocklist to URL %@", targetFileURL);
-        *errRef = [SCErr errorWithCode: 106];
+    NSError* writeErr = nil;
+    SCBlockFileWriter* writer = [[SCBlockFileWriter alloc] initWithFileURL: targetFileURL
+                                                               isAllowlist: [[blockInfo objectForKey: @"BlockAsWhitelist"] boolValue]
+                                                                     error: &writeErr];
+    if (writer == nil
+        || ![writer addEntries: [blockInfo objectForKey: @"Blocklist"] error: &writeErr]
+        || ![writer finishWithError: &writeErr]) {
+        NSLog(@"ERROR: Failed to write blocklist to URL %@ with error %@", targetFileURL, writeErr);
+        if (errRef != NULL) *errRef = [SCErr errorWithCode: 106];
         return NO;
     }
     
@@ -31,17 +30,20 @@
     return YES;
 }
 
-+ (NSDictionary*)readBlocklistFromFile:(NSURL*)fileURL {
-    NSDictionary* openedDict = [NSDictionary dictionaryWithContentsOfURL: fileURL];
++ (NSDictionary*)readBlocklistFromFile:(NSURL*)fileURL error:(NSError**)errRef {
+    NSError* readErr = nil;
+    SCBlockFileReader* reader = [[SCBlockFileReader alloc] initWithFileURL: fileURL error: &readErr];
+    NSArray<NSString*>* entries = [reader readAllEntries: &readErr];
     
-    if (openedDict == nil || openedDict[@"HostBlacklist"] == nil || openedDict[@"BlockAsWhitelist"] == nil) {
-        NSLog(@"ERROR: Could not read a valid block from file %@", fileURL);
+    if (entries == nil) {
+        NSLog(@"ERROR: Could not read a valid block from file %@ with error %@", fileURL, readErr);
+        if (errRef != nil) *errRef = readErr;
         return nil;
     }
     
     return @{
-        @"Blocklist": openedDict[@"HostBlacklist"],
-        @"BlockAsWhitelist": openedDict[@"BlockAsWhitelist"]
+        @"Blocklist": entries,
+        @"BlockAsWhitelist": @(reader.isAllowlist)
     };
 }
 
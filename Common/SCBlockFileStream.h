@@ -0,0 +1,66 @@
+//
+//  SCBlockFileStream.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Streaming access to saved .selfcontrol block files, so a huge blocklist never has to be
+// in memory all at once.
+//
+// Format version 2 (everything little-endian) is a 32-byte header - "SCBF", the format
+// version, flags (allowlist, has index), the entry count, the index's offset and the chunk
+// count - then the entries, packed into chunks of about 64KB. Each chunk is a 12-byte header
+// (compressed length, uncompressed length, entry count) and a zlib stream of entries, each a
+// varint length and that many bytes of UTF-8. The optional index at the end has the file
+// offset and first entry number of each chunk, so a reader can skip straight to an entry.
+//
+// Version 1 is the binary plist we used to write (HostBlacklist and BlockAsWhitelist).
+// SCBlockFileReader reads those too, though it has to load them all at once to do it.
+
+@interface SCBlockFileReader : NSObject
+
+// 1 for the old plist format, 2 for the streaming one
+@property (readonly) NSUInteger formatVersion;
+@property (readonly) BOOL isAllowlist;
+@property (readonly) NSUInteger entryCount;
+
+// Reads the header (or for old files, the whole plist). Fails with SCErr 107 if it's not a block
+// file we understand, or the file system's error if it can't be read at all
+- (nullable instancetype)initWithFileURL:(NSURL*)fileURL error:(NSError**)error;
+
+// Hands over the entries in order, in arrays of up to batchSize, skipping the first
+// firstEntry of them. Only one chunk and one batch are in memory at a time. Returns NO with
+// SCErr 107 if the file turns out to be damaged partway through, in which case some batches may
+// already have been handed over
+- (BOOL)enumerateEntriesStartingAt:(NSUInteger)firstEntry
+                         batchSize:(NSUInteger)batchSize
+                        usingBlock:(void(NS_NOESCAPE ^)(NSArray<NSString*>* entries, BOOL* stop))block
+                             error:(NSError**)error;
+
+// Convenience for when you need every entry anyway (i.e. to put them in defaults)
+- (nullable NSArray<NSString*>*)readAllEntries:(NSError**)error;
+
+@end
+
+@interface SCBlockFileWriter : NSObject
+
+@property (readonly) NSUInteger entryCount;
+
+// Writes to a temporary file next to fileURL, which replaces fileURL once finishWithError: succeeds
+- (nullable instancetype)initWithFileURL:(NSURL*)fileURL isAllowlist:(BOOL)isAllowlist error:(NSError**)error;
+
+- (BOOL)addEntry:(NSString*)entry error:(NSError**)error;
+- (BOOL)addEntries:(id<NSFastEnumeration>)entries error:(NSError**)error;
+
+// Writes out the last chunk, the index and the header, and moves the file into place.
+// A writer that's never finished removes its temporary file
+- (BOOL)finishWithError:(NSError**)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,456 @@
+//
+//  SCBlockFileStream.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCBlockFileStream.h"
+#import <zlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char const kBlockFileMagic[4] = { 'S', 'C', 'B', 'F' };
+static uint16_t const kBlockFileFormatVersion = 2;
+static size_t const kHeaderLength = 32;
+static size_t const kChunkHeaderLength = 12;
+static size_t const kIndexRecordLength = 16;
+// entries get packed into chunks of about this many bytes (before compression)
+static uint32_t const kTargetChunkLength = 64 * 1024;
+// nothing we'd block is anywhere near this long, and it keeps chunks (and so memory use) bounded
+static uint32_t const kMaxEntryLength = 16 * 1024;
+static uint32_t const kMaxChunkLength = kTargetChunkLength + kMaxEntryLength + 8;
+
+enum {
+    SCBlockFileFlagAllowlist = 1 << 0,
+    SCBlockFileFlagHasIndex = 1 << 1
+};
+
+#pragma mark - Encoding helpers
+
+static void SCWriteUInt16(uint8_t* bytes, uint16_t value) {
+    for (int i = 0; i < 2; i++) bytes[i] = (uint8_t)(value >> (8 * i));
+}
+static void SCWriteUInt32(uint8_t* bytes, uint32_t value) {
+    for (int i = 0; i < 4; i++) bytes[i] = (uint8_t)(value >> (8 * i));
+}
+static void SCWriteUInt64(uint8_t* bytes, uint64_t value) {
+    for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)(value >> (8 * i));
+}
+static uint16_t SCReadUInt16(const uint8_t* bytes) {
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+static uint32_t SCReadUInt32(const uint8_t* bytes) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | bytes[i];
+    return value;
+}
+static uint64_t SCReadUInt64(const uint8_t* bytes) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | bytes[i];
+    return value;
+}
+
+static void SCAppendVarint(NSMutableData* data, uint64_t value) {
+    uint8_t bytes[10];
+    size_t length = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0) byte |= 0x80;
+        bytes[length++] = byte;
+    } while (value != 0);
+    [data appendBytes: bytes length: length];
+}
+static BOOL SCReadVarint(const uint8_t** cursor, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *cursor < end; shift += 7) {
+        uint8_t byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static NSError* SCPOSIXError(int code, NSString* path) {
+    return [NSError errorWithDomain: NSPOSIXErrorDomain code: code userInfo: @{ NSFilePathErrorKey: path }];
+}
+static NSError* SCDamagedBlockFileError(NSURL* fileURL, NSString* reason) {
+    NSLog(@"ERROR: Can't read block file %@: %@", fileURL.path, reason);
+    return [SCErr errorWithCode: 107];
+}
+
+#pragma mark - SCBlockFileReader
+
+@implementation SCBlockFileReader {
+    NSURL* _fileURL;
+    // only for version 1 files, which we have to read in one go
+    NSArray<NSString*>* _legacyEntries;
+    uint64_t _indexOffset;
+    uint32_t _chunkCount;
+}
+
+- (nullable instancetype)initWithFileURL:(NSURL*)fileURL error:(NSError**)error {
+    if (self = [super init]) {
+        _fileURL = fileURL;
+
+        FILE* file = fopen(fileURL.fileSystemRepresentation, "rb");
+        if (file == NULL) {
+            if (error != NULL) *error = SCPOSIXError(errno, fileURL.path);
+            return nil;
+        }
+        uint8_t header[kHeaderLength];
+        size_t headerLength = fread(header, 1, kHeaderLength, file);
+        struct stat fileStat;
+        int statResult = fstat(fileno(file), &fileStat);
+        fclose(file);
+
+        if (headerLength < sizeof(kBlockFileMagic) || memcmp(header, kBlockFileMagic, sizeof(kBlockFileMagic)) != 0) {
+            return [self readLegacyFile: error] ? self : nil;
+        }
+
+        NSString* problem = nil;
+        uint16_t flags = 0;
+        if (headerLength < kHeaderLength || statResult != 0) {
+            problem = @"header is cut short";
+        } else if ((_formatVersion = SCReadUInt16(header + 4)) != kBlockFileFormatVersion) {
+            problem = [NSString stringWithFormat: @"unknown format version %lu", (unsigned long)_formatVersion];
+        } else {
+            flags = SCReadUInt16(header + 6);
+            uint64_t entryCount = SCReadUInt64(header + 8);
+            _indexOffset = (flags & SCBlockFileFlagHasIndex) ? SCReadUInt64(header + 16) : 0;
+            _chunkCount = SCReadUInt32(header + 24);
+
+            uint64_t fileLength = (uint64_t)fileStat.st_size;
+            if (entryCount > NSUIntegerMax) {
+                problem = @"too many entries";
+            } else if (_indexOffset != 0 && (_indexOffset < kHeaderLength || _indexOffset > fileLength
+                                             || fileLength - _indexOffset != (uint64_t)_chunkCount * kIndexRecordLength)) {
+                problem = @"index doesn't fit the file";
+            }
+            _entryCount = (NSUInteger)entryCount;
+        }
+        if (problem != nil) {
+            if (error != NULL) *error = SCDamagedBlockFileError(fileURL, problem);
+            return nil;
+        }
+        _isAllowlist = (flags & SCBlockFileFlagAllowlist) != 0;
+    }
+    return self;
+}
+
+- (BOOL)readLegacyFile:(NSError**)error {
+    NSError* readErr = nil;
+    NSData* data = [NSData dataWithContentsOfURL: _fileURL options: NSDataReadingMappedIfSafe error: &readErr];
+    if (data == nil) {
+        if (error != NULL) *error = readErr;
+        return NO;
+    }
+    NSDictionary* dict = [NSPropertyListSerialization propertyListWithData: data options: NSPropertyListImmutable format: NULL error: nil];
+    if (![dict isKindOfClass: [NSDictionary class]] || ![dict[@"HostBlacklist"] isKindOfClass: [NSArray class]] || dict[@"BlockAsWhitelist"] == nil) {
+        if (error != NULL) *error = SCDamagedBlockFileError(_fileURL, @"not a streaming block file or a block plist");
+        return NO;
+    }
+
+    _formatVersion = 1;
+    _legacyEntries = dict[@"HostBlacklist"];
+    _entryCount = _legacyEntries.count;
+    _isAllowlist = [dict[@"BlockAsWhitelist"] boolValue];
+    return YES;
+}
+
+- (BOOL)enumerateEntriesStartingAt:(NSUInteger)firstEntry
+                         batchSize:(NSUInteger)batchSize
+                        usingBlock:(void(NS_NOESCAPE ^)(NSArray<NSString*>* entries, BOOL* stop))block
+                             error:(NSError**)error {
+    batchSize = MAX(batchSize, 1);
+
+    if (_legacyEntries != nil) {
+        BOOL stop = NO;
+        for (NSUInteger i = firstEntry; i < _legacyEntries.count && !stop; i += batchSize) {
+            block([_legacyEntries subarrayWithRange: NSMakeRange(i, MIN(batchSize, _legacyEntries.count - i))], &stop);
+        }
+        return YES;
+    }
+    if (firstEntry >= self.entryCount) return YES;
+
+    FILE* file = fopen(_fileURL.fileSystemRepresentation, "rb");
+    if (file == NULL) {
+        if (error != NULL) *error = SCPOSIXError(errno, _fileURL.path);
+        return NO;
+    }
+    NSString* problem = [self enumerateEntriesInFile: file startingAt: firstEntry batchSize: batchSize usingBlock: block];
+    fclose(file);
+
+    if (problem != nil) {
+        if (error != NULL) *error = SCDamagedBlockFileError(_fileURL, problem);
+        return NO;
+    }
+    return YES;
+}
+
+// reads index record i, returning NO if it's unreadable or points somewhere it shouldn't
+- (BOOL)readIndexRecord:(uint32_t)i fromFile:(FILE*)file offset:(uint64_t*)offset firstEntry:(uint64_t*)firstEntry {
+    uint8_t record[kIndexRecordLength];
+    if (fseeko(file, (off_t)(_indexOffset + (uint64_t)i * kIndexRecordLength), SEEK_SET) != 0 || fread(record, 1, sizeof(record), file) != sizeof(record)) {
+        return NO;
+    }
+    *offset = SCReadUInt64(record);
+    *firstEntry = SCReadUInt64(record + 8);
+    return *offset >= kHeaderLength && *offset < _indexOffset && *firstEntry < self.entryCount;
+}
+
+// returns a description of the problem if the file's damaged, or nil if all went well
+- (nullable NSString*)enumerateEntriesInFile:(FILE*)file
+                                  startingAt:(NSUInteger)firstEntry
+                                   batchSize:(NSUInteger)batchSize
+                                  usingBlock:(void(NS_NOESCAPE ^)(NSArray<NSString*>* entries, BOOL* stop))block {
+    uint64_t offset = kHeaderLength;
+    uint64_t entryNumber = 0;
+    uint32_t chunkIndex = 0;
+
+    // with an index, binary search for the last chunk starting at or before firstEntry.
+    // Without one we can still skip chunks without decompressing them, just not without reading their headers
+    if (firstEntry > 0 && _indexOffset != 0 && _chunkCount > 0) {
+        uint32_t low = 0, high = _chunkCount;
+        while (high - low > 1) {
+            uint32_t mid = low + (high - low) / 2;
+            uint64_t midOffset, midFirstEntry;
+            if (![self readIndexRecord: mid fromFile: file offset: &midOffset firstEntry: &midFirstEntry]) return @"index is damaged";
+            if (midFirstEntry <= firstEntry) {
+                low = mid;
+            } else {
+                high = mid;
+            }
+        }
+        if (![self readIndexRecord: low fromFile: file offset: &offset firstEntry: &entryNumber]) return @"index is damaged";
+        chunkIndex = low;
+    }
+
+    NSMutableData* compressed = [NSMutableData data];
+    NSMutableData* uncompressed = [NSMutableData dataWithLength: kMaxChunkLength];
+    NSMutableArray<NSString*>* batch = [NSMutableArray arrayWithCapacity: batchSize];
+    BOOL stop = NO;
+
+    for (; chunkIndex < _chunkCount && !stop; chunkIndex++) {
+        @autoreleasepool {
+            uint8_t chunkHeader[kChunkHeaderLength];
+            if (fseeko(file, (off_t)offset, SEEK_SET) != 0 || fread(chunkHeader, 1, sizeof(chunkHeader), file) != sizeof(chunkHeader)) {
+                return @"chunk is cut short";
+            }
+            uint32_t compressedLength = SCReadUInt32(chunkHeader);
+            uint32_t uncompressedLength = SCReadUInt32(chunkHeader + 4);
+            uint32_t chunkEntryCount = SCReadUInt32(chunkHeader + 8);
+            if (uncompressedLength > kMaxChunkLength || compressedLength == 0 || compressedLength > compressBound(kMaxChunkLength)) {
+                return @"chunk is too big";
+            }
+            offset += kChunkHeaderLength + compressedLength;
+
+            if (entryNumber + chunkEntryCount <= firstEntry) {
+                // nothing we want in this one
+                entryNumber += chunkEntryCount;
+                continue;
+            }
+
+            compressed.length = compressedLength;
+            if (fread(compressed.mutableBytes, 1, compressedLength, file) != compressedLength) return @"chunk is cut short";
+            uLongf inflatedLength = uncompressedLength;
+            if (uncompress(uncompressed.mutableBytes, &inflatedLength, compressed.bytes, compressedLength) != Z_OK || inflatedLength != uncompressedLength) {
+                return @"chunk doesn't decompress";
+            }
+
+            const uint8_t* cursor = uncompressed.bytes;
+            const uint8_t* end = cursor + uncompressedLength;
+            for (uint32_t i = 0; i < chunkEntryCount && !stop; i++, entryNumber++) {
+                uint64_t entryLength;
+                if (!SCReadVarint(&cursor, end, &entryLength) || entryLength > (uint64_t)(end - cursor)) return @"entry is cut short";
+                if (entryNumber >= firstEntry) {
+                    NSString* entry = [[NSString alloc] initWithBytes: cursor length: (NSUInteger)entryLength encoding: NSUTF8StringEncoding];
+                    if (entry == nil) return @"entry isn't UTF-8";
+                    [batch addObject: entry];
+                    if (batch.count == batchSize) {
+                        block([batch copy], &stop);
+                        [batch removeAllObjects];
+                    }
+                }
+                cursor += entryLength;
+            }
+            if (!stop && cursor != end) return @"chunk has extra data";
+        }
+    }
+
+    if (!stop && batch.count > 0) {
+        block([batch copy], &stop);
+    }
+    if (!stop && entryNumber != self.entryCount) return @"entry count doesn't match the header";
+    return nil;
+}
+
+- (nullable NSArray<NSString*>*)readAllEntries:(NSError**)error {
+    if (_legacyEntries != nil) return _legacyEntries;
+
+    NSMutableArray<NSString*>* entries = [NSMutableArray arrayWithCapacity: self.entryCount];
+    BOOL success = [self enumerateEntriesStartingAt: 0 batchSize: 1024 usingBlock:^(NSArray<NSString*>* batch, BOOL* stop) {
+        [entries addObjectsFromArray: batch];
+    } error: error];
+    return success ? entries : nil;
+}
+
+@end
+
+#pragma mark - SCBlockFileWriter
+
+@implementation SCBlockFileWriter {
+    NSURL* _fileURL;
+    NSString* _temporaryPath;
+    FILE* _file;
+    BOOL _isAllowlist;
+    // the chunk we're filling up, uncompressed
+    NSMutableData* _chunk;
+    uint32_t _chunkEntryCount;
+    uint32_t _chunkCount;
+    NSMutableData* _index;
+    uint64_t _offset;
+}
+
+- (nullable instancetype)initWithFileURL:(NSURL*)fileURL isAllowlist:(BOOL)isAllowlist error:(NSError**)error {
+    if (self = [super init]) {
+        _fileURL = fileURL;
+        _isAllowlist = isAllowlist;
+        _chunk = [NSMutableData dataWithCapacity: kMaxChunkLength];
+        _index = [NSMutableData data];
+
+        NSString* temporaryName = [NSString stringWithFormat: @".%@.XXXXXX", fileURL.lastPathComponent];
+        NSString* pathTemplate = [fileURL.URLByDeletingLastPathComponent.path stringByAppendingPathComponent: temporaryName];
+        char* path = strdup(pathTemplate.fileSystemRepresentation);
+        int fd = mkstemp(path);
+        int openErrno = errno;
+        _temporaryPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation: path length: strlen(path)];
+        free(path);
+        if (fd < 0) {
+            if (error != NULL) *error = SCPOSIXError(openErrno, fileURL.path);
+            return nil;
+        }
+        // mkstemp makes it private, but block files are for sharing
+        fchmod(fd, 0644);
+        _file = fdopen(fd, "wb");
+        if (_file == NULL) {
+            if (error != NULL) *error = SCPOSIXError(errno, _temporaryPath);
+            close(fd);
+            unlink(_temporaryPath.fileSystemRepresentation);
+            return nil;
+        }
+
+        // the real header goes in once we know what's in the file
+        uint8_t header[kHeaderLength] = { 0 };
+        if (fwrite(header, 1, sizeof(header), _file) != sizeof(header)) {
+            if (error != NULL) *error = SCPOSIXError(errno, _temporaryPath);
+            return nil;
+        }
+        _offset = kHeaderLength;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_file != NULL) {
+        fclose(_file);
+        unlink(_temporaryPath.fileSystemRepresentation);
+    }
+}
+
+- (BOOL)addEntry:(NSString*)entry error:(NSError**)error {
+    NSAssert(_file != NULL, @"Can't add entries to a block file that's already finished");
+    NSData* entryData = [entry dataUsingEncoding: NSUTF8StringEncoding];
+    if (entryData == nil || entryData.length > kMaxEntryLength) {
+        NSLog(@"ERROR: Can't save blocklist entry of length %lu to a block file", (unsigned long)entry.length);
+        if (error != NULL) *error = SCPOSIXError(EINVAL, _fileURL.path);
+        return NO;
+    }
+
+    SCAppendVarint(_chunk, entryData.length);
+    [_chunk appendData: entryData];
+    _chunkEntryCount++;
+    _entryCount++;
+
+    if (_chunk.length >= kTargetChunkLength) {
+        return [self writeChunk: error];
+    }
+    return YES;
+}
+
+- (BOOL)addEntries:(id<NSFastEnumeration>)entries error:(NSError**)error {
+    for (NSString* entry in entries) {
+        if (![self addEntry: entry error: error]) return NO;
+    }
+    return YES;
+}
+
+- (BOOL)writeChunk:(NSError**)error {
+    if (_chunkEntryCount == 0) return YES;
+
+    uLongf compressedLength = compressBound(_chunk.length);
+    NSMutableData* compressed = [NSMutableData dataWithLength: compressedLength];
+    if (compress2(compressed.mutableBytes, &compressedLength, _chunk.bytes, _chunk.length, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        if (error != NULL) *error = SCPOSIXError(EIO, _temporaryPath);
+        return NO;
+    }
+
+    uint8_t chunkHeader[kChunkHeaderLength];
+    SCWriteUInt32(chunkHeader, (uint32_t)compressedLength);
+    SCWriteUInt32(chunkHeader + 4, (uint32_t)_chunk.length);
+    SCWriteUInt32(chunkHeader + 8, _chunkEntryCount);
+    if (fwrite(chunkHeader, 1, sizeof(chunkHeader), _file) != sizeof(chunkHeader)
+        || fwrite(compressed.bytes, 1, compressedLength, _file) != compressedLength) {
+        if (error != NULL) *error = SCPOSIXError(errno, _temporaryPath);
+        return NO;
+    }
+
+    uint8_t indexRecord[kIndexRecordLength];
+    SCWriteUInt64(indexRecord, _offset);
+    SCWriteUInt64(indexRecord + 8, _entryCount - _chunkEntryCount);
+    [_index appendBytes: indexRecord length: sizeof(indexRecord)];
+
+    _offset += kChunkHeaderLength + compressedLength;
+    _chunkCount++;
+    _chunk.length = 0;
+    _chunkEntryCount = 0;
+    return YES;
+}
+
+- (BOOL)finishWithError:(NSError**)error {
+    NSAssert(_file != NULL, @"Block file is already finished");
+    if (![self writeChunk: error]) return NO;
+
+    uint8_t header[kHeaderLength] = { 0 };
+    memcpy(header, kBlockFileMagic, sizeof(kBlockFileMagic));
+    SCWriteUInt16(header + 4, kBlockFileFormatVersion);
+    SCWriteUInt16(header + 6, (_isAllowlist ? SCBlockFileFlagAllowlist : 0) | SCBlockFileFlagHasIndex);
+    SCWriteUInt64(header + 8, _entryCount);
+    SCWriteUInt64(header + 16, _offset);
+    SCWriteUInt32(header + 24, _chunkCount);
+
+    if (fwrite(_index.bytes, 1, _index.length, _file) != _index.length
+        || fseeko(_file, 0, SEEK_SET) != 0
+        || fwrite(header, 1, sizeof(header), _file) != sizeof(header)
+        || fflush(_file) != 0
+        || fsync(fileno(_file)) != 0) {
+        if (error != NULL) *error = SCPOSIXError(errno, _temporaryPath);
+        return NO;
+    }
+    fclose(_file);
+    _file = NULL;
+
+    if (rename(_temporaryPath.fileSystemRepresentation, _fileURL.fileSystemRepresentation) != 0) {
+        if (error != NULL) *error = SCPOSIXError(errno, _fileURL.path);
+        unlink(_temporaryPath.fileSystemRepresentation);
+        return NO;
+    }
+    return YES;
+}
+
+@end
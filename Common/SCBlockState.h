@@ -0,0 +1,90 @@
+//
+//  SCBlockState.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// The handful of facts about the current block that the app and CLI keep asking about.
+// The daemon publishes one of these whenever the block changes (see SCBlockStateFile),
+// so they can find out without loading settings or talking to the daemon.
+@interface SCBlockState : NSObject
+
+@property (readonly) BOOL blockIsRunning;
+@property (readonly) BOOL isAllowlist;
+@property (readonly) NSDate* blockEndDate;
+@property (readonly) NSUInteger blocklistCount;
+// SHA-256 of the active blocklist's entries, newline-separated
+@property (readonly) NSData* blocklistDigest;
+// SettingsVersionNumber of the settings this was built from
+@property (readonly) uint64_t settingsVersion;
+
+// what the daemon's last integrity check found damaged, and what it couldn't repair
+// (both SCBlockComponent masks). Zero with a nil date if it hasn't run one this block
+@property (readonly) NSUInteger damagedComponents;
+@property (readonly) NSUInteger unrepairedComponents;
+@property (readonly, nullable) NSDate* integrityCheckDate;
+
+@property (readonly) NSDate* publishedDate;
+
+// Builds the state from an SCSettings dictionaryRepresentation
++ (instancetype)stateWithSettings:(NSDictionary*)settings
+                damagedComponents:(NSUInteger)damagedComponents
+             unrepairedComponents:(NSUInteger)unrepairedComponents
+               integrityCheckDate:(nullable NSDate*)integrityCheckDate;
+
+- (instancetype)initWithBlockIsRunning:(BOOL)blockIsRunning
+                           isAllowlist:(BOOL)isAllowlist
+                          blockEndDate:(NSDate*)blockEndDate
+                        blocklistCount:(NSUInteger)blocklistCount
+                       blocklistDigest:(NSData*)blocklistDigest
+                       settingsVersion:(uint64_t)settingsVersion
+                     damagedComponents:(NSUInteger)damagedComponents
+                  unrepairedComponents:(NSUInteger)unrepairedComponents
+                    integrityCheckDate:(nullable NSDate*)integrityCheckDate
+                         publishedDate:(NSDate*)publishedDate NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
++ (NSData*)digestOfBlocklist:(NSArray<NSString*>*)blocklist;
+
+// same as [SCBlockUtilities currentBlockIsExpired], for this state
+- (BOOL)blockIsExpired;
+
+// for printing
+- (NSDictionary<NSString*, id>*)dictionaryRepresentation;
+
+@end
+
+// A small fixed-layout record in a memory-mapped file, which the daemon rewrites in
+// place under a sequence lock: the sequence number is odd while a write is in progress,
+// and readers retry if it was odd or changed while they were copying. So reading costs
+// a stat (to notice the file being replaced or removed) plus a memcpy - no IPC, no parsing.
+//
+// Readers should fall back to SCSettings whenever readState returns nil (no file yet,
+// an older daemon that doesn't publish, or a record we don't understand).
+@interface SCBlockStateFile : NSObject
+
+// next to the secured settings file, and readable by everyone
+@property (class, readonly) NSString* defaultPath;
+
+@property (readonly) NSString* path;
+
+// at defaultPath
++ (instancetype)sharedFile;
+- (instancetype)initWithPath:(NSString*)path;
+
+// Daemon only: writes the state (creating the file if needed)
+- (BOOL)publishState:(SCBlockState*)state error:(NSError**)error;
+// The latest published state, or nil if there isn't a usable one
+- (nullable SCBlockState*)readState;
+
+// unmaps the file, so the next read or publish maps it again
+- (void)close;
+
+@end
+
+NS_ASSUME_NONNULL_END
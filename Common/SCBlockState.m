@@ -0,0 +1,336 @@
+//
+//  SCBlockState.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCBlockState.h"
+#import "SCSettings.h"
+#import <CommonCrypto/CommonCrypto.h>
+#import <stdatomic.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#pragma mark - On-disk layout
+
+static uint32_t const kBlockStateMagic = 0x53434253; // "SCBS"
+// bump this whenever SCBlockStatePayload changes, so old readers fall back instead of misreading it
+static uint32_t const kBlockStateLayoutVersion = 1;
+static int const kMaxReadAttempts = 64;
+
+enum {
+    SCBlockStateFlagRunning = 1 << 0,
+    SCBlockStateFlagAllowlist = 1 << 1,
+    SCBlockStateFlagIntegrityChecked = 1 << 2
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t layoutVersion;
+    uint64_t settingsVersion;
+    // all dates are seconds since the NSDate reference date
+    double blockEndDate;
+    double publishedDate;
+    double integrityCheckDate;
+    uint32_t flags;
+    uint32_t blocklistCount;
+    uint32_t damagedComponents;
+    uint32_t unrepairedComponents;
+    uint8_t blocklistDigest[CC_SHA256_DIGEST_LENGTH];
+} SCBlockStatePayload;
+
+typedef struct {
+    // odd while the daemon's in the middle of a write
+    _Atomic uint64_t sequence;
+    SCBlockStatePayload payload;
+} SCBlockStateRecord;
+
+static NSError* SCPOSIXError(int code, NSString* path) {
+    return [NSError errorWithDomain: NSPOSIXErrorDomain code: code userInfo: @{ NSFilePathErrorKey: path }];
+}
+
+static NSData* _Nullable SCDataFromHexString(id hexString) {
+    if (![hexString isKindOfClass: [NSString class]] || [hexString length] % 2 != 0) return nil;
+    const char* chars = [hexString UTF8String];
+    NSMutableData* data = [NSMutableData dataWithLength: [hexString length] / 2];
+    uint8_t* bytes = data.mutableBytes;
+    for (NSUInteger i = 0; i < data.length; i++) {
+        unsigned int byte;
+        if (sscanf(chars + i * 2, "%2x", &byte) != 1) return nil;
+        bytes[i] = (uint8_t)byte;
+    }
+    return data;
+}
+
+#pragma mark - SCBlockState
+
+@implementation SCBlockState
+
++ (instancetype)stateWithSettings:(NSDictionary*)settings
+                damagedComponents:(NSUInteger)damagedComponents
+             unrepairedComponents:(NSUInteger)unrepairedComponents
+               integrityCheckDate:(nullable NSDate*)integrityCheckDate {
+    // settings only have the blocklist's hash and count (see SCBlocklistTable), and the hash is the same digest
+    NSData* blocklistDigest = SCDataFromHexString(settings[@"ActiveBlocklistHash"]);
+    if (blocklistDigest.length != CC_SHA256_DIGEST_LENGTH) blocklistDigest = [SCBlockState digestOfBlocklist: @[]];
+    NSDate* endDate = settings[@"BlockEndDate"];
+    if (![endDate isKindOfClass: [NSDate class]]) endDate = [NSDate distantPast];
+
+    return [[SCBlockState alloc] initWithBlockIsRunning: [settings[@"BlockIsRunning"] boolValue]
+                                            isAllowlist: [settings[@"ActiveBlockAsWhitelist"] boolValue]
+                                           blockEndDate: endDate
+                                         blocklistCount: [settings[@"ActiveBlocklistCount"] unsignedIntegerValue]
+                                        blocklistDigest: blocklistDigest
+                                        settingsVersion: (uint64_t)MAX(0, [settings[@"SettingsVersionNumber"] longLongValue])
+                                      damagedComponents: damagedComponents
+                                   unrepairedComponents: unrepairedComponents
+                                     integrityCheckDate: integrityCheckDate
+                                          publishedDate: [NSDate date]];
+}
+
+- (instancetype)initWithBlockIsRunning:(BOOL)blockIsRunning
+                           isAllowlist:(BOOL)isAllowlist
+                          blockEndDate:(NSDate*)blockEndDate
+                        blocklistCount:(NSUInteger)blocklistCount
+                       blocklistDigest:(NSData*)blocklistDigest
+                       settingsVersion:(uint64_t)settingsVersion
+                     damagedComponents:(NSUInteger)damagedComponents
+                  unrepairedComponents:(NSUInteger)unrepairedComponents
+                    integrityCheckDate:(nullable NSDate*)integrityCheckDate
+                         publishedDate:(NSDate*)publishedDate {
+    if (self = [super init]) {
+        _blockIsRunning = blockIsRunning;
+        _isAllowlist = isAllowlist;
+        _blockEndDate = blockEndDate;
+        _blocklistCount = blocklistCount;
+        _blocklistDigest = [blocklistDigest copy];
+        _settingsVersion = settingsVersion;
+        _damagedComponents = damagedComponents;
+        _unrepairedComponents = unrepairedComponents;
+        _integrityCheckDate = integrityCheckDate;
+        _publishedDate = publishedDate;
+    }
+    return self;
+}
+
++ (NSData*)digestOfBlocklist:(NSArray<NSString*>*)blocklist {
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    for (NSString* entry in blocklist) {
+        NSData* entryData = [entry dataUsingEncoding: NSUTF8StringEncoding];
+        CC_SHA256_Update(&context, entryData.bytes, (CC_LONG)entryData.length);
+        CC_SHA256_Update(&context, "\n", 1);
+    }
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &context);
+    return [NSData dataWithBytes: digest length: sizeof(digest)];
+}
+
+- (BOOL)blockIsExpired {
+    return [self.blockEndDate timeIntervalSinceNow] <= 0;
+}
+
+- (NSDictionary<NSString*, id>*)dictionaryRepresentation {
+    NSMutableDictionary* dict = [@{
+        @"BlockIsRunning": @(self.blockIsRunning),
+        @"ActiveBlockAsWhitelist": @(self.isAllowlist),
+        @"BlockEndDate": self.blockEndDate,
+        @"ActiveBlocklistCount": @(self.blocklistCount),
+        @"ActiveBlocklistDigest": self.blocklistDigest,
+        @"SettingsVersionNumber": @(self.settingsVersion),
+        @"DamagedComponents": @(self.damagedComponents),
+        @"UnrepairedComponents": @(self.unrepairedComponents),
+        @"PublishedDate": self.publishedDate
+    } mutableCopy];
+    if (self.integrityCheckDate != nil) dict[@"IntegrityCheckDate"] = self.integrityCheckDate;
+    return dict;
+}
+
+- (NSString*)description {
+    return [NSString stringWithFormat: @"<SCBlockState %@>", [self dictionaryRepresentation]];
+}
+
+@end
+
+#pragma mark - SCBlockStateFile
+
+@implementation SCBlockStateFile {
+    // everything below is guarded by @synchronized (self)
+    SCBlockStateRecord* _record;
+    BOOL _writable;
+    dev_t _device;
+    ino_t _inode;
+}
+
++ (NSString*)defaultPath {
+    return [SCSettings.securedSettingsFilePath stringByAppendingString: @".state"];
+}
+
++ (instancetype)sharedFile {
+    static SCBlockStateFile* sharedFile = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedFile = [[SCBlockStateFile alloc] initWithPath: SCBlockStateFile.defaultPath];
+    });
+    return sharedFile;
+}
+
+- (instancetype)initWithPath:(NSString*)path {
+    if (self = [super init]) {
+        _path = [path copy];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self unmap];
+}
+
+- (void)close {
+    @synchronized (self) {
+        [self unmap];
+    }
+}
+
+- (void)unmap {
+    if (_record != NULL) {
+        munmap(_record, sizeof(SCBlockStateRecord));
+        _record = NULL;
+    }
+}
+
+// maps the file (again) if we don't have it mapped the way we need it, or it's been
+// replaced since we did. Returns NO if there's no file to map
+- (BOOL)mapWritable:(BOOL)writable error:(NSError**)error {
+    struct stat fileStat;
+    if (stat(self.path.fileSystemRepresentation, &fileStat) != 0) {
+        int statErrno = errno;
+        [self unmap];
+        if (!writable) {
+            if (error != NULL) *error = SCPOSIXError(statErrno, self.path);
+            return NO;
+        }
+    } else if (_record != NULL && fileStat.st_dev == _device && fileStat.st_ino == _inode && (_writable || !writable)) {
+        return YES;
+    }
+    [self unmap];
+
+    int fd = writable ? open(self.path.fileSystemRepresentation, O_RDWR | O_CREAT | O_CLOEXEC, 0644)
+                      : open(self.path.fileSystemRepresentation, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (error != NULL) *error = SCPOSIXError(errno, self.path);
+        return NO;
+    }
+
+    BOOL success = (fstat(fd, &fileStat) == 0);
+    if (success && writable) {
+        // everyone reads it, only we write it
+        success = (fchmod(fd, 0644) == 0);
+        if (success && fileStat.st_size != (off_t)sizeof(SCBlockStateRecord)) {
+            success = (ftruncate(fd, (off_t)sizeof(SCBlockStateRecord)) == 0);
+        }
+    } else if (success && fileStat.st_size < (off_t)sizeof(SCBlockStateRecord)) {
+        // still being created, or not ours
+        close(fd);
+        if (error != NULL) *error = SCPOSIXError(EINVAL, self.path);
+        return NO;
+    }
+
+    void* mapped = MAP_FAILED;
+    if (success) {
+        mapped = mmap(NULL, sizeof(SCBlockStateRecord), writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    }
+    int mapErrno = errno;
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        if (error != NULL) *error = SCPOSIXError(mapErrno, self.path);
+        return NO;
+    }
+
+    _record = mapped;
+    _writable = writable;
+    _device = fileStat.st_dev;
+    _inode = fileStat.st_ino;
+    return YES;
+}
+
+- (BOOL)publishState:(SCBlockState*)state error:(NSError**)error {
+    SCBlockStatePayload payload;
+    memset(&payload, 0, sizeof(payload));
+    payload.magic = kBlockStateMagic;
+    payload.layoutVersion = kBlockStateLayoutVersion;
+    payload.settingsVersion = state.settingsVersion;
+    payload.blockEndDate = state.blockEndDate.timeIntervalSinceReferenceDate;
+    payload.publishedDate = state.publishedDate.timeIntervalSinceReferenceDate;
+    payload.integrityCheckDate = state.integrityCheckDate.timeIntervalSinceReferenceDate;
+    payload.flags = (state.blockIsRunning ? SCBlockStateFlagRunning : 0)
+                  | (state.isAllowlist ? SCBlockStateFlagAllowlist : 0)
+                  | (state.integrityCheckDate != nil ? SCBlockStateFlagIntegrityChecked : 0);
+    payload.blocklistCount = (uint32_t)MIN(state.blocklistCount, UINT32_MAX);
+    payload.damagedComponents = (uint32_t)state.damagedComponents;
+    payload.unrepairedComponents = (uint32_t)state.unrepairedComponents;
+    [state.blocklistDigest getBytes: payload.blocklistDigest length: sizeof(payload.blocklistDigest)];
+
+    @synchronized (self) {
+        if (![self mapWritable: YES error: error]) return NO;
+
+        uint64_t sequence = atomic_load_explicit(&_record->sequence, memory_order_relaxed);
+        // if a previous writer died mid-write, the sequence was left odd - move past it
+        if (sequence & 1) sequence++;
+
+        atomic_store_explicit(&_record->sequence, sequence + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy(&_record->payload, &payload, sizeof(payload));
+        atomic_store_explicit(&_record->sequence, sequence + 2, memory_order_release);
+    }
+    return YES;
+}
+
+- (nullable SCBlockState*)readState {
+    SCBlockStatePayload payload;
+
+    @synchronized (self) {
+        if (![self mapWritable: NO error: NULL]) return nil;
+
+        BOOL consistent = NO;
+        for (int attempt = 0; attempt < kMaxReadAttempts && !consistent; attempt++) {
+            uint64_t before = atomic_load_explicit(&_record->sequence, memory_order_acquire);
+            if (before & 1) {
+                sched_yield();
+                continue;
+            }
+            memcpy(&payload, (const void*)&_record->payload, sizeof(payload));
+            atomic_thread_fence(memory_order_acquire);
+            uint64_t after = atomic_load_explicit(&_record->sequence, memory_order_relaxed);
+            consistent = (before == after);
+        }
+        if (!consistent) {
+            // the daemon should never take anywhere near this long to write ~100 bytes
+            NSLog(@"WARNING: Couldn't get a consistent read of the published block state at %@", self.path);
+            return nil;
+        }
+    }
+
+    if (payload.magic != kBlockStateMagic || payload.layoutVersion != kBlockStateLayoutVersion) return nil;
+
+    NSDate* integrityCheckDate = nil;
+    if (payload.flags & SCBlockStateFlagIntegrityChecked) {
+        integrityCheckDate = [NSDate dateWithTimeIntervalSinceReferenceDate: payload.integrityCheckDate];
+    }
+    return [[SCBlockState alloc] initWithBlockIsRunning: (payload.flags & SCBlockStateFlagRunning) != 0
+                                            isAllowlist: (payload.flags & SCBlockStateFlagAllowlist) != 0
+                                           blockEndDate: [NSDate dateWithTimeIntervalSinceReferenceDate: payload.blockEndDate]
+                                         blocklistCount: payload.blocklistCount
+                                        blocklistDigest: [NSData dataWithBytes: payload.blocklistDigest length: sizeof(payload.blocklistDigest)]
+                                        settingsVersion: payload.settingsVersion
+                                      damagedComponents: payload.damagedComponents
+                                   unrepairedComponents: payload.unrepairedComponents
+                                     integrityCheckDate: integrityCheckDate
+                                          publishedDate: [NSDate dateWithTimeIntervalSinceReferenceDate: payload.publishedDate]];
+}
+
+@end
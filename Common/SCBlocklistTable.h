@@ -0,0 +1,45 @@
+//
+//  SCBlocklistTable.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// An immutable, de-duplicated list of blocklist entries, stored as a string table that can be
+// memory-mapped straight from disk. SCSettings keeps the active blocklist in one of these
+// (see +[SCSettings securedBlocklistFilePath]) and only stores its hash and count itself,
+// so syncing settings costs the same however long the list is.
+//
+// The file is a header (magic, format version, entry count, string bytes and the content hash),
+// then count + 1 offsets into the strings, then the entry indexes in bytewise order (so
+// containsEntry: can binary search), then the strings themselves, each followed by a newline.
+// Loading a file checks all of that, hash included, before anything reads from it.
+@interface SCBlocklistTable : NSObject
+
+@property (readonly) NSUInteger count;
+// lowercase hex SHA-256 of the entries, each followed by a newline - the same digest as
+// +[SCBlockState digestOfBlocklist:] for the de-duplicated list
+@property (readonly) NSString* contentHash;
+// every entry, in the order they were added (built the first time you ask)
+@property (readonly) NSArray<NSString*>* entries;
+
++ (instancetype)emptyTable;
+// drops duplicates (keeping the first one), anything that isn't a string, and any entry with a newline in it
++ (instancetype)tableWithEntries:(NSArray<NSString*>*)entries;
+// memory-maps the file. nil if it's missing or isn't a valid table
++ (nullable instancetype)tableWithContentsOfFile:(NSString*)path error:(NSError**)error;
+
+// Atomically replaces whatever's at path
+- (BOOL)writeToFile:(NSString*)path error:(NSError**)error;
+
+- (NSString*)entryAtIndex:(NSUInteger)index;
+- (BOOL)containsEntry:(NSString*)entry;
+- (void)enumerateEntriesUsingBlock:(void(NS_NOESCAPE ^)(NSString* entry, NSUInteger idx, BOOL* stop))block;
+
+@end
+
+NS_ASSUME_NONNULL_END
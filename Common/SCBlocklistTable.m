@@ -0,0 +1,242 @@
+//
+//  SCBlocklistTable.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCBlocklistTable.h"
+#import <CommonCrypto/CommonCrypto.h>
+
+static uint32_t const kBlocklistTableMagic = 0x53434254; // "SCBT"
+static uint32_t const kBlocklistTableFormatVersion = 1;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t formatVersion;
+    uint32_t count;
+    uint32_t stringsLength;
+    uint8_t contentHash[CC_SHA256_DIGEST_LENGTH];
+} SCBlocklistTableHeader;
+
+static NSError* SCPOSIXError(int code, NSString* path) {
+    return [NSError errorWithDomain: NSPOSIXErrorDomain code: code userInfo: @{ NSFilePathErrorKey: path }];
+}
+
+// orders entries by their UTF-8 bytes, shorter first when one is a prefix of the other
+static int SCCompareEntryBytes(const char* a, size_t aLength, const char* b, size_t bLength) {
+    int result = memcmp(a, b, MIN(aLength, bLength));
+    if (result == 0) result = (aLength > bLength) - (aLength < bLength);
+    return result;
+}
+
+static NSString* SCHexString(const uint8_t* bytes, size_t length) {
+    NSMutableString* hex = [NSMutableString stringWithCapacity: length * 2];
+    for (size_t i = 0; i < length; i++) {
+        [hex appendFormat: @"%02x", bytes[i]];
+    }
+    return hex;
+}
+
+@implementation SCBlocklistTable {
+    // either mapped from a file or built in memory; everything below points into it
+    NSData* _data;
+    const uint32_t* _offsets;
+    const uint32_t* _sortedIndexes;
+    const char* _strings;
+    NSArray<NSString*>* _entries;
+}
+
++ (instancetype)emptyTable {
+    static SCBlocklistTable* emptyTable = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        emptyTable = [SCBlocklistTable tableWithEntries: @[]];
+    });
+    return emptyTable;
+}
+
++ (instancetype)tableWithEntries:(NSArray<NSString*>*)entries {
+    NSMutableArray<NSData*>* entryData = [NSMutableArray arrayWithCapacity: entries.count];
+    NSMutableSet<NSString*>* seen = [NSMutableSet setWithCapacity: entries.count];
+    NSUInteger stringsLength = 0;
+    for (NSString* entry in entries) {
+        // the list can come straight out of a plist (or over XPC), so it may not be all strings
+        if (![entry isKindOfClass: [NSString class]]) {
+            NSLog(@"WARNING: Dropping blocklist entry that isn't a string: %@", entry);
+            continue;
+        }
+        if ([seen containsObject: entry]) continue;
+        if ([entry rangeOfString: @"\n"].location != NSNotFound) {
+            NSLog(@"WARNING: Dropping blocklist entry with a newline in it: %@", entry);
+            continue;
+        }
+        NSData* data = [entry dataUsingEncoding: NSUTF8StringEncoding];
+        if (data == nil) continue;
+        [seen addObject: entry];
+        [entryData addObject: data];
+        stringsLength += data.length + 1;
+    }
+
+    uint32_t count = (uint32_t)entryData.count;
+    NSMutableData* strings = [NSMutableData dataWithCapacity: stringsLength];
+    NSMutableData* offsets = [NSMutableData dataWithLength: (count + 1) * sizeof(uint32_t)];
+    uint32_t* offsetValues = offsets.mutableBytes;
+    for (uint32_t i = 0; i < count; i++) {
+        offsetValues[i] = (uint32_t)strings.length;
+        [strings appendData: entryData[i]];
+        [strings appendBytes: "\n" length: 1];
+    }
+    offsetValues[count] = (uint32_t)strings.length;
+
+    NSMutableArray<NSNumber*>* order = [NSMutableArray arrayWithCapacity: count];
+    for (uint32_t i = 0; i < count; i++) [order addObject: @(i)];
+    [order sortUsingComparator:^NSComparisonResult(NSNumber* a, NSNumber* b) {
+        NSData* aData = entryData[a.unsignedIntValue];
+        NSData* bData = entryData[b.unsignedIntValue];
+        int result = SCCompareEntryBytes(aData.bytes, aData.length, bData.bytes, bData.length);
+        return (result < 0) ? NSOrderedAscending : (result > 0 ? NSOrderedDescending : NSOrderedSame);
+    }];
+
+    SCBlocklistTableHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kBlocklistTableMagic;
+    header.formatVersion = kBlocklistTableFormatVersion;
+    header.count = count;
+    header.stringsLength = (uint32_t)strings.length;
+    CC_SHA256(strings.bytes, (CC_LONG)strings.length, header.contentHash);
+
+    NSMutableData* data = [NSMutableData dataWithCapacity: sizeof(header) + offsets.length + count * sizeof(uint32_t) + strings.length];
+    [data appendBytes: &header length: sizeof(header)];
+    [data appendData: offsets];
+    for (NSNumber* index in order) {
+        uint32_t value = index.unsignedIntValue;
+        [data appendBytes: &value length: sizeof(value)];
+    }
+    [data appendData: strings];
+
+    SCBlocklistTable* table = [[SCBlocklistTable alloc] initWithValidatedData: data];
+    // nothing was dropped, so we can hand back the same list without rebuilding it
+    if (count == entries.count) table->_entries = [entries copy];
+    return table;
+}
+
++ (nullable instancetype)tableWithContentsOfFile:(NSString*)path error:(NSError**)error {
+    NSData* data = [NSData dataWithContentsOfFile: path options: NSDataReadingMappedAlways error: error];
+    if (data == nil) return nil;
+
+    if (![SCBlocklistTable dataIsValidTable: data]) {
+        NSLog(@"WARNING: %@ isn't a valid blocklist table", path);
+        if (error != NULL) *error = SCPOSIXError(EINVAL, path);
+        return nil;
+    }
+    return [[SCBlocklistTable alloc] initWithValidatedData: data];
+}
+
++ (BOOL)dataIsValidTable:(NSData*)data {
+    if (data.length < sizeof(SCBlocklistTableHeader)) return NO;
+    const SCBlocklistTableHeader* header = data.bytes;
+    if (header->magic != kBlocklistTableMagic || header->formatVersion != kBlocklistTableFormatVersion) return NO;
+
+    unsigned long long count = header->count;
+    unsigned long long expectedLength = sizeof(SCBlocklistTableHeader) + (2 * count + 1) * sizeof(uint32_t) + header->stringsLength;
+    if (data.length != expectedLength) return NO;
+
+    const uint32_t* offsets = (const uint32_t*)(header + 1);
+    const uint32_t* sortedIndexes = offsets + count + 1;
+    const char* strings = (const char*)(sortedIndexes + count);
+    if (offsets[0] != 0 || offsets[count] != header->stringsLength) return NO;
+    for (unsigned long long i = 0; i < count; i++) {
+        if (offsets[i + 1] <= offsets[i] || strings[offsets[i + 1] - 1] != '\n') return NO;
+        if (sortedIndexes[i] >= count) return NO;
+    }
+    // the hash only covers the strings, so check the index lookups rely on ourselves: strictly
+    // ascending means no index shows up twice, which makes it a permutation of all the entries
+    for (unsigned long long i = 1; i < count; i++) {
+        uint32_t previous = sortedIndexes[i - 1], current = sortedIndexes[i];
+        if (SCCompareEntryBytes(strings + offsets[previous], offsets[previous + 1] - offsets[previous] - 1,
+                                strings + offsets[current], offsets[current + 1] - offsets[current] - 1) >= 0) {
+            return NO;
+        }
+    }
+
+    uint8_t hash[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(strings, header->stringsLength, hash);
+    return memcmp(hash, header->contentHash, sizeof(hash)) == 0;
+}
+
+// data must have passed dataIsValidTable: (or been built by tableWithEntries:)
+- (instancetype)initWithValidatedData:(NSData*)data {
+    if (self = [super init]) {
+        _data = data;
+        const SCBlocklistTableHeader* header = data.bytes;
+        _count = header->count;
+        _contentHash = SCHexString(header->contentHash, sizeof(header->contentHash));
+        _offsets = (const uint32_t*)(header + 1);
+        _sortedIndexes = _offsets + _count + 1;
+        _strings = (const char*)(_sortedIndexes + _count);
+    }
+    return self;
+}
+
+- (BOOL)writeToFile:(NSString*)path error:(NSError**)error {
+    if (![_data writeToFile: path options: NSDataWritingAtomic error: error]) return NO;
+
+    // readable by the app and CLI, like the settings
+    return [[NSFileManager defaultManager] setAttributes: @{ NSFilePosixPermissions: [NSNumber numberWithShort: 0644] }
+                                            ofItemAtPath: path
+                                                   error: error];
+}
+
+- (NSString*)entryAtIndex:(NSUInteger)index {
+    NSParameterAssert(index < self.count);
+    NSString* entry = [[NSString alloc] initWithBytes: _strings + _offsets[index]
+                                               length: _offsets[index + 1] - _offsets[index] - 1
+                                             encoding: NSUTF8StringEncoding];
+    // only if someone wrote the file by hand - the hash doesn't care whether it's valid UTF-8
+    return entry ?: @"";
+}
+
+- (NSArray<NSString*>*)entries {
+    @synchronized (self) {
+        if (_entries == nil) {
+            NSMutableArray* entries = [NSMutableArray arrayWithCapacity: self.count];
+            for (NSUInteger i = 0; i < self.count; i++) {
+                [entries addObject: [self entryAtIndex: i]];
+            }
+            _entries = [entries copy];
+        }
+        return _entries;
+    }
+}
+
+- (BOOL)containsEntry:(NSString*)entry {
+    const char* bytes = entry.UTF8String;
+    if (bytes == NULL) return NO;
+    size_t length = strlen(bytes);
+
+    NSUInteger low = 0, high = self.count;
+    while (low < high) {
+        NSUInteger mid = low + (high - low) / 2;
+        uint32_t index = _sortedIndexes[mid];
+        size_t midLength = _offsets[index + 1] - _offsets[index] - 1;
+        int result = SCCompareEntryBytes(_strings + _offsets[index], midLength, bytes, length);
+
+        if (result == 0) return YES;
+        if (result < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NO;
+}
+
+- (void)enumerateEntriesUsingBlock:(void(NS_NOESCAPE ^)(NSString* entry, NSUInteger idx, BOOL* stop))block {
+    BOOL stop = NO;
+    for (NSUInteger i = 0; i < self.count && !stop; i++) {
+        block([self entryAtIndex: i], i, &stop);
+    }
+}
+
+@end
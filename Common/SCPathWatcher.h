@@ -0,0 +1,49 @@
+//
+//  SCPathWatcher.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+#import "SCPathWatcherBackend.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef void (^SCPathWatcherHandler)(NSString* path);
+
+// Watches any number of files, each with its own handler. Changes are coalesced per
+// path: the first change to a file starts a `latency`-long window, and the file's handler
+// runs once at the end of it, however many changes came in meanwhile (and regardless of
+// what's happening to the other files).
+// Files that don't exist yet are fine, as long as their directory does.
+@interface SCPathWatcher : NSObject
+
+// seconds from a file's first change until its handler runs. Defaults to 1.0
+@property (nonatomic) NSTimeInterval latency;
+@property (readonly) BOOL isWatching;
+
+// The backend for the platform we're built for, i.e. FSEvents on macOS
++ (nullable id<SCPathWatcherBackend>)platformBackend;
+
+// Uses the platform backend, and runs handlers on the main queue
+- (instancetype)init;
+// Handlers run on handlerQueue
+- (instancetype)initWithBackend:(id<SCPathWatcherBackend>)backend handlerQueue:(dispatch_queue_t)handlerQueue NS_DESIGNATED_INITIALIZER;
+
+// Adds (or replaces) the handler for a path. If we're already watching, the new path is picked up right away.
+- (void)watchPath:(NSString*)path handler:(SCPathWatcherHandler)handler;
+- (void)unwatchPath:(NSString*)path;
+
+- (BOOL)startWatchingWithError:(NSError**)error;
+- (void)stopWatching;
+
+// Feeds changes in as if the backend had reported them (paths that aren't watched are ignored)
+- (void)pathsChanged:(NSArray<NSString*>*)paths;
+
+// EventCount (raw changes to watched paths), DispatchCount (handler runs), WatchedPathCount
+- (NSDictionary<NSString*, id>*)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,195 @@
+//
+//  SCPathWatcher.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCPathWatcher.h"
+
+@interface SCPathWatcher () {
+    id<SCPathWatcherBackend> _backend;
+    dispatch_queue_t _handlerQueue;
+    // everything below is only touched on _queue
+    dispatch_queue_t _queue;
+    NSMutableDictionary<NSString*, SCPathWatcherHandler>* _handlers;
+    NSMutableSet<NSString*>* _pendingPaths;
+    NSArray<NSString*>* _watchedDirectories;
+    BOOL _watching;
+    // bumped on every stop, so coalescing windows from before then don't fire
+    NSUInteger _generation;
+    NSUInteger _eventCount;
+    NSUInteger _dispatchCount;
+}
+
+@end
+
+@implementation SCPathWatcher
+
++ (nullable id<SCPathWatcherBackend>)platformBackend {
+#if __APPLE__
+    return [SCFSEventsPathWatcherBackend new];
+#elif __linux__
+    return [SCInotifyPathWatcherBackend new];
+#else
+    return nil;
+#endif
+}
+
+- (instancetype)init {
+    return [self initWithBackend: [SCPathWatcher platformBackend] handlerQueue: dispatch_get_main_queue()];
+}
+
+- (instancetype)initWithBackend:(id<SCPathWatcherBackend>)backend handlerQueue:(dispatch_queue_t)handlerQueue {
+    if (self = [super init]) {
+        _backend = backend;
+        _handlerQueue = handlerQueue;
+        _queue = dispatch_queue_create("org.eyebeam.SCPathWatcher", DISPATCH_QUEUE_SERIAL);
+        _handlers = [NSMutableDictionary dictionary];
+        _pendingPaths = [NSMutableSet set];
+        _latency = 1.0;
+    }
+    return self;
+}
+
+- (BOOL)isWatching {
+    __block BOOL watching;
+    dispatch_sync(_queue, ^{
+        watching = self->_watching;
+    });
+    return watching;
+}
+
+- (void)watchPath:(NSString*)path handler:(SCPathWatcherHandler)handler {
+    NSString* standardPath = [path stringByStandardizingPath];
+    dispatch_sync(_queue, ^{
+        self->_handlers[standardPath] = [handler copy];
+        if (self->_watching) [self restartBackendIfNeeded];
+    });
+}
+
+- (void)unwatchPath:(NSString*)path {
+    NSString* standardPath = [path stringByStandardizingPath];
+    dispatch_sync(_queue, ^{
+        [self->_handlers removeObjectForKey: standardPath];
+        [self->_pendingPaths removeObject: standardPath];
+        if (self->_watching) [self restartBackendIfNeeded];
+    });
+}
+
+- (BOOL)startWatchingWithError:(NSError**)error {
+    __block BOOL success;
+    __block NSError* startErr = nil;
+    dispatch_sync(_queue, ^{
+        self->_watching = YES;
+        success = [self restartBackendIfNeededWithError: &startErr];
+        if (!success) self->_watching = NO;
+    });
+    if (error != NULL) *error = startErr;
+    return success;
+}
+
+- (void)stopWatching {
+    dispatch_sync(_queue, ^{
+        [self->_backend stopWatching];
+        self->_watching = NO;
+        self->_watchedDirectories = nil;
+        [self->_pendingPaths removeAllObjects];
+        self->_generation++;
+    });
+}
+
+- (void)pathsChanged:(NSArray<NSString*>*)paths {
+    dispatch_async(_queue, ^{
+        [self handleChangedPaths: paths];
+    });
+}
+
+- (NSDictionary<NSString*, id>*)statistics {
+    __block NSDictionary* statistics;
+    dispatch_sync(_queue, ^{
+        statistics = @{
+            @"EventCount": @(self->_eventCount),
+            @"DispatchCount": @(self->_dispatchCount),
+            @"WatchedPathCount": @(self->_handlers.count),
+            @"IsWatching": @(self->_watching)
+        };
+    });
+    return statistics;
+}
+
+#pragma mark - Internal (all on _queue)
+
+- (void)restartBackendIfNeeded {
+    NSError* err = nil;
+    if (![self restartBackendIfNeededWithError: &err]) {
+        NSLog(@"WARNING: SCPathWatcher failed to watch %@ with error %@", _handlers.allKeys, err);
+    }
+}
+
+- (BOOL)restartBackendIfNeededWithError:(NSError**)error {
+    NSMutableSet<NSString*>* directorySet = [NSMutableSet setWithCapacity: _handlers.count];
+    for (NSString* path in _handlers) {
+        [directorySet addObject: [path stringByDeletingLastPathComponent]];
+    }
+    NSArray<NSString*>* directories = [directorySet.allObjects sortedArrayUsingSelector: @selector(compare:)];
+    if ([directories isEqualToArray: _watchedDirectories]) return YES;
+
+    [_backend stopWatching];
+    _watchedDirectories = nil;
+    if (directories.count == 0) return YES;
+
+    __weak SCPathWatcher* weakSelf = self;
+    BOOL started = [_backend startWatchingDirectories: directories queue: _queue handler:^(NSArray<NSString*>* changedPaths) {
+        [weakSelf handleChangedPaths: changedPaths];
+    } error: error];
+    if (started) _watchedDirectories = directories;
+    return started;
+}
+
+// the watched path this event path refers to, if any
+- (nullable NSString*)watchedPathForEventPath:(NSString*)eventPath {
+    NSString* standardPath = [eventPath stringByStandardizingPath];
+    if (_handlers[standardPath] != nil) return standardPath;
+
+    // FSEvents reports /etc as /private/etc, and standardizing only strips that
+    // off if the file still exists - which it won't if someone just deleted it
+    if ([standardPath hasPrefix: @"/private/"]) {
+        NSString* publicPath = [standardPath substringFromIndex: [@"/private" length]];
+        if (_handlers[publicPath] != nil) return publicPath;
+    }
+
+    return nil;
+}
+
+- (void)handleChangedPaths:(NSArray<NSString*>*)changedPaths {
+    if (!_watching) return;
+
+    for (NSString* changedPath in changedPaths) {
+        NSString* path = [self watchedPathForEventPath: changedPath];
+        if (path == nil) continue;
+
+        _eventCount++;
+        if ([_pendingPaths containsObject: path]) continue;
+
+        [_pendingPaths addObject: path];
+        NSUInteger generation = _generation;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.latency * NSEC_PER_SEC)), _queue, ^{
+            if (generation != self->_generation || ![self->_pendingPaths containsObject: path]) return;
+            [self->_pendingPaths removeObject: path];
+
+            SCPathWatcherHandler handler = self->_handlers[path];
+            if (handler == nil) return;
+            self->_dispatchCount++;
+            dispatch_async(self->_handlerQueue, ^{
+                handler(path);
+            });
+        });
+    }
+}
+
+- (void)dealloc {
+    [_backend stopWatching];
+}
+
+@end
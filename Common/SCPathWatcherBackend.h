@@ -0,0 +1,43 @@
+//
+//  SCPathWatcherBackend.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Called with the full paths of anything that changed in a watched directory
+// (which may well include files nobody asked about - the caller filters)
+typedef void (^SCPathWatcherBackendHandler)(NSArray<NSString*>* changedPaths);
+
+// The platform-specific half of SCPathWatcher: reports raw changes to the contents of a
+// set of directories. We watch directories rather than the files themselves, because
+// most things (including us) replace files atomically with a rename.
+@protocol SCPathWatcherBackend <NSObject>
+
+- (BOOL)startWatchingDirectories:(NSArray<NSString*>*)directories
+                           queue:(dispatch_queue_t)queue
+                         handler:(SCPathWatcherBackendHandler)handler
+                           error:(NSError**)error;
+- (void)stopWatching;
+
+@end
+
+#if __APPLE__
+// FSEvents, with file-level events. Ignores changes made by this process,
+// so our own repairs don't come back around as tampering.
+@interface SCFSEventsPathWatcherBackend : NSObject <SCPathWatcherBackend>
+@end
+#endif
+
+#if __linux__
+// inotify, so the watcher and everything built on it can be exercised on Linux.
+// Unlike FSEvents it can't tell our own writes apart, so handlers must be idempotent.
+@interface SCInotifyPathWatcherBackend : NSObject <SCPathWatcherBackend>
+@end
+#endif
+
+NS_ASSUME_NONNULL_END
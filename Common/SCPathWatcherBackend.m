@@ -0,0 +1,193 @@
+//
+//  SCPathWatcherBackend.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCPathWatcherBackend.h"
+
+#if __APPLE__
+#include <CoreServices/CoreServices.h>
+#endif
+
+#if __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#if __APPLE__
+
+@interface SCFSEventsPathWatcherBackend () {
+    FSEventStreamRef _eventStream;
+    SCPathWatcherBackendHandler _handler;
+}
+
+@end
+
+@implementation SCFSEventsPathWatcherBackend
+
+static void SCFSEventsPathWatcherCallback(
+    ConstFSEventStreamRef streamRef,
+    void *callbackCtxInfo,
+    size_t numEvents,
+    void *eventPaths, // CFArrayRef
+    const FSEventStreamEventFlags eventFlags[],
+    const FSEventStreamEventId eventIds[])
+{
+    SCFSEventsPathWatcherBackend* backend = (__bridge SCFSEventsPathWatcherBackend*)callbackCtxInfo;
+    if (backend->_handler != nil) {
+        backend->_handler((__bridge NSArray*)eventPaths);
+    }
+}
+
+- (BOOL)startWatchingDirectories:(NSArray<NSString*>*)directories queue:(dispatch_queue_t)queue handler:(SCPathWatcherBackendHandler)handler error:(NSError**)error {
+    [self stopWatching];
+    _handler = handler;
+
+    FSEventStreamContext callbackCtx;
+    callbackCtx.version = 0;
+    callbackCtx.info = (__bridge void *)self;
+    callbackCtx.retain = NULL;
+    callbackCtx.release = NULL;
+    callbackCtx.copyDescription = NULL;
+
+    // SCPathWatcher does its own (per-path) coalescing, so we want events as they come
+    FSEventStreamRef eventStream = FSEventStreamCreate(
+        kCFAllocatorDefault,
+        &SCFSEventsPathWatcherCallback,
+        &callbackCtx,
+        (__bridge CFArrayRef)directories,
+        kFSEventStreamEventIdSinceNow,
+        0.0,
+        kFSEventStreamCreateFlagUseCFTypes | kFSEventStreamCreateFlagNoDefer | kFSEventStreamCreateFlagMarkSelf | kFSEventStreamCreateFlagIgnoreSelf | kFSEventStreamCreateFlagFileEvents
+    );
+    if (eventStream == NULL) {
+        if (error != NULL) *error = [NSError errorWithDomain: NSPOSIXErrorDomain code: EINVAL userInfo: @{ NSFilePathErrorKey: directories.firstObject ?: @"" }];
+        return NO;
+    }
+
+    FSEventStreamSetDispatchQueue(eventStream, queue);
+    if (!FSEventStreamStart(eventStream)) {
+        FSEventStreamInvalidate(eventStream);
+        FSEventStreamRelease(eventStream);
+        if (error != NULL) *error = [NSError errorWithDomain: NSPOSIXErrorDomain code: EIO userInfo: @{ NSFilePathErrorKey: directories.firstObject ?: @"" }];
+        return NO;
+    }
+
+    _eventStream = eventStream;
+    return YES;
+}
+
+- (void)stopWatching {
+    if (_eventStream == NULL) return;
+
+    FSEventStreamStop(_eventStream);
+    FSEventStreamInvalidate(_eventStream);
+    FSEventStreamRelease(_eventStream);
+    _eventStream = NULL;
+    _handler = nil;
+}
+
+- (void)dealloc {
+    [self stopWatching];
+}
+
+@end
+
+#endif
+
+#if __linux__
+
+static uint32_t const kSCInotifyEventMask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+@interface SCInotifyPathWatcherBackend () {
+    dispatch_source_t _readSource;
+    // watch descriptor -> the directory it's watching
+    NSMutableDictionary<NSNumber*, NSString*>* _watchedDirectories;
+}
+
+@end
+
+@implementation SCInotifyPathWatcherBackend
+
+- (BOOL)startWatchingDirectories:(NSArray<NSString*>*)directories queue:(dispatch_queue_t)queue handler:(SCPathWatcherBackendHandler)handler error:(NSError**)error {
+    [self stopWatching];
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        if (error != NULL) *error = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: nil];
+        return NO;
+    }
+
+    NSMutableDictionary<NSNumber*, NSString*>* watchedDirectories = [NSMutableDictionary dictionaryWithCapacity: directories.count];
+    for (NSString* directory in directories) {
+        int wd = inotify_add_watch(fd, directory.fileSystemRepresentation, kSCInotifyEventMask);
+        if (wd < 0) {
+            int watchErrno = errno;
+            close(fd);
+            if (error != NULL) *error = [NSError errorWithDomain: NSPOSIXErrorDomain code: watchErrno userInfo: @{ NSFilePathErrorKey: directory }];
+            return NO;
+        }
+        watchedDirectories[@(wd)] = directory;
+    }
+    _watchedDirectories = watchedDirectories;
+
+    dispatch_source_t readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, queue);
+    dispatch_source_set_event_handler(readSource, ^{
+        NSArray<NSString*>* changedPaths = [SCInotifyPathWatcherBackend readChangedPathsFromDescriptor: fd watchedDirectories: watchedDirectories];
+        if (changedPaths.count > 0) handler(changedPaths);
+    });
+    dispatch_source_set_cancel_handler(readSource, ^{
+        close(fd);
+    });
+    dispatch_resume(readSource);
+    _readSource = readSource;
+
+    return YES;
+}
+
++ (NSArray<NSString*>*)readChangedPathsFromDescriptor:(int)fd watchedDirectories:(NSDictionary<NSNumber*, NSString*>*)watchedDirectories {
+    NSMutableOrderedSet<NSString*>* changedPaths = [NSMutableOrderedSet orderedSet];
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (YES) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0) break;
+
+        for (char* ptr = buffer; ptr < buffer + length; ) {
+            const struct inotify_event* event = (const struct inotify_event*)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            NSString* directory = watchedDirectories[@(event->wd)];
+            if (directory == nil) continue;
+
+            if (event->len > 0) {
+                NSString* name = [[NSFileManager defaultManager] stringWithFileSystemRepresentation: event->name length: strlen(event->name)];
+                [changedPaths addObject: [directory stringByAppendingPathComponent: name]];
+            } else {
+                // the directory itself went away or moved
+                [changedPaths addObject: directory];
+            }
+        }
+    }
+
+    return changedPaths.array;
+}
+
+- (void)stopWatching {
+    if (_readSource == nil) return;
+
+    dispatch_source_cancel(_readSource);
+    _readSource = nil;
+    _watchedDirectories = nil;
+}
+
+- (void)dealloc {
+    [self stopWatching];
+}
+
+@end
+
+#endif
@@ -6,29 +6,49 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "SCBlocklistTable.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 @interface SCSettings : NSObject
 
 @property (readonly) uid_t userId;
+// An immutable snapshot of every setting (defaults included). Later changes don't affect it,
+// so it's the way to read several settings that have to agree with each other
 @property (readonly) NSDictionary* dictionaryRepresentation;
 @property (nonatomic, getter=isReadOnly) BOOL readOnly;
+// The active blocklist. Settings only hold its hash and count (ActiveBlocklistHash and
+// ActiveBlocklistCount): setting ActiveBlocklist stores a new table at securedBlocklistFilePath
+// and points them at it, and valueForKey: @"ActiveBlocklist" returns this table's entries
+@property (readonly) SCBlocklistTable* activeBlocklistTable;
 
 @property (class, nonatomic, readonly) NSString* settingsFileName;
 @property (class, nonatomic, readonly) NSString* securedSettingsFilePath;
+// changes since the last full write of securedSettingsFilePath (see SCSettingsJournal)
+@property (class, nonatomic, readonly) NSString* securedSettingsJournalPath;
+// the active blocklist, which is kept out of the settings themselves (see activeBlocklistTable)
+@property (class, nonatomic, readonly) NSString* securedBlocklistFilePath;
 
 + (instancetype)sharedSettings;
 
 - (void)reloadSettings;
 - (void)writeSettingsWithCompletion:(nullable void(^)(NSError* _Nullable))completionBlock;
 - (void)writeSettings;
+// For when the settings files are changed from outside: picks up anything newer on disk, and
+// rewrites everything if what's on disk is gone or older than what we have in memory
+- (void)restoreSettingsOnDisk;
 - (void)synchronizeSettingsWithCompletion:(nullable void(^)(NSError* _Nullable))completionBlock;
 - (void)synchronizeSettings;
 - (NSError*)syncSettingsAndWait:(NSInteger)timeoutSecs;
 
 - (void)setValue:(id)value forKey:(NSString*)key stopPropagation:(BOOL)stopPropagation;
 - (void)setValue:(nullable id)value forKey:(NSString*)key;
+// Applies every setValue: made inside the block as one update: the settings version only goes up once,
+// the changes are written to disk together, and other processes get one notification listing all of them.
+// Nobody else can change settings until the block returns, and other threads see all the changes
+// appear at once when it does. Batches can be nested (the outermost one wins).
+// Returns the error from writing the changes out, if any.
+- (nullable NSError*)performBatchUpdates:(void(NS_NOESCAPE ^)(SCSettings* settings))updates;
 
 - (id)valueForKey:(NSString*)key;
 - (BOOL)boolForKey:(NSString*)key;
@@ -6,6 +6,9 @@
 //
 
 #import "SCSettings.h"
+#import "SCSpanRecorder.h"
+#import "SCSettingsJournal.h"
+#import "SCBlocklistTable.h"
 #import <AppKit/AppKit.h>
 
 #ifndef TESTING
@@ -19,10 +22,29 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
 @interface SCSettings ()
 
 // Private vars
+// the master copy of the settings, which is only ever touched while synchronized on self
 @property (readonly) NSMutableDictionary* settingsDict;
+// an immutable copy of settingsDict with the defaults filled in, replaced after every change.
+// Readers just grab whichever one is current, so they never wait on the lock above
+@property (atomic, strong, nullable) NSDictionary* snapshot;
+@property (readonly) NSDictionary* defaultSettings;
 @property NSDate* lastSynchronizedWithDisk;
 @property dispatch_source_t syncTimer;
 @property dispatch_source_t debouncedChangeTimer;
+@property (readonly) SCSettingsJournal* journal;
+// the last blocklist table we stored or loaded. activeBlocklistTable hands it out
+// for as long as ActiveBlocklistHash still matches it
+@property (atomic, strong, nullable) SCBlocklistTable* blocklistTable;
+// the hash of the last blocklist file we refused (so we only report it once)
+@property (atomic, copy, nullable) NSString* rejectedBlocklistHash;
+// keys changed since we last wrote to disk, so a sync only has to journal those
+@property (readonly) NSMutableSet<NSString*>* unsyncedKeys;
+// while performBatchUpdates: is running: how deep we are, and what's changed so far (NSNull for removals)
+@property NSUInteger batchDepth;
+@property (nullable) NSMutableDictionary<NSString*, id>* batchChanges;
+@property BOOL batchShouldPropagate;
+// the thread running the batch, which gets to see its changes before they're published
+@property (atomic, nullable) NSThread* batchThread;
 
 @end
 
@@ -45,6 +67,9 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
         _readOnly = (geteuid() != 0);
         
         _settingsDict = nil;
+        _defaultSettings = [self defaultSettingsDict];
+        _journal = [[SCSettingsJournal alloc] initWithSnapshotPath: SCSettings.securedSettingsFilePath];
+        _unsyncedKeys = [NSMutableSet set];
         
         [[NSDistributedNotificationCenter defaultCenter] addObserver: self
                                                             selector: @selector(onSettingChanged:)
@@ -75,12 +100,20 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
 
     return filePath;
 }
++ (NSString*)securedSettingsJournalPath {
+    return [SCSettings.securedSettingsFilePath stringByAppendingString: @".journal"];
+}
++ (NSString*)securedBlocklistFilePath {
+    return [SCSettings.securedSettingsFilePath stringByAppendingString: @".blocklist"];
+}
 
 // NOTE: there should be a default setting for each valid setting, even if it's nil/zero/etc
 - (NSDictionary*)defaultSettingsDict {
     return @{
         @"BlockEndDate": [NSDate distantPast],
-        @"ActiveBlocklist": @[],
+        // the list itself lives in its own file (see activeBlocklistTable)
+        @"ActiveBlocklistHash": [SCBlocklistTable emptyTable].contentHash,
+        @"ActiveBlocklistCount": @0,
         @"ActiveBlockAsWhitelist": @NO,
 
         @"BlockIsRunning": @NO, // tells us whether a block is actually running on the system (to the best of our knowledge)
@@ -90,6 +123,10 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
         // the user sets these in defaults, then when a block is started they're copied over to settings
         @"EvaluateCommonSubdomains": @YES,
         @"IncludeLinkedDomains": @YES,
+        @"CompactHostsFile": @NO,
+        @"DNSSinkholeEnabled": @NO,
+        // the last real nameservers the sinkhole saw, for once the system's DNS points at it
+        @"DNSSinkholeUpstreams": @[],
         @"BlockSoundShouldPlay": @NO,
         @"BlockSound": @5,
         @"ClearCaches": @YES,
@@ -107,7 +144,8 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
         @synchronized (self) {
-            self->_settingsDict = [NSMutableDictionary dictionaryWithContentsOfFile: SCSettings.securedSettingsFilePath];
+            self->_settingsDict = [[self.journal readSettings] mutableCopy];
+            [self moveInlineBlocklistOutOfSettings];
             
             BOOL isTest = [[NSUserDefaults standardUserDefaults] boolForKey: @"isTest"];
             if (isTest) NSLog(@"Ignoring settings on disk because we're unit-testing");
@@ -117,6 +155,8 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
             // also if we're running tests, just use the default dict
             if (self->_settingsDict == nil || isTest) {
                 self->_settingsDict = [[self defaultSettingsDict] mutableCopy];
+                // nothing on disk to build on, so the first write has to be a full snapshot
+                [self.unsyncedKeys removeAllObjects];
                 
                 // write out our brand-new settings to disk!
                 if (!self.readOnly) {
@@ -125,6 +165,8 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
                 [SCSentry addBreadcrumb: @"Initialized SCSettings to default settings" category: @"settings"];
             }
             
+            [self publishSnapshot];
+
             // we're now current with disk!
             self->lastSynchronizedWithDisk = [NSDate date];
 
@@ -141,22 +183,133 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
 }
 
 - (NSDictionary*)dictionaryRepresentation {
-    NSMutableDictionary* dictCopy = [self.settingsDict mutableCopy];
-    
-    // fill in any gaps with default values (like we did if they called valueForKey:)
-    for (NSString* key in [[self defaultSettingsDict] allKeys]) {
-        if (dictCopy[key] == nil) {
-            dictCopy[key] = [self defaultSettingsDict][key];
+    return [self currentSnapshot];
+}
+
+- (NSDictionary*)currentSnapshot {
+    NSDictionary* snapshot = self.snapshot;
+    if (snapshot == nil) {
+        [self initializeSettingsDict];
+        snapshot = self.snapshot;
+    }
+    return snapshot;
+}
+
+// swaps in a new snapshot to match settingsDict (must be called while synchronized on self)
+- (void)publishSnapshot {
+    NSMutableDictionary* snapshot = [self.defaultSettings mutableCopy];
+    [snapshot addEntriesFromDictionary: _settingsDict];
+    self.snapshot = [snapshot copy];
+}
+
+// settings written by older versions have the whole blocklist in them. Move it out into
+// a table like we'd have stored it, and if we're the writer, drop it from the files at our
+// next write (must be called while synchronized on self)
+- (void)moveInlineBlocklistOutOfSettings {
+    id inlineBlocklist = _settingsDict[@"ActiveBlocklist"];
+    if (inlineBlocklist == nil) return;
+
+    SCBlocklistTable* table = [inlineBlocklist isKindOfClass: [NSArray class]] ? [SCBlocklistTable tableWithEntries: inlineBlocklist] : [SCBlocklistTable emptyTable];
+    [_settingsDict removeObjectForKey: @"ActiveBlocklist"];
+    _settingsDict[@"ActiveBlocklistHash"] = table.contentHash;
+    _settingsDict[@"ActiveBlocklistCount"] = @(table.count);
+    self.blocklistTable = table;
+
+    if (!self.readOnly) {
+        [self storeBlocklistTable: table];
+        [self.unsyncedKeys addObjectsFromArray: @[@"ActiveBlocklist", @"ActiveBlocklistHash", @"ActiveBlocklistCount"]];
+    }
+}
+
+- (SCBlocklistTable*)activeBlocklistTable {
+    NSString* hash = [self valueForKey: @"ActiveBlocklistHash"];
+    SCBlocklistTable* table = self.blocklistTable;
+    if ([table.contentHash isEqualToString: hash]) return table;
+    if ([hash isEqualToString: [SCBlocklistTable emptyTable].contentHash]) return [SCBlocklistTable emptyTable];
+
+    // somebody else stored it (or we've restarted since we did), so map it in from disk
+    NSError* loadErr = nil;
+    table = [SCBlocklistTable tableWithContentsOfFile: SCSettings.securedBlocklistFilePath error: &loadErr];
+    if (table == nil) {
+        NSLog(@"WARNING: Couldn't load the active blocklist (%@) with error %@", hash, loadErr);
+        return [SCBlocklistTable emptyTable];
+    }
+
+    if (![table.contentHash isEqualToString: hash]) {
+        if (!self.readOnly) {
+            // we're the only one who writes the file, and we always write it before the settings
+            // that point at it - so if it doesn't match, somebody else put it there. Treat it like
+            // an unreadable list (and if we still had the real one, restoreBlocklistOnDisk would
+            // have put it back already)
+            if (![self.rejectedBlocklistHash isEqualToString: table.contentHash]) {
+                self.rejectedBlocklistHash = table.contentHash;
+                NSLog(@"WARNING: Active blocklist on disk (%@) doesn't match settings (%@), ignoring it", table.contentHash, hash);
+                [SCSentry captureMessage: @"Blocklist on disk doesn't match settings! Ignoring it, tampering suspected..."];
+            }
+            return [SCBlocklistTable emptyTable];
         }
+        // the writer puts the file down before the settings that point at it, so it's a
+        // list our settings will hear about any moment now. Better to use that than nothing
     }
+    self.blocklistTable = table;
+    return table;
+}
+
+- (void)setActiveBlocklist:(nullable NSArray<NSString*>*)blocklist stopPropagation:(BOOL)stopPropagation {
+    SCBlocklistTable* table = [blocklist isKindOfClass: [NSArray class]] ? [SCBlocklistTable tableWithEntries: blocklist] : [SCBlocklistTable emptyTable];
 
-    return dictCopy;
+    @synchronized (self) {
+        // store the list before the settings point at it, so nobody goes looking before it's there
+        if (!self.readOnly) {
+            [self storeBlocklistTable: table];
+        }
+        self.blocklistTable = table;
+
+        [self performBatchUpdates:^(SCSettings* settings) {
+            [settings setValue: table.contentHash forKey: @"ActiveBlocklistHash" stopPropagation: stopPropagation];
+            [settings setValue: @(table.count) forKey: @"ActiveBlocklistCount" stopPropagation: stopPropagation];
+        }];
+    }
 }
 
-// both reloadSettings and writeSettings are synchronized with the same object, so
-// at any given time we are running a maximum of one of these methods, on one thread.
-// we don't want to be reading the file on one thread and writing out two different versions
-// on two other threads
+// writes the table to securedBlocklistFilePath, or removes the file if the list is empty
+- (void)storeBlocklistTable:(SCBlocklistTable*)table {
+#if TESTING
+    // no writing to disk during unit tests
+    return;
+#endif
+
+    NSString* path = SCSettings.securedBlocklistFilePath;
+    NSError* storeErr = nil;
+    if (table.count == 0) {
+        if (![[NSFileManager defaultManager] removeItemAtPath: path error: &storeErr] && [[NSFileManager defaultManager] fileExistsAtPath: path]) {
+            NSLog(@"WARNING: Failed to remove the old blocklist at %@ with error %@", path, storeErr);
+        }
+    } else if (![table writeToFile: path error: &storeErr]) {
+        NSLog(@"WARNING: Failed to store the active blocklist at %@ with error %@", path, storeErr);
+        [SCSentry captureError: storeErr];
+    }
+}
+
+// if the blocklist file's gone or changed, puts back the one we've got in memory
+// (must be called while synchronized on self)
+- (void)restoreBlocklistOnDisk {
+    SCBlocklistTable* table = self.blocklistTable;
+    if (self.readOnly || table == nil || table.count == 0 || ![table.contentHash isEqualToString: [self valueForKey: @"ActiveBlocklistHash"]]) return;
+
+    SCBlocklistTable* tableOnDisk = [SCBlocklistTable tableWithContentsOfFile: SCSettings.securedBlocklistFilePath error: nil];
+    if ([tableOnDisk.contentHash isEqualToString: table.contentHash]) return;
+
+    NSLog(@"WARNING: Blocklist on disk is missing or changed, rewriting it");
+    [SCSentry addBreadcrumb: @"Rewrote missing or changed blocklist on disk" category: @"settings"];
+    [self storeBlocklistTable: table];
+}
+
+// writeSettings and the swap at the end of a reload are synchronized with the same object,
+// so we're never writing out two different versions on two threads, or swapping in what's
+// on disk halfway through a write. Reading and parsing the files happens outside the lock
+// (SCSettingsJournal takes care of its own locking), and we decide whether to use the result
+// once we have the lock again.
 
 - (void)reloadSettings {
     // if the settings dictionary hasn't been loaded the first time, do that instead of reloading
@@ -165,9 +318,15 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
         return;
     }
 
+    // usually nothing's changed on disk since we last looked, which costs one stat to find out
+    NSDictionary* settingsFromDisk = [self.journal readSettingsIfChanged];
+    if (settingsFromDisk == nil) return;
+
+    [self adoptSettingsFromDiskIfNewer: settingsFromDisk];
+}
+
+- (void)adoptSettingsFromDiskIfNewer:(nullable NSDictionary*)settingsFromDisk {
     @synchronized (self) {
-        NSDictionary* settingsFromDisk = [NSDictionary dictionaryWithContentsOfFile: SCSettings.securedSettingsFilePath];
-        
         int diskSettingsVersion = [settingsFromDisk[@"SettingsVersionNumber"] intValue];
         int memorySettingsVersion = [[self valueForKey: @"SettingsVersionNumber"] intValue];
         NSDate* diskSettingsLastUpdated = settingsFromDisk[@"LastSettingsUpdate"];
@@ -197,6 +356,9 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
 
         if (diskMoreRecentThanMemory) {
             _settingsDict = [settingsFromDisk mutableCopy];
+            [self.unsyncedKeys removeAllObjects];
+            [self moveInlineBlocklistOutOfSettings];
+            [self publishSnapshot];
             self.lastSynchronizedWithDisk = [NSDate date];
             NSLog(@"Newer SCSettings found on disk (version %d vs %d with time interval %f), updating...", diskSettingsVersion, memorySettingsVersion, [diskSettingsLastUpdated timeIntervalSinceDate: memorySettingsLastUpdated]);
             [SCSentry addBreadcrumb: @"Updated SCSettings to newer settings found on disk" category: @"settings"];
@@ -224,18 +386,19 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
         
         // don't spend time on the main thread writing out files - it's OK for this to happen without blocking other things
         dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-            NSError* serializationErr;
-            NSData* plistData = [NSPropertyListSerialization dataWithPropertyList: self.settingsDict
-                                                                           format: NSPropertyListBinaryFormat_v1_0
-                                                                          options: kNilOptions
-                                                                            error: &serializationErr];
-                            
-            if (plistData == nil) {
-                NSLog(@"NSPropertyListSerialization error: %@", serializationErr);
-                if (completionBlock != nil) completionBlock(serializationErr);
-                return;
+            // usually we just need to journal the few keys that changed
+            if (self.unsyncedKeys.count > 0 && ![self.journal needsSnapshot]) {
+                NSError* journalErr;
+                if ([self.journal appendChangesForKeys: self.unsyncedKeys fromSettings: self.settingsDict error: &journalErr]) {
+                    [self.unsyncedKeys removeAllObjects];
+                    self.lastSynchronizedWithDisk = [NSDate date];
+                    if (completionBlock != nil) completionBlock(nil);
+                    return;
+                }
+                // fall back to rewriting the whole thing, which doesn't care what state the journal's in
+                NSLog(@"WARNING: Failed to append to settings journal with error %@, writing a full snapshot instead", journalErr);
             }
-            
+
             NSError* createDirectoryErr;
             BOOL createDirectorySuccessful = [[NSFileManager defaultManager] createDirectoryAtURL: [NSURL fileURLWithPath: SETTINGS_FILE_DIR]
                                                                       withIntermediateDirectories: YES
@@ -263,10 +426,7 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
             }
 
             NSError* writeErr;
-            BOOL writeSuccessful = [plistData writeToFile: SCSettings.securedSettingsFilePath
-                                                  options: NSDataWritingAtomic
-                                                    error: &writeErr
-                                    ];
+            BOOL writeSuccessful = [self.journal writeSnapshot: self.settingsDict error: &writeErr];
             
             NSError* chmodErr;
             BOOL chmodSuccessful = [[NSFileManager defaultManager]
@@ -279,6 +439,7 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
                                     error: &chmodErr];
 
             if (writeSuccessful) {
+                [self.unsyncedKeys removeAllObjects];
                 self.lastSynchronizedWithDisk = [NSDate date];
             }
 
@@ -297,6 +458,30 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
         });
     }
 }
+- (void)restoreSettingsOnDisk {
+    // read both files in full, since a changed snapshot doesn't show up in the journal
+    NSDictionary* settingsFromDisk = [self.journal readSettings];
+
+    @synchronized (self) {
+        // anything legitimately newer on disk wins, same as always
+        if (_settingsDict == nil) {
+            [self initializeSettingsDict];
+        } else {
+            [self adoptSettingsFromDiskIfNewer: settingsFromDisk];
+        }
+        [self restoreBlocklistOnDisk];
+
+        int diskSettingsVersion = [settingsFromDisk[@"SettingsVersionNumber"] intValue];
+        int memorySettingsVersion = [[self valueForKey: @"SettingsVersionNumber"] intValue];
+        if (settingsFromDisk != nil && diskSettingsVersion >= memorySettingsVersion) return;
+
+        NSLog(@"WARNING: Settings on disk are missing or out of date (version %d vs %d), rewriting them", diskSettingsVersion, memorySettingsVersion);
+        [SCSentry addBreadcrumb: @"Rewrote missing or outdated settings on disk" category: @"settings"];
+        // the journal can't be trusted to build on, so write out everything
+        [self.unsyncedKeys removeAllObjects];
+        [self writeSettings];
+    }
+}
 - (void)writeSettings {
     // by default, just log all errors
     [self writeSettingsWithCompletion:^(NSError * _Nullable err) {
@@ -335,6 +520,7 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
 }
 
 - (NSError*)syncSettingsAndWait:(NSInteger)timeoutSecs {
+    SCSpan* syncSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"settings.sync"];
     dispatch_semaphore_t sema = dispatch_semaphore_create(0);
     __block NSError* retErr = nil;
 
@@ -351,6 +537,7 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
     if (dispatch_semaphore_wait(sema, dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeoutSecs * (int64_t)NSEC_PER_SEC))) {
         retErr = [SCErr errorWithCode: 601];
     }
+    [syncSpan endWithAttributes: @{ @"Success": @(retErr == nil) }];
     
     return retErr;
 }
@@ -363,6 +550,12 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
         NSLog(@"WARNING: Read-only SCSettings instance can't update values (setting %@ to %@)", key, value);
         return;
     }
+
+    // the blocklist itself lives in its own file, and settings just keep track of which list it is
+    if ([key isEqualToString: @"ActiveBlocklist"]) {
+        [self setActiveBlocklist: ([value isKindOfClass: [NSArray class]] ? value : nil) stopPropagation: stopPropagation];
+        return;
+    }
     
     // we can't store nils in a dictionary
     // so we sneak around it
@@ -370,9 +563,8 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
         value = [NSNull null];
     }
     
-    // locking everything on self is kinda inefficient/unnecessary
-    // since it means we can only set one value at a time, and never when reading/writing from disk
-    // but it seems to be OK for now - we'll improve later
+    // writers take turns (and wait for reads/writes from disk), but readers don't wait on any of this:
+    // they keep using the last published snapshot until we publish the next one
     @synchronized (self) {
         // if we're about to insert NSNull anyway, may as well just unset the value
         if ([value isEqual: [NSNull null]]) {
@@ -380,28 +572,116 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
         } else {
             [self.settingsDict setValue: value forKey: key];
         }
-        
-        // record the update
-        int newVersionNumber = [[self valueForKey: @"SettingsVersionNumber"] intValue] + 1;
-        [self.settingsDict setValue: [NSNumber numberWithInt: newVersionNumber] forKey: @"SettingsVersionNumber"];
-        [self.settingsDict setValue: [NSDate date] forKey: @"LastSettingsUpdate"];
+
+        // in a batch, performBatchUpdates: records the update and tells everyone once it's done
+        if (self.batchDepth > 0) {
+            self.batchChanges[key] = value;
+            if (!stopPropagation) self.batchShouldPropagate = YES;
+            [self.unsyncedKeys addObject: key];
+            return;
+        }
+
+        [self recordUpdate];
+        [self.unsyncedKeys addObject: key];
+        [self publishSnapshot];
     }
     
     // notify other instances (presumably in other processes)
     // stopPropagation is a flag that stops one setting change from bouncing back and forth for ages
     // between two processes. It indicates that the change started in another process
     if (!stopPropagation) {
-        [[NSDistributedNotificationCenter defaultCenter] postNotificationName: @"org.eyebeam.SelfControl.SCSettingsValueChanged"
-                                                                       object: self.description
-                                                                     userInfo: @{
-                                                                                 @"key": key,
-                                                                                 @"value": value,
-                                                                                 @"versionNumber": self.settingsDict[@"SettingsVersionNumber"],
-                                                                                 @"date": [NSDate date]
-                                                                                 }
-                                                                      options: NSNotificationDeliverImmediately | NSNotificationPostToAllSessions
-         ];
+        [self postChangeNotification: @{
+            @"key": key,
+            @"value": value,
+            @"versionNumber": self.settingsDict[@"SettingsVersionNumber"],
+            @"date": [NSDate date]
+        }];
+    }
+}
+
+// bumps the version number and update date (must be called while synchronized on self)
+- (void)recordUpdate {
+    int newVersionNumber = [self.settingsDict[@"SettingsVersionNumber"] intValue] + 1;
+    [self.settingsDict setValue: [NSNumber numberWithInt: newVersionNumber] forKey: @"SettingsVersionNumber"];
+    [self.settingsDict setValue: [NSDate date] forKey: @"LastSettingsUpdate"];
+    [self.unsyncedKeys addObjectsFromArray: @[@"SettingsVersionNumber", @"LastSettingsUpdate"]];
+}
+
+- (void)postChangeNotification:(NSDictionary*)userInfo {
+    [[NSDistributedNotificationCenter defaultCenter] postNotificationName: @"org.eyebeam.SelfControl.SCSettingsValueChanged"
+                                                                   object: self.description
+                                                                 userInfo: userInfo
+                                                                  options: NSNotificationDeliverImmediately | NSNotificationPostToAllSessions
+     ];
+}
+
+- (nullable NSError*)performBatchUpdates:(void(NS_NOESCAPE ^)(SCSettings* settings))updates {
+    NSDictionary<NSString*, id>* changes;
+    BOOL shouldPropagate;
+    NSNumber* versionNumber;
+    NSDate* updateDate;
+
+    @synchronized (self) {
+        if (self.batchDepth == 0) {
+            self.batchChanges = [NSMutableDictionary dictionary];
+            self.batchShouldPropagate = NO;
+            self.batchThread = [NSThread currentThread];
+        }
+        self.batchDepth++;
+        @try {
+            updates(self);
+        } @finally {
+            self.batchDepth--;
+            if (self.batchDepth == 0) self.batchThread = nil;
+        }
+
+        // nested batches just fold into the outermost one
+        if (self.batchDepth > 0) return nil;
+
+        changes = self.batchChanges;
+        shouldPropagate = self.batchShouldPropagate;
+        self.batchChanges = nil;
+        if (changes.count == 0) return nil;
+
+        // everyone else sees the whole batch at once
+        [self recordUpdate];
+        [self publishSnapshot];
+        versionNumber = self.settingsDict[@"SettingsVersionNumber"];
+        updateDate = self.settingsDict[@"LastSettingsUpdate"];
     }
+
+    // changes mirrored from another process were already written by whoever made them
+    if (!shouldPropagate) return nil;
+
+    SCSpan* batchSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"settings.batch" attributes: @{ @"KeyCount": @(changes.count) }];
+    // write first, so anyone who goes to disk after hearing about the changes finds them there
+    __block NSError* writeErr = nil;
+    [self writeSettingsWithCompletion:^(NSError* _Nullable err) {
+        writeErr = err;
+    }];
+    if (writeErr != nil) {
+        NSLog(@"Error writing batched SCSettings changes: %@", writeErr);
+    }
+
+    // distributed notifications can only carry plist types, so removals are listed separately
+    NSMutableDictionary* setValues = [NSMutableDictionary dictionaryWithCapacity: changes.count];
+    NSMutableArray* removedKeys = [NSMutableArray array];
+    for (NSString* key in changes) {
+        if ([changes[key] isEqual: [NSNull null]]) {
+            [removedKeys addObject: key];
+        } else {
+            setValues[key] = changes[key];
+        }
+    }
+    [self postChangeNotification: @{
+        @"changes": setValues,
+        @"removedKeys": removedKeys,
+        @"versionNumber": versionNumber,
+        @"date": updateDate
+    }];
+    [batchSpan endWithAttributes: @{ @"Success": @(writeErr == nil) }];
+
+    return writeErr;
 }
 
 - (void)setValue:(id)value forKey:(NSString*)key {
@@ -409,19 +689,18 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
 }
 
 - (id)valueForKey:(NSString*)key {
-    id value = [self.settingsDict valueForKey: key];
-    
-    // when we get an NSNull we have to unwrap it and remember that means nil
-    if ([value isEqual: [NSNull null]]) {
-        value = nil;
+    if ([key isEqualToString: @"ActiveBlocklist"]) {
+        return [self activeBlocklistTable].entries;
     }
-    
-    // if we don't have a value in our dictionary but we do have a default value, use that instead!
-    if (value == nil && [self defaultSettingsDict][key] != nil) {
-        value = [self defaultSettingsDict][key];
+
+    // in the middle of a batch, the thread making the changes (and holding the lock) reads them directly
+    if (self.batchThread == [NSThread currentThread]) {
+        id value = self.settingsDict[key];
+        return (value != nil) ? value : self.defaultSettings[key];
     }
 
-    return value;
+    // everyone else: no locking, and the defaults are already filled in
+    return [self currentSnapshot][key];
 }
 - (BOOL)boolForKey:(NSString*)key {
     return [[self valueForKey: key] boolValue];
@@ -459,22 +738,15 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
 - (void)updateSentryContext {
     // make sure Sentry has the latest context in the event of a crash
     
-    NSMutableDictionary* dictCopy = [self.settingsDict mutableCopy];
+    // (the snapshot already has the default values filled in)
+    NSMutableDictionary* dictCopy = [[self currentSnapshot] mutableCopy];
     
-    // fill in any gaps with default values (like we did if they called valueForKey:)
-    for (NSString* key in [[self defaultSettingsDict] allKeys]) {
-        if (dictCopy[key] == nil) {
-            dictCopy[key] = [self defaultSettingsDict][key];
-        }
-    }
-    
-    // eliminate privacy-sensitive data (i.e. blocklist)
+    // eliminate privacy-sensitive data (i.e. blocklist, and its hash, which could be used to guess it)
     // but store the blocklist length as a useful piece of debug info
-    id activeBlocklist = dictCopy[@"ActiveBlocklist"];
-    NSUInteger blocklistLength = (activeBlocklist == nil) ? 0 : ((NSArray*)activeBlocklist).count;
-    [dictCopy setObject: @(blocklistLength) forKey: @"ActiveBlocklistLength"];
+    [dictCopy setObject: dictCopy[@"ActiveBlocklistCount"] ?: @0 forKey: @"ActiveBlocklistLength"];
+    [dictCopy removeObjectForKey: @"ActiveBlocklistCount"];
+    [dictCopy removeObjectForKey: @"ActiveBlocklistHash"];
     [dictCopy removeObjectForKey: @"Blocklist"];
-    [dictCopy removeObjectForKey: @"ActiveBlocklist"];
 
     // and serialize dates to string, since Sentry has a hard time with that
     NSArray<NSString*>* dateKeys = @[@"BlockEndDate", @"LastSettingsUpdate"];
@@ -500,7 +772,10 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
         return;
     }
     
-    if (note.userInfo[@"key"] == nil) {
+    NSDictionary* changes = note.userInfo[@"changes"];
+    NSArray* removedKeys = note.userInfo[@"removedKeys"];
+    BOOL isBatch = ([changes isKindOfClass: [NSDictionary class]] && [removedKeys isKindOfClass: [NSArray class]]);
+    if (note.userInfo[@"key"] == nil && !isBatch) {
         // something's wrong - we don't have a key to set
         return;
     }
@@ -522,6 +797,18 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
 
     if (!noteMoreRecentThanSettings) {
         NSLog(@"Ignoring setting change notification as %@ is older than %@", noteSettingUpdated, ourSettingsLastUpdated);
+    } else if (isBatch) {
+        NSLog(@"Accepting propagated batch of changes (%@ set, %@ removed) since version %d is newer than %d and/or %@ is newer than %@", changes.allKeys, removedKeys, noteVersionNumber, ourSettingsVersionNumber, noteSettingUpdated, ourSettingsLastUpdated);
+
+        // mirror the whole batch as one update of our own, again without propagating it
+        [self performBatchUpdates:^(SCSettings* settings) {
+            for (NSString* key in changes) {
+                [settings setValue: changes[key] forKey: key stopPropagation: YES];
+            }
+            for (NSString* key in removedKeys) {
+                [settings setValue: [NSNull null] forKey: key stopPropagation: YES];
+            }
+        }];
     } else {
         NSLog(@"Accepting propagated change (%@ --> %@) since version %d is newer than %d and/or %@ is newer than %@", note.userInfo[@"key"], note.userInfo[@"value"], noteVersionNumber, ourSettingsVersionNumber, noteSettingUpdated, ourSettingsLastUpdated);
         
@@ -549,14 +836,18 @@ NSString* const SETTINGS_FILE_DIR = @"/usr/local/etc/";
     // we _basically_ just copy the default settings dict in,
     // except we leave the settings version number and last settings update
     // intact - that helps keep us in sync with any other instances
-    NSDictionary* defaultSettings = [self defaultSettingsDict];
-    for (NSString* key in defaultSettings) {
-        if ([key isEqualToString: @"SettingsVersionNumber"] || [key isEqualToString: @"LastSettingsUpdate"]) {
-            continue;
+    NSDictionary* defaultSettings = self.defaultSettings;
+    [self performBatchUpdates:^(SCSettings* settings) {
+        for (NSString* key in defaultSettings) {
+            if ([key isEqualToString: @"SettingsVersionNumber"] || [key isEqualToString: @"LastSettingsUpdate"]) {
+                continue;
+            }
+            
+            [settings setValue: defaultSettings[key] forKey: key];
         }
-        
-        [self setValue: defaultSettings[key] forKey: key];
-    }
+        // which also clears out the blocklist file
+        [settings setValue: nil forKey: @"ActiveBlocklist"];
+    }];
 }
 
 - (void)dealloc {
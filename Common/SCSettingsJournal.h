@@ -0,0 +1,62 @@
+//
+//  SCSettingsJournal.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// On-disk storage for SCSettings: a binary plist snapshot (the same file SCSettings has
+// always written), plus an append-only journal of changes since that snapshot. Writing
+// a change only appends the keys that changed, so syncing costs about as much as the
+// change itself instead of a rewrite of every setting (blocklist and all).
+// Once the journal gets big enough it's compacted back into the snapshot.
+//
+// Each journal record is a length, a CRC32, and a binary plist of the changed keys.
+// A record that's cut short or doesn't check out (i.e. we crashed mid-write) ends the
+// journal: everything before it is kept, and the next append overwrites it.
+// The journal starts with a header holding the SHA-256 of its snapshot, and it's only replayed
+// over the snapshot with that digest. A journal left over from an older snapshot (i.e. we
+// crashed between writing a snapshot and starting its journal) is ignored, as is a journal from
+// before there were headers if the snapshot's newer than it - either way the next sync writes a
+// fresh snapshot (see needsSnapshot) rather than appending to it. Every write goes
+// through the journal (a new snapshot comes with a new journal), so readSettingsIfChanged
+// can tell nothing's changed from one stat of the journal, and when only records were
+// added it can replay them over the snapshot it parsed last time instead of parsing it again.
+@interface SCSettingsJournal : NSObject
+
+@property (readonly) NSString* snapshotPath;
+// snapshotPath with ".journal" on the end
+@property (readonly) NSString* journalPath;
+// the journal gets compacted once it's bigger than this many bytes. Defaults to 256KB
+@property unsigned long long compactionThreshold;
+
+- (instancetype)initWithSnapshotPath:(NSString*)snapshotPath;
+
+// The snapshot with the journal replayed over it, or nil if there's no (readable) snapshot.
+// Always reads both files, so it notices a snapshot that was changed behind our back
+- (nullable NSDictionary*)readSettings;
+// Same as readSettings, but returns nil without reading anything if the journal is exactly
+// as we last read or wrote it. Relies on the journal header to skip re-parsing the snapshot
+- (nullable NSDictionary*)readSettingsIfChanged;
+
+// StatCount, UnchangedCount (readSettingsIfChanged calls that stopped at the stat) and SnapshotParseCount
+@property (readonly) NSDictionary<NSString*, NSNumber*>* statistics;
+
+// Appends one record with the current values of the given keys (a key that's
+// missing from settings is recorded as removed)
+- (BOOL)appendChangesForKeys:(NSSet<NSString*>*)keys fromSettings:(NSDictionary*)settings error:(NSError**)error;
+
+// Atomically replaces the snapshot with the given settings, then starts a new (empty) journal for it
+- (BOOL)writeSnapshot:(NSDictionary*)settings error:(NSError**)error;
+
+// YES if there's no snapshot to append to, the journal's due for compaction, or the last
+// read found a journal that doesn't belong to the snapshot
+- (BOOL)needsSnapshot;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,398 @@
+//
+//  SCSettingsJournal.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCSettingsJournal.h"
+#import <CommonCrypto/CommonCrypto.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// length + CRC32, both little-endian
+static size_t const kRecordHeaderLength = 8;
+static unsigned long long const kUnknownLength = ULLONG_MAX;
+
+// the journal starts with a magic number and the SHA-256 of the snapshot it goes with.
+// (journals from before there was a header just start with records)
+static uint8_t const kJournalMagic[4] = { 'S', 'C', 'J', '1' };
+static size_t const kJournalHeaderLength = sizeof(kJournalMagic) + CC_SHA256_DIGEST_LENGTH;
+
+// what a file looked like the last time we read it. If it still looks like that, it hasn't changed
+typedef struct {
+    BOOL exists;
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+} SCFileSignature;
+
+static BOOL SCFileSignaturesEqual(SCFileSignature a, SCFileSignature b) {
+    if (a.exists != b.exists) return NO;
+    if (!a.exists) return YES;
+    return a.device == b.device && a.inode == b.inode && a.size == b.size
+        && a.modified.tv_sec == b.modified.tv_sec && a.modified.tv_nsec == b.modified.tv_nsec;
+}
+
+static SCFileSignature SCFileSignatureFromStat(const struct stat* fileStat) {
+    SCFileSignature signature = { .exists = YES, .device = fileStat->st_dev, .inode = fileStat->st_ino, .size = fileStat->st_size };
+#if __APPLE__
+    signature.modified = fileStat->st_mtimespec;
+#else
+    signature.modified = fileStat->st_mtim;
+#endif
+    return signature;
+}
+
+static NSData* SCSHA256(NSData* data) {
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(data.bytes, (CC_LONG)data.length, digest);
+    return [NSData dataWithBytes: digest length: sizeof(digest)];
+}
+
+static uint32_t SCCRC32(const uint8_t* bytes, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void SCWriteUInt32(uint8_t* buffer, uint32_t value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = (value >> 8) & 0xFF;
+    buffer[2] = (value >> 16) & 0xFF;
+    buffer[3] = (value >> 24) & 0xFF;
+}
+static uint32_t SCReadUInt32(const uint8_t* buffer) {
+    return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+static NSError* SCPOSIXError(int code, NSString* path) {
+    return [NSError errorWithDomain: NSPOSIXErrorDomain code: code userInfo: @{ NSFilePathErrorKey: path }];
+}
+
+@implementation SCSettingsJournal {
+    // everything below is guarded by @synchronized (self)
+
+    // how much of the journal on disk is made of good records (as of when we last looked)
+    unsigned long long _validLength;
+
+    // the journal as of when we last read or wrote it, so an unchanged journal costs one stat
+    SCFileSignature _journalSignature;
+    BOOL _journalSignatureKnown;
+    // the last snapshot we parsed and its digest, so a journal that's only grown doesn't mean
+    // parsing the whole snapshot (blocklist and all) again
+    NSDictionary* _cachedSnapshot;
+    NSData* _cachedSnapshotDigest;
+    // the last read found a journal left over from some other snapshot, so it mustn't be appended to
+    BOOL _journalIsStale;
+
+    NSUInteger _statCount;
+    NSUInteger _unchangedCount;
+    NSUInteger _snapshotParseCount;
+}
+
+- (instancetype)initWithSnapshotPath:(NSString*)snapshotPath {
+    if (self = [super init]) {
+        _snapshotPath = [snapshotPath copy];
+        _journalPath = [snapshotPath stringByAppendingString: @".journal"];
+        _compactionThreshold = 256 * 1024;
+        _validLength = kUnknownLength;
+    }
+    return self;
+}
+
+#pragma mark - Reading
+
+- (nullable NSDictionary*)readSettings {
+    @synchronized (self) {
+        return [self readSettingsTrustingCache: NO];
+    }
+}
+
+- (nullable NSDictionary*)readSettingsIfChanged {
+    @synchronized (self) {
+        _statCount++;
+        struct stat journalStat;
+        SCFileSignature signature = { .exists = NO };
+        if (stat(self.journalPath.fileSystemRepresentation, &journalStat) == 0) {
+            signature = SCFileSignatureFromStat(&journalStat);
+        }
+        if (_journalSignatureKnown && SCFileSignaturesEqual(signature, _journalSignature)) {
+            _unchangedCount++;
+            return nil;
+        }
+
+        return [self readSettingsTrustingCache: YES];
+    }
+}
+
+- (NSDictionary<NSString*, NSNumber*>*)statistics {
+    @synchronized (self) {
+        return @{
+            @"StatCount": @(_statCount),
+            @"UnchangedCount": @(_unchangedCount),
+            @"SnapshotParseCount": @(_snapshotParseCount)
+        };
+    }
+}
+
+// if trustCache is set and the journal header says the snapshot is the one we parsed last time,
+// we skip reading it and just replay the journal over our copy
+- (nullable NSDictionary*)readSettingsTrustingCache:(BOOL)trustCache {
+    // look at the journal first: if it changes after this, we want the next check to notice
+    int fd = open(self.journalPath.fileSystemRepresentation, O_RDONLY | O_CLOEXEC);
+    NSData* journal = nil;
+    SCFileSignature signature = { .exists = NO };
+    if (fd >= 0) {
+        struct stat journalStat;
+        if (fstat(fd, &journalStat) == 0) signature = SCFileSignatureFromStat(&journalStat);
+        journal = [[[NSFileHandle alloc] initWithFileDescriptor: fd closeOnDealloc: NO] readDataToEndOfFile];
+        close(fd);
+    }
+
+    NSData* headerDigest = nil;
+    NSUInteger recordsOffset = [SCSettingsJournal recordsOffsetInJournal: journal snapshotDigest: &headerDigest];
+
+    NSMutableDictionary* settings;
+    BOOL journalMatchesSnapshot;
+    if (trustCache && _cachedSnapshot != nil && headerDigest != nil && [headerDigest isEqualToData: _cachedSnapshotDigest]) {
+        settings = [_cachedSnapshot mutableCopy];
+        journalMatchesSnapshot = YES;
+    } else {
+        struct stat snapshotStat;
+        BOOL snapshotStatted = (stat(self.snapshotPath.fileSystemRepresentation, &snapshotStat) == 0);
+        NSData* snapshotData = [NSData dataWithContentsOfFile: self.snapshotPath];
+        NSDictionary* snapshot = (snapshotData == nil) ? nil : [NSPropertyListSerialization propertyListWithData: snapshotData
+                                                                                                         options: NSPropertyListImmutable
+                                                                                                          format: NULL
+                                                                                                           error: NULL];
+        _snapshotParseCount++;
+        if (![snapshot isKindOfClass: [NSDictionary class]]) {
+            _cachedSnapshot = nil;
+            _cachedSnapshotDigest = nil;
+            _journalSignatureKnown = NO;
+            return nil;
+        }
+        _cachedSnapshot = snapshot;
+        _cachedSnapshotDigest = SCSHA256(snapshotData);
+        settings = [snapshot mutableCopy];
+
+        if (headerDigest != nil) {
+            journalMatchesSnapshot = [headerDigest isEqualToData: _cachedSnapshotDigest];
+        } else if (journal.length == 0) {
+            journalMatchesSnapshot = YES;
+        } else {
+            // an old headerless journal can't tell us which snapshot it's for, so it only counts
+            // if it was written after the snapshot
+            journalMatchesSnapshot = !snapshotStatted || !signature.exists
+                || ![SCSettingsJournal timespec: signature.modified isEarlierThan: SCFileSignatureFromStat(&snapshotStat).modified];
+        }
+    }
+
+    _journalIsStale = !journalMatchesSnapshot;
+    if (journalMatchesSnapshot) {
+        NSUInteger replayedCount = 0;
+        _validLength = [SCSettingsJournal replayJournal: journal fromOffset: recordsOffset onto: settings recordCount: &replayedCount];
+        if (journal != nil && _validLength < journal.length) {
+            NSLog(@"WARNING: Settings journal has a damaged record after %lu good ones, ignoring the rest of it", (unsigned long)replayedCount);
+        }
+    } else {
+        NSLog(@"WARNING: Settings journal doesn't belong to the settings snapshot, ignoring it");
+        _validLength = kUnknownLength;
+    }
+
+    _journalSignature = signature;
+    _journalSignatureKnown = YES;
+
+    return settings;
+}
+
++ (BOOL)timespec:(struct timespec)a isEarlierThan:(struct timespec)b {
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+// where the records start (after the header, if there is one), and the snapshot digest from the header
++ (NSUInteger)recordsOffsetInJournal:(nullable NSData*)journal snapshotDigest:(NSData* _Nullable * _Nullable)snapshotDigest {
+    if (journal.length < kJournalHeaderLength || memcmp(journal.bytes, kJournalMagic, sizeof(kJournalMagic)) != 0) {
+        if (snapshotDigest != NULL) *snapshotDigest = nil;
+        return 0;
+    }
+    if (snapshotDigest != NULL) *snapshotDigest = [journal subdataWithRange: NSMakeRange(sizeof(kJournalMagic), CC_SHA256_DIGEST_LENGTH)];
+    return kJournalHeaderLength;
+}
+
+// applies each good record in the journal to settings (if given), and returns where the good records end
++ (unsigned long long)replayJournal:(nullable NSData*)journal fromOffset:(NSUInteger)startOffset onto:(nullable NSMutableDictionary*)settings recordCount:(nullable NSUInteger*)recordCount {
+    const uint8_t* bytes = journal.bytes;
+    NSUInteger length = journal.length;
+    NSUInteger offset = MIN(startOffset, length);
+    NSUInteger count = 0;
+
+    while (length - offset >= kRecordHeaderLength) {
+        uint32_t payloadLength = SCReadUInt32(bytes + offset);
+        uint32_t expectedCRC = SCReadUInt32(bytes + offset + 4);
+        if (payloadLength > length - offset - kRecordHeaderLength) break;
+
+        const uint8_t* payload = bytes + offset + kRecordHeaderLength;
+        if (SCCRC32(payload, payloadLength) != expectedCRC) break;
+
+        NSDictionary* record = [NSPropertyListSerialization propertyListWithData: [NSData dataWithBytesNoCopy: (void*)payload length: payloadLength freeWhenDone: NO]
+                                                                         options: NSPropertyListImmutable
+                                                                          format: NULL
+                                                                           error: NULL];
+        if (![record isKindOfClass: [NSDictionary class]]) break;
+
+        if (settings != nil) {
+            NSDictionary* changed = record[@"Set"];
+            NSArray* removed = record[@"Removed"];
+            if ([changed isKindOfClass: [NSDictionary class]]) [settings addEntriesFromDictionary: changed];
+            if ([removed isKindOfClass: [NSArray class]]) [settings removeObjectsForKeys: removed];
+        }
+
+        offset += kRecordHeaderLength + payloadLength;
+        count++;
+    }
+
+    if (recordCount != NULL) *recordCount = count;
+    return offset;
+}
+
+#pragma mark - Writing
+
+- (BOOL)appendChangesForKeys:(NSSet<NSString*>*)keys fromSettings:(NSDictionary*)settings error:(NSError**)error {
+    @synchronized (self) {
+        return [self lockedAppendChangesForKeys: keys fromSettings: settings error: error];
+    }
+}
+
+- (BOOL)lockedAppendChangesForKeys:(NSSet<NSString*>*)keys fromSettings:(NSDictionary*)settings error:(NSError**)error {
+    NSMutableDictionary* changed = [NSMutableDictionary dictionaryWithCapacity: keys.count];
+    NSMutableArray* removed = [NSMutableArray array];
+    for (NSString* key in keys) {
+        id value = settings[key];
+        if (value == nil || [value isEqual: [NSNull null]]) {
+            [removed addObject: key];
+        } else {
+            changed[key] = value;
+        }
+    }
+
+    NSData* payload = [NSPropertyListSerialization dataWithPropertyList: @{ @"Set": changed, @"Removed": removed }
+                                                                 format: NSPropertyListBinaryFormat_v1_0
+                                                                options: kNilOptions
+                                                                  error: error];
+    if (payload == nil) return NO;
+
+    NSMutableData* record = [NSMutableData dataWithLength: kRecordHeaderLength];
+    SCWriteUInt32(record.mutableBytes, (uint32_t)payload.length);
+    SCWriteUInt32((uint8_t*)record.mutableBytes + 4, SCCRC32(payload.bytes, payload.length));
+    [record appendData: payload];
+
+    int fd = open(self.journalPath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_CLOEXEC, 0755);
+    if (fd < 0) {
+        if (error != NULL) *error = SCPOSIXError(errno, self.journalPath);
+        return NO;
+    }
+
+    struct stat journalStat;
+    if (fstat(fd, &journalStat) != 0) {
+        int statErrno = errno;
+        close(fd);
+        if (error != NULL) *error = SCPOSIXError(statErrno, self.journalPath);
+        return NO;
+    }
+
+    // if the file isn't the way we left it, find where the good records end again,
+    // so we don't append after a half-written one
+    unsigned long long fileLength = (unsigned long long)journalStat.st_size;
+    if (_validLength == kUnknownLength || _validLength != fileLength) {
+        NSData* journal = [NSData dataWithContentsOfFile: self.journalPath];
+        NSUInteger recordsOffset = [SCSettingsJournal recordsOffsetInJournal: journal snapshotDigest: NULL];
+        _validLength = [SCSettingsJournal replayJournal: journal fromOffset: recordsOffset onto: nil recordCount: NULL];
+    }
+    if (fileLength != _validLength && ftruncate(fd, (off_t)_validLength) != 0) {
+        int truncateErrno = errno;
+        close(fd);
+        if (error != NULL) *error = SCPOSIXError(truncateErrno, self.journalPath);
+        return NO;
+    }
+
+    BOOL success = (pwrite(fd, record.bytes, record.length, (off_t)_validLength) == (ssize_t)record.length) && (fsync(fd) == 0);
+    int writeErrno = errno;
+    // we already know what's in our own record, so it doesn't count as a change for readSettingsIfChanged
+    // (unless someone else had changed the journal since we last read it)
+    BOOL hadCurrentJournal = _journalSignatureKnown && _journalSignature.exists && SCFileSignaturesEqual(SCFileSignatureFromStat(&journalStat), _journalSignature);
+    if (success && hadCurrentJournal && fstat(fd, &journalStat) == 0) {
+        _journalSignature = SCFileSignatureFromStat(&journalStat);
+    } else {
+        _journalSignatureKnown = NO;
+    }
+    close(fd);
+    if (!success) {
+        // whatever made it out will get dropped as a damaged record
+        _validLength = kUnknownLength;
+        if (error != NULL) *error = SCPOSIXError(writeErrno, self.journalPath);
+        return NO;
+    }
+
+    _validLength += record.length;
+    return YES;
+}
+
+- (BOOL)writeSnapshot:(NSDictionary*)settings error:(NSError**)error {
+    @synchronized (self) {
+        NSData* plistData = [NSPropertyListSerialization dataWithPropertyList: settings
+                                                                       format: NSPropertyListBinaryFormat_v1_0
+                                                                      options: kNilOptions
+                                                                        error: error];
+        if (plistData == nil) return NO;
+
+        _journalSignatureKnown = NO;
+        if (![plistData writeToFile: self.snapshotPath options: NSDataWritingAtomic error: error]) {
+            return NO;
+        }
+
+        // the snapshot has everything now, so start a fresh journal for it. If we don't make it
+        // this far, the old journal's header won't match the new snapshot, so it won't be replayed
+        NSData* snapshotDigest = SCSHA256(plistData);
+        NSMutableData* header = [NSMutableData dataWithBytes: kJournalMagic length: sizeof(kJournalMagic)];
+        [header appendData: snapshotDigest];
+        // (replaced rather than truncated, so it's a new file that readers can't mistake for the old one)
+        if (![header writeToFile: self.journalPath options: NSDataWritingAtomic error: error]) {
+            _validLength = kUnknownLength;
+            return NO;
+        }
+        _validLength = kJournalHeaderLength;
+        _journalIsStale = NO;
+
+        // readers parse the new snapshot the first time they see the new journal
+        _cachedSnapshot = nil;
+        _cachedSnapshotDigest = nil;
+        struct stat journalStat;
+        if (stat(self.journalPath.fileSystemRepresentation, &journalStat) == 0) {
+            _journalSignature = SCFileSignatureFromStat(&journalStat);
+            _journalSignatureKnown = YES;
+        }
+
+        return YES;
+    }
+}
+
+- (BOOL)needsSnapshot {
+    @synchronized (self) {
+        if (_journalIsStale) return YES;
+    }
+    struct stat fileStat;
+    if (stat(self.snapshotPath.fileSystemRepresentation, &fileStat) != 0) return YES;
+    if (stat(self.journalPath.fileSystemRepresentation, &fileStat) != 0) return NO;
+    return (unsigned long long)fileStat.st_size >= self.compactionThreshold + kJournalHeaderLength;
+}
+
+@end
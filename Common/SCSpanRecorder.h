@@ -0,0 +1,79 @@
+//
+//  SCSpanRecorder.h
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SCSpanRecorder;
+
+// One timed phase of a block operation (i.e. "pf.anchor.write" during startBlock).
+// Get one from -[SCSpanRecorder startSpan:], and call end once the phase is done;
+// it only shows up in the recorder after that.
+@interface SCSpan : NSObject
+
+@property (readonly) NSString* name;
+// the operation that was running when the span started (nil if there wasn't one)
+@property (readonly, nullable) NSString* operation;
+@property (readonly) NSUInteger operationID;
+@property (readonly) NSDate* startDate;
+// 0 until the span has ended
+@property (readonly) NSTimeInterval duration;
+@property (readonly) NSDictionary<NSString*, id>* attributes;
+
+- (void)setAttribute:(nullable id)value forKey:(NSString*)key;
+// ending a span more than once does nothing
+- (void)end;
+- (void)endWithAttributes:(nullable NSDictionary<NSString*, id>*)attributes;
+
+// { Name, Operation, OperationID, StartDate, DurationSecs, Attributes } - all plist types, so it can go over XPC
+- (NSDictionary<NSString*, id>*)dictionaryRepresentation;
+
+@end
+
+// SCSpanRecorder keeps the last few hundred spans in a ring buffer, so we can look back at
+// what the last few block starts/updates/removals actually spent their time on.
+// Spans are tagged with whatever operation is running when they start. Each thread has its
+// own operations, which nest (i.e. a removeBlock inside a checkup), and spans get tagged with
+// the innermost one open on the thread that starts them - so an operation has to begin and
+// end on the same thread. Work it hands off to other threads (i.e. GCD workers) only gets
+// tagged with it if it's carried over with currentOperation and performInOperation:block:.
+// Everything here is safe to call from any thread.
+@interface SCSpanRecorder : NSObject
+
++ (instancetype)sharedRecorder;
+
+@property (readonly) NSUInteger capacity;
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity;
+
+// Operations are recorded as spans of their own (named after the operation) when they end.
+// Spans that end while their operation is still open are held until the operation ends,
+// and discardOperation drops them all, for operations that turned out to be uninteresting
+// (i.e. an integrity check that found nothing to fix) and shouldn't push real ones out of the buffer.
+- (void)beginOperation:(NSString*)name;
+- (void)endOperation;
+- (void)discardOperation;
+
+// The innermost operation open on this thread (nil if there isn't one). Grab it when handing
+// work off to another thread, and run the work with performInOperation:block: over there,
+// so spans it starts are still tagged with the operation.
+- (nullable SCSpan*)currentOperation;
+- (void)performInOperation:(nullable SCSpan*)operation block:(NS_NOESCAPE dispatch_block_t)block;
+
+- (SCSpan*)startSpan:(NSString*)name;
+- (SCSpan*)startSpan:(NSString*)name attributes:(nullable NSDictionary<NSString*, id>*)attributes;
+// for phases that were timed somewhere else, i.e. totals from SCBlockWorkScheduler
+- (void)recordSpan:(NSString*)name startDate:(NSDate*)startDate duration:(NSTimeInterval)duration attributes:(nullable NSDictionary<NSString*, id>*)attributes;
+
+// dictionaryRepresentations of every span still in the buffer, oldest first
+- (NSArray<NSDictionary<NSString*, id>*>*)recentSpans;
+- (void)removeAllSpans;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,286 @@
+//
+//  SCSpanRecorder.m
+//  SelfControl
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCSpanRecorder.h"
+
+static NSUInteger const kDefaultSpanCapacity = 512;
+
+@interface SCSpanRecorder ()
+
+- (void)addSpan:(SCSpan*)span;
+
+@end
+
+@interface SCSpan () {
+    NSMutableDictionary<NSString*, id>* _attributes;
+    // systemUptime is monotonic, unlike the wall clock, so durations survive clock changes
+    NSTimeInterval _startUptime;
+    BOOL _ended;
+}
+
+@property (readwrite) NSTimeInterval duration;
+@property (nonatomic, nullable) SCSpanRecorder* recorder;
+
+- (instancetype)initWithName:(NSString*)name operation:(nullable NSString*)operation operationID:(NSUInteger)operationID attributes:(nullable NSDictionary<NSString*, id>*)attributes recorder:(nullable SCSpanRecorder*)recorder;
+- (void)setDurationForRecordedSpan:(NSTimeInterval)duration startDate:(NSDate*)startDate;
+
+@end
+
+@implementation SCSpan
+
+- (instancetype)initWithName:(NSString*)name operation:(nullable NSString*)operation operationID:(NSUInteger)operationID attributes:(nullable NSDictionary<NSString*, id>*)attributes recorder:(nullable SCSpanRecorder*)recorder {
+    if (self = [super init]) {
+        _name = [name copy];
+        _operation = [operation copy];
+        _operationID = operationID;
+        _startDate = [NSDate date];
+        _startUptime = [NSProcessInfo processInfo].systemUptime;
+        _attributes = attributes != nil ? [attributes mutableCopy] : [NSMutableDictionary dictionary];
+        _recorder = recorder;
+    }
+    return self;
+}
+
+- (NSDictionary<NSString*, id>*)attributes {
+    @synchronized (self) {
+        return [_attributes copy];
+    }
+}
+
+- (void)setAttribute:(nullable id)value forKey:(NSString*)key {
+    @synchronized (self) {
+        _attributes[key] = value;
+    }
+}
+
+- (void)end {
+    [self endWithAttributes: nil];
+}
+
+- (void)endWithAttributes:(nullable NSDictionary<NSString*, id>*)attributes {
+    SCSpanRecorder* recorder;
+    @synchronized (self) {
+        if (_ended) return;
+        _ended = YES;
+
+        self.duration = [NSProcessInfo processInfo].systemUptime - _startUptime;
+        if (attributes != nil) {
+            [_attributes addEntriesFromDictionary: attributes];
+        }
+        recorder = self.recorder;
+        self.recorder = nil;
+    }
+
+    [recorder addSpan: self];
+}
+
+- (void)setDurationForRecordedSpan:(NSTimeInterval)duration startDate:(NSDate*)startDate {
+    _ended = YES;
+    _startDate = startDate;
+    self.duration = duration;
+}
+
+- (NSDictionary<NSString*, id>*)dictionaryRepresentation {
+    NSMutableDictionary* dict = [@{
+        @"Name": self.name,
+        @"OperationID": @(self.operationID),
+        @"StartDate": self.startDate,
+        @"DurationSecs": @(self.duration),
+        @"Attributes": self.attributes
+    } mutableCopy];
+    if (self.operation != nil) {
+        dict[@"Operation"] = self.operation;
+    }
+    return dict;
+}
+
+@end
+
+@implementation SCSpanRecorder {
+    // ring buffer: once it's full, _nextIndex points at the oldest span
+    NSMutableArray<SCSpan*>* _spans;
+    NSUInteger _nextIndex;
+
+    // thread -> its open operations, innermost last
+    NSMapTable<NSThread*, NSMutableArray<SCSpan*>*>* _operationStacks;
+    NSUInteger _lastOperationID;
+    // operation ID -> spans that ended while that operation was open
+    NSMutableDictionary<NSNumber*, NSMutableArray<SCSpan*>*>* _heldSpans;
+}
+
++ (instancetype)sharedRecorder {
+    static SCSpanRecorder* recorder = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        recorder = [[SCSpanRecorder alloc] initWithCapacity: kDefaultSpanCapacity];
+    });
+    return recorder;
+}
+
+- (instancetype)init {
+    return [self initWithCapacity: kDefaultSpanCapacity];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    if (self = [super init]) {
+        _capacity = MAX(capacity, 1u);
+        _spans = [NSMutableArray arrayWithCapacity: _capacity];
+        _operationStacks = [NSMapTable weakToStrongObjectsMapTable];
+        _heldSpans = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+// must be called while synchronized on self
+- (NSMutableArray<SCSpan*>*)operationStackForCurrentThread {
+    NSThread* thread = [NSThread currentThread];
+    NSMutableArray<SCSpan*>* operationStack = [_operationStacks objectForKey: thread];
+    if (operationStack == nil) {
+        operationStack = [NSMutableArray array];
+        [_operationStacks setObject: operationStack forKey: thread];
+    }
+    return operationStack;
+}
+
+- (void)beginOperation:(NSString*)name {
+    @synchronized (self) {
+        _lastOperationID++;
+        // the operation's own span is added by hand in endOperation, after everything it held
+        SCSpan* operationSpan = [[SCSpan alloc] initWithName: name operation: name operationID: _lastOperationID attributes: nil recorder: nil];
+        [[self operationStackForCurrentThread] addObject: operationSpan];
+        _heldSpans[@(_lastOperationID)] = [NSMutableArray array];
+    }
+}
+
+- (void)endOperation {
+    [self popOperationKeepingSpans: YES];
+}
+
+- (void)discardOperation {
+    [self popOperationKeepingSpans: NO];
+}
+
+- (void)popOperationKeepingSpans:(BOOL)keepSpans {
+    @synchronized (self) {
+        NSMutableArray<SCSpan*>* operationStack = [_operationStacks objectForKey: [NSThread currentThread]];
+        SCSpan* operationSpan = operationStack.lastObject;
+        if (operationSpan == nil) {
+            NSLog(@"WARNING: SCSpanRecorder endOperation called without a matching beginOperation on this thread");
+            return;
+        }
+        [operationStack removeLastObject];
+        if (operationStack.count == 0) {
+            [_operationStacks removeObjectForKey: [NSThread currentThread]];
+        }
+        [operationSpan end];
+
+        NSNumber* operationKey = @(operationSpan.operationID);
+        NSArray<SCSpan*>* heldSpans = _heldSpans[operationKey];
+        [_heldSpans removeObjectForKey: operationKey];
+        if (!keepSpans) return;
+
+        for (SCSpan* span in heldSpans) {
+            [self addSpan: span];
+        }
+        [self addSpan: operationSpan];
+    }
+}
+
+- (SCSpan*)currentOperation {
+    @synchronized (self) {
+        return [_operationStacks objectForKey: [NSThread currentThread]].lastObject;
+    }
+}
+
+- (void)performInOperation:(SCSpan*)operation block:(NS_NOESCAPE dispatch_block_t)block {
+    if (operation == nil) {
+        block();
+        return;
+    }
+
+    // it's the same operation, just open on this thread too for a while - so it isn't begun
+    // or ended again, and whatever this thread already had open is back afterwards
+    @synchronized (self) {
+        [[self operationStackForCurrentThread] addObject: operation];
+    }
+    block();
+    @synchronized (self) {
+        NSMutableArray<SCSpan*>* operationStack = [_operationStacks objectForKey: [NSThread currentThread]];
+        if (operationStack.lastObject == operation) [operationStack removeLastObject];
+        if (operationStack.count == 0) {
+            [_operationStacks removeObjectForKey: [NSThread currentThread]];
+        }
+    }
+}
+
+- (SCSpan*)startSpan:(NSString*)name {
+    return [self startSpan: name attributes: nil];
+}
+
+- (SCSpan*)startSpan:(NSString*)name attributes:(nullable NSDictionary<NSString*, id>*)attributes {
+    @synchronized (self) {
+        SCSpan* currentOperation = [_operationStacks objectForKey: [NSThread currentThread]].lastObject;
+        return [[SCSpan alloc] initWithName: name
+                                  operation: currentOperation.operation
+                                operationID: currentOperation.operationID
+                                 attributes: attributes
+                                   recorder: self];
+    }
+}
+
+- (void)recordSpan:(NSString*)name startDate:(NSDate*)startDate duration:(NSTimeInterval)duration attributes:(nullable NSDictionary<NSString*, id>*)attributes {
+    SCSpan* span = [self startSpan: name attributes: attributes];
+    span.recorder = nil;
+    [span setDurationForRecordedSpan: duration startDate: startDate];
+    [self addSpan: span];
+}
+
+- (void)addSpan:(SCSpan*)span {
+    @synchronized (self) {
+        // once the operation is over, its stragglers go straight into the buffer
+        NSMutableArray<SCSpan*>* heldSpans = _heldSpans[@(span.operationID)];
+        if (heldSpans != nil) {
+            [heldSpans addObject: span];
+            return;
+        }
+
+        if (_spans.count < self.capacity) {
+            [_spans addObject: span];
+        } else {
+            _spans[_nextIndex] = span;
+        }
+        _nextIndex = (_nextIndex + 1) % self.capacity;
+    }
+}
+
+- (NSArray<NSDictionary<NSString*, id>*>*)recentSpans {
+    NSArray<SCSpan*>* orderedSpans;
+    @synchronized (self) {
+        if (_spans.count < self.capacity) {
+            orderedSpans = [_spans copy];
+        } else {
+            NSRange olderRange = NSMakeRange(_nextIndex, self.capacity - _nextIndex);
+            NSRange newerRange = NSMakeRange(0, _nextIndex);
+            orderedSpans = [[_spans subarrayWithRange: olderRange] arrayByAddingObjectsFromArray: [_spans subarrayWithRange: newerRange]];
+        }
+    }
+
+    NSMutableArray* dicts = [NSMutableArray arrayWithCapacity: orderedSpans.count];
+    for (SCSpan* span in orderedSpans) {
+        [dicts addObject: [span dictionaryRepresentation]];
+    }
+    return dicts;
+}
+
+- (void)removeAllSpans {
+    @synchronized (self) {
+        [_spans removeAllObjects];
+        _nextIndex = 0;
+    }
+}
+
+@end
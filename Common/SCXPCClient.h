@@ -19,6 +19,7 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)connectAndExecuteCommandBlock:(void(^)(NSError *))commandBlock;
 
 - (void)getVersion:(void(^)(NSString* version, NSError* error))reply;
+- (void)getBlockTimings:(void(^)(NSDictionary* _Nullable timings, NSError* _Nullable error))reply;
 - (void)startBlockWithControllingUID:(uid_t)controllingUID blocklist:(NSArray<NSString*>*)blocklist isAllowlist:(BOOL)isAllowlist endDate:(NSDate*)endDate blockSettings:(NSDictionary*)blockSettings reply:(void(^)(NSError* error))reply;
 - (void)updateBlocklist:(NSArray<NSString*>*)newBlocklist reply:(void(^)(NSError* error))reply;
 - (void)updateBlockEndDate:(NSDate*)newEndDate reply:(void(^)(NSError* error))reply;
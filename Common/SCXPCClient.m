@@ -285,6 +285,24 @@
     }];
 }
 
+- (void)getBlockTimings:(void(^)(NSDictionary* timings, NSError* error))reply {
+    [self connectAndExecuteCommandBlock:^(NSError * connectError) {
+        if (connectError != nil) {
+            NSLog(@"Failed to get block timings with connection error: %@", connectError);
+            [SCSentry captureError: connectError];
+            reply(nil, connectError);
+        } else {
+            [[self.daemonConnection remoteObjectProxyWithErrorHandler:^(NSError * proxyError) {
+                NSLog(@"Failed to get block timings with remote object proxy error: %@", proxyError);
+                [SCSentry captureError: proxyError];
+                reply(nil, proxyError);
+            }] getBlockTimingsWithReply:^(NSDictionary * _Nonnull timings) {
+                reply(timings, nil);
+            }];
+        }
+    }];
+}
+
 - (void)startBlockWithControllingUID:(uid_t)controllingUID blocklist:(NSArray<NSString*>*)blocklist isAllowlist:(BOOL)isAllowlist endDate:(NSDate*)endDate blockSettings:(NSDictionary*)blockSettings reply:(void(^)(NSError* error))reply {
     [self connectAndExecuteCommandBlock:^(NSError * connectError) {
         if (connectError != nil) {
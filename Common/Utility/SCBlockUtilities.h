@@ -7,10 +7,16 @@
 
 #import <Foundation/Foundation.h>
 
+@class SCBlockState;
+
 NS_ASSUME_NONNULL_BEGIN
 
 @interface SCBlockUtilities : NSObject
 
+// what the daemon last published about the block, if we're a client that should use it
+// (i.e. the app or CLI) and there's a usable one. Otherwise nil, and you should ask SCSettings
++ (nullable SCBlockState*)publishedBlockState;
+
 // uses the below methods as well as filesystem checks to see if the block is REALLY running or not
 + (BOOL)anyBlockIsRunning;
 + (BOOL)modernBlockIsRunning;
@@ -18,6 +24,10 @@ NS_ASSUME_NONNULL_BEGIN
 
 + (BOOL)currentBlockIsExpired;
 
+// nil if a block ending at currentEndDate can be changed to end at newEndDate instead,
+// or the error to give back if not (blocks can only be extended, by at most a day at a time)
++ (nullable NSError*)errorForChangingBlockEndDate:(NSDate*)currentEndDate toDate:(NSDate*)newEndDate;
+
 + (BOOL)blockRulesFoundOnSystem;
 
 + (void)removeBlockFromSettings;
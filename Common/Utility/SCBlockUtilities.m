@@ -8,6 +8,7 @@
 #import "SCBlockUtilities.h"
 #import "HostFileBlocker.h"
 #import "PacketFilter.h"
+#import "SCBlockState.h"
 
 @implementation SCBlockUtilities
 
@@ -17,7 +18,17 @@
     return blockIsRunning;
 }
 
++ (nullable SCBlockState*)publishedBlockState {
+    // the daemon (and the tests) write settings, so they always know better than what's published
+    if (![SCSettings sharedSettings].readOnly) return nil;
+
+    return [[SCBlockStateFile sharedFile] readState];
+}
+
 + (BOOL)modernBlockIsRunning {
+    SCBlockState* state = [SCBlockUtilities publishedBlockState];
+    if (state != nil) return state.blockIsRunning;
+
     SCSettings* settings = [SCSettings sharedSettings];
     
     return [settings boolForKey: @"BlockIsRunning"];
@@ -52,6 +63,9 @@
 
 // returns YES if the block should have expired active based on the specified end time (i.e. the end time is in the past), or NO otherwise
 + (BOOL)currentBlockIsExpired {
+    SCBlockState* state = [SCBlockUtilities publishedBlockState];
+    if (state != nil) return [state blockIsExpired];
+
     // the block should be running if the end date hasn't arrived yet
     SCSettings* settings = [SCSettings sharedSettings];
     if ([[settings valueForKey: @"BlockEndDate"] timeIntervalSinceNow] > 0) {
@@ -61,16 +75,31 @@
     }
 }
 
++ (NSError*)errorForChangingBlockEndDate:(NSDate*)currentEndDate toDate:(NSDate*)newEndDate {
+    // this can only be used to *extend* the block end date - not shorten it!
+    // and we also won't let them extend by more than 24 hours at a time, for safety...
+    // TODO: they should be able to extend up to MaxBlockLength minutes, right?
+    NSTimeInterval extension = [newEndDate timeIntervalSinceDate: currentEndDate];
+    if (extension < 0) {
+        return [SCErr errorWithCode: 308];
+    }
+    if (extension > 86400) { // 86400 seconds = 1 day
+        return [SCErr errorWithCode: 309];
+    }
+    return nil;
+}
+
 + (BOOL)blockRulesFoundOnSystem {
     return [PacketFilter blockFoundInPF] || [HostFileBlocker blockFoundInHostsFile];
 }
 
 + (void) removeBlockFromSettings {
-    SCSettings* settings = [SCSettings sharedSettings];
-    [settings setValue: @NO forKey: @"BlockIsRunning"];
-    [settings setValue: nil forKey: @"BlockEndDate"];
-    [settings setValue: nil forKey: @"ActiveBlocklist"];
-    [settings setValue: nil forKey: @"ActiveBlockAsWhitelist"];
+    [[SCSettings sharedSettings] performBatchUpdates:^(SCSettings* settings) {
+        [settings setValue: @NO forKey: @"BlockIsRunning"];
+        [settings setValue: nil forKey: @"BlockEndDate"];
+        [settings setValue: nil forKey: @"ActiveBlocklist"];
+        [settings setValue: nil forKey: @"ActiveBlockAsWhitelist"];
+    }];
 }
 
 @end
@@ -7,6 +7,7 @@
 
 #import "SCHelperToolUtilities.h"
 #import "BlockManager.h"
+#import "SCSpanRecorder.h"
 #import <ServiceManagement/ServiceManagement.h>
 
 @implementation SCHelperToolUtilities
@@ -21,12 +22,23 @@
     BOOL blockAsAllowlist = [settings boolForKey: @"ActiveBlockAsWhitelist"];
 
     BlockManager* blockManager = [[BlockManager alloc] initAsAllowlist: blockAsAllowlist allowLocal: allowLocalNetworks includeCommonSubdomains: shouldEvaluateCommonSubdomains includeLinkedDomains: includeLinkedDomains];
+    blockManager.compactHostsRules = [settings boolForKey: @"CompactHostsFile"];
 
     NSLog(@"About to run BlockManager commands");
     
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
+    SCSpan* prepareSpan = [recorder startSpan: @"block.prepare"];
     [blockManager prepareToAddBlock];
-    [blockManager addBlockEntriesFromStrings: [settings valueForKey: @"ActiveBlocklist"]];
+    [prepareSpan end];
+
+    NSArray<NSString*>* blocklist = [settings valueForKey: @"ActiveBlocklist"];
+    SCSpan* addSpan = [recorder startSpan: @"block.add" attributes: @{ @"BlocklistCount": @(blocklist.count) }];
+    [blockManager addBlockEntriesFromStrings: blocklist];
+    [addSpan end];
+
+    SCSpan* finalizeSpan = [recorder startSpan: @"block.finalize"];
     [blockManager finalizeBlock];
+    [finalizeSpan end];
 
 }
 
@@ -61,13 +73,18 @@
         return;
     }
     
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
+    SCSpan* browserSpan = [recorder startSpan: @"caches.clear.browser"];
     NSError* err = [SCHelperToolUtilities clearBrowserCaches];
     if (err) {
         NSLog(@"WARNING: Error clearing browser caches: %@", err);
         [SCSentry captureError: err];
     }
+    [browserSpan endWithAttributes: @{ @"Success": @(err == nil) }];
 
+    SCSpan* dnsSpan = [recorder startSpan: @"caches.clear.dns"];
     [SCHelperToolUtilities clearOSDNSCache];
+    [dnsSpan end];
 }
 
 + (NSError*)clearBrowserCaches {
@@ -146,8 +163,14 @@
 }
 
 + (void)removeBlock {
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
+    [recorder beginOperation: @"removeBlock"];
+
     [SCBlockUtilities removeBlockFromSettings];
-    [[BlockManager new] clearBlock];
+
+    SCSpan* clearSpan = [recorder startSpan: @"block.clear"];
+    BOOL cleared = [[BlockManager new] clearBlock];
+    [clearSpan endWithAttributes: @{ @"Success": @(cleared) }];
     
     [SCHelperToolUtilities clearCachesIfRequested];
 
@@ -167,6 +190,7 @@
     [SCHelperToolUtilities sendConfigurationChangedNotification];
 
     NSLog(@"INFO: Block cleared.");
+    [recorder endOperation];
 }
 
 + (void)sendConfigurationChangedNotification {
@@ -0,0 +1,65 @@
+//
+//  SCBlockRefresher.h
+//  selfcontrold
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SCDNSResolution;
+
+// Blocks can run for many hours, and sites behind CDNs move to new IPs much faster
+// than that. SCBlockRefresher re-resolves the domains in the active blocklist as their
+// DNS records expire (and whenever the network changes), and adds any addresses that
+// aren't blocked yet straight into the running pf tables.
+// Work is done a small batch at a time, so it never causes a spike in CPU or network use.
+// Only blocklists are refreshed - allowlist blocks can't be appended to.
+@interface SCBlockRefresher : NSObject
+
++ (instancetype)sharedRefresher;
+
+// max number of domains resolved in one batch, and the minimum gap between batches
+@property NSUInteger batchSize;
+@property NSTimeInterval batchSpacing;
+// DNS TTLs are clamped to this range to decide when a domain is next refreshed
+@property NSTimeInterval minimumRefreshInterval;
+@property NSTimeInterval maximumRefreshInterval;
+// refreshes may run up to this much early or late, so they can share wakeups
+// with each other and with the daemon's other scheduled work
+@property NSTimeInterval refreshTolerance;
+
+// where pf's files are (nil for the real system), and the nameservers to resolve
+// with (nil for the system's, on port 53) - so tests can point us at fakes
+@property (nullable, copy) NSString* rootPath;
+@property (nullable, copy) NSArray<NSString*>* nameservers;
+@property uint16_t nameserverPort;
+
+// held while new rules go into the live block, so we don't collide with anyone else
+// changing it. blockAppendedHandler runs (with the lock still held) after they go in
+@property (nullable, strong) NSLock* blockLock;
+@property (nullable, copy) dispatch_block_t blockAppendedHandler;
+
+@property (readonly) BOOL isRunning;
+
+// Loads the active blocklist from settings and starts refreshing it (if we're
+// already running, just reloads the blocklist). Sits idle if no (non-allowlist) block is running.
+- (void)start;
+- (void)stop;
+
+// Call whenever the active blocklist or the installed rules change out from under us
+// (i.e. the blocklist is updated or the block is re-installed)
+- (void)reloadBlocklist;
+
+// Takes a resolution done somewhere else (i.e. BlockManager refreshing an expired cache entry)
+// as if it were one of ours, adding any new addresses for a tracked domain to the live block
+- (void)applyResolution:(SCDNSResolution*)resolution;
+
+// Counters describing how much drift we've caught, suitable for logging or sending over XPC
+- (NSDictionary<NSString*, id>*)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,424 @@
+//
+//  SCBlockRefresher.m
+//  selfcontrold
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCBlockRefresher.h"
+#import "SCDNSResolver.h"
+#import "SCDNSCache.h"
+#import "SCIPPrefixSet.h"
+#import "SCBlockEntry.h"
+#import "PacketFilter.h"
+#import "BlockManager.h"
+#import "SCDeadlineScheduler.h"
+#include <notify.h>
+
+// give the network a few seconds to settle down after a change before we start resolving
+static NSTimeInterval const kNetworkChangeSettleSecs = 5.0;
+static NSString* const kRefreshBatchEvent = @"refresher.batch";
+// don't hang on to the block lock if someone else (i.e. a block update) is using it
+static NSTimeInterval const kRefresherLockTimeout = 0.5;
+
+// one domain (with its port/mask) from the blocklist that we keep up-to-date
+@interface SCRefreshTarget : NSObject
+
+@property (strong) SCBlockEntry* entry;
+@property (strong) NSDate* nextRefreshDate;
+@property BOOL inFlight;
+
+@end
+
+@implementation SCRefreshTarget
+@end
+
+@interface SCBlockRefresher () {
+    dispatch_queue_t _queue;
+    BOOL _isRunning;
+    int _networkChangeToken;
+    BOOL _networkChangeRegistered;
+
+    SCDNSResolver* _resolver;
+    NSMutableArray<SCRefreshTarget*>* _targets;
+    // table name -> everything we know is already in that pf table
+    NSMutableDictionary<NSString*, SCIPPrefixSet*>* _installedPrefixes;
+    NSDate* _lastBatchDate;
+
+    // statistics
+    NSUInteger _resolutionCount;
+    NSUInteger _failedResolutionCount;
+    NSUInteger _driftedDomainCount;
+    NSUInteger _newAddressCount;
+    NSUInteger _networkChangeCount;
+    NSDate* _lastRefreshDate;
+}
+
+@end
+
+@implementation SCBlockRefresher
+
++ (instancetype)sharedRefresher {
+    static SCBlockRefresher* refresher = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        refresher = [SCBlockRefresher new];
+    });
+    return refresher;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _queue = dispatch_queue_create("org.eyebeam.selfcontrold.SCBlockRefresher", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_queue, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+        _batchSize = 16;
+        _batchSpacing = 2.0;
+        _minimumRefreshInterval = 5 * 60;
+        _refreshTolerance = 60;
+        _maximumRefreshInterval = 60 * 60;
+        _targets = [NSMutableArray array];
+        _installedPrefixes = [NSMutableDictionary dictionary];
+        _lastBatchDate = [NSDate distantPast];
+        _nameserverPort = 53;
+    }
+    return self;
+}
+
+- (BOOL)isRunning {
+    __block BOOL isRunning;
+    dispatch_sync(_queue, ^{
+        isRunning = self->_isRunning;
+    });
+    return isRunning;
+}
+
+- (void)start {
+    dispatch_async(_queue, ^{
+        if (self->_isRunning) {
+            [self loadBlocklist];
+            return;
+        }
+        self->_isRunning = YES;
+
+        self->_resolver = [self newResolver];
+
+        __weak SCBlockRefresher* weakSelf = self;
+        int token;
+        if (notify_register_dispatch("com.apple.system.config.network_change", &token, self->_queue, ^(int t) {
+            [weakSelf handleNetworkChange];
+        }) == NOTIFY_STATUS_OK) {
+            self->_networkChangeToken = token;
+            self->_networkChangeRegistered = YES;
+        } else {
+            NSLog(@"SCBlockRefresher: Warning: couldn't register for network change notifications");
+        }
+
+        [self loadBlocklist];
+    });
+}
+
+- (void)stop {
+    dispatch_async(_queue, ^{
+        if (!self->_isRunning) return;
+        self->_isRunning = NO;
+
+        if (self->_networkChangeRegistered) {
+            notify_cancel(self->_networkChangeToken);
+            self->_networkChangeRegistered = NO;
+        }
+        [[SCDeadlineScheduler sharedScheduler] cancelEvent: kRefreshBatchEvent];
+        [self->_resolver invalidate];
+        self->_resolver = nil;
+        [self->_targets removeAllObjects];
+        [self->_installedPrefixes removeAllObjects];
+    });
+}
+
+- (void)reloadBlocklist {
+    dispatch_async(_queue, ^{
+        if (!self->_isRunning) return;
+        [self loadBlocklist];
+    });
+}
+
+- (NSDictionary<NSString*, id>*)statistics {
+    __block NSDictionary* stats;
+    dispatch_sync(_queue, ^{
+        stats = @{
+            @"IsRunning": @(self->_isRunning),
+            @"TrackedDomainCount": @(self->_targets.count),
+            @"ResolutionCount": @(self->_resolutionCount),
+            @"FailedResolutionCount": @(self->_failedResolutionCount),
+            @"DriftedDomainCount": @(self->_driftedDomainCount),
+            @"NewAddressCount": @(self->_newAddressCount),
+            @"NetworkChangeCount": @(self->_networkChangeCount),
+            @"LastRefreshDate": self->_lastRefreshDate ?: [NSDate distantPast]
+        };
+    });
+    return stats;
+}
+
+- (void)applyResolution:(SCDNSResolution*)resolution {
+    dispatch_async(_queue, ^{
+        if (!self->_isRunning) return;
+
+        NSString* domain = resolution.domain.lowercaseString;
+        NSMutableArray<SCRefreshTarget*>* targets = [NSMutableArray array];
+        for (SCRefreshTarget* target in self->_targets) {
+            if (!target.inFlight && [target.entry.hostname.lowercaseString isEqualToString: domain]) {
+                [targets addObject: target];
+            }
+        }
+        if (targets.count == 0) return;
+
+        [self applyResolutions: @{ domain: resolution } forTargets: targets];
+        [self scheduleNextBatch];
+    });
+}
+
+#pragma mark - Internal (all on _queue)
+
+- (SCDNSResolver*)newResolver {
+    NSArray<NSString*>* nameservers = self.nameservers;
+    if (nameservers == nil) return [SCDNSResolver new];
+    return [[SCDNSResolver alloc] initWithNameservers: nameservers port: self.nameserverPort];
+}
+
+- (PacketFilter*)newPacketFilter {
+    NSString* rootPath = self.rootPath;
+    if (rootPath == nil) return [[PacketFilter alloc] initAsAllowlist: NO];
+    return [[PacketFilter alloc] initAsAllowlist: NO rootPath: rootPath];
+}
+
+- (void)loadBlocklist {
+    SCSettings* settings = [SCSettings sharedSettings];
+    [_targets removeAllObjects];
+    [_installedPrefixes removeAllObjects];
+
+    if (![SCBlockUtilities modernBlockIsRunning] || [settings boolForKey: @"ActiveBlockAsWhitelist"]) {
+        NSLog(@"SCBlockRefresher: no refreshable block running");
+        [self scheduleNextBatch];
+        return;
+    }
+
+    // mirror what BlockManager resolves when it installs the block
+    BOOL includeCommonSubdomains = [settings boolForKey: @"EvaluateCommonSubdomains"];
+    NSMutableArray<SCBlockEntry*>* entries = [NSMutableArray array];
+    for (NSString* entryString in [settings valueForKey: @"ActiveBlocklist"]) {
+        SCBlockEntry* entry = [SCBlockEntry entryFromString: entryString];
+        if (entry == nil || [entry.hostname isEqualToString: @"*"] || [entry.hostname isValidIPAddress]) continue;
+
+        [entries addObject: entry];
+        if (includeCommonSubdomains) {
+            for (NSString* subdomain in [BlockManager commonSubdomainsForHostName: entry.hostname]) {
+                SCBlockEntry* subdomainEntry = [SCBlockEntry entryFromString: subdomain];
+                if (subdomainEntry != nil && ![subdomainEntry.hostname isValidIPAddress]) {
+                    [entries addObject: subdomainEntry];
+                }
+            }
+        }
+    }
+
+    // the block was just installed, so nothing is due right away - but spread the
+    // first round of refreshes out over the minimum interval instead of doing them all at once
+    NSMutableSet<SCBlockEntry*>* seenEntries = [NSMutableSet set];
+    for (SCBlockEntry* entry in entries) {
+        if ([BlockManager domainIsGoogle: entry.hostname] || [seenEntries containsObject: entry]) continue;
+        [seenEntries addObject: entry];
+
+        SCRefreshTarget* target = [SCRefreshTarget new];
+        target.entry = entry;
+        target.nextRefreshDate = [NSDate dateWithTimeIntervalSinceNow: arc4random_uniform((uint32_t)self.minimumRefreshInterval)];
+        [_targets addObject: target];
+    }
+
+    PacketFilter* pf = [self newPacketFilter];
+    NSDictionary<NSString*, NSArray<NSString*>*>* installedTables = [pf installedTableAddresses];
+    for (NSString* tableName in installedTables) {
+        SCIPPrefixSet* prefixSet = [SCIPPrefixSet new];
+        for (NSString* prefix in installedTables[tableName]) {
+            [prefixSet addPrefixString: prefix];
+        }
+        _installedPrefixes[tableName] = prefixSet;
+    }
+
+    NSLog(@"SCBlockRefresher: tracking %lu domains for re-resolution", (unsigned long)_targets.count);
+    [self scheduleNextBatch];
+}
+
+- (void)handleNetworkChange {
+    if (!_isRunning) return;
+    _networkChangeCount++;
+
+    // the nameservers may well have changed too
+    [_resolver invalidate];
+    _resolver = [self newResolver];
+
+    NSDate* refreshDate = [NSDate dateWithTimeIntervalSinceNow: kNetworkChangeSettleSecs];
+    for (SCRefreshTarget* target in _targets) {
+        if (!target.inFlight && [target.nextRefreshDate compare: refreshDate] == NSOrderedDescending) {
+            target.nextRefreshDate = refreshDate;
+        }
+    }
+    [self scheduleNextBatch];
+}
+
+- (void)scheduleNextBatch {
+    SCDeadlineScheduler* scheduler = [SCDeadlineScheduler sharedScheduler];
+    if (!_isRunning) {
+        [scheduler cancelEvent: kRefreshBatchEvent];
+        return;
+    }
+
+    NSDate* earliestDate = nil;
+    for (SCRefreshTarget* target in _targets) {
+        if (target.inFlight) continue;
+        if (earliestDate == nil || [target.nextRefreshDate compare: earliestDate] == NSOrderedAscending) {
+            earliestDate = target.nextRefreshDate;
+        }
+    }
+    if (earliestDate == nil) {
+        [scheduler cancelEvent: kRefreshBatchEvent];
+        return;
+    }
+
+    NSDate* fireDate = [earliestDate laterDate: [_lastBatchDate dateByAddingTimeInterval: self.batchSpacing]];
+
+    // none of this is time-critical, so let it ride along with whatever else wakes the daemon up
+    __weak SCBlockRefresher* weakSelf = self;
+    dispatch_queue_t queue = _queue;
+    [scheduler scheduleEvent: kRefreshBatchEvent atDate: fireDate tolerance: self.refreshTolerance handler:^{
+        dispatch_async(queue, ^{
+            [weakSelf runBatch];
+        });
+    }];
+}
+
+- (void)runBatch {
+    if (!_isRunning) return;
+
+    // anything due within the tolerance gets done now, rather than costing its own wakeup later
+    NSDate* now = [NSDate date];
+    NSDate* dueDate = [now dateByAddingTimeInterval: self.refreshTolerance];
+    NSMutableArray<SCRefreshTarget*>* dueTargets = [NSMutableArray array];
+    for (SCRefreshTarget* target in _targets) {
+        if (!target.inFlight && [target.nextRefreshDate compare: dueDate] != NSOrderedDescending) {
+            [dueTargets addObject: target];
+        }
+    }
+    [dueTargets sortUsingComparator:^NSComparisonResult(SCRefreshTarget* a, SCRefreshTarget* b) {
+        return [a.nextRefreshDate compare: b.nextRefreshDate];
+    }];
+    if (dueTargets.count > self.batchSize) {
+        [dueTargets removeObjectsInRange: NSMakeRange(self.batchSize, dueTargets.count - self.batchSize)];
+    }
+    if (dueTargets.count == 0) {
+        [self scheduleNextBatch];
+        return;
+    }
+
+    _lastBatchDate = now;
+    dispatch_group_t group = dispatch_group_create();
+    NSMutableDictionary<NSString*, SCDNSResolution*>* resolutions = [NSMutableDictionary dictionary];
+    for (SCRefreshTarget* target in dueTargets) {
+        target.inFlight = YES;
+        dispatch_group_enter(group);
+        [_resolver resolveDomain: target.entry.hostname completion:^(SCDNSResolution* resolution) {
+            dispatch_async(self->_queue, ^{
+                resolutions[target.entry.hostname.lowercaseString] = resolution;
+                dispatch_group_leave(group);
+            });
+        }];
+    }
+
+    dispatch_group_notify(group, _queue, ^{
+        [self applyResolutions: resolutions forTargets: dueTargets];
+        [self scheduleNextBatch];
+    });
+}
+
+- (void)applyResolutions:(NSDictionary<NSString*, SCDNSResolution*>*)resolutions forTargets:(NSArray<SCRefreshTarget*>*)targets {
+    if (!_isRunning) return;
+
+    PacketFilter* pf = [self newPacketFilter];
+    SCDNSCache* cache = [SCDNSCache sharedCache];
+    NSMutableArray<SCRefreshTarget*>* driftedTargets = [NSMutableArray array];
+    NSMutableArray<NSArray*>* newRules = [NSMutableArray array]; // [address, port, maskLen]
+
+    for (SCRefreshTarget* target in targets) {
+        target.inFlight = NO;
+        SCDNSResolution* resolution = resolutions[target.entry.hostname.lowercaseString];
+        _resolutionCount++;
+
+        BOOL failed = (resolution == nil || resolution.status == SCDNSResolutionStatusTimedOut || resolution.status == SCDNSResolutionStatusServerFailure || resolution.status == SCDNSResolutionStatusCancelled);
+        if (failed) {
+            _failedResolutionCount++;
+            target.nextRefreshDate = [NSDate dateWithTimeIntervalSinceNow: self.minimumRefreshInterval];
+            continue;
+        }
+
+        [cache recordResolution: resolution];
+        NSTimeInterval interval = MAX(self.minimumRefreshInterval, MIN(resolution.ttl, self.maximumRefreshInterval));
+        target.nextRefreshDate = [NSDate dateWithTimeIntervalSinceNow: interval];
+
+        NSString* tableName = [pf tableNameForPort: target.entry.port];
+        SCIPPrefixSet* installed = _installedPrefixes[tableName];
+        BOOL drifted = NO;
+        for (NSString* address in resolution.addresses) {
+            NSString* prefix = target.entry.maskLen ? [NSString stringWithFormat: @"%@/%ld", address, (long)target.entry.maskLen] : address;
+            if ([installed containsPrefixString: prefix]) continue;
+
+            [newRules addObject: @[address, @(target.entry.port), @(target.entry.maskLen)]];
+            drifted = YES;
+        }
+        if (drifted) [driftedTargets addObject: target];
+    }
+    _lastRefreshDate = [NSDate date];
+
+    if (newRules.count == 0) return;
+
+    // we're modifying the live block, so don't step on anyone else doing the same
+    NSLock* blockLock = self.blockLock;
+    if (blockLock != nil && ![blockLock lockBeforeDate: [NSDate dateWithTimeIntervalSinceNow: kRefresherLockTimeout]]) {
+        NSLog(@"SCBlockRefresher: couldn't get block lock, will retry %lu drifted domains shortly", (unsigned long)driftedTargets.count);
+        for (SCRefreshTarget* target in driftedTargets) {
+            target.nextRefreshDate = [NSDate dateWithTimeIntervalSinceNow: self.batchSpacing];
+        }
+        return;
+    }
+
+    int status = -1;
+    if ([SCBlockUtilities modernBlockIsRunning] && ![SCBlockUtilities currentBlockIsExpired]) {
+        [pf enterAppendMode];
+        for (NSArray* rule in newRules) {
+            [pf addRuleWithIP: rule[0] port: [rule[1] integerValue] maskLen: [rule[2] integerValue]];
+        }
+        status = [pf finishAppending];
+        // i.e. so the integrity check doesn't take our new rules for tampering
+        dispatch_block_t appendedHandler = self.blockAppendedHandler;
+        if (status == 0 && appendedHandler != nil) appendedHandler();
+    }
+    [blockLock unlock];
+
+    if (status != 0) {
+        NSLog(@"SCBlockRefresher: Warning: failed to add %lu new addresses to the block (status %d)", (unsigned long)newRules.count, status);
+        for (SCRefreshTarget* target in driftedTargets) {
+            target.nextRefreshDate = [NSDate dateWithTimeIntervalSinceNow: self.minimumRefreshInterval];
+        }
+        return;
+    }
+
+    for (NSArray* rule in newRules) {
+        NSString* tableName = [pf tableNameForPort: [rule[1] integerValue]];
+        if (_installedPrefixes[tableName] == nil) {
+            _installedPrefixes[tableName] = [SCIPPrefixSet new];
+        }
+        [_installedPrefixes[tableName] addAddress: rule[0] maskLen: [rule[2] integerValue]];
+    }
+    _driftedDomainCount += driftedTargets.count;
+    _newAddressCount += newRules.count;
+
+    NSLog(@"SCBlockRefresher: %lu domains moved to new addresses, added %lu addresses to the block (%lu total so far)", (unsigned long)driftedTargets.count, (unsigned long)newRules.count, (unsigned long)_newAddressCount);
+}
+
+@end
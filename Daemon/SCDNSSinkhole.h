@@ -0,0 +1,38 @@
+//
+//  SCDNSSinkhole.h
+//  selfcontrold
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Runs an SCDNSResponder on 127.0.0.1:53 for the active blocklist, alongside the usual
+// hosts file and pf rules, if the block was started with DNSSinkholeEnabled on.
+// Upstream queries go to the network's nameservers from SystemConfiguration (other than
+// ourselves). The last real ones we saw are kept in DNSSinkholeUpstreams, for once the system
+// is pointed at us, and they're looked up again whenever the network changes.
+// Point the network's DNS server at 127.0.0.1 to have everything go through it.
+// Only blocklists use the sinkhole - an allowlist has nothing to answer for.
+@interface SCDNSSinkhole : NSObject
+
++ (instancetype)sharedSinkhole;
+
+@property (readonly) BOOL isRunning;
+
+// Starts answering for the active blocklist (if we're already running, just reloads it).
+// Does nothing if there's no (non-allowlist) block or the setting's off.
+- (void)start;
+- (void)stop;
+
+// Call whenever the active blocklist changes
+- (void)reloadBlocklist;
+
+// Counters from the responder, suitable for logging or sending over XPC
+- (NSDictionary<NSString*, id>*)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
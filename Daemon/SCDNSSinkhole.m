@@ -0,0 +1,167 @@
+//
+//  SCDNSSinkhole.m
+//  selfcontrold
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCDNSSinkhole.h"
+#import "SCDNSResponder.h"
+#import "SCDomainSuffixIndex.h"
+#import "SCDNSResolver.h"
+#include <notify.h>
+
+static uint16_t const kSinkholePort = 53;
+
+@interface SCDNSSinkhole () {
+    dispatch_queue_t _queue;
+    SCDNSResponder* _responder;
+    int _networkChangeToken;
+    BOOL _networkChangeRegistered;
+}
+
+@end
+
+@implementation SCDNSSinkhole
+
++ (instancetype)sharedSinkhole {
+    static SCDNSSinkhole* sinkhole = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sinkhole = [SCDNSSinkhole new];
+    });
+    return sinkhole;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _queue = dispatch_queue_create("org.eyebeam.selfcontrold.SCDNSSinkhole", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+// The network's real nameservers minus any that are just us. Once the user points DNS at
+// 127.0.0.1, this is empty.
++ (NSArray<NSString*>*)systemUpstreamNameservers {
+    return [SCDNSResolver nameservers: [SCDNSResolver systemNameservers] excludingLoopbackOnPort: kSinkholePort];
+}
+
+- (BOOL)isRunning {
+    __block BOOL running;
+    dispatch_sync(_queue, ^{
+        running = (self->_responder != nil);
+    });
+    return running;
+}
+
+- (void)start {
+    dispatch_async(_queue, ^{
+        [self loadBlocklist];
+    });
+}
+
+- (void)stop {
+    dispatch_async(_queue, ^{
+        [self stopResponder];
+    });
+}
+
+- (void)reloadBlocklist {
+    dispatch_async(_queue, ^{
+        if (self->_responder == nil) return;
+        [self loadBlocklist];
+    });
+}
+
+- (NSDictionary<NSString*, id>*)statistics {
+    __block SCDNSResponder* responder;
+    dispatch_sync(_queue, ^{
+        responder = self->_responder;
+    });
+    return (responder != nil) ? [responder statistics] : @{ @"IsRunning": @NO };
+}
+
+#pragma mark - Internal (all on _queue)
+
+// The nameservers to forward to. Whenever the system has real ones we remember them, so that
+// after the user points the system at us we still know where to send unblocked names.
+- (NSArray<NSString*>*)upstreamNameservers {
+    SCSettings* settings = [SCSettings sharedSettings];
+    NSArray<NSString*>* upstreams = [SCDNSSinkhole systemUpstreamNameservers];
+    if (upstreams.count > 0) {
+        if (![upstreams isEqualToArray: [settings valueForKey: @"DNSSinkholeUpstreams"]]) {
+            [settings setValue: upstreams forKey: @"DNSSinkholeUpstreams"];
+        }
+        return upstreams;
+    }
+
+    NSArray* remembered = [settings valueForKey: @"DNSSinkholeUpstreams"];
+    return [remembered isKindOfClass: [NSArray class]] ? remembered : @[];
+}
+
+- (void)networkChanged {
+    if (_responder == nil) return;
+
+    NSArray<NSString*>* upstreams = [self upstreamNameservers];
+    if ([upstreams isEqualToArray: _responder.upstreamNameservers]) return;
+
+    _responder.upstreamNameservers = upstreams;
+    NSLog(@"SCDNSSinkhole: network changed, now forwarding to %@", [upstreams componentsJoinedByString: @", "]);
+}
+
+- (void)loadBlocklist {
+    SCSettings* settings = [SCSettings sharedSettings];
+    if (![settings boolForKey: @"DNSSinkholeEnabled"] || ![SCBlockUtilities modernBlockIsRunning] || [settings boolForKey: @"ActiveBlockAsWhitelist"]) {
+        [self stopResponder];
+        return;
+    }
+
+    SCDomainSuffixIndex* index = [SCDomainSuffixIndex indexWithBlocklist: [settings valueForKey: @"ActiveBlocklist"]
+                                                      includeSubdomains: [settings boolForKey: @"EvaluateCommonSubdomains"]];
+
+    // already up, so just swap the new rules in
+    if (_responder != nil) {
+        _responder.blockIndex = index;
+        NSLog(@"SCDNSSinkhole: reloaded with %lu rules", (unsigned long)index.count);
+        return;
+    }
+
+    SCDNSResponder* responder = [[SCDNSResponder alloc] initWithBlockIndex: index
+                                                       upstreamNameservers: [self upstreamNameservers]
+                                                              upstreamPort: 53];
+    NSError* startErr = nil;
+    if (![responder startOnPort: kSinkholePort error: &startErr]) {
+        // the hosts file and pf rules are still doing their jobs, so this isn't fatal
+        NSLog(@"SCDNSSinkhole: ERROR: couldn't start with error %@", startErr);
+        [SCSentry captureError: startErr];
+        return;
+    }
+
+    _responder = responder;
+    NSLog(@"SCDNSSinkhole: answering on 127.0.0.1:%u with %lu rules", responder.port, (unsigned long)index.count);
+
+    __weak SCDNSSinkhole* weakSelf = self;
+    int token;
+    if (notify_register_dispatch("com.apple.system.config.network_change", &token, _queue, ^(int t) {
+        [weakSelf networkChanged];
+    }) == NOTIFY_STATUS_OK) {
+        _networkChangeToken = token;
+        _networkChangeRegistered = YES;
+    } else {
+        NSLog(@"SCDNSSinkhole: Warning: couldn't register for network change notifications");
+    }
+}
+
+- (void)stopResponder {
+    if (_responder == nil) return;
+
+    if (_networkChangeRegistered) {
+        notify_cancel(_networkChangeToken);
+        _networkChangeRegistered = NO;
+    }
+    [_responder stop];
+    _responder = nil;
+    NSLog(@"SCDNSSinkhole: stopped");
+}
+
+@end
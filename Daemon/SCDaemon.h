@@ -21,9 +21,9 @@ NS_ASSUME_NONNULL_BEGIN
 // and running block checkup jobs if necessary
 - (void)start;
 
-// Starts checking up on the block on a regular basis
-// to make sure it hasn't expired, been tampered with, etc
-// (and will remove it or fix it if so)
+// Starts checking up on the block to make sure it hasn't expired, been tampered with, etc
+// (and will remove it or fix it if so). Checkups run right away, when the block's due to
+// end, and every so often in between. Call again whenever the block end date changes.
 - (void)startCheckupTimer;
 
 // Stops the checkup timer (this should only be called if there's
@@ -32,9 +32,13 @@ NS_ASSUME_NONNULL_BEGIN
 
 // Lets the daemon know that there was recent activity
 // so we can reset our inactivity timer.
-// The daemon will die if goes for too long without activity.
+// The daemon will die if goes for too long without activity
+// (and without a block running).
 - (void)resetInactivityTimer;
 
+// Counters from the watcher on the hosts files, pf files and settings file
+- (NSDictionary<NSString*, id>*)tamperWatcherStatistics;
+
 @end
 
 NS_ASSUME_NONNULL_END
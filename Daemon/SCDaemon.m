@@ -9,10 +9,32 @@
 #import "SCDaemonProtocol.h"
 #import "SCDaemonXPC.h"
 #import"SCDaemonBlockMethods.h"
-#import "SCFileWatcher.h"
+#import "SCPathWatcher.h"
+#import "HostFileBlockerSet.h"
+#import "HostFileBlocker.h"
+#import "PacketFilter.h"
+#import "SCBlockRefresher.h"
+#import "BlockManager.h"
+#import "SCDNSSinkhole.h"
+#import "SCDeadlineScheduler.h"
 
 static NSString* serviceName = @"org.eyebeam.selfcontrold";
 float const INACTIVITY_LIMIT_SECS = 60 * 2; // 2 minutes
+// the block ending is the one thing that has to happen on time
+NSTimeInterval const BLOCK_END_TOLERANCE_SECS = 0.5;
+// everything else gets noticed by the tamper watcher, so periodic checkups are just a
+// backstop (i.e. for pf rules flushed without touching any files)
+NSTimeInterval const CHECKUP_INTERVAL_SECS = 10 * 60;
+NSTimeInterval const CHECKUP_TOLERANCE_SECS = 60;
+// if a checkup couldn't get the lock (i.e. a slow block start), try again this soon
+NSTimeInterval const CHECKUP_RETRY_SECS = 1.0;
+NSTimeInterval const INACTIVITY_TOLERANCE_SECS = 15;
+
+static NSString* const kBlockEndEvent = @"daemon.blockEnd";
+static NSString* const kCheckupEvent = @"daemon.checkup";
+static NSString* const kInactivityEvent = @"daemon.inactivity";
+// how long to let a burst of changes to a watched file settle before we look at it
+NSTimeInterval const TAMPER_WATCHER_LATENCY_SECS = 0.5;
 
 @interface NSXPCConnection(PrivateAuditToken)
 
@@ -24,11 +46,10 @@ float const INACTIVITY_LIMIT_SECS = 60 * 2; // 2 minutes
 @interface SCDaemon () <NSXPCListenerDelegate>
 
 @property (nonatomic, strong, readwrite) NSXPCListener* listener;
-@property (strong, readwrite) NSTimer* checkupTimer;
-@property (strong, readwrite) NSTimer* inactivityTimer;
-@property (nonatomic, strong, readwrite) NSDate* lastActivityDate;
+// read from XPC threads and scheduler handlers alike; changes happen under @synchronized(self)
+@property (atomic, readwrite) BOOL checkupsRunning;
 
-@property (nonatomic, strong) SCFileWatcher* hostsFileWatcher;
+@property (strong) SCPathWatcher* tamperWatcher;
 
 @end
 
@@ -51,6 +72,21 @@ float const INACTIVITY_LIMIT_SECS = 60 * 2; // 2 minutes
 }
 
 - (void)start {
+    // whatever's published might be from before we restarted (or a settings change we missed).
+    // do it before we take any requests, since those publish too
+    [SCDaemonBlockMethods publishBlockState];
+
+    // the refresher adds to the live block, so it has to take turns with our block methods
+    SCBlockRefresher* refresher = [SCBlockRefresher sharedRefresher];
+    refresher.blockLock = SCDaemonBlockMethods.daemonMethodLock;
+    refresher.blockAppendedHandler = ^{
+        [SCDaemonBlockMethods recordPFAnchorIntegrity];
+    };
+    // late refreshes of cached addresses go in the same way as the refresher's own
+    BlockManager.liveBlockRefreshHandler = ^(SCDNSResolution* resolution) {
+        [[SCBlockRefresher sharedRefresher] applyResolution: resolution];
+    };
+
     [self.listener resume];
 
     // if there's any evidence of a block (i.e. an official one running,
@@ -63,83 +99,178 @@ float const INACTIVITY_LIMIT_SECS = 60 * 2; // 2 minutes
     if ([SCBlockUtilities anyBlockIsRunning] || [SCBlockUtilities blockRulesFoundOnSystem]) {
         [self startCheckupTimer];
     }
+    if ([SCBlockUtilities modernBlockIsRunning]) {
+        [[SCBlockRefresher sharedRefresher] start];
+        [[SCDNSSinkhole sharedSinkhole] start];
+    }
     
-    [self startInactivityTimer];
     [self resetInactivityTimer];
     
-    self.hostsFileWatcher = [SCFileWatcher watcherWithFile: @"/etc/hosts" block:^(NSError * _Nonnull error) {
-        if ([SCBlockUtilities anyBlockIsRunning]) {
-            NSLog(@"INFO: hosts file changed, checking block integrity");
-            [SCDaemonBlockMethods checkBlockIntegrity];
-        }
-    }];
+    [self startTamperWatcher];
 }
 
-- (void)startCheckupTimer {
-    // this method must always be called on the main thread, so the timer will work properly
-    if (![NSThread isMainThread]) {
-        dispatch_sync(dispatch_get_main_queue(), ^{
-            [self startCheckupTimer];
-        });
-        return;
+- (void)startTamperWatcher {
+    // handlers take the daemon method lock, so keep them off the main thread
+    dispatch_queue_t handlerQueue = dispatch_queue_create("org.eyebeam.selfcontrold.tamperwatcher", DISPATCH_QUEUE_SERIAL);
+    SCPathWatcher* watcher = [[SCPathWatcher alloc] initWithBackend: [SCPathWatcher platformBackend] handlerQueue: handlerQueue];
+    watcher.latency = TAMPER_WATCHER_LATENCY_SECS;
+
+    // each file goes straight to the check (and repair) for the part of the block that lives there
+    void (^watchComponent)(NSString*, SCBlockComponent) = ^(NSString* path, SCBlockComponent component) {
+        [watcher watchPath: path handler:^(NSString* changedPath) {
+            if (![SCBlockUtilities anyBlockIsRunning]) return;
+            NSLog(@"INFO: %@ changed, checking block integrity (%@)", changedPath, [SCBlockIntegrityRecord descriptionForComponents: component]);
+            [SCDaemonBlockMethods checkBlockIntegrityOfComponents: component];
+        }];
+    };
+
+    // the VPN hosts files are watched whether or not they exist yet, so one that turns up
+    // mid-block gets blocked too (not just the ones that were there when the block started)
+    NSMutableOrderedSet<NSString*>* hostsPaths = [NSMutableOrderedSet orderedSetWithObject: [HostFileBlocker new].path];
+    [hostsPaths addObjectsFromArray: HostFileBlockerSet.commonBackupHostFilePaths];
+    for (NSString* hostsPath in hostsPaths) {
+        [watcher watchPath: hostsPath handler:^(NSString* changedPath) {
+            if (![SCBlockUtilities anyBlockIsRunning]) return;
+            NSLog(@"INFO: %@ changed, checking block integrity (hosts)", changedPath);
+            [SCDaemonBlockMethods checkHostsFileAtPath: changedPath];
+        }];
     }
+    PacketFilter* pf = [[PacketFilter alloc] init];
+    watchComponent(pf.pfConfPath, SCBlockComponentPFConf);
+    watchComponent(pf.anchorPath, SCBlockComponentPFAnchor);
 
-    // if the timer's already running, don't stress it!
-    if (self.checkupTimer != nil) {
+    for (NSString* settingsPath in @[SCSettings.securedSettingsFilePath, SCSettings.securedSettingsJournalPath, SCSettings.securedBlocklistFilePath]) {
+        [watcher watchPath: settingsPath handler:^(NSString* changedPath) {
+            if (![SCBlockUtilities anyBlockIsRunning]) return;
+            NSLog(@"INFO: settings file changed, checking settings");
+            [SCDaemonBlockMethods checkSettingsIntegrity];
+        }];
+    }
+
+    NSError* watchErr = nil;
+    if (![watcher startWatchingWithError: &watchErr]) {
+        // the periodic integrity checks will still catch everything, just not as quickly
+        NSLog(@"WARNING: failed to start watching block files with error %@", watchErr);
+        [SCSentry captureError: watchErr];
         return;
     }
-    
-    self.checkupTimer = [NSTimer scheduledTimerWithTimeInterval: 1 repeats: YES block:^(NSTimer * _Nonnull timer) {
-       [SCDaemonBlockMethods checkupBlock];
-    }];
+    self.tamperWatcher = watcher;
+}
+
+- (void)startCheckupTimer {
+    SCDeadlineScheduler* scheduler = [SCDeadlineScheduler sharedScheduler];
+
+    // checkups keep us alive as long as there's a block, so no need to watch for inactivity
+    [scheduler cancelEvent: kInactivityEvent];
+    [self scheduleBlockEndCheckup];
+
+    // if we're already going, that's all (i.e. the end date might've changed)
+    @synchronized (self) {
+        if (self.checkupsRunning) {
+            return;
+        }
+        self.checkupsRunning = YES;
+    }
 
     // run the first checkup immediately!
-    [SCDaemonBlockMethods checkupBlock];
+    [scheduler scheduleEvent: kCheckupEvent afterInterval: 0 tolerance: 0 handler:^{
+        [self runScheduledCheckup];
+    }];
 }
 - (void)stopCheckupTimer {
-    if (self.checkupTimer == nil) {
+    @synchronized (self) {
+        if (!self.checkupsRunning) {
+            return;
+        }
+        self.checkupsRunning = NO;
+    }
+
+    SCDeadlineScheduler* scheduler = [SCDeadlineScheduler sharedScheduler];
+    [scheduler cancelEvent: kBlockEndEvent];
+    [scheduler cancelEvent: kCheckupEvent];
+
+    // no block means nothing to keep fresh (or to answer for)
+    [[SCBlockRefresher sharedRefresher] stop];
+    [[SCDNSSinkhole sharedSinkhole] stop];
+
+    // and once we've been idle long enough, the daemon can exit
+    [self resetInactivityTimer];
+}
+
+- (void)scheduleBlockEndCheckup {
+    NSDate* blockEndDate = [[SCSettings sharedSettings] valueForKey: @"BlockEndDate"];
+    if (![blockEndDate isKindOfClass: [NSDate class]] || [blockEndDate timeIntervalSinceNow] <= 0) {
+        // legacy blocks (or ones that are already over) get picked up by the regular checkups
+        [[SCDeadlineScheduler sharedScheduler] cancelEvent: kBlockEndEvent];
         return;
     }
-    
-    [self.checkupTimer invalidate];
-    self.checkupTimer = nil;
+
+    [[SCDeadlineScheduler sharedScheduler] scheduleEvent: kBlockEndEvent atDate: blockEndDate tolerance: BLOCK_END_TOLERANCE_SECS handler:^{
+        [self runScheduledCheckup];
+    }];
+}
+
+- (void)runScheduledCheckup {
+    if (![SCDaemonBlockMethods checkupBlock]) {
+        if (!self.checkupsRunning) {
+            return;
+        }
+        // someone else has the lock, and this may have been the block-end event (which has
+        // already fired), so try again shortly rather than waiting for the next checkup
+        NSLog(@"WARNING: Checkup couldn't get the daemon lock, retrying in %f seconds", CHECKUP_RETRY_SECS);
+        [[SCDeadlineScheduler sharedScheduler] scheduleEvent: kBlockEndEvent afterInterval: CHECKUP_RETRY_SECS tolerance: BLOCK_END_TOLERANCE_SECS handler:^{
+            [self runScheduledCheckup];
+        }];
+        return;
+    }
+
+    // the checkup may well have ended the block (and stopped checkups)
+    if (!self.checkupsRunning) {
+        return;
+    }
+    [[SCDeadlineScheduler sharedScheduler] scheduleEvent: kCheckupEvent afterInterval: CHECKUP_INTERVAL_SECS tolerance: CHECKUP_TOLERANCE_SECS handler:^{
+        [self runScheduledCheckup];
+    }];
+    // i.e. the clock was set back, so the block isn't over after all
+    if (![[SCDeadlineScheduler sharedScheduler] hasEvent: kBlockEndEvent]) {
+        [self scheduleBlockEndCheckup];
+    }
 }
 
+- (void)resetInactivityTimer {
+    // while there's a block, checkups are what keep an eye on things - we don't go idle
+    if (self.checkupsRunning) {
+        return;
+    }
 
-- (void)startInactivityTimer {
-    self.inactivityTimer = [NSTimer scheduledTimerWithTimeInterval: 15.0 repeats: YES block:^(NSTimer * _Nonnull timer) {
+    [[SCDeadlineScheduler sharedScheduler] scheduleEvent: kInactivityEvent afterInterval: INACTIVITY_LIMIT_SECS tolerance: INACTIVITY_TOLERANCE_SECS handler:^{
         // we haven't had any activity in a while, the daemon appears to be idling
         // so kill it to avoid the user having unnecessary processes running!
-        if ([[NSDate date] timeIntervalSinceDate: self.lastActivityDate] > INACTIVITY_LIMIT_SECS) {
-            // if we're inactive but also there's a block running, that's a bad thing
-            // start the checkups going again - unclear why they would've stopped
-            if ([SCBlockUtilities anyBlockIsRunning] || [SCBlockUtilities blockRulesFoundOnSystem]) {
-                [self startCheckupTimer];
-                [SCDaemonBlockMethods checkupBlock];
-                return;
-            }
-            
-            NSLog(@"Daemon inactive for more than %f seconds, exiting!", INACTIVITY_LIMIT_SECS);
-            [SCHelperToolUtilities unloadDaemonJob];
+        // if we're inactive but also there's a block running, that's a bad thing
+        // start the checkups going again - unclear why they would've stopped
+        if ([SCBlockUtilities anyBlockIsRunning] || [SCBlockUtilities blockRulesFoundOnSystem]) {
+            [self startCheckupTimer];
+            return;
         }
+
+        NSLog(@"Daemon inactive for more than %f seconds, exiting!", INACTIVITY_LIMIT_SECS);
+        [SCHelperToolUtilities unloadDaemonJob];
     }];
 }
-- (void)resetInactivityTimer {
-    self.lastActivityDate = [NSDate date];
+
+- (NSDictionary<NSString*, id>*)tamperWatcherStatistics {
+    SCPathWatcher* watcher = self.tamperWatcher;
+    return (watcher != nil) ? [watcher statistics] : @{ @"IsWatching": @NO };
 }
 
 - (void)dealloc {
-    if (self.checkupTimer) {
-        [self.checkupTimer invalidate];
-        self.checkupTimer = nil;
-    }
-    if (self.inactivityTimer) {
-        [self.inactivityTimer invalidate];
-        self.inactivityTimer = nil;
-    }
-    if (self.hostsFileWatcher) {
-        [self.hostsFileWatcher stopWatching];
-        self.hostsFileWatcher = nil;
+    SCDeadlineScheduler* scheduler = [SCDeadlineScheduler sharedScheduler];
+    [scheduler cancelEvent: kBlockEndEvent];
+    [scheduler cancelEvent: kCheckupEvent];
+    [scheduler cancelEvent: kInactivityEvent];
+    if (self.tamperWatcher) {
+        [self.tamperWatcher stopWatching];
+        self.tamperWatcher = nil;
     }
 }
 
@@ -6,6 +6,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "SCBlockIntegrityRecord.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -18,8 +19,9 @@ NS_ASSUME_NONNULL_BEGIN
 // Starts a block
 + (void)startBlockWithControllingUID:(uid_t)controllingUID blocklist:(NSArray<NSString*>*)blocklist isAllowlist:(BOOL)isAllowlist endDate:(NSDate*)endDate blockSettings:(NSDictionary*)blockSettings authorization:(NSData *)authData reply:(void(^)(NSError* error))reply;
 
-// Checks whether the block is expired or compromised, and takes action to fix
-+ (void)checkupBlock;
+// Checks whether the block is expired or compromised, and takes action to fix.
+// Returns NO if it couldn't get the method lock in time, so the checkup didn't run
++ (BOOL)checkupBlock;
 
 // updates the blocklist for the currently running block
 // (i.e. adds new sites to the list)
@@ -29,7 +31,33 @@ NS_ASSUME_NONNULL_BEGIN
 // (i.e. extends the block)
 + (void)updateBlockEndDate:(NSDate*)newEndDate authorization:(NSData *)authData reply:(void(^)(NSError* error))reply;
 
+// Compares the installed block against what we recorded when we installed it,
+// and puts back whichever parts have been changed
 + (void)checkBlockIntegrity;
+// Same, but only checks (and repairs) the given components - i.e. when we know which file changed
++ (void)checkBlockIntegrityOfComponents:(SCBlockComponent)components;
+// Called when a hosts file changes. If it's a VPN hosts file that's turned up since the
+// block was installed, reinstalls the block so it covers that one too; otherwise it's
+// just an integrity check of the hosts files
++ (void)checkHostsFileAtPath:(NSString*)path;
+
+// Called when the settings files change underneath us: picks up legitimate changes,
+// rewrites them if they were deleted or rolled back, then runs a checkup in case the block's been touched
++ (void)checkSettingsIntegrity;
+
+// Records the block as it's installed right now, for checkBlockIntegrity to compare against.
+// Call with daemonMethodLock held, after any change we make to the block.
++ (void)recordBlockIntegrity;
+// Same, but only for the pf anchor (for changes that only append pf rules)
++ (void)recordPFAnchorIntegrity;
+
+// Writes the current block state (plus the last integrity check's result) to SCBlockStateFile,
+// for the app and CLI. Call with daemonMethodLock held (or before anything else can take it)
++ (void)publishBlockState;
+
+// Recent spans from SCSpanRecorder (oldest first), plus the block work scheduler's
+// and refresher's statistics, to help figure out what's making blocks slow
++ (NSDictionary*)blockTimings;
 
 @end
 
@@ -13,10 +13,25 @@
 #import "SCDaemon.h"
 #import "LaunchctlHelper.h"
 #import "HostFileBlockerSet.h"
+#import "SCBlockRefresher.h"
+#import "SCDNSSinkhole.h"
+#import "SCSpanRecorder.h"
+#import "SCBlockWorkScheduler.h"
+#import "SCBlockIntegrityRecord.h"
+#import "SCDeadlineScheduler.h"
+#import "SCBlockState.h"
+#import "SCDNSCache.h"
 
 NSTimeInterval METHOD_LOCK_TIMEOUT = 5.0;
 NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for checkups, because we'd prefer not to have tons pile up
 
+// the block as we last installed it, for integrity checks (only touched with the method lock held)
+static SCBlockIntegrityRecord* installedBlockRecord = nil;
+// what the last integrity check found, for publishBlockState (also only touched with the method lock held)
+static SCBlockComponent lastDamagedComponents = SCBlockComponentNone;
+static SCBlockComponent lastUnrepairedComponents = SCBlockComponentNone;
+static NSDate* lastIntegrityCheckDate = nil;
+
 @implementation SCDaemonBlockMethods
 
 + (NSLock*)daemonMethodLock {
@@ -47,11 +62,38 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
     return [self lockOrTimeout: reply timeout: METHOD_LOCK_TIMEOUT];
 }
 
++ (void)recordBlockIntegrity {
+    PacketFilter* pf = [[PacketFilter alloc] initAsAllowlist: [[SCSettings sharedSettings] boolForKey: @"ActiveBlockAsWhitelist"]];
+    installedBlockRecord = [SCBlockIntegrityRecord recordWithHostFileBlockerSet: [[HostFileBlockerSet alloc] init] packetFilter: pf];
+}
++ (void)recordPFAnchorIntegrity {
+    [installedBlockRecord rerecordComponents: SCBlockComponentPFAnchor];
+}
+
++ (void)publishBlockState {
+    SCBlockState* state = [SCBlockState stateWithSettings: [SCSettings sharedSettings].dictionaryRepresentation
+                                        damagedComponents: lastDamagedComponents
+                                     unrepairedComponents: lastUnrepairedComponents
+                                       integrityCheckDate: lastIntegrityCheckDate];
+    NSError* err = nil;
+    if (![[SCBlockStateFile sharedFile] publishState: state error: &err]) {
+        // not fatal - the app and CLI will fall back to reading settings
+        NSLog(@"WARNING: Couldn't publish block state with error %@", err);
+        [SCSentry captureError: err];
+    }
+}
++ (void)forgetIntegrityResults {
+    lastDamagedComponents = SCBlockComponentNone;
+    lastUnrepairedComponents = SCBlockComponentNone;
+    lastIntegrityCheckDate = nil;
+}
+
 
 + (void)startBlockWithControllingUID:(uid_t)controllingUID blocklist:(NSArray<NSString*>*)blocklist isAllowlist:(BOOL)isAllowlist endDate:(NSDate*)endDate blockSettings:(NSDictionary*)blockSettings authorization:(NSData *)authData reply:(void(^)(NSError* error))reply {
     if (![SCDaemonBlockMethods lockOrTimeout: reply]) {
         return;
     }
+    [[SCSpanRecorder sharedRecorder] beginOperation: @"startBlock"];
     
     // we reset at the _end_ of every method, but we'll also reset at the _start_ here
     // because startBlock can sometimes take a while, and it'd be a shame if the daemon killed itself
@@ -65,13 +107,16 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
         NSError* err = [SCErr errorWithCode: 301];
         [SCSentry captureError: err];
         reply(err);
+        [[SCSpanRecorder sharedRecorder] endOperation];
         [self.daemonMethodLock unlock];
         return;
     }
     
     // clear any legacy block information - no longer useful and could potentially confuse things
     // but first, copy it over one more time (this should've already happened once in the app, but you never know)
-    if ([SCMigrationUtilities legacySettingsFoundForUser: controllingUID]) {
+    SCSpan* migrationSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"legacy.migration"];
+    BOOL legacySettingsFound = [SCMigrationUtilities legacySettingsFoundForUser: controllingUID];
+    if (legacySettingsFound) {
         [SCMigrationUtilities copyLegacySettingsToDefaults: controllingUID];
         [SCMigrationUtilities clearLegacySettingsForUser: controllingUID];
         
@@ -79,42 +124,63 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
         // make sure it's dead and gone
         [LaunchctlHelper unloadLaunchdJobWithPlistAt: @"/Library/LaunchDaemons/org.eyebeam.SelfControl.plist"];
     }
+    [migrationSpan endWithAttributes: @{ @"LegacySettingsFound": @(legacySettingsFound) }];
 
-    SCSettings* settings = [SCSettings sharedSettings];
-    // update SCSettings with the blocklist and end date that've been requested
-    [settings setValue: blocklist forKey: @"ActiveBlocklist"];
-    [settings setValue: @(isAllowlist) forKey: @"ActiveBlockAsWhitelist"];
-    [settings setValue: endDate forKey: @"BlockEndDate"];
-    
-    // update all the settings for the block, which we're basically just copying from defaults to settings
-    [settings setValue: blockSettings[@"ClearCaches"] forKey: @"ClearCaches"];
-    [settings setValue: blockSettings[@"AllowLocalNetworks"] forKey: @"AllowLocalNetworks"];
-    [settings setValue: blockSettings[@"EvaluateCommonSubdomains"] forKey: @"EvaluateCommonSubdomains"];
-    [settings setValue: blockSettings[@"IncludeLinkedDomains"] forKey: @"IncludeLinkedDomains"];
-    [settings setValue: blockSettings[@"BlockSoundShouldPlay"] forKey: @"BlockSoundShouldPlay"];
-    [settings setValue: blockSettings[@"BlockSound"] forKey: @"BlockSound"];
-    [settings setValue: blockSettings[@"EnableErrorReporting"] forKey: @"EnableErrorReporting"];
-
-    if(([blocklist count] <= 0 && !isAllowlist) || [SCBlockUtilities currentBlockIsExpired]) {
+    if(([blocklist count] <= 0 && !isAllowlist) || [endDate timeIntervalSinceNow] <= 0) {
         NSLog(@"ERROR: Blocklist is empty, or block end date is in the past");
-        NSLog(@"Block End Date: %@ (%@), vs now is %@", [settings valueForKey: @"BlockEndDate"], [[settings valueForKey: @"BlockEndDate"] class], [NSDate date]);
+        NSLog(@"Block End Date: %@ (%@), vs now is %@", endDate, [endDate class], [NSDate date]);
         NSError* err = [SCErr errorWithCode: 302];
         [SCSentry captureError: err];
         reply(err);
+        [[SCSpanRecorder sharedRecorder] endOperation];
         [self.daemonMethodLock unlock];
         return;
     }
 
+    SCSettings* settings = [SCSettings sharedSettings];
+    // everything about the new block goes in as one update, so it's written out once
+    // and everyone else hears about it all at once
+    NSError* syncErr = [settings performBatchUpdates:^(SCSettings* batch) {
+        // update SCSettings with the blocklist and end date that've been requested
+        [batch setValue: blocklist forKey: @"ActiveBlocklist"];
+        [batch setValue: @(isAllowlist) forKey: @"ActiveBlockAsWhitelist"];
+        [batch setValue: endDate forKey: @"BlockEndDate"];
+        
+        // update all the settings for the block, which we're basically just copying from defaults to settings
+        [batch setValue: blockSettings[@"ClearCaches"] forKey: @"ClearCaches"];
+        [batch setValue: blockSettings[@"AllowLocalNetworks"] forKey: @"AllowLocalNetworks"];
+        [batch setValue: blockSettings[@"EvaluateCommonSubdomains"] forKey: @"EvaluateCommonSubdomains"];
+        [batch setValue: blockSettings[@"IncludeLinkedDomains"] forKey: @"IncludeLinkedDomains"];
+        [batch setValue: blockSettings[@"CompactHostsFile"] forKey: @"CompactHostsFile"];
+        [batch setValue: blockSettings[@"DNSSinkholeEnabled"] forKey: @"DNSSinkholeEnabled"];
+        [batch setValue: blockSettings[@"BlockSoundShouldPlay"] forKey: @"BlockSoundShouldPlay"];
+        [batch setValue: blockSettings[@"BlockSound"] forKey: @"BlockSound"];
+        [batch setValue: blockSettings[@"EnableErrorReporting"] forKey: @"EnableErrorReporting"];
+    }];
+    if (syncErr != nil) {
+        NSLog(@"WARNING: Sync failed or timed out with error %@ before starting block", syncErr);
+        [SCSentry captureError: syncErr];
+    }
+
     NSLog(@"Adding firewall rules...");
     [SCHelperToolUtilities installBlockRulesFromSettings];
-    [settings setValue: @YES forKey: @"BlockIsRunning"];
-    
-    NSError* syncErr = [settings syncSettingsAndWait: 5]; // synchronize ASAP since BlockIsRunning is a really important one
+
+    // BlockIsRunning only goes in once the rules are, so nobody sees a block that isn't there yet.
+    // If we die partway through installing, the daemon finds the rules on its next launch with
+    // no block marked as running, and clears them out - the start fails, rather than leaving
+    // a half-installed block behind. Written out ASAP since it's a really important one
+    syncErr = [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: @YES forKey: @"BlockIsRunning"];
+    }];
     if (syncErr != nil) {
-        NSLog(@"WARNING: Sync failed or timed out with error %@ after starting block", syncErr);
+        NSLog(@"WARNING: Sync failed or timed out with error %@ after installing block rules", syncErr);
         [SCSentry captureError: syncErr];
     }
 
+    [SCDaemonBlockMethods recordBlockIntegrity];
+    [SCDaemonBlockMethods forgetIntegrityResults];
+    [SCDaemonBlockMethods publishBlockState];
+
     NSLog(@"Firewall rules added!");
     
     [SCHelperToolUtilities sendConfigurationChangedNotification];
@@ -129,6 +195,9 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
 
     [[SCDaemon sharedDaemon] resetInactivityTimer];
     [[SCDaemon sharedDaemon] startCheckupTimer];
+    [[SCBlockRefresher sharedRefresher] start];
+    [[SCDNSSinkhole sharedSinkhole] start];
+    [[SCSpanRecorder sharedRecorder] endOperation];
     [self.daemonMethodLock unlock];
 }
 
@@ -136,6 +205,7 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
     if (![SCDaemonBlockMethods lockOrTimeout: reply]) {
         return;
     }
+    [[SCSpanRecorder sharedRecorder] beginOperation: @"updateBlocklist"];
     
     [SCSentry addBreadcrumb: @"Daemon method updateBlocklist called" category: @"daemon"];
     if ([SCBlockUtilities legacyBlockIsRunning]) {
@@ -143,6 +213,7 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
         NSError* err = [SCErr errorWithCode: 303];
         [SCSentry captureError: err];
         reply(err);
+        [[SCSpanRecorder sharedRecorder] endOperation];
         [self.daemonMethodLock unlock];
         return;
     }
@@ -151,6 +222,7 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
         NSError* err = [SCErr errorWithCode: 304];
         [SCSentry captureError: err];
         reply(err);
+        [[SCSpanRecorder sharedRecorder] endOperation];
         [self.daemonMethodLock unlock];
         return;
     }
@@ -162,15 +234,22 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
         NSError* err = [SCErr errorWithCode: 305];
         [SCSentry captureError: err];
         reply(err);
+        [[SCSpanRecorder sharedRecorder] endOperation];
         [self.daemonMethodLock unlock];
         return;
     }
     
-    NSArray* activeBlocklist = [settings valueForKey: @"ActiveBlocklist"];
-    NSMutableArray* added = [NSMutableArray arrayWithArray: newBlocklist];
-    [added removeObjectsInArray: activeBlocklist];
-    NSMutableArray* removed = [NSMutableArray arrayWithArray: activeBlocklist];
-    [removed removeObjectsInArray: newBlocklist];
+    // look entries up in the (mapped) table instead of comparing the two lists item by item
+    SCBlocklistTable* activeBlocklist = settings.activeBlocklistTable;
+    NSMutableArray* added = [NSMutableArray array];
+    for (NSString* entry in newBlocklist) {
+        if (![activeBlocklist containsEntry: entry]) [added addObject: entry];
+    }
+    NSSet* newBlocklistSet = [NSSet setWithArray: newBlocklist];
+    NSMutableArray* removed = [NSMutableArray array];
+    [activeBlocklist enumerateEntriesUsingBlock:^(NSString* entry, NSUInteger idx, BOOL* stop) {
+        if (![newBlocklistSet containsObject: entry]) [removed addObject: entry];
+    }];
     
     // throw a warning if something got removed for some reason, since we ignore them
     if (removed.count > 0) {
@@ -178,21 +257,27 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
     }
     
     BlockManager* blockManager = [[BlockManager alloc] initAsAllowlist: [settings boolForKey: @"ActiveBlockAsWhitelist"]
-                                                            allowLocal: [settings boolForKey: @"EvaluateCommonSubdomains"]
-                                               includeCommonSubdomains: [settings boolForKey: @"AllowLocalNetworks"]
+                                                            allowLocal: [settings boolForKey: @"AllowLocalNetworks"]
+                                               includeCommonSubdomains: [settings boolForKey: @"EvaluateCommonSubdomains"]
                                                   includeLinkedDomains: [settings boolForKey: @"IncludeLinkedDomains"]];
+    // appended rules match whatever format the block was started with
+    blockManager.compactHostsRules = [settings boolForKey: @"CompactHostsFile"];
+    SCSpan* appendSpan = [[SCSpanRecorder sharedRecorder] startSpan: @"block.append" attributes: @{ @"AddedCount": @(added.count) }];
     [blockManager enterAppendMode];
     [blockManager addBlockEntriesFromStrings: added];
     [blockManager finishAppending];
-    
-    [settings setValue: newBlocklist forKey: @"ActiveBlocklist"];
+    [appendSpan end];
+    [SCDaemonBlockMethods recordBlockIntegrity];
     
     // make sure everyone knows about our new list
-    NSError* syncErr = [settings syncSettingsAndWait: 5];
+    NSError* syncErr = [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: newBlocklist forKey: @"ActiveBlocklist"];
+    }];
     if (syncErr != nil) {
         NSLog(@"WARNING: Sync failed or timed out with error %@ after updating blocklist", syncErr);
         [SCSentry captureError: syncErr];
     }
+    [SCDaemonBlockMethods publishBlockState];
 
     [SCHelperToolUtilities sendConfigurationChangedNotification];
 
@@ -200,11 +285,15 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
     // that blocked pages are not loaded from a cache.
     [SCHelperToolUtilities clearCachesIfRequested];
 
+    [[SCBlockRefresher sharedRefresher] reloadBlocklist];
+    [[SCDNSSinkhole sharedSinkhole] reloadBlocklist];
+
     [SCSentry addBreadcrumb: @"Daemon updated blocklist successfully" category: @"daemon"];
     NSLog(@"INFO: Blocklist successfully updated.");
     reply(nil);
 
     [[SCDaemon sharedDaemon] resetInactivityTimer];
+    [[SCSpanRecorder sharedRecorder] endOperation];
     [self.daemonMethodLock unlock];
 }
 
@@ -234,33 +323,26 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
     
     SCSettings* settings = [SCSettings sharedSettings];
     
-    // this can only be used to *extend* the block end date - not shorten it!
-    // and we also won't let them extend by more than 24 hours at a time, for safety...
-    // TODO: they should be able to extend up to MaxBlockLength minutes, right?
+    // blocks can only be extended (by up to a day at a time), never shortened
     NSDate* currentEndDate = [settings valueForKey: @"BlockEndDate"];
-    if ([newEndDate timeIntervalSinceDate: currentEndDate] < 0) {
-        NSLog(@"ERROR: Can't update block end date to an earlier date");
-        NSError* err = [SCErr errorWithCode: 308];
-        [SCSentry captureError: err];
-        reply(err);
-        [self.daemonMethodLock unlock];
-    }
-    if ([newEndDate timeIntervalSinceDate: currentEndDate] > 86400) { // 86400 seconds = 1 day
-        NSLog(@"ERROR: Can't extend block end date by more than 1 day at a time");
-        NSError* err = [SCErr errorWithCode: 309];
-        [SCSentry captureError: err];
-        reply(err);
+    NSError* endDateErr = [SCBlockUtilities errorForChangingBlockEndDate: currentEndDate toDate: newEndDate];
+    if (endDateErr != nil) {
+        NSLog(@"ERROR: Can't update block end date from %@ to %@: %@", currentEndDate, newEndDate, endDateErr.localizedDescription);
+        [SCSentry captureError: endDateErr];
+        reply(endDateErr);
         [self.daemonMethodLock unlock];
+        return;
     }
     
-    [settings setValue: newEndDate forKey: @"BlockEndDate"];
-    
     // make sure everyone knows about our new end date
-    NSError* syncErr = [settings syncSettingsAndWait: 5];
+    NSError* syncErr = [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: newEndDate forKey: @"BlockEndDate"];
+    }];
     if (syncErr != nil) {
         NSLog(@"WARNING: Sync failed or timed out with error %@ after extending block", syncErr);
         [SCSentry captureError: syncErr];
     }
+    [SCDaemonBlockMethods publishBlockState];
 
     [SCHelperToolUtilities sendConfigurationChangedNotification];
 
@@ -268,13 +350,15 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
     NSLog(@"INFO: Block successfully extended.");
     reply(nil);
     
+    // move the end-of-block checkup to the new end date
+    [[SCDaemon sharedDaemon] startCheckupTimer];
     [[SCDaemon sharedDaemon] resetInactivityTimer];
     [self.daemonMethodLock unlock];
 }
 
-+ (void)checkupBlock {
++ (BOOL)checkupBlock {
     if (![SCDaemonBlockMethods lockOrTimeout: nil timeout: CHECKUP_LOCK_TIMEOUT]) {
-        return;
+        return NO;
     }
     
     [SCSentry addBreadcrumb: @"Daemon method checkupBlock called" category: @"daemon"];
@@ -297,6 +381,9 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
         [SCSentry captureMessage: @"Checkup ran and no active block found! Removing block, tampering suspected..."];
         
         [SCHelperToolUtilities removeBlock];
+        installedBlockRecord = nil;
+        [SCDaemonBlockMethods forgetIntegrityResults];
+        [SCDaemonBlockMethods publishBlockState];
 
         [SCHelperToolUtilities sendConfigurationChangedNotification];
         
@@ -314,6 +401,9 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
         NSLog(@"INFO: Checkup ran, block expired, removing block.");
         
         [SCHelperToolUtilities removeBlock];
+        installedBlockRecord = nil;
+        [SCDaemonBlockMethods forgetIntegrityResults];
+        [SCDaemonBlockMethods publishBlockState];
 
         [SCHelperToolUtilities sendConfigurationChangedNotification];
 
@@ -337,52 +427,180 @@ NSTimeInterval CHECKUP_LOCK_TIMEOUT = 0.5; // use a shorter lock timeout for che
     if (shouldRunIntegrityCheck) {
         [SCDaemonBlockMethods checkBlockIntegrity];
     }
+    return YES;
 }
 
 + (void)checkBlockIntegrity {
+    [self checkBlockIntegrityOfComponents: SCBlockComponentAll];
+}
+
++ (void)checkBlockIntegrityOfComponents:(SCBlockComponent)components {
     if (![SCDaemonBlockMethods lockOrTimeout: nil timeout: CHECKUP_LOCK_TIMEOUT]) {
         return;
     }
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
+    [recorder beginOperation: @"checkBlockIntegrity"];
     
     [SCSentry addBreadcrumb: @"Daemon method checkBlockIntegrity called" category: @"daemon"];
 
+    if (installedBlockRecord == nil) {
+        // the daemon restarted since the block was installed, so we've got nothing to compare
+        // against. Do the old header check, and if the block looks fine, trust it from here on.
+        [self checkBlockIntegrityWithoutRecord];
+    } else {
+        SCSpan* checkSpan = [recorder startSpan: @"integrity.check" attributes: @{ @"Components": [SCBlockIntegrityRecord descriptionForComponents: components] }];
+        SCBlockComponent damaged = [installedBlockRecord damagedComponentsAmong: components];
+        [checkSpan endWithAttributes: @{ @"Intact": @(damaged == SCBlockComponentNone) }];
+        lastDamagedComponents = damaged;
+        lastUnrepairedComponents = SCBlockComponentNone;
+
+        if (damaged == SCBlockComponentNone) {
+            NSLog(@"INFO: Integrity check ran; no action needed.");
+            // these run every 15 seconds, so only keep the ones that actually had to do something
+            [recorder discardOperation];
+        } else {
+            NSString* damagedDescription = [SCBlockIntegrityRecord descriptionForComponents: damaged];
+            NSLog(@"INFO: Block was modified (%@), restoring from the recorded rules...", damagedDescription);
+
+            SCSpan* repairSpan = [recorder startSpan: @"integrity.repair" attributes: @{ @"Components": damagedDescription }];
+            SCBlockComponent failed = [installedBlockRecord repairComponents: damaged];
+            [repairSpan endWithAttributes: @{ @"Failed": [SCBlockIntegrityRecord descriptionForComponents: failed] }];
+            lastUnrepairedComponents = failed;
+
+            if (failed != SCBlockComponentNone) {
+                NSLog(@"WARNING: Couldn't restore %@ from the recorded rules, reinstalling the whole block.", [SCBlockIntegrityRecord descriptionForComponents: failed]);
+                [self reinstallBlock];
+            } else {
+                if (damaged & SCBlockComponentHostsFile) {
+                    [SCHelperToolUtilities clearCachesIfRequested];
+                }
+                [SCSentry addBreadcrumb: [NSString stringWithFormat: @"Daemon found compromised block integrity and restored %@", damagedDescription] category: @"daemon"];
+                NSLog(@"INFO: Integrity check ran; restored %@.", damagedDescription);
+            }
+            [recorder endOperation];
+        }
+    }
+    lastIntegrityCheckDate = [NSDate date];
+    [self publishBlockState];
+    
+    [self.daemonMethodLock unlock];
+}
+
++ (void)checkHostsFileAtPath:(NSString*)path {
+    if (![SCDaemonBlockMethods lockOrTimeout: nil timeout: CHECKUP_LOCK_TIMEOUT]) {
+        return;
+    }
+
+    NSString* standardPath = [path stringByStandardizingPath];
+    BOOL isNewHostsFile = (installedBlockRecord != nil)
+        && ![[SCSettings sharedSettings] boolForKey: @"ActiveBlockAsWhitelist"]
+        && [[NSFileManager defaultManager] isReadableFileAtPath: standardPath]
+        && ![[installedBlockRecord.hostsPaths valueForKey: @"stringByStandardizingPath"] containsObject: standardPath];
+    if (!isNewHostsFile) {
+        [self.daemonMethodLock unlock];
+        [self checkBlockIntegrityOfComponents: SCBlockComponentHostsFile];
+        return;
+    }
+
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
+    [recorder beginOperation: @"checkBlockIntegrity"];
+    NSLog(@"INFO: New hosts file appeared at %@, reinstalling the block to cover it.", standardPath);
+    [SCSentry addBreadcrumb: @"Daemon found a new VPN hosts file and reinstalled the block" category: @"daemon"];
+    [self reinstallBlock];
+    [recorder endOperation];
+    lastIntegrityCheckDate = [NSDate date];
+    [self publishBlockState];
+
+    [self.daemonMethodLock unlock];
+}
+
++ (void)checkSettingsIntegrity {
+    // we've still got everything in memory, so if the files were deleted or rolled back we can just put them back
+    [[SCSettings sharedSettings] restoreSettingsOnDisk];
+
+    // and if the settings don't say there's a block anymore (or say it's over), checkup will sort that out
+    [self checkupBlock];
+}
+
+// must be called with the method lock held, and an operation begun
++ (void)checkBlockIntegrityWithoutRecord {
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
     SCSettings* settings = [SCSettings sharedSettings];
+    SCSpan* checkSpan = [recorder startSpan: @"integrity.check"];
     PacketFilter* pf = [[PacketFilter alloc] init];
     HostFileBlockerSet* hostFileBlockerSet = [[HostFileBlockerSet alloc] init];
-    if(![pf containsSelfControlBlock] || (![settings boolForKey: @"ActiveBlockAsWhitelist"] && ![hostFileBlockerSet.defaultBlocker containsSelfControlBlock])) {
+    BOOL blockIsIntact = [pf containsSelfControlBlock] && ([settings boolForKey: @"ActiveBlockAsWhitelist"] || [hostFileBlockerSet.defaultBlocker containsSelfControlBlock]);
+    [checkSpan endWithAttributes: @{ @"Intact": @(blockIsIntact), @"Recorded": @NO }];
+    // we can't tell which parts were missing without a record, and reinstalling repairs all of them
+    lastDamagedComponents = blockIsIntact ? SCBlockComponentNone : SCBlockComponentAll;
+    lastUnrepairedComponents = SCBlockComponentNone;
+    if(!blockIsIntact) {
         NSLog(@"INFO: Block is missing in PF or hosts, re-adding...");
-        // The firewall is missing at least the block header.  Let's clear everything
-        // before we re-add to make sure everything goes smoothly.
-
-        [pf stopBlock: false];
-
-        [hostFileBlockerSet removeSelfControlBlock];
-        BOOL success = [hostFileBlockerSet writeNewFileContents];
-        // Revert the host file blocker's file contents to disk so we can check
-        // whether or not it still contains the block after our write (aka we messed up).
-        [hostFileBlockerSet revertFileContentsToDisk];
-        if(!success || [hostFileBlockerSet.defaultBlocker containsSelfControlBlock]) {
-            NSLog(@"WARNING: Error removing host file block.  Attempting to restore backup.");
-
-            if([hostFileBlockerSet restoreBackupHostsFile])
-                NSLog(@"INFO: Host file backup restored.");
-            else
-                NSLog(@"ERROR: Host file backup could not be restored.  This may result in a permanent block.");
-        }
+        [self reinstallBlock];
+        [recorder endOperation];
+    } else {
+        [SCDaemonBlockMethods recordBlockIntegrity];
+        NSLog(@"INFO: Integrity check ran; no action needed, recorded the installed block.");
+        [recorder discardOperation];
+    }
+}
 
-        // Get rid of the backup file since we're about to make a new one.
-        [hostFileBlockerSet deleteBackupHostsFile];
+// clears out whatever's left of the block and installs it again from settings (re-resolving everything).
+// must be called with the method lock held
++ (void)reinstallBlock {
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
+    PacketFilter* pf = [[PacketFilter alloc] init];
+    HostFileBlockerSet* hostFileBlockerSet = [[HostFileBlockerSet alloc] init];
 
-        // Perform the re-add of the rules
-        [SCHelperToolUtilities installBlockRulesFromSettings];
-        
-        [SCHelperToolUtilities clearCachesIfRequested];
+    // The firewall is missing at least the block header.  Let's clear everything
+    // before we re-add to make sure everything goes smoothly.
+    SCSpan* clearSpan = [recorder startSpan: @"block.clear"];
+    [pf stopBlock: false];
+
+    [hostFileBlockerSet removeSelfControlBlock];
+    BOOL success = [hostFileBlockerSet writeNewFileContents];
+    // Revert the host file blocker's file contents to disk so we can check
+    // whether or not it still contains the block after our write (aka we messed up).
+    [hostFileBlockerSet revertFileContentsToDisk];
+    if(!success || [hostFileBlockerSet.defaultBlocker containsSelfControlBlock]) {
+        NSLog(@"WARNING: Error removing host file block.  Attempting to restore backup.");
+
+        if([hostFileBlockerSet restoreBackupHostsFile])
+            NSLog(@"INFO: Host file backup restored.");
+        else
+            NSLog(@"ERROR: Host file backup could not be restored.  This may result in a permanent block.");
+    }
+
+    // Get rid of the backup file since we're about to make a new one.
+    [hostFileBlockerSet deleteBackupHostsFile];
+    [clearSpan end];
 
-        [SCSentry addBreadcrumb: @"Daemon found compromised block integrity and re-added rules" category: @"daemon"];
-        NSLog(@"INFO: Integrity check ran; readded block rules.");
-    } else NSLog(@"INFO: Integrity check ran; no action needed.");
+    // Perform the re-add of the rules
+    [SCHelperToolUtilities installBlockRulesFromSettings];
+    [SCDaemonBlockMethods recordBlockIntegrity];
     
-    [self.daemonMethodLock unlock];
+    [SCHelperToolUtilities clearCachesIfRequested];
+
+    [[SCBlockRefresher sharedRefresher] reloadBlocklist];
+
+    [SCSentry addBreadcrumb: @"Daemon found compromised block integrity and re-added rules" category: @"daemon"];
+    NSLog(@"INFO: Integrity check ran; readded block rules.");
+}
+
++ (NSDictionary*)blockTimings {
+    // deliberately doesn't take the method lock - the recorder and the stats are all
+    // thread-safe, and it'd be a shame to time out while a slow block start is running
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
+    return @{
+        @"Spans": [recorder recentSpans],
+        @"SpanCapacity": @(recorder.capacity),
+        @"Scheduler": [[SCBlockWorkScheduler sharedScheduler] statistics],
+        @"Refresher": [[SCBlockRefresher sharedRefresher] statistics],
+        @"DNSCache": [[SCDNSCache sharedCache] statistics],
+        @"DNSSinkhole": [[SCDNSSinkhole sharedSinkhole] statistics],
+        @"TamperWatcher": [[SCDaemon sharedDaemon] tamperWatcherStatistics],
+        @"DeadlineScheduler": [[SCDeadlineScheduler sharedScheduler] statistics]
+    };
 }
 
 @end
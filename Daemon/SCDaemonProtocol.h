@@ -23,6 +23,10 @@ NS_ASSUME_NONNULL_BEGIN
 // XPC method to get version of the installed daemon
 - (void)getVersionWithReply:(void(^)(NSString * version))reply;
 
+// XPC method to get timings for recent block starts/updates/removals
+// (see SCDaemonBlockMethods blockTimings)
+- (void)getBlockTimingsWithReply:(void(^)(NSDictionary* timings))reply;
+
 @end
 
 NS_ASSUME_NONNULL_END
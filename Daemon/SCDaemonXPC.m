@@ -74,4 +74,11 @@
     reply(SELFCONTROL_VERSION_STRING);
 }
 
+// Like getVersion, this doesn't require authorization: it's read-only, and
+// only has timings and counts (no blocklist contents).
+- (void)getBlockTimingsWithReply:(void(^)(NSDictionary* timings))reply {
+    NSLog(@"XPC method called: getBlockTimingsWithReply");
+    reply([SCDaemonBlockMethods blockTimings]);
+}
+
 @end
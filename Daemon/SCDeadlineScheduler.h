@@ -0,0 +1,41 @@
+//
+//  SCDeadlineScheduler.h
+//  selfcontrold
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// One timer for everything the daemon needs to do at a particular time (the block ending,
+// periodic checkups, re-resolving domains, exiting when idle), instead of polling.
+// Each event is one-shot, named (scheduling a name again replaces it), and has a tolerance:
+// it runs somewhere between its deadline and deadline + tolerance. The timer is only armed
+// for the earliest point something *must* run, and every event that's due by then runs in
+// the same wakeup - so a generous tolerance lets events ride along with each other.
+// Handlers run one at a time on a background serial queue, and may reschedule themselves.
+@interface SCDeadlineScheduler : NSObject
+
++ (instancetype)sharedScheduler;
+
+// Runs handler once the system clock reaches date. If the clock is changed to (or
+// jumps past) the date, it runs right away; across sleep, it runs on wake.
+- (void)scheduleEvent:(NSString*)name atDate:(NSDate*)date tolerance:(NSTimeInterval)tolerance handler:(dispatch_block_t)handler;
+// Runs handler after interval seconds have elapsed (including time asleep),
+// regardless of any changes to the system clock in the meantime
+- (void)scheduleEvent:(NSString*)name afterInterval:(NSTimeInterval)interval tolerance:(NSTimeInterval)tolerance handler:(dispatch_block_t)handler;
+- (void)cancelEvent:(NSString*)name;
+- (BOOL)hasEvent:(NSString*)name;
+
+// Re-evaluates every deadline against the current clock. Called automatically
+// when the system clock changes.
+- (void)clockDidChange;
+
+// WakeupCount, FiredEventCount, and PendingEvents (name -> seconds until its deadline)
+- (NSDictionary<NSString*, id>*)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
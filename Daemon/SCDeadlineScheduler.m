@@ -0,0 +1,206 @@
+//
+//  SCDeadlineScheduler.m
+//  selfcontrold
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCDeadlineScheduler.h"
+#include <time.h>
+
+// seconds on a clock that never jumps, and keeps counting while asleep
+static NSTimeInterval SCElapsedTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (NSTimeInterval)ts.tv_sec + (NSTimeInterval)ts.tv_nsec / NSEC_PER_SEC;
+}
+
+@interface SCDeadlineEvent : NSObject
+
+@property (copy) NSString* name;
+// exactly one of these is set, depending on which clock the event is on
+@property (strong, nullable) NSDate* fireDate;
+@property NSTimeInterval fireElapsedTime;
+@property NSTimeInterval tolerance;
+@property (copy) dispatch_block_t handler;
+
+@end
+
+@implementation SCDeadlineEvent
+
+- (NSTimeInterval)secondsUntilDeadline {
+    if (self.fireDate != nil) return [self.fireDate timeIntervalSinceNow];
+    return self.fireElapsedTime - SCElapsedTime();
+}
+
+@end
+
+@interface SCDeadlineScheduler () {
+    // everything below is only touched on _queue
+    dispatch_queue_t _queue;
+    dispatch_queue_t _handlerQueue;
+    dispatch_source_t _timer;
+    NSMutableDictionary<NSString*, SCDeadlineEvent*>* _events;
+    id _clockChangeObserver;
+
+    NSUInteger _wakeupCount;
+    NSUInteger _firedEventCount;
+}
+
+@end
+
+@implementation SCDeadlineScheduler
+
++ (instancetype)sharedScheduler {
+    static SCDeadlineScheduler* scheduler = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        scheduler = [SCDeadlineScheduler new];
+    });
+    return scheduler;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _queue = dispatch_queue_create("org.eyebeam.selfcontrold.SCDeadlineScheduler", DISPATCH_QUEUE_SERIAL);
+        _handlerQueue = dispatch_queue_create("org.eyebeam.selfcontrold.SCDeadlineScheduler.handlers", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_handlerQueue, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+        _events = [NSMutableDictionary dictionary];
+
+        _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        __weak SCDeadlineScheduler* weakSelf = self;
+        dispatch_source_set_event_handler(_timer, ^{
+            [weakSelf timerFired];
+        });
+        dispatch_resume(_timer);
+
+        _clockChangeObserver = [[NSNotificationCenter defaultCenter] addObserverForName: NSSystemClockDidChangeNotification
+                                                                                 object: nil
+                                                                                  queue: nil
+                                                                             usingBlock:^(NSNotification* note) {
+            [weakSelf clockDidChange];
+        }];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver: _clockChangeObserver];
+    dispatch_source_cancel(_timer);
+}
+
+- (void)scheduleEvent:(NSString*)name atDate:(NSDate*)date tolerance:(NSTimeInterval)tolerance handler:(dispatch_block_t)handler {
+    SCDeadlineEvent* event = [SCDeadlineEvent new];
+    event.name = name;
+    event.fireDate = date;
+    event.tolerance = MAX(0, tolerance);
+    event.handler = handler;
+    [self addEvent: event];
+}
+
+- (void)scheduleEvent:(NSString*)name afterInterval:(NSTimeInterval)interval tolerance:(NSTimeInterval)tolerance handler:(dispatch_block_t)handler {
+    SCDeadlineEvent* event = [SCDeadlineEvent new];
+    event.name = name;
+    event.fireElapsedTime = SCElapsedTime() + MAX(0, interval);
+    event.tolerance = MAX(0, tolerance);
+    event.handler = handler;
+    [self addEvent: event];
+}
+
+- (void)addEvent:(SCDeadlineEvent*)event {
+    dispatch_async(_queue, ^{
+        self->_events[event.name] = event;
+        [self rearmTimer];
+    });
+}
+
+- (void)cancelEvent:(NSString*)name {
+    dispatch_async(_queue, ^{
+        if (self->_events[name] == nil) return;
+        [self->_events removeObjectForKey: name];
+        [self rearmTimer];
+    });
+}
+
+- (BOOL)hasEvent:(NSString*)name {
+    __block BOOL hasEvent;
+    dispatch_sync(_queue, ^{
+        hasEvent = (self->_events[name] != nil);
+    });
+    return hasEvent;
+}
+
+- (void)clockDidChange {
+    dispatch_async(_queue, ^{
+        [self runDueEvents];
+        [self rearmTimer];
+    });
+}
+
+- (NSDictionary<NSString*, id>*)statistics {
+    __block NSDictionary* statistics;
+    dispatch_sync(_queue, ^{
+        NSMutableDictionary<NSString*, NSNumber*>* pendingEvents = [NSMutableDictionary dictionaryWithCapacity: self->_events.count];
+        for (SCDeadlineEvent* event in self->_events.allValues) {
+            pendingEvents[event.name] = @(MAX(0, [event secondsUntilDeadline]));
+        }
+        statistics = @{
+            @"WakeupCount": @(self->_wakeupCount),
+            @"FiredEventCount": @(self->_firedEventCount),
+            @"PendingEvents": pendingEvents
+        };
+    });
+    return statistics;
+}
+
+#pragma mark - Internal (all on _queue)
+
+- (void)timerFired {
+    _wakeupCount++;
+    [self runDueEvents];
+    [self rearmTimer];
+}
+
+- (void)runDueEvents {
+    NSMutableArray<SCDeadlineEvent*>* dueEvents = [NSMutableArray array];
+    for (SCDeadlineEvent* event in _events.allValues) {
+        if ([event secondsUntilDeadline] <= 0) [dueEvents addObject: event];
+    }
+    [dueEvents sortUsingComparator:^NSComparisonResult(SCDeadlineEvent* a, SCDeadlineEvent* b) {
+        return [@([a secondsUntilDeadline]) compare: @([b secondsUntilDeadline])];
+    }];
+
+    for (SCDeadlineEvent* event in dueEvents) {
+        // take it out first, so the handler can schedule it again
+        [_events removeObjectForKey: event.name];
+        _firedEventCount++;
+        dispatch_async(_handlerQueue, event.handler);
+    }
+}
+
+- (void)rearmTimer {
+    // wake up at the last moment the most pressing event can still run on time,
+    // and (in runDueEvents) take everything else that's due by then along with it
+    NSTimeInterval nextWakeup = DBL_MAX;
+    NSTimeInterval leeway = 0;
+    for (SCDeadlineEvent* event in _events.allValues) {
+        NSTimeInterval latest = [event secondsUntilDeadline] + event.tolerance;
+        if (latest < nextWakeup) {
+            nextWakeup = latest;
+            leeway = MIN(event.tolerance / 10.0, 1.0);
+        }
+    }
+
+    if (nextWakeup == DBL_MAX) {
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+
+    // armed on the wall clock so it keeps counting across sleep, and notices clock changes
+    // (elapsed-time events get re-measured from the monotonic clock whenever the clock changes)
+    dispatch_time_t start = dispatch_walltime(NULL, (int64_t)(MAX(0, nextWakeup) * NSEC_PER_SEC));
+    dispatch_source_set_timer(_timer, start, DISPATCH_TIME_FOREVER, (uint64_t)(leeway * NSEC_PER_SEC));
+}
+
+@end
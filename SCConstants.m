@@ -53,6 +53,8 @@ OSStatus const AUTH_CANCELLED_STATUS = -60006;
             @"GetStartedShown": @NO,
             @"EvaluateCommonSubdomains": @YES,
             @"IncludeLinkedDomains": @YES,
+            @"CompactHostsFile": @NO,
+            @"DNSSinkholeEnabled": @NO,
             @"BlockSoundShouldPlay": @NO,
             @"BlockSound": @5,
             @"ClearCaches": @YES,
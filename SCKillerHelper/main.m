@@ -17,6 +17,7 @@
 #import "SCMigrationUtilities.h"
 #import <sysexits.h>
 #import "SCSentry.h"
+#import "SCBlockState.h"
 
 #define LOG_FILE @"~/Documents/SelfControl-Killer.log"
 
@@ -198,6 +199,13 @@ int main(int argc, char* argv[]) {
         [settings resetAllSettingsToDefaults];
         [settings synchronizeSettings];
         [log appendFormat: @"Reset all modern secured settings to default values.\n"];
+
+        // and the block state the daemon published for the app, which would otherwise still say the block's on
+        if ([fileManager removeItemAtPath: SCBlockStateFile.defaultPath error: nil]) {
+            [log appendString: @"Removed published block state file.\n"];
+        } else {
+            [log appendString: @"No published block state file removed.\n"];
+        }
         
         if ([SCMigrationUtilities legacySettingsFoundForUser: controllingUID]) {
             [SCMigrationUtilities copyLegacySettingsToDefaults: controllingUID];
@@ -0,0 +1,164 @@
+//
+//  SCBlockBenchmarks.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCShardedCollections.h"
+#import "PacketFilter.h"
+#import "HostFileBlockerSet.h"
+
+// Microbenchmarks for the block-building hot paths. These log their numbers
+// (look for "SCBlockBenchmarks:" in the test output) and only assert on things
+// that should hold on any machine.
+@interface SCBlockBenchmarks : XCTestCase
+
+@end
+
+@implementation SCBlockBenchmarks
+
+// runs the block on workerCount real threads at once, passing each its worker index
+- (NSTimeInterval)runWorkers:(NSUInteger)workerCount block:(void (^)(NSUInteger workerIndex))block {
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_semaphore_t startSignal = dispatch_semaphore_create(0);
+
+    for (NSUInteger i = 0; i < workerCount; i++) {
+        dispatch_group_enter(group);
+        NSThread* thread = [[NSThread alloc] initWithBlock:^{
+            dispatch_semaphore_wait(startSignal, DISPATCH_TIME_FOREVER);
+            block(i);
+            dispatch_group_leave(group);
+        }];
+        [thread start];
+    }
+
+    NSDate* startDate = [NSDate date];
+    for (NSUInteger i = 0; i < workerCount; i++) dispatch_semaphore_signal(startSignal);
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    return [[NSDate date] timeIntervalSinceDate: startDate];
+}
+
+- (void)testWorkerBufferLockWaitVersusSingleLock {
+    static NSUInteger const kItemsPerWorker = 20000;
+
+    for (NSNumber* workers in @[@1, @4, @16, @64]) {
+        NSUInteger workerCount = workers.unsignedIntegerValue;
+
+        // one shard is equivalent to the old single monitor around the rules
+        SCWorkerBuffer* singleLockBuffer = [[SCWorkerBuffer alloc] initWithShardCount: 1];
+        SCWorkerBuffer* shardedBuffer = [SCWorkerBuffer new];
+
+        NSTimeInterval singleLockTime = [self runWorkers: workerCount block:^(NSUInteger workerIndex) {
+            for (NSUInteger i = 0; i < kItemsPerWorker; i++) [singleLockBuffer addObject: @(i)];
+        }];
+        NSTimeInterval shardedTime = [self runWorkers: workerCount block:^(NSUInteger workerIndex) {
+            for (NSUInteger i = 0; i < kItemsPerWorker; i++) [shardedBuffer addObject: @(i)];
+        }];
+
+        XCTAssertEqual([singleLockBuffer drainObjects].count, workerCount * kItemsPerWorker);
+        XCTAssertEqual([shardedBuffer drainObjects].count, workerCount * kItemsPerWorker);
+        XCTAssertEqual([shardedBuffer drainObjects].count, 0);
+
+        NSLog(@"SCBlockBenchmarks: %lu workers: single lock %.3fs (%.3fs waiting, %llu contended), sharded %.3fs (%.3fs waiting, %llu contended)",
+              (unsigned long)workerCount,
+              singleLockTime, singleLockBuffer.lockWaitTime, singleLockBuffer.contendedLockCount,
+              shardedTime, shardedBuffer.lockWaitTime, shardedBuffer.contendedLockCount);
+        // how much less the sharded buffer waits depends on the machine and whatever else is
+        // running, so that's only reported above - the counts are all we can rely on
+    }
+}
+
+- (void)testShardedSetDedupesAcrossWorkers {
+    SCShardedSet* set = [SCShardedSet new];
+    __block _Atomic NSUInteger newCount = 0;
+
+    // every worker adds the same 5000 objects, but each should only count as new once
+    [self runWorkers: 16 block:^(NSUInteger workerIndex) {
+        for (NSUInteger i = 0; i < 5000; i++) {
+            if ([set addObject: [NSString stringWithFormat: @"domain%lu.com", (unsigned long)i]]) newCount++;
+        }
+    }];
+
+    XCTAssertEqual(newCount, 5000);
+    XCTAssertEqual(set.count, 5000);
+    XCTAssertTrue([set containsObject: @"domain42.com"]);
+    NSLog(@"SCBlockBenchmarks: sharded set dedupe spent %.3fs waiting (%llu contended)", set.lockWaitTime, set.contendedLockCount);
+}
+
+- (void)testPacketFilterRulesFromManyWorkers {
+    PacketFilter* pf = [[PacketFilter alloc] initAsAllowlist: NO];
+    pf.anchorPath = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSUUID UUID].UUIDString];
+
+    NSTimeInterval runTime = [self runWorkers: 32 block:^(NSUInteger workerIndex) {
+        for (NSUInteger i = 0; i < 2000; i++) {
+            // 10.x.y.z, unique per worker, and port 443 every so often
+            NSString* ip = [NSString stringWithFormat: @"10.%lu.%lu.%lu", (unsigned long)workerIndex, (unsigned long)(i / 256), (unsigned long)(i % 256)];
+            [pf addRuleWithIP: ip port: (i % 10 == 0) ? 443 : 0 maskLen: 0];
+        }
+    }];
+
+    NSString* config = [pf configurationString];
+    XCTAssertEqual(pf.tableAddressCount, 32 * 2000);
+    XCTAssertTrue([config containsString: @"table <org.eyebeam.block.p443> persist"]);
+    NSLog(@"SCBlockBenchmarks: 32 workers added 64000 pf rules in %.3fs, %.4fs waiting on locks", runTime, pf.ruleLockWaitTime);
+}
+
+// builds a fake root with /etc/hosts plus the given number of VPN hosts files,
+// runs a full hosts block through HostFileBlockerSet and returns how long it took
+- (NSTimeInterval)runHostsBlockWithVPNFileCount:(NSUInteger)vpnFileCount domainCount:(NSUInteger)domainCount checkRoot:(void (^)(NSString* rootPath, NSArray<NSString*>* hostsPaths))check {
+    NSArray<NSString*>* vpnPaths = @[@"etc/pulse-hosts.bak", @"etc/jnpr-pulse-hosts.bak", @"etc/pulse.hosts.bak", @"etc/jnpr-nc-hosts.bak", @"etc/hosts.ac"];
+    NSString* rootPath = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSUUID UUID].UUIDString];
+    [[NSFileManager defaultManager] createDirectoryAtPath: [rootPath stringByAppendingPathComponent: @"etc"] withIntermediateDirectories: YES attributes: nil error: nil];
+
+    NSMutableArray<NSString*>* hostsPaths = [NSMutableArray arrayWithObject: [rootPath stringByAppendingPathComponent: @"etc/hosts"]];
+    for (NSUInteger i = 0; i < MIN(vpnFileCount, vpnPaths.count); i++) {
+        [hostsPaths addObject: [rootPath stringByAppendingPathComponent: vpnPaths[i]]];
+    }
+    for (NSString* path in hostsPaths) {
+        [@"127.0.0.1\tlocalhost\n10.1.2.3\tvpn.internal\n" writeToFile: path atomically: YES encoding: NSUTF8StringEncoding error: nil];
+    }
+
+    NSDate* startDate = [NSDate date];
+    HostFileBlockerSet* blockerSet = [[HostFileBlockerSet alloc] initWithRootPath: rootPath];
+    [blockerSet addSelfControlBlockHeader];
+    [self runWorkers: 8 block:^(NSUInteger workerIndex) {
+        for (NSUInteger i = workerIndex; i < domainCount; i += 8) {
+            [blockerSet addRuleBlockingDomain: [NSString stringWithFormat: @"site%06lu.example.com", (unsigned long)i]];
+        }
+    }];
+    [blockerSet addSelfControlBlockFooter];
+    XCTAssertTrue([blockerSet writeNewFileContents]);
+    NSTimeInterval elapsed = [[NSDate date] timeIntervalSinceDate: startDate];
+
+    XCTAssertEqual(blockerSet.blockers.count, hostsPaths.count);
+    check(rootPath, hostsPaths);
+    [[NSFileManager defaultManager] removeItemAtPath: rootPath error: nil];
+    return elapsed;
+}
+
+- (void)testHostsBlockAcrossVPNFiles {
+    static NSUInteger const kDomainCount = 50000;
+
+    void (^check)(NSString*, NSArray<NSString*>*) = ^(NSString* rootPath, NSArray<NSString*>* hostsPaths) {
+        NSString* firstSection = nil;
+        for (NSString* path in hostsPaths) {
+            NSString* contents = [NSString stringWithContentsOfFile: path encoding: NSUTF8StringEncoding error: nil];
+            XCTAssertTrue([contents hasPrefix: @"127.0.0.1\tlocalhost\n10.1.2.3\tvpn.internal\n\n# BEGIN SELFCONTROL BLOCK\n0.0.0.0\tsite000000.example.com\n"], @"%@", path);
+            XCTAssertTrue([contents hasSuffix: @"::\tsite049999.example.com\n# END SELFCONTROL BLOCK\n"], @"%@", path);
+
+            // every file should get exactly the same block
+            NSString* section = [contents substringFromIndex: [contents rangeOfString: @"# BEGIN SELFCONTROL BLOCK"].location];
+            if (firstSection == nil) firstSection = section;
+            XCTAssertEqualObjects(section, firstSection, @"%@", path);
+        }
+    };
+
+    NSTimeInterval noVPNTime = [self runHostsBlockWithVPNFileCount: 0 domainCount: kDomainCount checkRoot: check];
+    NSTimeInterval fiveVPNTime = [self runHostsBlockWithVPNFileCount: 5 domainCount: kDomainCount checkRoot: check];
+    NSLog(@"SCBlockBenchmarks: hosts block of %lu domains took %.3fs for /etc/hosts alone, %.3fs with 5 VPN hosts files too (%.2fx)",
+          (unsigned long)kDomainCount, noVPNTime, fiveVPNTime, fiveVPNTime / MAX(noVPNTime, 0.0001));
+}
+
+@end
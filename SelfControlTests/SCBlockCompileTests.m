@@ -0,0 +1,134 @@
+//
+//  SCBlockCompileTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "BlockManager.h"
+#import "SCStaticResolver.h"
+
+@interface SCBlockCompileTests : XCTestCase
+
+@end
+
+@implementation SCBlockCompileTests {
+    NSString* tempDir;
+}
+
+- (void)setUp {
+    tempDir = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath: tempDir error: nil];
+}
+
+- (NSDictionary*)compileBlocklist:(NSArray<NSString*>*)blocklist toRoot:(NSString*)root {
+    SCStaticResolver* resolver = [[SCStaticResolver alloc] initWithAddressTable: @{
+        @"example.com": @[@"93.184.216.34", @"2606:2800:220:1:248:1893:25c8:1946"],
+        @"WWW.example.com": @[@"93.184.216.34"]
+    }];
+    BlockManager* blockManager = [[BlockManager alloc] initForCompilingToRootPath: root
+                                                                         resolver: resolver
+                                                                      asAllowlist: NO
+                                                                       allowLocal: YES
+                                                          includeCommonSubdomains: YES
+                                                             includeLinkedDomains: NO];
+    [blockManager prepareToAddBlock];
+    [blockManager addBlockEntriesFromStrings: blocklist];
+
+    NSError* err = nil;
+    NSDictionary* manifest = [blockManager compileBlock: &err];
+    XCTAssertNil(err);
+    return manifest;
+}
+
+- (NSString*)contentsOfFile:(NSString*)relativePath inRoot:(NSString*)root {
+    return [NSString stringWithContentsOfFile: [root stringByAppendingPathComponent: relativePath] encoding: NSUTF8StringEncoding error: nil];
+}
+
+- (void)testCompileWritesHostsAnchorAndManifest {
+    NSString* root = [tempDir stringByAppendingPathComponent: @"out"];
+    NSDictionary* manifest = [self compileBlocklist: @[@"example.com", @"10.1.2.3", @"unknown.test"] toRoot: root];
+
+    XCTAssertNotNil(manifest);
+    // example.com, www.example.com, 10.1.2.3, unknown.test, www.unknown.test
+    XCTAssertEqualObjects(manifest[@"EntryCount"], @5);
+    XCTAssertEqualObjects(manifest[@"Resolutions"][@"example.com"], (@[@"2606:2800:220:1:248:1893:25c8:1946", @"93.184.216.34"]));
+    XCTAssertEqualObjects(manifest[@"Resolutions"][@"www.example.com"], @[@"93.184.216.34"]);
+    XCTAssertEqualObjects(manifest[@"UnresolvedDomains"], (@[@"unknown.test", @"www.unknown.test"]));
+    XCTAssertEqualObjects(manifest[@"Files"][@"PFAnchor"], @"etc/pf.anchors/org.eyebeam");
+
+    NSString* anchor = [self contentsOfFile: manifest[@"Files"][@"PFAnchor"] inRoot: root];
+    XCTAssertTrue([anchor containsString: @"table <org.eyebeam.block> persist"]);
+    XCTAssertTrue([anchor containsString: @"\t10.1.2.3 \\\n"]);
+    XCTAssertTrue([anchor containsString: @"\t93.184.216.34 \\\n"]);
+    XCTAssertTrue([anchor containsString: @"\t2606:2800:220:1:248:1893:25c8:1946 \\\n"]);
+
+    NSString* fragment = [self contentsOfFile: manifest[@"Files"][@"HostsFragment"] inRoot: root];
+    XCTAssertTrue([fragment hasPrefix: @"# BEGIN SELFCONTROL BLOCK\n"]);
+    XCTAssertTrue([fragment hasSuffix: @"# END SELFCONTROL BLOCK\n"]);
+    XCTAssertTrue([fragment containsString: @"0.0.0.0\texample.com\n"]);
+    XCTAssertTrue([fragment containsString: @"::\twww.unknown.test\n"]);
+    // IPs only go in pf
+    XCTAssertFalse([fragment containsString: @"10.1.2.3"]);
+
+    // the full hosts file is the default one plus the block
+    NSString* hosts = [self contentsOfFile: manifest[@"Files"][@"Hosts"] inRoot: root];
+    XCTAssertTrue([hosts containsString: @"broadcasthost"]);
+    XCTAssertTrue([hosts hasSuffix: fragment]);
+
+    NSData* manifestData = [NSData dataWithContentsOfFile: [root stringByAppendingPathComponent: @"manifest.json"]];
+    XCTAssertEqualObjects([NSJSONSerialization JSONObjectWithData: manifestData options: 0 error: nil], manifest);
+}
+
+- (void)testCompileIsDeterministic {
+    NSArray* blocklist = @[@"example.com", @"facebook.com", @"netflix.com", @"unknown.test", @"10.1.2.3", @"10.1.2.0/24"];
+    NSString* rootA = [tempDir stringByAppendingPathComponent: @"a"];
+    NSString* rootB = [tempDir stringByAppendingPathComponent: @"b"];
+    [self compileBlocklist: blocklist toRoot: rootA];
+    [self compileBlocklist: [[blocklist reverseObjectEnumerator] allObjects] toRoot: rootB];
+
+    for (NSString* file in @[@"etc/hosts", @"etc/pf.anchors/org.eyebeam", @"hosts.fragment", @"manifest.json"]) {
+        NSString* contentsA = [self contentsOfFile: file inRoot: rootA];
+        XCTAssertNotNil(contentsA, @"%@ wasn't written", file);
+        XCTAssertEqualObjects(contentsA, [self contentsOfFile: file inRoot: rootB], @"%@ differs between runs", file);
+    }
+}
+
+- (void)testStaticResolverReadsHostsFormat {
+    [[NSFileManager defaultManager] createDirectoryAtPath: tempDir withIntermediateDirectories: YES attributes: nil error: nil];
+    NSString* path = [tempDir stringByAppendingPathComponent: @"resolutions.hosts"];
+    [@"# comment\n1.2.3.4  a.test b.test\n\n::1 a.test # trailing\nnot-an-ip c.test\n" writeToFile: path atomically: YES encoding: NSUTF8StringEncoding error: nil];
+
+    SCStaticResolver* resolver = [SCStaticResolver resolverWithContentsOfFile: path error: nil];
+    XCTAssertNotNil(resolver);
+
+    NSString* missingPath = [tempDir stringByAppendingPathComponent: @"missing.json"];
+    NSError* err = nil;
+    XCTAssertNil([SCStaticResolver resolverWithContentsOfFile: missingPath error: &err]);
+    XCTAssertNotNil(err);
+
+    XCTestExpectation* expectation = [self expectationWithDescription: @"lookups finish"];
+    expectation.expectedFulfillmentCount = 3;
+    [resolver resolveDomain: @"A.test" completion:^(SCDNSResolution* resolution) {
+        XCTAssertEqual(resolution.status, SCDNSResolutionStatusSuccess);
+        XCTAssertEqualObjects(resolution.addresses, (@[@"1.2.3.4", @"::1"]));
+        [expectation fulfill];
+    }];
+    [resolver resolveDomain: @"b.test" completion:^(SCDNSResolution* resolution) {
+        XCTAssertEqualObjects(resolution.addresses, @[@"1.2.3.4"]);
+        [expectation fulfill];
+    }];
+    [resolver resolveDomain: @"c.test" completion:^(SCDNSResolution* resolution) {
+        XCTAssertEqual(resolution.status, SCDNSResolutionStatusNXDomain);
+        XCTAssertEqual(resolution.addresses.count, 0);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout: 5 handler: nil];
+    XCTAssertEqual(resolver.lookupCount, 3);
+}
+
+@end
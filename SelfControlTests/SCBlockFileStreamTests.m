@@ -0,0 +1,213 @@
+//
+//  SCBlockFileStreamTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCBlockFileStream.h"
+#import "SCBlockFileReaderWriter.h"
+
+@interface SCBlockFileStreamTests : XCTestCase
+
+@property NSURL* fileURL;
+
+@end
+
+@implementation SCBlockFileStreamTests
+
+- (void)setUp {
+    NSString* name = [NSString stringWithFormat: @"SCBlockFileStreamTests-%@.selfcontrol", [NSUUID UUID].UUIDString];
+    self.fileURL = [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: name]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtURL: self.fileURL error: nil];
+}
+
+- (void)writeEntries:(NSArray<NSString*>*)entries isAllowlist:(BOOL)isAllowlist {
+    NSError* err = nil;
+    SCBlockFileWriter* writer = [[SCBlockFileWriter alloc] initWithFileURL: self.fileURL isAllowlist: isAllowlist error: &err];
+    XCTAssertNotNil(writer);
+    XCTAssertTrue([writer addEntries: entries error: &err]);
+    XCTAssertTrue([writer finishWithError: &err]);
+    XCTAssertNil(err);
+}
+
+- (void)overwriteBytes:(const void*)bytes length:(NSUInteger)length atOffset:(unsigned long long)offset {
+    NSFileHandle* handle = [NSFileHandle fileHandleForWritingToURL: self.fileURL error: nil];
+    [handle seekToFileOffset: offset];
+    [handle writeData: [NSData dataWithBytes: bytes length: length]];
+    [handle closeFile];
+}
+
+- (void)testRoundTrip {
+    NSArray* entries = @[ @"facebook.com", @"reddit.com:443", @"bücher.de", @"10.0.0.0/8", @"" ];
+    [self writeEntries: entries isAllowlist: YES];
+
+    NSError* err = nil;
+    SCBlockFileReader* reader = [[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: &err];
+    XCTAssertNotNil(reader);
+    XCTAssertEqual(reader.formatVersion, 2);
+    XCTAssertTrue(reader.isAllowlist);
+    XCTAssertEqual(reader.entryCount, entries.count);
+    XCTAssertEqualObjects([reader readAllEntries: &err], entries);
+
+    // no temporary files left lying around next to it
+    NSArray* siblings = [[NSFileManager defaultManager] contentsOfDirectoryAtPath: NSTemporaryDirectory() error: nil];
+    for (NSString* sibling in siblings) {
+        XCTAssertFalse([sibling hasPrefix: [@"." stringByAppendingString: self.fileURL.lastPathComponent]]);
+    }
+
+    [self writeEntries: @[] isAllowlist: NO];
+    reader = [[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: &err];
+    XCTAssertFalse(reader.isAllowlist);
+    XCTAssertEqualObjects([reader readAllEntries: &err], @[]);
+}
+
+- (void)testReadsLegacyPlist {
+    NSArray* entries = @[ @"facebook.com", @"reddit.com" ];
+    NSData* plistData = [NSPropertyListSerialization dataWithPropertyList: @{ @"HostBlacklist": entries, @"BlockAsWhitelist": @YES }
+                                                                   format: NSPropertyListBinaryFormat_v1_0
+                                                                  options: 0
+                                                                    error: nil];
+    XCTAssertTrue([plistData writeToURL: self.fileURL atomically: YES]);
+
+    SCBlockFileReader* reader = [[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: nil];
+    XCTAssertEqual(reader.formatVersion, 1);
+    XCTAssertTrue(reader.isAllowlist);
+    XCTAssertEqual(reader.entryCount, 2);
+
+    NSMutableArray* batches = [NSMutableArray array];
+    XCTAssertTrue([reader enumerateEntriesStartingAt: 1 batchSize: 10 usingBlock:^(NSArray<NSString*>* batch, BOOL* stop) {
+        [batches addObject: batch];
+    } error: nil]);
+    XCTAssertEqualObjects(batches, (@[ @[ @"reddit.com" ] ]));
+
+    NSDictionary* blockInfo = [SCBlockFileReaderWriter readBlocklistFromFile: self.fileURL error: nil];
+    XCTAssertEqualObjects(blockInfo[@"Blocklist"], entries);
+    XCTAssertEqualObjects(blockInfo[@"BlockAsWhitelist"], @YES);
+}
+
+- (void)testFacadeRoundTrip {
+    NSArray* entries = @[ @"facebook.com", @"reddit.com" ];
+    NSError* err = nil;
+    XCTAssertTrue([SCBlockFileReaderWriter writeBlocklistToFileURL: self.fileURL
+                                                         blockInfo: @{ @"Blocklist": entries, @"BlockAsWhitelist": @NO }
+                                                             error: &err]);
+
+    NSDictionary* blockInfo = [SCBlockFileReaderWriter readBlocklistFromFile: self.fileURL error: nil];
+    XCTAssertEqualObjects(blockInfo[@"Blocklist"], entries);
+    XCTAssertEqualObjects(blockInfo[@"BlockAsWhitelist"], @NO);
+}
+
+- (void)testStartsPartwayThrough {
+    NSMutableArray* entries = [NSMutableArray array];
+    for (int i = 0; i < 50000; i++) {
+        [entries addObject: [NSString stringWithFormat: @"site%d.example.com", i]];
+    }
+    [self writeEntries: entries isAllowlist: NO];
+
+    SCBlockFileReader* reader = [[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: nil];
+    for (NSNumber* start in @[ @0, @1, @9999, @31337, @49999, @50000, @60000 ]) {
+        NSUInteger firstEntry = start.unsignedIntegerValue;
+        __block NSUInteger nextEntry = firstEntry;
+        __block BOOL inOrder = YES;
+        XCTAssertTrue([reader enumerateEntriesStartingAt: firstEntry batchSize: 777 usingBlock:^(NSArray<NSString*>* batch, BOOL* stop) {
+            for (NSString* entry in batch) {
+                inOrder = inOrder && [entry isEqualToString: entries[nextEntry]];
+                nextEntry++;
+            }
+        } error: nil]);
+        XCTAssertTrue(inOrder);
+        XCTAssertEqual(nextEntry, MAX(firstEntry, entries.count));
+    }
+
+    // and stopping early stops
+    __block NSUInteger batchCount = 0;
+    XCTAssertTrue([reader enumerateEntriesStartingAt: 0 batchSize: 100 usingBlock:^(NSArray<NSString*>* batch, BOOL* stop) {
+        XCTAssertEqual(batch.count, 100);
+        *stop = (++batchCount == 3);
+    } error: nil]);
+    XCTAssertEqual(batchCount, 3);
+}
+
+- (void)testRejectsDamagedFiles {
+    NSError* err = nil;
+    XCTAssertNil([[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: &err]);
+    XCTAssertEqualObjects(err.domain, NSPOSIXErrorDomain);
+
+    NSMutableArray* entries = [NSMutableArray array];
+    for (int i = 0; i < 20000; i++) {
+        [entries addObject: [NSString stringWithFormat: @"site%d.example.com", i]];
+    }
+    [self writeEntries: entries isAllowlist: NO];
+    NSData* original = [NSData dataWithContentsOfURL: self.fileURL];
+
+    // a newer format version
+    uint16_t newerVersion = 3;
+    [self overwriteBytes: &newerVersion length: sizeof(newerVersion) atOffset: 4];
+    err = nil;
+    XCTAssertNil([[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: &err]);
+    XCTAssertEqual(err.code, 107);
+
+    // cut short, so the index doesn't fit
+    [[original subdataWithRange: NSMakeRange(0, original.length - 5)] writeToURL: self.fileURL atomically: YES];
+    err = nil;
+    XCTAssertNil([[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: &err]);
+    XCTAssertEqual(err.code, 107);
+
+    // garbage in the middle of a chunk only shows up once we read it
+    [original writeToURL: self.fileURL atomically: YES];
+    uint8_t garbage[64];
+    memset(garbage, 0xA5, sizeof(garbage));
+    [self overwriteBytes: garbage length: sizeof(garbage) atOffset: 32 + 12 + 16];
+    SCBlockFileReader* reader = [[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: nil];
+    XCTAssertNotNil(reader);
+    err = nil;
+    XCTAssertNil([reader readAllEntries: &err]);
+    XCTAssertEqual(err.code, 107);
+    err = nil;
+    XCTAssertNil([SCBlockFileReaderWriter readBlocklistFromFile: self.fileURL error: &err]);
+    XCTAssertEqual(err.code, 107);
+
+    // and neither a block file nor a plist
+    [[@"facebook.com\nreddit.com\n" dataUsingEncoding: NSUTF8StringEncoding] writeToURL: self.fileURL atomically: YES];
+    err = nil;
+    XCTAssertNil([[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: &err]);
+    XCTAssertEqual(err.code, 107);
+}
+
+- (void)testMillionEntriesStreamInBatches {
+    NSUInteger const entryCount = 1000000;
+    SCBlockFileWriter* writer = [[SCBlockFileWriter alloc] initWithFileURL: self.fileURL isAllowlist: NO error: nil];
+    for (NSUInteger i = 0; i < entryCount; i++) {
+        @autoreleasepool {
+            XCTAssertTrue([writer addEntry: [NSString stringWithFormat: @"site%lu.example.com", (unsigned long)i] error: nil]);
+        }
+    }
+    XCTAssertTrue([writer finishWithError: nil]);
+    XCTAssertEqual(writer.entryCount, entryCount);
+
+    SCBlockFileReader* reader = [[SCBlockFileReader alloc] initWithFileURL: self.fileURL error: nil];
+    XCTAssertEqual(reader.entryCount, entryCount);
+    __block NSUInteger readCount = 0;
+    __block NSUInteger batchCount = 0;
+    __block NSUInteger unevenBatches = 0;
+    __block BOOL inOrder = YES;
+    XCTAssertTrue([reader enumerateEntriesStartingAt: 0 batchSize: 1000 usingBlock:^(NSArray<NSString*>* batch, BOOL* stop) {
+        batchCount++;
+        if (batch.count != 1000) unevenBatches++;
+        inOrder = inOrder && [batch.lastObject isEqualToString: [NSString stringWithFormat: @"site%lu.example.com", (unsigned long)(readCount + batch.count - 1)]];
+        readCount += batch.count;
+    } error: nil]);
+
+    // the list is only ever handed over a batch at a time, never all at once
+    XCTAssertEqual(readCount, entryCount);
+    XCTAssertEqual(batchCount, entryCount / 1000);
+    XCTAssertEqual(unevenBatches, 0);
+    XCTAssertTrue(inOrder);
+}
+
+@end
@@ -0,0 +1,159 @@
+//
+//  SCBlockIntegrityRecordTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCBlockIntegrityRecord.h"
+#import "HostFileBlocker.h"
+#import "HostFileBlockerSet.h"
+#import "PacketFilter.h"
+#import "SCFakeSystemRoot.h"
+
+// Installs a block into a fake system root (hosts, pf anchor and pf.conf), whose
+// pfctl just records its arguments, then messes with it.
+@interface SCBlockIntegrityRecordTests : XCTestCase
+
+@property (strong) SCFakeSystemRoot* root;
+@property (strong) NSString* rootPath;
+@property (strong) NSString* hostsPath;
+@property (strong) PacketFilter* pf;
+
+@end
+
+@implementation SCBlockIntegrityRecordTests
+
+- (void)setUp {
+    self.root = [SCFakeSystemRoot rootWithName: @"SCBlockIntegrityRecordTests"];
+    self.rootPath = self.root.path;
+    self.hostsPath = self.root.hostsPath;
+    self.pf = [[PacketFilter alloc] initAsAllowlist: NO rootPath: self.rootPath];
+
+    HostFileBlocker* blocker = [[HostFileBlocker alloc] initWithPath: self.hostsPath];
+    [blocker addSelfControlBlockHeader];
+    [blocker addRuleBlockingDomain: @"facebook.com"];
+    [blocker addRuleBlockingDomain: @"www.facebook.com"];
+    [blocker addSelfControlBlockFooter];
+    XCTAssertTrue([blocker writeNewFileContents]);
+
+    [self.pf addRuleWithIP: @"10.0.0.1" port: 0 maskLen: 0];
+    [self.pf addRuleWithIP: @"10.0.0.2" port: 443 maskLen: 0];
+    [self.pf addSelfControlConfig];
+    [self.pf writeConfiguration];
+}
+
+- (void)tearDown {
+    [self.root remove];
+}
+
+- (SCBlockIntegrityRecord*)newRecord {
+    HostFileBlockerSet* hostFileBlockerSet = [[HostFileBlockerSet alloc] initWithRootPath: self.rootPath];
+    return [SCBlockIntegrityRecord recordWithHostFileBlockerSet: hostFileBlockerSet packetFilter: self.pf];
+}
+
+- (NSString*)contentsOfFile:(NSString*)path {
+    return [NSString stringWithContentsOfFile: path encoding: NSUTF8StringEncoding error: nil];
+}
+
+- (NSArray<NSString*>*)invocations {
+    return [self.root pfctlInvocations];
+}
+
+- (void)testFreshRecordIsIntact {
+    SCBlockIntegrityRecord* record = [self newRecord];
+    XCTAssertEqual(record.recordedComponents, SCBlockComponentHostsFile | SCBlockComponentPFAnchor | SCBlockComponentPFConf);
+    XCTAssertEqual([record damagedComponents], SCBlockComponentNone);
+    XCTAssertEqual([record repairComponents: SCBlockComponentNone], SCBlockComponentNone);
+    XCTAssertEqualObjects([self invocations], @[]);
+}
+
+- (void)testEditingOutsideTheBlockIsNotDamage {
+    SCBlockIntegrityRecord* record = [self newRecord];
+
+    NSString* hosts = [self contentsOfFile: self.hostsPath];
+    hosts = [@"10.9.9.9\tnas.local\n" stringByAppendingString: hosts];
+    [hosts writeToFile: self.hostsPath atomically: YES encoding: NSUTF8StringEncoding error: nil];
+
+    NSString* pfConf = [[self contentsOfFile: self.pf.pfConfPath] stringByAppendingString: @"# a comment of the user's\n"];
+    [pfConf writeToFile: self.pf.pfConfPath atomically: YES encoding: NSUTF8StringEncoding error: nil];
+
+    XCTAssertEqual([record damagedComponents], SCBlockComponentNone);
+}
+
+- (void)testTamperedHostsBlockIsRestored {
+    SCBlockIntegrityRecord* record = [self newRecord];
+    NSString* originalAnchor = [self contentsOfFile: self.pf.anchorPath];
+
+    NSString* hosts = [self contentsOfFile: self.hostsPath];
+    hosts = [hosts stringByReplacingOccurrencesOfString: @"0.0.0.0\twww.facebook.com\n" withString: @""];
+    hosts = [@"10.9.9.9\tnas.local\n" stringByAppendingString: hosts];
+    [hosts writeToFile: self.hostsPath atomically: YES encoding: NSUTF8StringEncoding error: nil];
+
+    XCTAssertEqual([record damagedComponents], SCBlockComponentHostsFile);
+    XCTAssertEqual([record repairComponents: SCBlockComponentHostsFile], SCBlockComponentNone);
+    XCTAssertEqual([record damagedComponents], SCBlockComponentNone);
+
+    NSString* repaired = [self contentsOfFile: self.hostsPath];
+    XCTAssertTrue([repaired containsString: @"0.0.0.0\twww.facebook.com"]);
+    // the user's own edit stays, and pf is left completely alone
+    XCTAssertTrue([repaired hasPrefix: @"10.9.9.9\tnas.local\n"]);
+    XCTAssertEqualObjects([self contentsOfFile: self.pf.anchorPath], originalAnchor);
+    XCTAssertEqualObjects([self invocations], @[]);
+}
+
+- (void)testDeletedHostsBlockIsRestored {
+    SCBlockIntegrityRecord* record = [self newRecord];
+    NSString* original = [self contentsOfFile: self.hostsPath];
+    [@"127.0.0.1\tlocalhost\n" writeToFile: self.hostsPath atomically: YES encoding: NSUTF8StringEncoding error: nil];
+
+    XCTAssertEqual([record damagedComponents], SCBlockComponentHostsFile);
+    XCTAssertEqual([record repairComponents: SCBlockComponentHostsFile], SCBlockComponentNone);
+    XCTAssertEqualObjects([self contentsOfFile: self.hostsPath], original);
+}
+
+- (void)testTamperedAnchorIsRestored {
+    SCBlockIntegrityRecord* record = [self newRecord];
+    NSString* originalAnchor = [self contentsOfFile: self.pf.anchorPath];
+    NSString* originalHosts = [self contentsOfFile: self.hostsPath];
+
+    [@"" writeToFile: self.pf.anchorPath atomically: YES encoding: NSUTF8StringEncoding error: nil];
+
+    XCTAssertEqual([record damagedComponents], SCBlockComponentPFAnchor);
+    XCTAssertEqual([record repairComponents: SCBlockComponentPFAnchor], SCBlockComponentNone);
+    XCTAssertEqual([record damagedComponents], SCBlockComponentNone);
+
+    XCTAssertEqualObjects([self contentsOfFile: self.pf.anchorPath], originalAnchor);
+    XCTAssertEqualObjects([self contentsOfFile: self.hostsPath], originalHosts);
+    // just the anchor gets reloaded, not all of pf.conf
+    XCTAssertEqualObjects([self invocations], (@[[NSString stringWithFormat: @"-a org.eyebeam -f %@", self.pf.anchorPath]]));
+}
+
+- (void)testRemovedPFConfLinesAreRestored {
+    SCBlockIntegrityRecord* record = [self newRecord];
+
+    [@"scrub-anchor \"com.apple/*\"\nanchor \"com.apple/*\"\n" writeToFile: self.pf.pfConfPath atomically: YES encoding: NSUTF8StringEncoding error: nil];
+
+    XCTAssertEqual([record damagedComponents], SCBlockComponentPFConf);
+    XCTAssertEqual([record repairComponents: SCBlockComponentPFConf], SCBlockComponentNone);
+    XCTAssertEqual([record damagedComponents], SCBlockComponentNone);
+
+    XCTAssertTrue([[self contentsOfFile: self.pf.pfConfPath] containsString: @"load anchor \"org.eyebeam\""]);
+    XCTAssertEqualObjects([self invocations], (@[[NSString stringWithFormat: @"-f %@", self.pf.pfConfPath]]));
+}
+
+- (void)testRerecordingAcceptsOurOwnChanges {
+    SCBlockIntegrityRecord* record = [self newRecord];
+
+    PacketFilter* appender = [[PacketFilter alloc] initAsAllowlist: NO rootPath: self.rootPath];
+    [appender enterAppendMode];
+    [appender addRuleWithIP: @"10.0.0.3" port: 0 maskLen: 0];
+    XCTAssertEqual([appender finishAppending], 0);
+    XCTAssertEqual([record damagedComponents], SCBlockComponentPFAnchor);
+
+    [record rerecordComponents: SCBlockComponentPFAnchor];
+    XCTAssertEqual([record damagedComponents], SCBlockComponentNone);
+}
+
+@end
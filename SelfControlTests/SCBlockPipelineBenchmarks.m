@@ -0,0 +1,338 @@
+//
+//  SCBlockPipelineBenchmarks.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import <sys/resource.h>
+#import <mach/mach.h>
+#import <malloc/malloc.h>
+#import <stdatomic.h>
+#import "BlockManager.h"
+#import "SCDNSResolver.h"
+#import "SCFakeSystemRoot.h"
+
+// Env vars:
+//   SC_BENCHMARK_LARGE=1         also run the 1M-entry blocklist (slow, and needs a few GB of RAM)
+//   SC_BENCHMARK_REPORT=<path>   where to write the JSON report (default: a file in the temp dir)
+static NSString* const kLargeBenchmarkEnvVar = @"SC_BENCHMARK_LARGE";
+static NSString* const kReportPathEnvVar = @"SC_BENCHMARK_REPORT";
+
+#pragma mark - Simulated resolver
+
+// Answers every lookup after a bit of (deterministic) fake network latency, with addresses
+// from the 198.18.0.0/15 benchmarking range derived from the domain name. About 1 in 10
+// domains comes back as NXDOMAIN, like a real blocklist full of dead sites.
+@interface SCSimulatedLatencyResolver : NSObject <SCDomainResolving>
+@property NSTimeInterval baseLatency;
+@property NSTimeInterval latencyJitter;
+@end
+
+@implementation SCSimulatedLatencyResolver {
+    _Atomic NSUInteger pending;
+    dispatch_queue_t queue;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _baseLatency = 0.005;
+        _latencyJitter = 0.010;
+        queue = dispatch_get_global_queue(QOS_CLASS_UTILITY, 0);
+    }
+    return self;
+}
+
+- (NSUInteger)pendingLookupCount {
+    return pending;
+}
+
+- (void)resolveDomain:(NSString*)domain completion:(SCDNSResolutionHandler)completion {
+    pending++;
+
+    // FNV-1a, so the same domain always gets the same answer (and latency) across runs
+    uint32_t hash = 2166136261u;
+    for (NSUInteger i = 0; i < domain.length; i++) {
+        hash = (hash ^ [domain characterAtIndex: i]) * 16777619u;
+    }
+
+    NSArray<NSString*>* addresses = @[];
+    SCDNSResolutionStatus status = SCDNSResolutionStatusNXDomain;
+    if (hash % 10 != 0) {
+        status = SCDNSResolutionStatusSuccess;
+        NSMutableArray* generated = [NSMutableArray array];
+        for (uint32_t i = 0; i <= hash % 3; i++) {
+            uint32_t h = hash + i * 7919;
+            [generated addObject: [NSString stringWithFormat: @"198.%u.%u.%u", 18 + (h >> 24) % 2, (h >> 16) & 0xFF, (h >> 8) & 0xFF]];
+        }
+        addresses = generated;
+    }
+
+    NSTimeInterval latency = self.baseLatency + self.latencyJitter * ((hash >> 4) % 1000) / 1000.0;
+    SCDNSResolution* resolution = [[SCDNSResolution alloc] initWithDomain: domain status: status addresses: addresses ttl: 300 duration: latency];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(latency * NSEC_PER_SEC)), queue, ^{
+        self->pending--;
+        completion(resolution);
+    });
+}
+
+- (void)cancelAllQueries {
+    // everything finishes on its own within latency + jitter
+}
+
+@end
+
+#pragma mark - Benchmarks
+
+@interface SCBlockPipelineBenchmarks : XCTestCase
+@end
+
+@implementation SCBlockPipelineBenchmarks {
+    NSString* rootPath;
+    NSMutableDictionary* report;
+}
+
+- (void)setUp {
+    rootPath = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSString stringWithFormat: @"SCBlockPipelineBenchmarks-%@", [NSUUID UUID].UUIDString]];
+    report = [NSMutableDictionary dictionary];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath: rootPath error: nil];
+}
+
+// thresholds live in SelfControlTests/Benchmarks, next to this file
+- (NSDictionary*)thresholds {
+    NSString* testsDir = [@(__FILE__) stringByDeletingLastPathComponent];
+    NSString* path = [[testsDir stringByAppendingPathComponent: @"Benchmarks"] stringByAppendingPathComponent: @"thresholds.json"];
+    NSData* data = [NSData dataWithContentsOfFile: path];
+    XCTAssertNotNil(data, @"Couldn't read benchmark thresholds from %@", path);
+    return data ? [NSJSONSerialization JSONObjectWithData: data options: 0 error: nil] : @{};
+}
+
+#pragma mark Synthetic blocklists
+
+// Deterministic (seeded) blocklist with a mix similar to real-world lists: mostly domains
+// (some with subdomains or www.), plus IPs, CIDR ranges, and a few entries with ports
+- (NSArray<NSString*>*)syntheticBlocklistWithCount:(NSUInteger)count seed:(uint64_t)seed {
+    static NSArray* syllables;
+    static NSArray* tlds;
+    static NSArray* subdomains;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        syllables = @[@"ka", @"lo", @"mi", @"news", @"tube", @"shop", @"ra", @"zen", @"feed", @"chat", @"po", @"vid", @"net", @"go", @"social", @"play"];
+        tlds = @[@"com", @"com", @"com", @"net", @"org", @"io", @"co.uk", @"de", @"tv"];
+        subdomains = @[@"www.", @"m.", @"cdn.", @"api.", @"static.", @"news."];
+    });
+
+    __block uint64_t state = seed;
+    uint64_t (^next)(void) = ^uint64_t {
+        // splitmix64
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    };
+
+    NSMutableArray<NSString*>* blocklist = [NSMutableArray arrayWithCapacity: count];
+    for (NSUInteger i = 0; i < count; i++) {
+        uint64_t r = next();
+        uint64_t kind = r % 100;
+
+        NSMutableString* domain = [NSMutableString string];
+        if (kind < 20) [domain appendString: subdomains[(r >> 8) % subdomains.count]];
+        NSUInteger syllableCount = 2 + (r >> 16) % 3;
+        for (NSUInteger s = 0; s < syllableCount; s++) {
+            [domain appendString: syllables[(next() >> 20) % syllables.count]];
+        }
+        // keeps domains unique-ish even for huge lists
+        [domain appendFormat: @"%lu.%@", (unsigned long)(i % 9973), tlds[(r >> 24) % tlds.count]];
+
+        NSString* ip = [NSString stringWithFormat: @"%llu.%llu.%llu.%llu", 1 + (r >> 8) % 222, (r >> 16) % 256, (r >> 24) % 256, (r >> 32) % 256];
+        if (kind < 75) {
+            [blocklist addObject: domain];
+        } else if (kind < 78) {
+            [blocklist addObject: [NSString stringWithFormat: @"%@:%llu", domain, (r >> 40) % 2 ? 443ull : 8080ull]];
+        } else if (kind < 88) {
+            [blocklist addObject: ip];
+        } else if (kind < 96) {
+            [blocklist addObject: [NSString stringWithFormat: @"%@/%llu", ip, 16 + (r >> 40) % 13]];
+        } else {
+            [blocklist addObject: [NSString stringWithFormat: @"%@:%llu", ip, (r >> 40) % 2 ? 443ull : 25ull]];
+        }
+    }
+    return blocklist;
+}
+
+#pragma mark Measurement
+
+static uint64_t SCCurrentResidentBytes(void) {
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return info.resident_size;
+}
+
+static uint64_t SCPeakResidentBytes(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // ru_maxrss is in bytes on macOS (kilobytes on Linux)
+    return (uint64_t)usage.ru_maxrss;
+}
+
+- (unsigned long long)outputBytes {
+    NSFileManager* fileMan = [NSFileManager defaultManager];
+    unsigned long long total = 0;
+    for (NSString* file in @[@"etc/hosts", @"etc/pf.anchors/org.eyebeam"]) {
+        total += [[fileMan attributesOfItemAtPath: [rootPath stringByAppendingPathComponent: file] error: nil] fileSize];
+    }
+    return total;
+}
+
+// runs the block and returns the metrics for it
+- (NSDictionary*)measurePhase:(dispatch_block_t)phase {
+    malloc_statistics_t mallocBefore, mallocAfter;
+    malloc_zone_statistics(NULL, &mallocBefore);
+    uint64_t rssBefore = SCCurrentResidentBytes();
+    NSDate* startDate = [NSDate date];
+
+    @autoreleasepool {
+        phase();
+    }
+
+    NSTimeInterval wallSecs = [[NSDate date] timeIntervalSinceDate: startDate];
+    malloc_zone_statistics(NULL, &mallocAfter);
+
+    return @{
+        @"WallSecs": @(wallSecs),
+        @"PeakRSSBytes": @(SCPeakResidentBytes()),
+        @"RSSDeltaBytes": @((int64_t)SCCurrentResidentBytes() - (int64_t)rssBefore),
+        // net allocations still live after the phase (what it left behind for later phases)
+        @"AllocationsInUseDelta": @((int64_t)mallocAfter.blocks_in_use - (int64_t)mallocBefore.blocks_in_use),
+        @"AllocatedBytesInUseDelta": @((int64_t)mallocAfter.size_in_use - (int64_t)mallocBefore.size_in_use),
+        @"OutputBytes": @([self outputBytes])
+    };
+}
+
+#pragma mark Pipeline
+
+- (NSDictionary*)runPipelineWithEntryCount:(NSUInteger)entryCount {
+    SCFakeSystemRoot* fakeRoot = [[SCFakeSystemRoot alloc] initWithPath: [rootPath stringByAppendingPathComponent: [NSString stringWithFormat: @"%lu", (unsigned long)entryCount]]];
+    NSString* root = fakeRoot.path;
+    NSString* previousRootPath = rootPath;
+    rootPath = root;
+
+    NSArray<NSString*>* blocklist = [self syntheticBlocklistWithCount: entryCount seed: 0x5E1FC0DE];
+    // appends are usually a handful of sites, so ~1% of the list (but at least a few)
+    NSArray<NSString*>* appendList = [self syntheticBlocklistWithCount: MAX(entryCount / 100, 10u) seed: 0xA99E4D];
+
+    SCSimulatedLatencyResolver* resolver = [SCSimulatedLatencyResolver new];
+    BlockManager* (^newBlockManager)(void) = ^BlockManager* {
+        return [[BlockManager alloc] initAsAllowlist: NO allowLocal: YES includeCommonSubdomains: YES includeLinkedDomains: NO rootPath: root resolver: resolver];
+    };
+
+    NSMutableDictionary* phases = [NSMutableDictionary dictionary];
+    __block BlockManager* blockManager = newBlockManager();
+    phases[@"prepare"] = [self measurePhase:^{
+        [blockManager prepareToAddBlock];
+    }];
+    phases[@"add"] = [self measurePhase:^{
+        [blockManager addBlockEntriesFromStrings: blocklist];
+    }];
+    phases[@"finalize"] = [self measurePhase:^{
+        [blockManager finalizeBlock];
+    }];
+    XCTAssertTrue([blockManager blockIsActive]);
+
+    // the daemon uses a fresh BlockManager for every append, so do the same here
+    blockManager = newBlockManager();
+    phases[@"append"] = [self measurePhase:^{
+        [blockManager enterAppendMode];
+        [blockManager addBlockEntriesFromStrings: appendList];
+        [blockManager finishAppending];
+    }];
+
+    blockManager = newBlockManager();
+    phases[@"clear"] = [self measurePhase:^{
+        XCTAssertTrue([blockManager clearBlock]);
+    }];
+    XCTAssertFalse([blockManager blockIsActive]);
+
+    NSUInteger pfctlInvocations = [fakeRoot pfctlInvocations].count;
+
+    rootPath = previousRootPath;
+    return @{
+        @"EntryCount": @(entryCount),
+        @"AppendEntryCount": @(appendList.count),
+        @"PfctlInvocations": @(pfctlInvocations),
+        @"Phases": phases
+    };
+}
+
+- (void)checkResults:(NSDictionary*)results againstThresholds:(NSDictionary*)thresholds {
+    NSString* sizeKey = [results[@"EntryCount"] stringValue];
+    NSDictionary* sizeThresholds = thresholds[sizeKey];
+    if (![sizeThresholds isKindOfClass: [NSDictionary class]]) return;
+
+    for (NSString* phase in sizeThresholds) {
+        NSDictionary* phaseResults = results[@"Phases"][phase];
+        XCTAssertNotNil(phaseResults, @"Threshold given for unknown phase %@", phase);
+        for (NSString* metric in sizeThresholds[phase]) {
+            double limit = [sizeThresholds[phase][metric] doubleValue];
+            double value = [phaseResults[metric] doubleValue];
+            XCTAssertLessThanOrEqual(value, limit, @"%@ entries, %@ phase: %@ = %f is over the threshold of %f", sizeKey, phase, metric, value, limit);
+        }
+    }
+}
+
+- (void)runBenchmarksWithSizes:(NSArray<NSNumber*>*)sizes {
+    NSDictionary* thresholds = [self thresholds];
+    NSMutableDictionary* results = [NSMutableDictionary dictionary];
+    for (NSNumber* size in sizes) {
+        NSDictionary* sizeResults = [self runPipelineWithEntryCount: size.unsignedIntegerValue];
+        results[size.stringValue] = sizeResults;
+        [self checkResults: sizeResults againstThresholds: thresholds];
+    }
+
+    report[@"Machine"] = @{
+        @"ActiveProcessorCount": @([NSProcessInfo processInfo].activeProcessorCount),
+        @"PhysicalMemoryBytes": @([NSProcessInfo processInfo].physicalMemory),
+        @"OSVersion": [NSProcessInfo processInfo].operatingSystemVersionString
+    };
+    report[@"Results"] = results;
+
+    NSString* reportPath = [NSProcessInfo processInfo].environment[kReportPathEnvVar];
+    if (reportPath.length == 0) {
+        reportPath = [NSTemporaryDirectory() stringByAppendingPathComponent: @"selfcontrol-block-benchmarks.json"];
+    }
+    NSData* reportData = [NSJSONSerialization dataWithJSONObject: report options: NSJSONWritingPrettyPrinted | NSJSONWritingSortedKeys error: nil];
+    XCTAssertTrue([reportData writeToFile: reportPath atomically: YES]);
+    NSLog(@"SCBlockPipelineBenchmarks: wrote report to %@", reportPath);
+}
+
+- (void)testPipelineBenchmarks {
+    NSMutableArray* sizes = [@[@100, @10000] mutableCopy];
+    if ([[NSProcessInfo processInfo].environment[kLargeBenchmarkEnvVar] boolValue]) {
+        [sizes addObject: @1000000];
+    }
+    [self runBenchmarksWithSizes: sizes];
+}
+
+- (void)testSyntheticBlocklistIsDeterministicAndMixed {
+    NSArray* listA = [self syntheticBlocklistWithCount: 1000 seed: 42];
+    NSArray* listB = [self syntheticBlocklistWithCount: 1000 seed: 42];
+    XCTAssertEqualObjects(listA, listB);
+
+    NSUInteger cidrs = 0, ports = 0, ips = 0;
+    for (NSString* entry in listA) {
+        if ([entry containsString: @"/"]) cidrs++;
+        else if ([entry containsString: @":"]) ports++;
+        else if ([entry isValidIPv4Address]) ips++;
+    }
+    XCTAssertGreaterThan(cidrs, 0);
+    XCTAssertGreaterThan(ports, 0);
+    XCTAssertGreaterThan(ips, 0);
+}
+
+@end
@@ -0,0 +1,251 @@
+//
+//  SCBlockRefresherTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCBlockRefresher.h"
+#import "SCDeadlineScheduler.h"
+#import "PacketFilter.h"
+#import "SCStubDNSServer.h"
+#import "SCFakeSystemRoot.h"
+#import "SCDNSResponder.h"
+#import "SCDNSResolver.h"
+#import "SCDomainSuffixIndex.h"
+
+// Runs a refresher against a block installed in a fake system root, resolving
+// with the stub DNS server instead of the real one.
+@interface SCBlockRefresherTests : XCTestCase
+
+@property (strong) SCFakeSystemRoot* root;
+@property (strong) SCStubDNSServer* server;
+@property (strong) SCBlockRefresher* refresher;
+@property (atomic) NSUInteger appendCount;
+
+@end
+
+@implementation SCBlockRefresherTests
+
++ (void)setUp {
+    // SCSettings shouldn't be readOnly during our tests
+    [SCSettings sharedSettings].readOnly = NO;
+}
+
+- (void)setUp {
+    self.root = [SCFakeSystemRoot rootWithName: @"SCBlockRefresherTests"];
+    PacketFilter* pf = [[PacketFilter alloc] initAsAllowlist: NO rootPath: self.root.path];
+    [pf addRuleWithIP: @"10.0.0.1" port: 0 maskLen: 0];
+    [pf addSelfControlConfig];
+    [pf writeConfiguration];
+
+    self.server = [SCStubDNSServer new];
+    XCTAssertNotNil(self.server);
+
+    SCSettings* settings = [SCSettings sharedSettings];
+    [settings setValue: @YES forKey: @"BlockIsRunning"];
+    [settings setValue: [NSDate dateWithTimeIntervalSinceNow: 300] forKey: @"BlockEndDate"];
+    [settings setValue: @NO forKey: @"ActiveBlockAsWhitelist"];
+    [settings setValue: @NO forKey: @"EvaluateCommonSubdomains"];
+
+    self.refresher = [SCBlockRefresher new];
+    self.refresher.rootPath = self.root.path;
+    self.refresher.nameservers = @[@"127.0.0.1"];
+    self.refresher.nameserverPort = self.server.port;
+    self.refresher.blockLock = [NSLock new];
+    // the first round of refreshes is spread over the minimum interval, so this makes it immediate
+    self.refresher.minimumRefreshInterval = 1;
+    self.refresher.batchSpacing = 0.1;
+    self.refresher.refreshTolerance = 0;
+    self.appendCount = 0;
+    __weak SCBlockRefresherTests* weakSelf = self;
+    self.refresher.blockAppendedHandler = ^{
+        weakSelf.appendCount++;
+    };
+}
+
+- (void)tearDown {
+    [self.refresher stop];
+    // stop is async, and this makes sure it's done
+    XCTAssertFalse(self.refresher.isRunning);
+    [self.server stop];
+    [self.root remove];
+
+    SCSettings* settings = [SCSettings sharedSettings];
+    [settings setValue: @NO forKey: @"BlockIsRunning"];
+    [settings setValue: @[] forKey: @"ActiveBlocklist"];
+}
+
+- (NSUInteger)statistic:(NSString*)key {
+    return [[self.refresher statistics][key] unsignedIntegerValue];
+}
+
+- (void)waitForStatistic:(NSString*)key toReach:(NSUInteger)value {
+    NSPredicate* predicate = [NSPredicate predicateWithBlock:^BOOL(SCBlockRefresherTests* tests, NSDictionary* bindings) {
+        return [tests statistic: key] >= value;
+    }];
+    XCTestExpectation* expectation = [self expectationForPredicate: predicate evaluatedWithObject: self handler: nil];
+    [self waitForExpectations: @[expectation] timeout: 10.0];
+}
+
+// lets the refresher run for a while, when we're checking that it doesn't do something
+- (void)idleFor:(NSTimeInterval)interval {
+    XCTestExpectation* nothing = [self expectationWithDescription: @"nothing"];
+    nothing.inverted = YES;
+    [self waitForExpectations: @[nothing] timeout: interval];
+}
+
+- (NSString*)anchor {
+    return [NSString stringWithContentsOfFile: [[PacketFilter alloc] initAsAllowlist: NO rootPath: self.root.path].anchorPath encoding: NSUTF8StringEncoding error: nil];
+}
+
+- (void)testStartAndStop {
+    self.server.records = @{ @"steady.test": @[@"10.0.0.1"] };
+    self.server.answerTTL = 1;
+    self.refresher.maximumRefreshInterval = 1;
+    [[SCSettings sharedSettings] setValue: @[@"steady.test"] forKey: @"ActiveBlocklist"];
+
+    XCTAssertFalse(self.refresher.isRunning);
+    [self.refresher start];
+    XCTAssertTrue(self.refresher.isRunning);
+
+    // a short TTL means it keeps getting re-resolved
+    [self waitForStatistic: @"ResolutionCount" toReach: 2];
+    XCTAssertEqual([self statistic: @"TrackedDomainCount"], 1);
+    XCTAssertEqual([self statistic: @"FailedResolutionCount"], 0);
+    // and it's already blocked, so nothing changes
+    XCTAssertEqual([self statistic: @"NewAddressCount"], 0);
+    XCTAssertEqual(self.appendCount, 0);
+    XCTAssertEqualObjects([self.root pfctlInvocations], @[]);
+
+    [self.refresher stop];
+    XCTAssertFalse(self.refresher.isRunning);
+    XCTAssertFalse([[SCDeadlineScheduler sharedScheduler] hasEvent: @"refresher.batch"]);
+    XCTAssertEqual([self statistic: @"TrackedDomainCount"], 0);
+
+    // give anything already sent a chance to land, then make sure nothing else goes out
+    [self idleFor: 0.5];
+    NSUInteger queryCount = self.server.queryCount;
+    [self idleFor: 2.5];
+    XCTAssertEqual(self.server.queryCount, queryCount);
+}
+
+- (void)testAllowlistBlocksAreLeftAlone {
+    self.server.records = @{ @"steady.test": @[@"10.0.0.1"] };
+    [[SCSettings sharedSettings] setValue: @[@"steady.test"] forKey: @"ActiveBlocklist"];
+    [[SCSettings sharedSettings] setValue: @YES forKey: @"ActiveBlockAsWhitelist"];
+
+    [self.refresher start];
+    XCTAssertTrue(self.refresher.isRunning);
+    XCTAssertEqual([self statistic: @"TrackedDomainCount"], 0);
+    XCTAssertFalse([[SCDeadlineScheduler sharedScheduler] hasEvent: @"refresher.batch"]);
+
+    [self idleFor: 1.5];
+    XCTAssertEqual(self.server.queryCount, 0);
+}
+
+- (void)testSchedulingFollowsBatchSizeAndTTL {
+    NSMutableDictionary* records = [NSMutableDictionary dictionary];
+    NSMutableArray* blocklist = [NSMutableArray array];
+    for (int i = 0; i < 10; i++) {
+        NSString* domain = [NSString stringWithFormat: @"site%d.test", i];
+        records[domain] = @[[NSString stringWithFormat: @"10.0.1.%d", i]];
+        [blocklist addObject: domain];
+    }
+    self.server.records = records;
+    self.server.answerTTL = 300;
+    self.refresher.batchSize = 4;
+    self.refresher.maximumRefreshInterval = 60 * 60;
+    [[SCSettings sharedSettings] setValue: blocklist forKey: @"ActiveBlocklist"];
+
+    [self.refresher start];
+    [self waitForStatistic: @"ResolutionCount" toReach: 10];
+
+    // every domain had moved, and they were done in three batches of at most 4
+    XCTAssertEqual([self statistic: @"DriftedDomainCount"], 10);
+    XCTAssertEqual([self statistic: @"NewAddressCount"], 10);
+    XCTAssertEqual(self.appendCount, 3);
+    NSString* anchor = [self anchor];
+    for (int i = 0; i < 10; i++) {
+        XCTAssertTrue([anchor containsString: [NSString stringWithFormat: @"10.0.1.%d ", i]]);
+    }
+
+    // and the next refresh waits for the TTL to run out
+    [self idleFor: 1.5];
+    XCTAssertEqual([self statistic: @"ResolutionCount"], 10);
+    XCTAssertTrue([[SCDeadlineScheduler sharedScheduler] hasEvent: @"refresher.batch"]);
+}
+
+- (void)testChangedAddressesAreAddedToTheBlock {
+    self.server.records = @{ @"moving.test": @[@"10.0.0.1"] };
+    self.server.answerTTL = 1;
+    self.refresher.maximumRefreshInterval = 1;
+    [[SCSettings sharedSettings] setValue: @[@"moving.test"] forKey: @"ActiveBlocklist"];
+
+    [self.refresher start];
+    [self waitForStatistic: @"ResolutionCount" toReach: 1];
+    XCTAssertEqual([self statistic: @"NewAddressCount"], 0);
+
+    // the site moves
+    self.server.records = @{ @"moving.test": @[@"10.0.0.1", @"10.0.0.9"] };
+    [self waitForStatistic: @"NewAddressCount" toReach: 1];
+    XCTAssertEqual([self statistic: @"DriftedDomainCount"], 1);
+    XCTAssertEqual(self.appendCount, 1);
+    XCTAssertTrue([[self.root pfctlInvocations] containsObject: @"-a org.eyebeam -t org.eyebeam.block -T add 10.0.0.9"]);
+    XCTAssertTrue([[self anchor] containsString: @"10.0.0.9 "]);
+
+    // once it's in, we don't add it again
+    NSUInteger resolutionCount = [self statistic: @"ResolutionCount"];
+    [self waitForStatistic: @"ResolutionCount" toReach: resolutionCount + 2];
+    XCTAssertEqual([self statistic: @"NewAddressCount"], 1);
+    XCTAssertEqual(self.appendCount, 1);
+}
+
+- (void)testOutsideResolutionsAreAddedToTheBlock {
+    self.server.records = @{ @"moving.test": @[@"10.0.0.1"] };
+    self.refresher.minimumRefreshInterval = 60 * 60;
+    self.refresher.maximumRefreshInterval = 60 * 60;
+    [[SCSettings sharedSettings] setValue: @[@"moving.test"] forKey: @"ActiveBlocklist"];
+    [self.refresher start];
+
+    // i.e. BlockManager's background refresh of an expired cache entry, finishing after the block went in
+    SCDNSResolution* resolution = [[SCDNSResolution alloc] initWithDomain: @"moving.test" status: SCDNSResolutionStatusSuccess addresses: @[@"10.0.0.1", @"10.0.0.7"] ttl: 300 duration: 0];
+    [self.refresher applyResolution: resolution];
+    [self waitForStatistic: @"NewAddressCount" toReach: 1];
+    XCTAssertEqual(self.appendCount, 1);
+    XCTAssertTrue([[self.root pfctlInvocations] containsObject: @"-a org.eyebeam -t org.eyebeam.block -T add 10.0.0.7"]);
+
+    // domains we aren't tracking are left alone
+    [self.refresher applyResolution: [[SCDNSResolution alloc] initWithDomain: @"other.test" status: SCDNSResolutionStatusSuccess addresses: @[@"10.0.0.8"] ttl: 300 duration: 0]];
+    [self idleFor: 0.5];
+    XCTAssertEqual([self statistic: @"NewAddressCount"], 1);
+    XCTAssertEqual(self.appendCount, 1);
+}
+
+- (void)testSinkholedAnswersAreIgnored {
+    // the system's pointed at our own sinkhole, which is answering 0.0.0.0/:: for the blocked domain
+    self.server.records = @{ @"moving.test": @[@"10.0.0.9"] };
+    SCDNSResponder* sinkhole = [[SCDNSResponder alloc] initWithBlockIndex: [[SCDomainSuffixIndex alloc] initWithRules: @[@"moving.test"]]
+                                                    upstreamNameservers: @[@"127.0.0.1"]
+                                                           upstreamPort: self.server.port];
+    NSError* startErr = nil;
+    XCTAssertTrue([sinkhole startOnPort: 0 error: &startErr], @"%@", startErr);
+    self.refresher.nameserverPort = sinkhole.port;
+    self.refresher.maximumRefreshInterval = 1;
+    [[SCSettings sharedSettings] setValue: @[@"moving.test"] forKey: @"ActiveBlocklist"];
+
+    [self.refresher start];
+    [self waitForStatistic: @"FailedResolutionCount" toReach: 2];
+
+    // those answers aren't addresses, so they never make it into the block
+    XCTAssertEqual([self statistic: @"NewAddressCount"], 0);
+    XCTAssertEqual(self.appendCount, 0);
+    XCTAssertEqualObjects([self.root pfctlInvocations], @[]);
+    XCTAssertGreaterThan([sinkhole.statistics[@"BlockedCount"] unsignedIntegerValue], 0);
+    XCTAssertEqual(self.server.queryCount, 0);
+
+    [sinkhole stop];
+}
+
+@end
@@ -0,0 +1,251 @@
+//
+//  SCBlockStateTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCBlockState.h"
+#import "SCBlocklistTable.h"
+
+@interface SCBlockStateTests : XCTestCase
+
+@property NSString* path;
+
+@end
+
+@implementation SCBlockStateTests
+
+- (void)setUp {
+    self.path = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSString stringWithFormat: @"SCBlockStateTests-%@.state", [NSUUID UUID].UUIDString]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath: self.path error: nil];
+}
+
+- (SCBlockState*)stateWithBlocklist:(NSArray<NSString*>*)blocklist endDate:(NSDate*)endDate version:(uint64_t)version {
+    return [[SCBlockState alloc] initWithBlockIsRunning: YES
+                                            isAllowlist: NO
+                                           blockEndDate: endDate
+                                         blocklistCount: blocklist.count
+                                        blocklistDigest: [SCBlockState digestOfBlocklist: blocklist]
+                                        settingsVersion: version
+                                      damagedComponents: 0
+                                   unrepairedComponents: 0
+                                     integrityCheckDate: nil
+                                          publishedDate: [NSDate date]];
+}
+
+- (void)overwriteBytes:(const void*)bytes length:(NSUInteger)length atOffset:(unsigned long long)offset {
+    NSFileHandle* handle = [NSFileHandle fileHandleForWritingAtPath: self.path];
+    [handle seekToFileOffset: offset];
+    [handle writeData: [NSData dataWithBytes: bytes length: length]];
+    [handle closeFile];
+}
+
+- (void)testRoundTrip {
+    SCBlockStateFile* writer = [[SCBlockStateFile alloc] initWithPath: self.path];
+    SCBlockStateFile* reader = [[SCBlockStateFile alloc] initWithPath: self.path];
+    NSDate* endDate = [NSDate dateWithTimeIntervalSinceReferenceDate: floor([NSDate timeIntervalSinceReferenceDate]) + 600.5];
+    NSDate* checkDate = [NSDate dateWithTimeIntervalSinceReferenceDate: 12345.25];
+    NSArray* blocklist = @[ @"facebook.com", @"reddit.com" ];
+
+    SCBlockState* state = [[SCBlockState alloc] initWithBlockIsRunning: YES
+                                                           isAllowlist: YES
+                                                          blockEndDate: endDate
+                                                        blocklistCount: blocklist.count
+                                                       blocklistDigest: [SCBlockState digestOfBlocklist: blocklist]
+                                                       settingsVersion: 42
+                                                     damagedComponents: 3
+                                                  unrepairedComponents: 1
+                                                    integrityCheckDate: checkDate
+                                                         publishedDate: [NSDate date]];
+    NSError* err = nil;
+    XCTAssertTrue([writer publishState: state error: &err]);
+    XCTAssertNil(err);
+
+    SCBlockState* read = [reader readState];
+    XCTAssertNotNil(read);
+    XCTAssertTrue(read.blockIsRunning);
+    XCTAssertTrue(read.isAllowlist);
+    XCTAssertEqualObjects(read.blockEndDate, endDate);
+    XCTAssertEqual(read.blocklistCount, 2);
+    XCTAssertEqualObjects(read.blocklistDigest, [SCBlockState digestOfBlocklist: blocklist]);
+    XCTAssertEqual(read.settingsVersion, 42);
+    XCTAssertEqual(read.damagedComponents, 3);
+    XCTAssertEqual(read.unrepairedComponents, 1);
+    XCTAssertEqualObjects(read.integrityCheckDate, checkDate);
+    XCTAssertFalse([read blockIsExpired]);
+
+    // updates in place show up without remapping
+    XCTAssertTrue([writer publishState: [self stateWithBlocklist: @[] endDate: [NSDate distantPast] version: 43] error: nil]);
+    read = [reader readState];
+    XCTAssertEqual(read.settingsVersion, 43);
+    XCTAssertNil(read.integrityCheckDate);
+    XCTAssertTrue([read blockIsExpired]);
+}
+
+- (void)testStateFromSettings {
+    NSDate* endDate = [NSDate dateWithTimeIntervalSinceNow: 60];
+    NSArray* blocklist = @[ @"a.com", @"b.com", @"c.com" ];
+    SCBlocklistTable* table = [SCBlocklistTable tableWithEntries: blocklist];
+    SCBlockState* state = [SCBlockState stateWithSettings: @{
+        @"BlockIsRunning": @YES,
+        @"ActiveBlockAsWhitelist": @NO,
+        @"BlockEndDate": endDate,
+        @"ActiveBlocklistHash": table.contentHash,
+        @"ActiveBlocklistCount": @(table.count),
+        @"SettingsVersionNumber": @7
+    } damagedComponents: 0 unrepairedComponents: 0 integrityCheckDate: nil];
+
+    XCTAssertTrue(state.blockIsRunning);
+    XCTAssertFalse(state.isAllowlist);
+    XCTAssertEqualObjects(state.blockEndDate, endDate);
+    XCTAssertEqual(state.blocklistCount, 3);
+    XCTAssertEqual(state.settingsVersion, 7);
+    XCTAssertEqualObjects(state.blocklistDigest, [SCBlockState digestOfBlocklist: blocklist]);
+
+    // missing keys shouldn't look like a running block
+    SCBlockState* emptyState = [SCBlockState stateWithSettings: @{} damagedComponents: 0 unrepairedComponents: 0 integrityCheckDate: nil];
+    XCTAssertFalse(emptyState.blockIsRunning);
+    XCTAssertTrue([emptyState blockIsExpired]);
+    XCTAssertEqualObjects(emptyState.blocklistDigest, [SCBlockState digestOfBlocklist: @[]]);
+}
+
+- (void)testMissingFileReadsNil {
+    SCBlockStateFile* reader = [[SCBlockStateFile alloc] initWithPath: self.path];
+    XCTAssertNil([reader readState]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath: self.path]);
+}
+
+- (void)testNoticesFileRemovedOrReplaced {
+    SCBlockStateFile* writer = [[SCBlockStateFile alloc] initWithPath: self.path];
+    SCBlockStateFile* reader = [[SCBlockStateFile alloc] initWithPath: self.path];
+    XCTAssertTrue([writer publishState: [self stateWithBlocklist: @[ @"a.com" ] endDate: [NSDate distantFuture] version: 1] error: nil]);
+    XCTAssertEqual([reader readState].settingsVersion, 1);
+
+    // i.e. the killer cleaning up
+    [[NSFileManager defaultManager] removeItemAtPath: self.path error: nil];
+    XCTAssertNil([reader readState]);
+
+    // a new daemon (with a fresh file) publishing again
+    SCBlockStateFile* newWriter = [[SCBlockStateFile alloc] initWithPath: self.path];
+    XCTAssertTrue([newWriter publishState: [self stateWithBlocklist: @[ @"a.com" ] endDate: [NSDate distantFuture] version: 2] error: nil]);
+    XCTAssertEqual([reader readState].settingsVersion, 2);
+
+    // and the old writer's mapping is stale now, so it has to notice too
+    XCTAssertTrue([writer publishState: [self stateWithBlocklist: @[ @"a.com" ] endDate: [NSDate distantFuture] version: 3] error: nil]);
+    XCTAssertEqual([reader readState].settingsVersion, 3);
+}
+
+- (void)testUnrecognizedRecordReadsNil {
+    [[NSData dataWithBytes: "not a block state" length: 17] writeToFile: self.path atomically: NO];
+    SCBlockStateFile* reader = [[SCBlockStateFile alloc] initWithPath: self.path];
+    XCTAssertNil([reader readState]);
+
+    // right size, wrong contents
+    SCBlockStateFile* writer = [[SCBlockStateFile alloc] initWithPath: self.path];
+    XCTAssertTrue([writer publishState: [self stateWithBlocklist: @[] endDate: [NSDate distantFuture] version: 1] error: nil]);
+    XCTAssertNotNil([reader readState]);
+    uint32_t badMagic = 0xDEADBEEF;
+    [self overwriteBytes: &badMagic length: sizeof(badMagic) atOffset: sizeof(uint64_t)];
+    XCTAssertNil([reader readState]);
+
+    // publishing again fixes it
+    XCTAssertTrue([writer publishState: [self stateWithBlocklist: @[] endDate: [NSDate distantFuture] version: 2] error: nil]);
+    XCTAssertEqual([reader readState].settingsVersion, 2);
+}
+
+- (void)testHalfWrittenRecordReadsNil {
+    SCBlockStateFile* writer = [[SCBlockStateFile alloc] initWithPath: self.path];
+    SCBlockStateFile* reader = [[SCBlockStateFile alloc] initWithPath: self.path];
+    XCTAssertTrue([writer publishState: [self stateWithBlocklist: @[] endDate: [NSDate distantFuture] version: 1] error: nil]);
+
+    // as if the daemon died partway through a write
+    uint64_t oddSequence = 5;
+    [self overwriteBytes: &oddSequence length: sizeof(oddSequence) atOffset: 0];
+    XCTAssertNil([reader readState]);
+
+    // and the next write recovers
+    XCTAssertTrue([writer publishState: [self stateWithBlocklist: @[] endDate: [NSDate distantFuture] version: 2] error: nil]);
+    XCTAssertEqual([reader readState].settingsVersion, 2);
+}
+
+- (void)testReadersNeverSeeTornWrites {
+    static uint64_t const kWrites = 20000;
+    SCBlockStateFile* writer = [[SCBlockStateFile alloc] initWithPath: self.path];
+    XCTAssertTrue([writer publishState: [self stateWithBlocklist: @[ @"0" ] endDate: [NSDate distantFuture] version: 0] error: nil]);
+
+    // precompute the digests, so the writer spends its time writing
+    NSMutableArray<NSData*>* digests = [NSMutableArray array];
+    for (uint64_t i = 0; i < 16; i++) {
+        [digests addObject: [SCBlockState digestOfBlocklist: @[ [@(i) stringValue] ]]];
+    }
+
+    __block BOOL writerDone = NO;
+    __block NSUInteger mismatches = 0;
+    __block NSUInteger reads = 0;
+    dispatch_group_t readers = dispatch_group_create();
+    for (int i = 0; i < 3; i++) {
+        dispatch_group_async(readers, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            // each reader maps the file itself, like separate processes would
+            SCBlockStateFile* reader = [[SCBlockStateFile alloc] initWithPath: self.path];
+            NSUInteger localMismatches = 0, localReads = 0;
+            while (!writerDone) {
+                SCBlockState* state = [reader readState];
+                if (state == nil) continue;
+                uint64_t version = state.settingsVersion;
+                if (state.blocklistCount != version % 16 || ![state.blocklistDigest isEqual: digests[version % 16]]
+                    || state.blockEndDate.timeIntervalSinceReferenceDate != (double)version) {
+                    localMismatches++;
+                }
+                localReads++;
+            }
+            @synchronized (self) {
+                mismatches += localMismatches;
+                reads += localReads;
+            }
+        });
+    }
+
+    for (uint64_t i = 1; i <= kWrites; i++) {
+        SCBlockState* state = [[SCBlockState alloc] initWithBlockIsRunning: YES
+                                                               isAllowlist: NO
+                                                              blockEndDate: [NSDate dateWithTimeIntervalSinceReferenceDate: (double)i]
+                                                            blocklistCount: i % 16
+                                                           blocklistDigest: digests[i % 16]
+                                                           settingsVersion: i
+                                                         damagedComponents: 0
+                                                      unrepairedComponents: 0
+                                                        integrityCheckDate: nil
+                                                             publishedDate: [NSDate date]];
+        [writer publishState: state error: nil];
+    }
+    writerDone = YES;
+    dispatch_group_wait(readers, DISPATCH_TIME_FOREVER);
+
+    NSLog(@"SCBlockStateTests: %lu reads during %llu writes, %lu torn", (unsigned long)reads, kWrites, (unsigned long)mismatches);
+    XCTAssertEqual(mismatches, 0);
+    XCTAssertGreaterThan(reads, 0);
+}
+
+- (void)testReadCost {
+    SCBlockStateFile* writer = [[SCBlockStateFile alloc] initWithPath: self.path];
+    XCTAssertTrue([writer publishState: [self stateWithBlocklist: @[ @"facebook.com" ] endDate: [NSDate distantFuture] version: 1] error: nil]);
+    SCBlockStateFile* reader = [[SCBlockStateFile alloc] initWithPath: self.path];
+    [reader readState];
+
+    // timed, not pass/fail - we're expecting single-digit microseconds per read
+    static int const kReads = 10000;
+    [self measureBlock:^{
+        for (int i = 0; i < kReads; i++) {
+            @autoreleasepool {
+                XCTAssertNotNil([reader readState]);
+            }
+        }
+    }];
+}
+
+@end
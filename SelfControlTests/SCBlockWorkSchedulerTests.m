@@ -0,0 +1,121 @@
+//
+//  SCBlockWorkSchedulerTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+#import "SCBlockWorkScheduler.h"
+
+@interface SCBlockWorkSchedulerTests : XCTestCase
+
+@end
+
+@implementation SCBlockWorkSchedulerTests
+
+- (void)testCPUWorkNeverExceedsPoolWidth {
+    SCBlockWorkScheduler* scheduler = [[SCBlockWorkScheduler alloc] initWithCPUConcurrency: 2];
+    dispatch_group_t group = dispatch_group_create();
+    __block atomic_int running = 0;
+    __block atomic_int maxRunning = 0;
+    __block atomic_int completed = 0;
+
+    for (int i = 0; i < 40; i++) {
+        [scheduler performCPUWorkForStage: SCBlockWorkStageParse group: group block:^{
+            int nowRunning = atomic_fetch_add(&running, 1) + 1;
+            int prevMax = atomic_load(&maxRunning);
+            while (nowRunning > prevMax && !atomic_compare_exchange_weak(&maxRunning, &prevMax, nowRunning)) {}
+            usleep(2000);
+            atomic_fetch_sub(&running, 1);
+            atomic_fetch_add(&completed, 1);
+        }];
+    }
+
+    XCTAssertEqual(dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC)), 0);
+    XCTAssertEqual(atomic_load(&completed), 40);
+    XCTAssertLessThanOrEqual(atomic_load(&maxRunning), 2);
+
+    NSDictionary* parseStats = [scheduler statistics][@"Stages"][@"Parse"];
+    XCTAssertEqualObjects(parseStats[@"Submitted"], @40);
+    XCTAssertEqualObjects(parseStats[@"Completed"], @40);
+    XCTAssertEqualObjects(parseStats[@"Queued"], @0);
+    XCTAssertEqualObjects(parseStats[@"Running"], @0);
+    XCTAssertGreaterThan([parseStats[@"MaxSecs"] doubleValue], 0.0);
+}
+
+- (void)testWorkCanQueueMoreWorkInTheSameGroup {
+    SCBlockWorkScheduler* scheduler = [[SCBlockWorkScheduler alloc] initWithCPUConcurrency: 1];
+    dispatch_group_t group = dispatch_group_create();
+    __block atomic_int emitted = 0;
+
+    // like BlockManager: an expand item queues emit items before it finishes
+    [scheduler performBlockingIOWorkForStage: SCBlockWorkStageExpand group: group block:^{
+        for (int i = 0; i < 5; i++) {
+            [scheduler performCPUWorkForStage: SCBlockWorkStageEmit group: group block:^{
+                usleep(1000);
+                atomic_fetch_add(&emitted, 1);
+            }];
+        }
+    }];
+
+    XCTAssertEqual(dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC)), 0);
+    XCTAssertEqual(atomic_load(&emitted), 5);
+}
+
+- (void)testIOPoolAdaptsToLatency {
+    SCBlockWorkScheduler* scheduler = [[SCBlockWorkScheduler alloc] initWithCPUConcurrency: 4];
+    scheduler.minIOConcurrency = 2;
+    scheduler.maxIOConcurrency = 32;
+    scheduler.targetIOLatency = 0.05;
+    NSUInteger startingWidth = scheduler.ioConcurrency;
+    XCTAssertEqual(startingWidth, 8);
+
+    // fast I/O should grow the pool
+    dispatch_group_t group = dispatch_group_create();
+    for (int i = 0; i < 200; i++) {
+        [scheduler performBlockingIOWorkForStage: SCBlockWorkStageExpand group: group block:^{}];
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    NSUInteger grownWidth = scheduler.ioConcurrency;
+    XCTAssertGreaterThan(grownWidth, startingWidth);
+
+    // slow I/O should shrink it again, but never below the minimum
+    for (int round = 0; round < 8; round++) {
+        [scheduler performBlockingIOWorkForStage: SCBlockWorkStageExpand group: group block:^{
+            usleep(100000);
+        }];
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    }
+    NSUInteger shrunkWidth = scheduler.ioConcurrency;
+    XCTAssertLessThan(shrunkWidth, grownWidth);
+    XCTAssertGreaterThanOrEqual(shrunkWidth, 2);
+}
+
+- (void)testAsyncWorkIsTimed {
+    SCBlockWorkScheduler* scheduler = [[SCBlockWorkScheduler alloc] initWithCPUConcurrency: 1];
+    NSDate* startDate = [scheduler beginAsyncWorkForStage: SCBlockWorkStageResolve];
+    usleep(10000);
+    [scheduler endAsyncWorkForStage: SCBlockWorkStageResolve startDate: startDate];
+
+    NSDictionary* resolveStats = [scheduler statistics][@"Stages"][@"Resolve"];
+    XCTAssertEqualObjects(resolveStats[@"Completed"], @1);
+    XCTAssertEqualObjects(resolveStats[@"Running"], @0);
+    XCTAssertGreaterThanOrEqual([resolveStats[@"TotalSecs"] doubleValue], 0.01);
+
+    // a snapshot only counts what comes after it
+    NSDictionary* snapshot = [scheduler statistics];
+    startDate = [scheduler beginAsyncWorkForStage: SCBlockWorkStageResolve];
+    [scheduler endAsyncWorkForStage: SCBlockWorkStageResolve startDate: startDate];
+    resolveStats = [scheduler statisticsSinceSnapshot: snapshot][@"Stages"][@"Resolve"];
+    XCTAssertEqualObjects(resolveStats[@"Submitted"], @1);
+    XCTAssertEqualObjects(resolveStats[@"Completed"], @1);
+    XCTAssertEqualObjects([scheduler statistics][@"Stages"][@"Resolve"][@"Completed"], @2);
+
+    [scheduler resetStatistics];
+    resolveStats = [scheduler statistics][@"Stages"][@"Resolve"];
+    XCTAssertEqualObjects(resolveStats[@"Completed"], @0);
+}
+
+@end
@@ -0,0 +1,179 @@
+//
+//  SCBlocklistTableTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCBlocklistTable.h"
+#import "SCBlockState.h"
+#import "SCSettings.h"
+
+@interface SCBlocklistTableTests : XCTestCase
+
+@property NSString* path;
+
+@end
+
+@implementation SCBlocklistTableTests
+
++ (void)setUp {
+    // SCSettings shouldn't be readOnly during our tests
+    // so we can test changing values
+    [SCSettings sharedSettings].readOnly = NO;
+}
+
+- (void)setUp {
+    self.path = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSString stringWithFormat: @"SCBlocklistTableTests-%@.blocklist", [NSUUID UUID].UUIDString]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath: self.path error: nil];
+}
+
+- (void)testBuildsDeduplicatedTable {
+    SCBlocklistTable* table = [SCBlocklistTable tableWithEntries: @[ @"reddit.com", @"facebook.com", @"reddit.com", @"bad\nentry", @"", @42, @[ @"nested.com" ], @"10.0.0.0/8" ]];
+
+    XCTAssertEqual(table.count, 4);
+    XCTAssertEqualObjects(table.entries, (@[ @"reddit.com", @"facebook.com", @"", @"10.0.0.0/8" ]));
+    XCTAssertEqualObjects([table entryAtIndex: 1], @"facebook.com");
+    XCTAssertTrue([table containsEntry: @"facebook.com"]);
+    XCTAssertTrue([table containsEntry: @""]);
+    XCTAssertTrue([table containsEntry: @"10.0.0.0/8"]);
+    XCTAssertFalse([table containsEntry: @"facebook.co"]);
+    XCTAssertFalse([table containsEntry: @"facebook.com.au"]);
+    XCTAssertFalse([table containsEntry: @"bad\nentry"]);
+
+    // the hash is the same digest the published block state uses
+    XCTAssertEqualObjects(table.contentHash, [self hexString: [SCBlockState digestOfBlocklist: table.entries]]);
+    XCTAssertEqualObjects(table.contentHash, [SCBlocklistTable tableWithEntries: table.entries].contentHash);
+    XCTAssertNotEqualObjects(table.contentHash, [SCBlocklistTable tableWithEntries: @[ @"facebook.com", @"reddit.com" ]].contentHash);
+
+    XCTAssertEqual([SCBlocklistTable emptyTable].count, 0);
+    XCTAssertEqualObjects([SCBlocklistTable emptyTable].entries, @[]);
+    XCTAssertFalse([[SCBlocklistTable emptyTable] containsEntry: @""]);
+}
+
+- (NSString*)hexString:(NSData*)data {
+    NSMutableString* hex = [NSMutableString string];
+    const uint8_t* bytes = data.bytes;
+    for (NSUInteger i = 0; i < data.length; i++) [hex appendFormat: @"%02x", bytes[i]];
+    return hex;
+}
+
+- (void)testRoundTripsThroughFile {
+    NSMutableArray* entries = [NSMutableArray array];
+    for (int i = 0; i < 5000; i++) {
+        [entries addObject: [NSString stringWithFormat: @"site%d.example.com", (i * 7919) % 5000]];
+    }
+    [entries addObject: @"bücher.de"];
+    SCBlocklistTable* table = [SCBlocklistTable tableWithEntries: entries];
+
+    NSError* err = nil;
+    XCTAssertTrue([table writeToFile: self.path error: &err]);
+    XCTAssertNil(err);
+
+    SCBlocklistTable* mapped = [SCBlocklistTable tableWithContentsOfFile: self.path error: &err];
+    XCTAssertNotNil(mapped);
+    XCTAssertEqual(mapped.count, table.count);
+    XCTAssertEqualObjects(mapped.contentHash, table.contentHash);
+    XCTAssertEqualObjects(mapped.entries, table.entries);
+    for (NSString* entry in entries) {
+        XCTAssertTrue([mapped containsEntry: entry]);
+    }
+    XCTAssertFalse([mapped containsEntry: @"site5000.example.com"]);
+
+    __block NSUInteger enumerated = 0;
+    [mapped enumerateEntriesUsingBlock:^(NSString* entry, NSUInteger idx, BOOL* stop) {
+        enumerated++;
+        *stop = (idx == 9);
+    }];
+    XCTAssertEqual(enumerated, 10);
+}
+
+- (void)testRejectsDamagedFiles {
+    NSError* err = nil;
+    XCTAssertNil([SCBlocklistTable tableWithContentsOfFile: self.path error: &err]);
+    XCTAssertNotNil(err);
+
+    SCBlocklistTable* table = [SCBlocklistTable tableWithEntries: @[ @"facebook.com", @"reddit.com" ]];
+    XCTAssertTrue([table writeToFile: self.path error: nil]);
+    NSMutableData* data = [NSMutableData dataWithContentsOfFile: self.path];
+
+    // an edited entry doesn't match the hash
+    NSMutableData* edited = [data mutableCopy];
+    ((char*)edited.mutableBytes)[edited.length - 2] = 'x';
+    [edited writeToFile: self.path atomically: YES];
+    XCTAssertNil([SCBlocklistTable tableWithContentsOfFile: self.path error: nil]);
+
+    // the hash doesn't cover the sorted index, so a shuffled or repeated one has to be caught too
+    // (it comes after the header and the count + 1 offsets)
+    NSUInteger sortedIndexesStart = 4 * sizeof(uint32_t) + 32 + 3 * sizeof(uint32_t);
+    uint32_t swapped[2] = { 1, 0 };
+    NSMutableData* shuffled = [data mutableCopy];
+    [shuffled replaceBytesInRange: NSMakeRange(sortedIndexesStart, sizeof(swapped)) withBytes: swapped];
+    [shuffled writeToFile: self.path atomically: YES];
+    XCTAssertNil([SCBlocklistTable tableWithContentsOfFile: self.path error: nil]);
+    uint32_t repeated[2] = { 0, 0 };
+    NSMutableData* duplicated = [data mutableCopy];
+    [duplicated replaceBytesInRange: NSMakeRange(sortedIndexesStart, sizeof(repeated)) withBytes: repeated];
+    [duplicated writeToFile: self.path atomically: YES];
+    XCTAssertNil([SCBlocklistTable tableWithContentsOfFile: self.path error: nil]);
+
+    // and a truncated one doesn't add up
+    [[data subdataWithRange: NSMakeRange(0, data.length - 1)] writeToFile: self.path atomically: YES];
+    XCTAssertNil([SCBlocklistTable tableWithContentsOfFile: self.path error: nil]);
+
+    [[NSData data] writeToFile: self.path atomically: YES];
+    XCTAssertNil([SCBlocklistTable tableWithContentsOfFile: self.path error: nil]);
+}
+
+- (void)testSettingsOnlyHoldHashAndCount {
+    SCSettings* settings = [SCSettings sharedSettings];
+    NSMutableArray* bigList = [NSMutableArray array];
+    for (int i = 0; i < 2000; i++) {
+        [bigList addObject: [NSString stringWithFormat: @"site%d.example.com", i]];
+    }
+
+    [settings setValue: bigList forKey: @"ActiveBlocklist"];
+    NSDictionary* snapshot = settings.dictionaryRepresentation;
+    XCTAssertNil(snapshot[@"ActiveBlocklist"]);
+    XCTAssertEqualObjects(snapshot[@"ActiveBlocklistCount"], @2000);
+    XCTAssertEqualObjects(snapshot[@"ActiveBlocklistHash"], [SCBlocklistTable tableWithEntries: bigList].contentHash);
+    XCTAssertEqualObjects([settings valueForKey: @"ActiveBlocklist"], bigList);
+    XCTAssertTrue([settings.activeBlocklistTable containsEntry: @"site1999.example.com"]);
+
+    // so a settings sync costs the same no matter how long the list is
+    NSData* snapshotData = [NSPropertyListSerialization dataWithPropertyList: snapshot format: NSPropertyListBinaryFormat_v1_0 options: 0 error: nil];
+    XCTAssertLessThan(snapshotData.length, 4096);
+
+    [settings setValue: nil forKey: @"ActiveBlocklist"];
+    XCTAssertEqualObjects([settings valueForKey: @"ActiveBlocklistCount"], @0);
+    XCTAssertEqualObjects([settings valueForKey: @"ActiveBlocklistHash"], [SCBlocklistTable emptyTable].contentHash);
+    XCTAssertEqualObjects([settings valueForKey: @"ActiveBlocklist"], @[]);
+}
+
+- (void)testLookupCost {
+    NSMutableArray* entries = [NSMutableArray array];
+    for (int i = 0; i < 50000; i++) {
+        [entries addObject: [NSString stringWithFormat: @"site%d.example.com", i]];
+    }
+    XCTAssertTrue([[SCBlocklistTable tableWithEntries: entries] writeToFile: self.path error: nil]);
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    SCBlocklistTable* mapped = [SCBlocklistTable tableWithContentsOfFile: self.path error: nil];
+    double loadMillis = (CFAbsoluteTimeGetCurrent() - start) * 1000;
+
+    start = CFAbsoluteTimeGetCurrent();
+    NSUInteger found = 0;
+    for (int i = 0; i < 50000; i += 5) {
+        if ([mapped containsEntry: entries[i]]) found++;
+    }
+    double lookupMicros = (CFAbsoluteTimeGetCurrent() - start) * 1e6 / 10000;
+
+    NSLog(@"SCBlocklistTableTests: mapped and verified 50000 entries in %.2f ms, %.2f us per lookup", loadMillis, lookupMicros);
+    XCTAssertEqual(found, 10000);
+}
+
+@end
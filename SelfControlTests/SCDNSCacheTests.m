@@ -0,0 +1,118 @@
+//
+//  SCDNSCacheTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCDNSCache.h"
+#import "SCDNSResolver.h"
+
+@interface SCDNSCacheTests : XCTestCase
+
+@property (strong) NSString* cachePath;
+
+@end
+
+@implementation SCDNSCacheTests
+
+- (void)setUp {
+    self.cachePath = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSString stringWithFormat: @"SCDNSCacheTests-%@.plist", [NSUUID UUID].UUIDString]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath: self.cachePath error: nil];
+}
+
+- (SCDNSCache*)newCache {
+    SCDNSCache* cache = [[SCDNSCache alloc] initWithFilePath: self.cachePath];
+    cache.readOnly = NO;
+    return cache;
+}
+
+- (void)testRecordAndLookup {
+    SCDNSCache* cache = [self newCache];
+    XCTAssertNil([cache entryForDomain: @"example.com"]);
+
+    [cache recordAddresses: @[@"10.0.0.1", @"10.0.0.2"] forDomain: @"Example.com" ttl: 300];
+    SCDNSCacheEntry* entry = [cache entryForDomain: @"example.COM"];
+    XCTAssertEqualObjects(entry.addresses, (@[@"10.0.0.1", @"10.0.0.2"]));
+    XCTAssertFalse(entry.negative);
+    XCTAssertFalse(entry.expired);
+    XCTAssertEqualWithAccuracy([entry.expirationDate timeIntervalSinceNow], 300, 5);
+}
+
+- (void)testTTLClampingAndStaleEntries {
+    SCDNSCache* cache = [self newCache];
+    cache.minimumTTL = 0;
+    cache.maximumTTL = 600;
+
+    [cache recordAddresses: @[@"10.0.0.1"] forDomain: @"long.test" ttl: 86400];
+    XCTAssertEqualWithAccuracy([[cache entryForDomain: @"long.test"].expirationDate timeIntervalSinceNow], 600, 5);
+
+    // expired, but within maxStaleAge - we still get it back, marked expired
+    [cache recordAddresses: @[@"10.0.0.2"] forDomain: @"stale.test" ttl: 0];
+    cache.maxStaleAge = 60;
+    SCDNSCacheEntry* staleEntry = [cache entryForDomain: @"stale.test"];
+    XCTAssertNotNil(staleEntry);
+    XCTAssertTrue(staleEntry.expired);
+
+    cache.maxStaleAge = -1;
+    XCTAssertNil([cache entryForDomain: @"stale.test"]);
+    // and once it's too stale it's gone for good, even if we'd take older entries again
+    cache.maxStaleAge = 60;
+    XCTAssertNil([cache entryForDomain: @"stale.test"]);
+
+    NSDictionary* stats = [cache statistics];
+    XCTAssertEqualObjects(stats[@"HitCount"], @1);
+    XCTAssertEqualObjects(stats[@"StaleHitCount"], @1);
+    XCTAssertEqualObjects(stats[@"TooStaleCount"], @1);
+    XCTAssertEqualObjects(stats[@"MissCount"], @1);
+    XCTAssertEqualObjects(stats[@"EntryCount"], @1);
+}
+
+- (void)testRecordResolution {
+    SCDNSCache* cache = [self newCache];
+
+    [cache recordResolution: [[SCDNSResolution alloc] initWithDomain: @"nx.test" status: SCDNSResolutionStatusNXDomain addresses: @[] ttl: 900 duration: 0.1]];
+    [cache recordResolution: [[SCDNSResolution alloc] initWithDomain: @"slow.test" status: SCDNSResolutionStatusTimedOut addresses: @[] ttl: 0 duration: 3.0]];
+    [cache recordResolution: [[SCDNSResolution alloc] initWithDomain: @"cancelled.test" status: SCDNSResolutionStatusCancelled addresses: @[@"10.0.0.3"] ttl: 0 duration: 3.0]];
+
+    SCDNSCacheEntry* negativeEntry = [cache entryForDomain: @"nx.test"];
+    XCTAssertTrue(negativeEntry.negative);
+    XCTAssertEqual(negativeEntry.addresses.count, 0);
+    XCTAssertNil([cache entryForDomain: @"slow.test"]);
+    XCTAssertNil([cache entryForDomain: @"cancelled.test"]);
+}
+
+- (void)testPersistence {
+    SCDNSCache* cache = [self newCache];
+    [cache recordAddresses: @[@"10.0.0.1", @"fe80::1"] forDomain: @"example.com" ttl: 300];
+    [cache recordAddresses: @[] forDomain: @"nx.test" ttl: 300];
+    [cache synchronize];
+
+    SCDNSCache* reloadedCache = [self newCache];
+    XCTAssertEqual(reloadedCache.count, 2);
+    XCTAssertEqualObjects([reloadedCache entryForDomain: @"example.com"].addresses, (@[@"10.0.0.1", @"fe80::1"]));
+    XCTAssertTrue([reloadedCache entryForDomain: @"nx.test"].negative);
+
+    // read-only caches never touch the disk
+    reloadedCache.readOnly = YES;
+    [reloadedCache removeAllEntries];
+    [reloadedCache synchronize];
+    XCTAssertEqual([self newCache].count, 2);
+}
+
+- (void)testPruning {
+    SCDNSCache* cache = [self newCache];
+    cache.maxEntries = 10;
+    for (int i = 0; i < 25; i++) {
+        [cache recordAddresses: @[@"10.0.0.1"] forDomain: [NSString stringWithFormat: @"site%d.test", i] ttl: 300];
+    }
+    [cache synchronize];
+
+    XCTAssertEqual(cache.count, 10);
+}
+
+@end
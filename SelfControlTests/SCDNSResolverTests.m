@@ -0,0 +1,203 @@
+//
+//  SCDNSResolverTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCDNSResolver.h"
+#import "SCStubDNSServer.h"
+
+@interface SCDNSResolverTests : XCTestCase
+
+@property (strong) SCStubDNSServer* server;
+@property (strong) SCDNSResolver* resolver;
+
+@end
+
+@implementation SCDNSResolverTests
+
+- (void)setUp {
+    self.server = [SCStubDNSServer new];
+    XCTAssertNotNil(self.server);
+    self.server.records = @{
+        @"example.com": @[@"93.184.216.34", @"2606:2800:220:1:248:1893:25c8:1946"],
+        @"ipv4only.test": @[@"10.1.2.3", @"10.1.2.4"]
+    };
+    self.server.silentDomains = [NSSet setWithObject: @"dead.test"];
+
+    self.resolver = [[SCDNSResolver alloc] initWithNameservers: @[@"127.0.0.1"] port: self.server.port];
+    self.resolver.queryTimeout = 1.0;
+    self.resolver.retransmitInterval = 0.25;
+}
+
+- (void)tearDown {
+    [self.resolver invalidate];
+    [self.server stop];
+}
+
+- (SCDNSResolution*)resolveAndWait:(NSString*)domain {
+    XCTestExpectation* expectation = [self expectationWithDescription: domain];
+    __block SCDNSResolution* result;
+    [self.resolver resolveDomain: domain completion:^(SCDNSResolution* resolution) {
+        result = resolution;
+        [expectation fulfill];
+    }];
+    [self waitForExpectations: @[expectation] timeout: 5.0];
+    return result;
+}
+
+- (void)testResolvesIPv4AndIPv6 {
+    SCDNSResolution* resolution = [self resolveAndWait: @"Example.com."];
+
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusSuccess);
+    XCTAssertEqualObjects(resolution.domain, @"example.com");
+    XCTAssertEqualObjects([NSSet setWithArray: resolution.addresses], ([NSSet setWithArray: @[@"93.184.216.34", @"2606:2800:220:1:248:1893:25c8:1946"]]));
+    XCTAssertEqual(resolution.ttl, 60);
+
+    // IPv4-only names get NODATA on AAAA, which shouldn't stop us from returning the A records
+    resolution = [self resolveAndWait: @"ipv4only.test"];
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusSuccess);
+    XCTAssertEqual(resolution.addresses.count, 2);
+}
+
+- (void)testNXDomainUsesSOATTL {
+    SCDNSResolution* resolution = [self resolveAndWait: @"doesnotexist.test"];
+
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusNXDomain);
+    XCTAssertEqual(resolution.addresses.count, 0);
+    XCTAssertEqual(resolution.ttl, 120);
+}
+
+- (void)testTruncatedAnswersAreRetriedOverTCP {
+    self.server.truncatedDomains = [NSSet setWithObject: @"example.com"];
+    SCDNSResolution* resolution = [self resolveAndWait: @"example.com"];
+
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusSuccess);
+    XCTAssertEqual(resolution.addresses.count, 2);
+    // both the A and AAAA queries came back truncated over UDP
+    XCTAssertEqual(self.server.tcpQueryCount, 2);
+}
+
+- (void)testUnencodableDomain {
+    NSString* longLabel = [@"" stringByPaddingToLength: 64 withString: @"a" startingAtIndex: 0];
+    SCDNSResolution* resolution = [self resolveAndWait: [longLabel stringByAppendingString: @".com"]];
+
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusNXDomain);
+    XCTAssertEqual(self.server.queryCount, 0);
+}
+
+- (void)testTimeoutWithRetransmits {
+    SCDNSResolution* resolution = [self resolveAndWait: @"dead.test"];
+
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusTimedOut);
+    XCTAssertLessThan(resolution.duration, 2.0);
+    // 2 queries (A + AAAA), each sent about 4 times in the 1 second timeout
+    XCTAssertGreaterThan(self.server.queryCount, 2);
+}
+
+- (void)testDeadDomainDoesNotDelayOthers {
+    XCTestExpectation* deadExpectation = [self expectationWithDescription: @"dead"];
+    [self.resolver resolveDomain: @"dead.test" completion:^(SCDNSResolution* resolution) {
+        [deadExpectation fulfill];
+    }];
+
+    NSDate* start = [NSDate date];
+    SCDNSResolution* resolution = [self resolveAndWait: @"example.com"];
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusSuccess);
+    XCTAssertLessThan([[NSDate date] timeIntervalSinceDate: start], 0.5);
+
+    [self waitForExpectations: @[deadExpectation] timeout: 5.0];
+}
+
+- (void)testCancelAllQueries {
+    XCTestExpectation* expectation = [self expectationWithDescription: @"cancelled"];
+    __block SCDNSResolution* result;
+    self.resolver.queryTimeout = 30.0;
+    [self.resolver resolveDomain: @"dead.test" completion:^(SCDNSResolution* resolution) {
+        result = resolution;
+        [expectation fulfill];
+    }];
+
+    XCTAssertEqual(self.resolver.pendingLookupCount, 1);
+    [self.resolver cancelAllQueries];
+    [self waitForExpectations: @[expectation] timeout: 1.0];
+
+    XCTAssertEqual(result.status, SCDNSResolutionStatusCancelled);
+    XCTAssertEqual(self.resolver.pendingLookupCount, 0);
+}
+
+- (void)testCoalescesDuplicateLookups {
+    self.server.responseDelay = 0.1;
+
+    NSDictionary* results = [self.resolver resolveDomains: @[@"example.com", @"EXAMPLE.COM", @"example.com"] timeout: 5.0];
+
+    XCTAssertEqual(results.count, 1);
+    XCTAssertEqual(self.server.queryCount, 2);
+}
+
+- (void)testManyConcurrentLookupsAreBounded {
+    NSMutableDictionary* records = [NSMutableDictionary dictionary];
+    NSMutableArray* domains = [NSMutableArray array];
+    for (int i = 0; i < 500; i++) {
+        NSString* domain = [NSString stringWithFormat: @"site%d.test", i];
+        records[domain] = @[[NSString stringWithFormat: @"10.0.%d.%d", i / 256, i % 256]];
+        [domains addObject: domain];
+    }
+    // throw some dead ones in the middle
+    [domains addObjectsFromArray: @[@"dead.test", @"dead2.test", @"dead3.test"]];
+    self.server.records = records;
+    self.server.silentDomains = [NSSet setWithArray: @[@"dead.test", @"dead2.test", @"dead3.test"]];
+    self.resolver.maxOutstandingQueries = 16;
+
+    NSDate* start = [NSDate date];
+    NSDictionary<NSString*, SCDNSResolution*>* results = [self.resolver resolveDomains: domains timeout: 10.0];
+    NSTimeInterval elapsed = [[NSDate date] timeIntervalSinceDate: start];
+
+    XCTAssertEqual(results.count, domains.count);
+    XCTAssertLessThan(elapsed, 3.0);
+    for (int i = 0; i < 500; i++) {
+        NSString* domain = [NSString stringWithFormat: @"site%d.test", i];
+        XCTAssertEqual(results[domain].status, SCDNSResolutionStatusSuccess);
+        XCTAssertEqualObjects(results[domain].addresses, records[domain]);
+    }
+    XCTAssertEqual(results[@"dead2.test"].status, SCDNSResolutionStatusTimedOut);
+}
+
+- (void)testQueuedQueriesGetTheirFullTimeout {
+    NSMutableDictionary* records = [NSMutableDictionary dictionary];
+    NSMutableArray* domains = [NSMutableArray array];
+    for (int i = 0; i < 20; i++) {
+        NSString* domain = [NSString stringWithFormat: @"slow%d.test", i];
+        records[domain] = @[[NSString stringWithFormat: @"10.1.0.%d", i]];
+        [domains addObject: domain];
+    }
+    self.server.records = records;
+    self.server.responseDelay = 0.3;
+    // 2 lookups on the wire at a time, so the last ones wait ~3s in line - much longer than the timeout
+    self.resolver.maxOutstandingQueries = 4;
+    self.resolver.retransmitInterval = 1.0;
+
+    NSDictionary<NSString*, SCDNSResolution*>* results = [self.resolver resolveDomains: domains timeout: 20.0];
+
+    XCTAssertEqual(results.count, domains.count);
+    for (NSString* domain in domains) {
+        XCTAssertEqual(results[domain].status, SCDNSResolutionStatusSuccess, @"%@", domain);
+    }
+    // each query went out exactly once, none of them timed out before being sent
+    XCTAssertEqual(self.server.queryCount, domains.count * 2);
+}
+
+- (void)testResolveDomainsDeadlineCancels {
+    self.resolver.queryTimeout = 30.0;
+
+    NSDate* start = [NSDate date];
+    NSDictionary<NSString*, SCDNSResolution*>* results = [self.resolver resolveDomains: @[@"example.com", @"dead.test"] timeout: 0.5];
+
+    XCTAssertLessThan([[NSDate date] timeIntervalSinceDate: start], 2.0);
+    XCTAssertEqual(results[@"example.com"].status, SCDNSResolutionStatusSuccess);
+    XCTAssertEqual(results[@"dead.test"].status, SCDNSResolutionStatusCancelled);
+}
+
+@end
@@ -0,0 +1,259 @@
+//
+//  SCDNSResponderTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCDNSResponder.h"
+#import "SCDomainSuffixIndex.h"
+#import "SCDNSResolver.h"
+#import "SCStubDNSServer.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+@interface SCDNSResponderTests : XCTestCase
+
+@property (strong) SCStubDNSServer* upstream;
+@property (strong) SCDNSResponder* responder;
+@property (strong) SCDNSResolver* client;
+
+@end
+
+@implementation SCDNSResponderTests
+
+- (void)setUp {
+    self.upstream = [SCStubDNSServer new];
+    XCTAssertNotNil(self.upstream);
+    self.upstream.records = @{
+        @"allowed.test": @[@"10.1.2.3", @"2001:db8::1"],
+        @"news.test": @[@"10.4.5.6"]
+    };
+    self.upstream.silentDomains = [NSSet setWithObject: @"dead.test"];
+
+    SCDomainSuffixIndex* index = [[SCDomainSuffixIndex alloc] initWithRules: @[@"blocked.test", @"*.ads.test"]];
+    self.responder = [[SCDNSResponder alloc] initWithBlockIndex: index upstreamNameservers: @[@"127.0.0.1"] upstreamPort: self.upstream.port];
+    self.responder.upstreamTimeout = 0.2;
+    NSError* startErr = nil;
+    XCTAssertTrue([self.responder startOnPort: 0 error: &startErr], @"%@", startErr);
+
+    self.client = [[SCDNSResolver alloc] initWithNameservers: @[@"127.0.0.1"] port: self.responder.port];
+    self.client.queryTimeout = 2.0;
+    self.client.retransmitInterval = 1.0;
+    // we want to see the sinkhole answers themselves
+    self.client.ignoresSinkholedAnswers = NO;
+}
+
+- (void)tearDown {
+    [self.client invalidate];
+    [self.responder stop];
+    [self.upstream stop];
+}
+
+- (SCDNSResolution*)resolve:(NSString*)domain {
+    return [self.client resolveDomains: @[domain] timeout: 5.0][domain];
+}
+
+#pragma mark - Matching
+
+- (void)testSuffixIndexMatching {
+    SCDomainSuffixIndex* index = [[SCDomainSuffixIndex alloc] initWithRules: @[@"Example.com", @"*.ads.net.", @" *.tracker.org "]];
+    XCTAssertEqual(index.count, 3);
+
+    XCTAssertTrue([index matchesDomain: @"example.com"]);
+    XCTAssertTrue([index matchesDomain: @"EXAMPLE.COM."]);
+    XCTAssertFalse([index matchesDomain: @"www.example.com"]);
+    XCTAssertFalse([index matchesDomain: @"notexample.com"]);
+
+    // wildcards cover everything below, but not the name itself
+    XCTAssertTrue([index matchesDomain: @"x.ads.net"]);
+    XCTAssertTrue([index matchesDomain: @"a.b.c.ads.net"]);
+    XCTAssertTrue([index matchesDomain: @"pixel.tracker.org"]);
+    XCTAssertFalse([index matchesDomain: @"ads.net"]);
+    XCTAssertFalse([index matchesDomain: @"badads.net"]);
+
+    XCTAssertFalse([index matchesDomain: @""]);
+    XCTAssertFalse([index matchesDomain: @"."]);
+}
+
+- (void)testIndexFromBlocklistSkipsNonDomains {
+    NSArray<NSString*>* blocklist = @[@"facebook.com", @"*.doubleclick.net", @"10.0.0.1", @"192.168.0.0/16", @"example.org:8080", @"2001:db8::1", @""];
+
+    SCDomainSuffixIndex* index = [SCDomainSuffixIndex indexWithBlocklist: blocklist includeSubdomains: NO];
+    XCTAssertEqual(index.count, 2);
+    XCTAssertTrue([index matchesDomain: @"facebook.com"]);
+    XCTAssertFalse([index matchesDomain: @"www.facebook.com"]);
+    XCTAssertTrue([index matchesDomain: @"ad.doubleclick.net"]);
+    XCTAssertFalse([index matchesDomain: @"example.org"]);
+
+    SCDomainSuffixIndex* withSubdomains = [SCDomainSuffixIndex indexWithBlocklist: blocklist includeSubdomains: YES];
+    XCTAssertTrue([withSubdomains matchesDomain: @"facebook.com"]);
+    XCTAssertTrue([withSubdomains matchesDomain: @"m.facebook.com"]);
+}
+
+- (void)testSuffixIndexLookupsAreFast {
+    NSMutableArray<NSString*>* rules = [NSMutableArray arrayWithCapacity: 200000];
+    for (int i = 0; i < 100000; i++) {
+        [rules addObject: [NSString stringWithFormat: @"site%d.test", i]];
+        [rules addObject: [NSString stringWithFormat: @"*.cdn%d.test", i]];
+    }
+    SCDomainSuffixIndex* index = [[SCDomainSuffixIndex alloc] initWithRules: rules];
+    XCTAssertEqual(index.count, 200000);
+
+    NSMutableArray<NSString*>* queries = [NSMutableArray arrayWithCapacity: 100000];
+    for (int i = 0; i < 100000; i++) {
+        [queries addObject: [NSString stringWithFormat: (i % 2) ? @"img.static.cdn%d.test" : @"www.other%d.example.com", i]];
+    }
+
+    NSDate* start = [NSDate date];
+    NSUInteger matches = 0;
+    for (NSString* query in queries) {
+        if ([index matchesDomain: query]) matches++;
+    }
+    NSTimeInterval elapsed = [[NSDate date] timeIntervalSinceDate: start];
+    NSLog(@"100k lookups against 200k rules in %f seconds", elapsed);
+
+    XCTAssertEqual(matches, 50000);
+    // i.e. comfortably under 10 microseconds a lookup
+    XCTAssertLessThan(elapsed, 1.0);
+}
+
+#pragma mark - Responder
+
+- (void)testBlockedNamesGetSinkholeAnswers {
+    for (NSString* domain in @[@"blocked.test", @"tracking.ads.test", @"a.b.ads.test"]) {
+        SCDNSResolution* resolution = [self resolve: domain];
+        XCTAssertEqual(resolution.status, SCDNSResolutionStatusSuccess, @"%@", domain);
+        XCTAssertEqualObjects([NSSet setWithArray: resolution.addresses], ([NSSet setWithArray: @[@"0.0.0.0", @"::"]]), @"%@", domain);
+        XCTAssertEqual(resolution.ttl, self.responder.sinkholeTTL);
+    }
+
+    // none of that should have gone upstream
+    XCTAssertEqual(self.upstream.queryCount, 0);
+    XCTAssertEqual([self.responder.statistics[@"BlockedCount"] unsignedIntegerValue], 6);
+}
+
+- (void)testUnblockedNamesAreForwardedAndCached {
+    SCDNSResolution* resolution = [self resolve: @"allowed.test"];
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusSuccess);
+    XCTAssertEqualObjects([NSSet setWithArray: resolution.addresses], ([NSSet setWithArray: @[@"10.1.2.3", @"2001:db8::1"]]));
+    // the bare name of a wildcard rule isn't blocked
+    XCTAssertEqual([self resolve: @"ads.test"].status, SCDNSResolutionStatusNXDomain);
+    XCTAssertEqual(self.upstream.queryCount, 4);
+
+    // second time around (case and all) comes straight from the cache
+    resolution = [self resolve: @"ALLOWED.test"];
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusSuccess);
+    XCTAssertEqual(resolution.addresses.count, 2);
+    XCTAssertLessThanOrEqual(resolution.ttl, 60);
+    XCTAssertEqual([self resolve: @"ads.test"].status, SCDNSResolutionStatusNXDomain);
+    XCTAssertEqual(self.upstream.queryCount, 4);
+    XCTAssertEqual([self.responder.statistics[@"CacheHitCount"] unsignedIntegerValue], 4);
+}
+
+- (void)testNewBlockIndexTakesPriorityOverCache {
+    XCTAssertEqualObjects([self resolve: @"news.test"].addresses, @[@"10.4.5.6"]);
+
+    self.responder.blockIndex = [[SCDomainSuffixIndex alloc] initWithRules: @[@"news.test"]];
+    XCTAssertEqualObjects([NSSet setWithArray: [self resolve: @"news.test"].addresses], ([NSSet setWithArray: @[@"0.0.0.0", @"::"]]));
+}
+
+- (void)testDeadUpstreamGetsServerFailure {
+    SCDNSResolution* resolution = [self resolve: @"dead.test"];
+    XCTAssertEqual(resolution.status, SCDNSResolutionStatusServerFailure);
+    XCTAssertGreaterThan([self.responder.statistics[@"UpstreamFailureCount"] unsignedIntegerValue], 0);
+    XCTAssertEqual([self.responder.statistics[@"PendingUpstreamCount"] unsignedIntegerValue], 0);
+}
+
+- (void)testNoUsableUpstreamStillSinkholes {
+    SCDNSResponder* isolated = [[SCDNSResponder alloc] initWithBlockIndex: [[SCDomainSuffixIndex alloc] initWithRules: @[@"blocked.test"]]
+                                                    upstreamNameservers: @[@"not-a-nameserver"]
+                                                           upstreamPort: 53];
+    XCTAssertTrue([isolated startOnPort: 0 error: nil]);
+    SCDNSResolver* client = [[SCDNSResolver alloc] initWithNameservers: @[@"127.0.0.1"] port: isolated.port];
+    client.ignoresSinkholedAnswers = NO;
+
+    NSDictionary<NSString*, SCDNSResolution*>* resolutions = [client resolveDomains: @[@"blocked.test", @"allowed.test"] timeout: 5.0];
+    XCTAssertEqual(resolutions[@"blocked.test"].status, SCDNSResolutionStatusSuccess);
+    XCTAssertEqual(resolutions[@"allowed.test"].status, SCDNSResolutionStatusServerFailure);
+
+    [client invalidate];
+    [isolated stop];
+}
+
+- (void)testUpstreamsCanChangeWhileRunning {
+    self.responder.upstreamNameservers = @[];
+    XCTAssertEqual([self resolve: @"news.test"].status, SCDNSResolutionStatusServerFailure);
+    XCTAssertEqual(self.upstream.queryCount, 0);
+
+    self.responder.upstreamNameservers = @[@"127.0.0.1"];
+    XCTAssertEqualObjects(self.responder.upstreamNameservers, @[@"127.0.0.1"]);
+    XCTAssertEqualObjects([self resolve: @"news.test"].addresses, @[@"10.4.5.6"]);
+}
+
+- (void)testAnswersOverTCP {
+    // a standard query for blocked.test, type A, class IN
+    uint8_t query[] = {
+        0x00, 0x1E, // length prefix
+        0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        7, 'b', 'l', 'o', 'c', 'k', 'e', 'd', 4, 't', 'e', 's', 't', 0,
+        0x00, 0x01, 0x00, 0x01
+    };
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(self.responder.port);
+    XCTAssertEqual(connect(fd, (struct sockaddr*)&address, sizeof(address)), 0);
+    struct timeval timeout = { .tv_sec = 5, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    XCTAssertEqual(send(fd, query, sizeof(query), 0), (ssize_t)sizeof(query));
+
+    uint8_t answer[512];
+    ssize_t received = 0;
+    while (received < (ssize_t)sizeof(answer)) {
+        ssize_t got = recv(fd, answer + received, sizeof(answer) - (size_t)received, 0);
+        if (got <= 0) break;
+        received += got;
+        if (received >= 2 && received >= 2 + ((answer[0] << 8) | answer[1])) break;
+    }
+    close(fd);
+
+    // same ID, NOERROR, one answer, and it's the sinkhole address
+    XCTAssertGreaterThanOrEqual(received, 2 + 12);
+    NSUInteger length = (NSUInteger)((answer[0] << 8) | answer[1]);
+    XCTAssertEqual((NSUInteger)received, 2 + length);
+    XCTAssertEqual(answer[2], 0x12);
+    XCTAssertEqual(answer[3], 0x34);
+    XCTAssertEqual(answer[5] & 0x0F, 0);
+    XCTAssertEqual((answer[8] << 8) | answer[9], 1);
+    XCTAssertEqual(memcmp(answer + received - 4, (uint8_t[]){ 0, 0, 0, 0 }, 4), 0);
+
+    XCTAssertEqual([self.responder.statistics[@"TCPQueryCount"] unsignedIntegerValue], 1);
+    XCTAssertEqual(self.upstream.queryCount, 0);
+}
+
+- (void)testHandlesThousandsOfQueriesPerSecond {
+    NSMutableArray<NSString*>* domains = [NSMutableArray arrayWithCapacity: 2000];
+    for (int i = 0; i < 2000; i++) {
+        [domains addObject: [NSString stringWithFormat: @"host%d.ads.test", i]];
+    }
+    self.client.maxOutstandingQueries = 256;
+
+    NSDate* start = [NSDate date];
+    NSDictionary<NSString*, SCDNSResolution*>* resolutions = [self.client resolveDomains: domains timeout: 10.0];
+    NSTimeInterval elapsed = [[NSDate date] timeIntervalSinceDate: start];
+    NSLog(@"Answered %lu queries in %f seconds (%.0f/sec)", (unsigned long)domains.count * 2, elapsed, domains.count * 2 / elapsed);
+
+    XCTAssertEqual(resolutions.count, domains.count);
+    for (SCDNSResolution* resolution in resolutions.allValues) {
+        XCTAssertEqual(resolution.status, SCDNSResolutionStatusSuccess);
+    }
+    XCTAssertLessThan(elapsed, 2.0);
+}
+
+@end
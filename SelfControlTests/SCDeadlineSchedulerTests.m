@@ -0,0 +1,132 @@
+//
+//  SCDeadlineSchedulerTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCDeadlineScheduler.h"
+
+@interface SCDeadlineSchedulerTests : XCTestCase
+
+@property (strong) SCDeadlineScheduler* scheduler;
+
+@end
+
+@implementation SCDeadlineSchedulerTests
+
+- (void)setUp {
+    self.scheduler = [SCDeadlineScheduler new];
+}
+
+- (void)testEventRunsOnceItsDue {
+    XCTestExpectation* fired = [self expectationWithDescription: @"event fired"];
+    NSDate* scheduledAt = [NSDate date];
+    __block NSTimeInterval firedAfter = 0;
+    [self.scheduler scheduleEvent: @"test" afterInterval: 0.3 tolerance: 0.2 handler:^{
+        firedAfter = [[NSDate date] timeIntervalSinceDate: scheduledAt];
+        [fired fulfill];
+    }];
+    [self waitForExpectationsWithTimeout: 2.0 handler: nil];
+
+    // never early; how late depends on how busy the machine is, so the 2s wait is the only upper bound
+    XCTAssertGreaterThanOrEqual(firedAfter, 0.3);
+    XCTAssertFalse([self.scheduler hasEvent: @"test"]);
+    XCTAssertEqual([self.scheduler.statistics[@"FiredEventCount"] unsignedIntegerValue], 1);
+}
+
+- (void)testWallClockDeadline {
+    XCTestExpectation* fired = [self expectationWithDescription: @"event fired"];
+    NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow: 0.3];
+    __block NSDate* firedDate = nil;
+    [self.scheduler scheduleEvent: @"blockEnd" atDate: deadline tolerance: 0.5 handler:^{
+        firedDate = [NSDate date];
+        [fired fulfill];
+    }];
+    [self waitForExpectationsWithTimeout: 2.0 handler: nil];
+
+    XCTAssertGreaterThanOrEqual([firedDate timeIntervalSinceDate: deadline], 0);
+    XCTAssertFalse([self.scheduler hasEvent: @"blockEnd"]);
+    XCTAssertEqual([self.scheduler.statistics[@"FiredEventCount"] unsignedIntegerValue], 1);
+}
+
+- (void)testPastDeadlineRunsRightAway {
+    XCTestExpectation* fired = [self expectationWithDescription: @"event fired"];
+    [self.scheduler scheduleEvent: @"overdue" atDate: [NSDate dateWithTimeIntervalSinceNow: -60] tolerance: 0 handler:^{
+        [fired fulfill];
+    }];
+    [self waitForExpectationsWithTimeout: 0.5 handler: nil];
+}
+
+- (void)testEventsShareWakeups {
+    XCTestExpectation* firedBoth = [self expectationWithDescription: @"both events fired"];
+    firedBoth.expectedFulfillmentCount = 2;
+
+    // the lax one is due first, but can wait for the strict one
+    [self.scheduler scheduleEvent: @"lax" afterInterval: 0.1 tolerance: 5.0 handler:^{
+        [firedBoth fulfill];
+    }];
+    [self.scheduler scheduleEvent: @"strict" afterInterval: 0.4 tolerance: 0 handler:^{
+        [firedBoth fulfill];
+    }];
+    [self waitForExpectationsWithTimeout: 2.0 handler: nil];
+
+    XCTAssertEqual([self.scheduler.statistics[@"WakeupCount"] unsignedIntegerValue], 1);
+}
+
+- (void)testLaxEventsWaitForTheirTolerance {
+    XCTestExpectation* fired = [self expectationWithDescription: @"event fired"];
+    fired.inverted = YES;
+    [self.scheduler scheduleEvent: @"lax" afterInterval: 0.1 tolerance: 10.0 handler:^{
+        [fired fulfill];
+    }];
+    [self waitForExpectationsWithTimeout: 0.5 handler: nil];
+
+    XCTAssertTrue([self.scheduler hasEvent: @"lax"]);
+    XCTAssertEqual([self.scheduler.statistics[@"WakeupCount"] unsignedIntegerValue], 0);
+    XCTAssertEqualObjects([self.scheduler.statistics[@"PendingEvents"] allKeys], @[@"lax"]);
+}
+
+- (void)testReschedulingReplacesAndCancelRemoves {
+    XCTestExpectation* replaced = [self expectationWithDescription: @"replaced event fired"];
+    replaced.inverted = YES;
+    XCTestExpectation* fired = [self expectationWithDescription: @"new event fired"];
+    XCTestExpectation* cancelled = [self expectationWithDescription: @"cancelled event fired"];
+    cancelled.inverted = YES;
+
+    [self.scheduler scheduleEvent: @"checkup" afterInterval: 0.1 tolerance: 0 handler:^{
+        [replaced fulfill];
+    }];
+    [self.scheduler scheduleEvent: @"checkup" afterInterval: 0.2 tolerance: 0 handler:^{
+        [fired fulfill];
+    }];
+    [self.scheduler scheduleEvent: @"inactivity" afterInterval: 0.1 tolerance: 0 handler:^{
+        [cancelled fulfill];
+    }];
+    [self.scheduler cancelEvent: @"inactivity"];
+
+    [self waitForExpectationsWithTimeout: 1.0 handler: nil];
+}
+
+- (void)testHandlerCanRescheduleItself {
+    XCTestExpectation* fired = [self expectationWithDescription: @"event fired three times"];
+    fired.expectedFulfillmentCount = 3;
+    __block NSUInteger runs = 0;
+    __weak SCDeadlineScheduler* scheduler = self.scheduler;
+    __block dispatch_block_t handler;
+    handler = ^{
+        [fired fulfill];
+        if (++runs < 3) {
+            [scheduler scheduleEvent: @"periodic" afterInterval: 0.05 tolerance: 0 handler: handler];
+        } else {
+            handler = nil;
+        }
+    };
+    [self.scheduler scheduleEvent: @"periodic" afterInterval: 0.05 tolerance: 0 handler: handler];
+
+    [self waitForExpectationsWithTimeout: 2.0 handler: nil];
+    XCTAssertFalse([self.scheduler hasEvent: @"periodic"]);
+}
+
+@end
@@ -0,0 +1,40 @@
+//
+//  SCFakeSystemRoot.h
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A scratch directory that looks enough like / for BlockManager, PacketFilter and friends
+// (pass its path as their rootPath): etc/hosts, etc/pf.conf, etc/pf.anchors, and a stand-in
+// sbin/pfctl that just records its arguments instead of touching the real firewall. Like the
+// real pfctl, it hands out a token for -E.
+@interface SCFakeSystemRoot : NSObject
+
+@property (readonly) NSString* path;
+@property (readonly) NSString* hostsPath;
+@property (readonly) NSString* pfConfPath;
+@property (readonly) NSString* pfctlPath;
+@property (readonly) NSString* pfctlLogPath;
+
+// make pfctl exit 1 for `-T add` table updates or `-f` (re)loads, to test our fallbacks
+@property (nonatomic) BOOL failTableAdds;
+@property (nonatomic) BOOL failReloads;
+
+// creates a fresh root in a new temporary directory, named after the caller for easier debugging
++ (instancetype)rootWithName:(NSString*)name;
+// creates (or resets) a root at path
+- (instancetype)initWithPath:(NSString*)path;
+
+// every pfctl invocation so far, one string of arguments each
+- (NSArray<NSString*>*)pfctlInvocations;
+
+- (void)remove;
+
+@end
+
+NS_ASSUME_NONNULL_END
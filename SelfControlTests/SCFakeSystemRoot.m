@@ -0,0 +1,81 @@
+//
+//  SCFakeSystemRoot.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCFakeSystemRoot.h"
+
+@implementation SCFakeSystemRoot
+
++ (instancetype)rootWithName:(NSString*)name {
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSString stringWithFormat: @"%@-%@", name, [NSUUID UUID].UUIDString]];
+    return [[SCFakeSystemRoot alloc] initWithPath: path];
+}
+
+- (instancetype)initWithPath:(NSString*)path {
+    if (self = [super init]) {
+        _path = path;
+        _hostsPath = [path stringByAppendingPathComponent: @"etc/hosts"];
+        _pfConfPath = [path stringByAppendingPathComponent: @"etc/pf.conf"];
+        _pfctlPath = [path stringByAppendingPathComponent: @"sbin/pfctl"];
+        _pfctlLogPath = [path stringByAppendingPathComponent: @"pfctl.log"];
+
+        NSFileManager* fileMan = [NSFileManager defaultManager];
+        [fileMan removeItemAtPath: path error: nil];
+        for (NSString* dir in @[@"etc/pf.anchors", @"sbin"]) {
+            [fileMan createDirectoryAtPath: [path stringByAppendingPathComponent: dir] withIntermediateDirectories: YES attributes: nil error: nil];
+        }
+        [@"127.0.0.1\tlocalhost\n" writeToFile: _hostsPath atomically: YES encoding: NSUTF8StringEncoding error: nil];
+        [@"scrub-anchor \"com.apple/*\"\nanchor \"com.apple/*\"\nload anchor \"com.apple\" from \"/etc/pf.anchors/com.apple\"\n"
+         writeToFile: _pfConfPath atomically: YES encoding: NSUTF8StringEncoding error: nil];
+
+        NSString* script = [NSString stringWithFormat: @"#!/bin/sh\n"
+                            "echo \"$*\" >> '%@'\n"
+                            "case \"$*\" in *\"-T add\"*) [ -f '%@' ] && exit 1 ;; esac\n"
+                            "case \"$*\" in *\" -f \"*|\"-f \"*) [ -f '%@' ] && exit 1 ;; esac\n"
+                            "case \"$*\" in *-E*) echo 'Token : 1234567890' ;; esac\n"
+                            "exit 0\n",
+                            _pfctlLogPath, [self flagPathForName: @"fail-table-add"], [self flagPathForName: @"fail-reload"]];
+        [script writeToFile: _pfctlPath atomically: YES encoding: NSUTF8StringEncoding error: nil];
+        [fileMan setAttributes: @{ NSFilePosixPermissions: @0755 } ofItemAtPath: _pfctlPath error: nil];
+    }
+    return self;
+}
+
+// the script checks for these on every run, so tests can flip them at any point
+- (NSString*)flagPathForName:(NSString*)name {
+    return [self.path stringByAppendingPathComponent: name];
+}
+
+- (void)setFlag:(NSString*)name enabled:(BOOL)enabled {
+    if (enabled) {
+        [@"" writeToFile: [self flagPathForName: name] atomically: YES encoding: NSUTF8StringEncoding error: nil];
+    } else {
+        [[NSFileManager defaultManager] removeItemAtPath: [self flagPathForName: name] error: nil];
+    }
+}
+
+- (void)setFailTableAdds:(BOOL)failTableAdds {
+    _failTableAdds = failTableAdds;
+    [self setFlag: @"fail-table-add" enabled: failTableAdds];
+}
+
+- (void)setFailReloads:(BOOL)failReloads {
+    _failReloads = failReloads;
+    [self setFlag: @"fail-reload" enabled: failReloads];
+}
+
+- (NSArray<NSString*>*)pfctlInvocations {
+    NSString* log = [NSString stringWithContentsOfFile: self.pfctlLogPath encoding: NSUTF8StringEncoding error: nil];
+    NSMutableArray* lines = [[log componentsSeparatedByString: @"\n"] mutableCopy];
+    [lines removeObject: @""];
+    return lines ?: @[];
+}
+
+- (void)remove {
+    [[NSFileManager defaultManager] removeItemAtPath: self.path error: nil];
+}
+
+@end
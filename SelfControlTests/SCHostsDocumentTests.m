@@ -0,0 +1,246 @@
+//
+//  SCHostsDocumentTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCHostsDocument.h"
+#import "HostFileBlocker.h"
+
+static NSString* const kUserHosts = @"127.0.0.1\tlocalhost\n::1\tlocalhost\n";
+
+@interface SCHostsDocumentTests : XCTestCase
+
+@end
+
+@implementation SCHostsDocumentTests
+
+- (void)testNewBlockRendersInTheUsualFormat {
+    SCHostsDocument* doc = [[SCHostsDocument alloc] initWithString: kUserHosts];
+    XCTAssertFalse(doc.hasBlock);
+
+    [doc addBlockHeader];
+    [doc appendRulesBlockingDomains: @[@"example.com", @"www.example.com"]];
+    [doc addBlockFooter];
+
+    NSString* expected = [kUserHosts stringByAppendingString:
+                          @"\n# BEGIN SELFCONTROL BLOCK\n"
+                          "0.0.0.0\texample.com\n::\texample.com\n"
+                          "0.0.0.0\twww.example.com\n::\twww.example.com\n"
+                          "# END SELFCONTROL BLOCK\n"];
+    XCTAssertEqualObjects([doc renderedString], expected);
+    XCTAssertEqualObjects([[NSString alloc] initWithData: [doc renderedDataUsingEncoding: NSUTF8StringEncoding] encoding: NSUTF8StringEncoding], expected);
+    XCTAssertTrue([[doc blockSection] hasPrefix: @"# BEGIN SELFCONTROL BLOCK\n"]);
+    XCTAssertTrue([[doc blockSection] hasSuffix: @"# END SELFCONTROL BLOCK\n"]);
+}
+
+- (void)testParsedFilesRoundTripExactly {
+    NSArray<NSString*>* files = @[
+        kUserHosts,
+        @"",
+        [kUserHosts stringByAppendingString: @"\n# BEGIN SELFCONTROL BLOCK\n0.0.0.0\ta.com\n::\ta.com\n# END SELFCONTROL BLOCK\n10.0.0.1\tafter\n"],
+        // no footer, and no trailing newline
+        [kUserHosts stringByAppendingString: @"# BEGIN SELFCONTROL BLOCK\n0.0.0.0\ta.com"]
+    ];
+    for (NSString* file in files) {
+        XCTAssertEqualObjects([[[SCHostsDocument alloc] initWithString: file] renderedString], file);
+    }
+}
+
+- (void)testAppendingToLiveBlockGoesBeforeFooter {
+    NSString* file = [kUserHosts stringByAppendingString: @"\n# BEGIN SELFCONTROL BLOCK\n0.0.0.0\ta.com\n::\ta.com\n# END SELFCONTROL BLOCK\n10.0.0.1\tafter\n"];
+    SCHostsDocument* doc = [[SCHostsDocument alloc] initWithString: file];
+    XCTAssertTrue(doc.hasBlock);
+    XCTAssertTrue(doc.hasBlockFooter);
+
+    [doc appendRulesBlockingDomains: @[@"b.com"]];
+
+    NSString* expected = [kUserHosts stringByAppendingString: @"\n# BEGIN SELFCONTROL BLOCK\n0.0.0.0\ta.com\n::\ta.com\n0.0.0.0\tb.com\n::\tb.com\n# END SELFCONTROL BLOCK\n10.0.0.1\tafter\n"];
+    XCTAssertEqualObjects([doc renderedString], expected);
+}
+
+- (void)testRemovingBlockLeavesUserEntriesTidy {
+    SCHostsDocument* doc = [[SCHostsDocument alloc] initWithString: [kUserHosts stringByAppendingString: @"\n# BEGIN SELFCONTROL BLOCK\n0.0.0.0\ta.com\n# END SELFCONTROL BLOCK\n10.0.0.1\tafter\n"]];
+    [doc removeBlock];
+    XCTAssertFalse(doc.hasBlock);
+    XCTAssertEqualObjects([doc renderedString], [kUserHosts stringByAppendingString: @"10.0.0.1\tafter\n"]);
+
+    // a block we just added comes back out without a trace
+    SCHostsDocument* fresh = [[SCHostsDocument alloc] initWithString: kUserHosts];
+    [fresh addBlockHeader];
+    [fresh appendRulesBlockingDomains: @[@"a.com"]];
+    [fresh addBlockFooter];
+    [fresh removeBlock];
+    XCTAssertEqualObjects([fresh renderedString], kUserHosts);
+
+    // without a footer, everything after the header goes
+    SCHostsDocument* broken = [[SCHostsDocument alloc] initWithString: [kUserHosts stringByAppendingString: @"\n# BEGIN SELFCONTROL BLOCK\n0.0.0.0\ta.com\n10.0.0.1\tafter\n"]];
+    [broken removeBlock];
+    XCTAssertEqualObjects([broken renderedString], kUserHosts);
+    XCTAssertNil([broken blockSection]);
+}
+
+- (void)testSharedRuleDataWritesTheSameBlockEverywhere {
+    NSData* ruleData = [SCHostsDocument ruleDataBlockingDomains: @[@"a.com", @"b.com"]];
+    SCHostsDocument* hosts = [[SCHostsDocument alloc] initWithString: kUserHosts];
+    SCHostsDocument* vpnHosts = [[SCHostsDocument alloc] initWithString: @"10.1.2.3\tvpn.internal\n"];
+
+    NSString* dir = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSUUID UUID].UUIDString];
+    [[NSFileManager defaultManager] createDirectoryAtPath: dir withIntermediateDirectories: YES attributes: nil error: nil];
+    for (SCHostsDocument* doc in @[hosts, vpnHosts]) {
+        [doc addBlockHeader];
+        [doc appendRuleData: ruleData];
+        [doc addBlockFooter];
+        XCTAssertEqual(doc.bodyLength, ruleData.length + 1);
+
+        NSString* path = [dir stringByAppendingPathComponent: [NSUUID UUID].UUIDString];
+        XCTAssertTrue([doc writeToFile: path encoding: NSUTF8StringEncoding]);
+        XCTAssertEqualObjects([NSString stringWithContentsOfFile: path encoding: NSUTF8StringEncoding error: nil], [doc renderedString]);
+    }
+    XCTAssertEqualObjects([hosts blockSection], [vpnHosts blockSection]);
+
+    // nothing but the written files should be left behind
+    XCTAssertEqual([[NSFileManager defaultManager] contentsOfDirectoryAtPath: dir error: nil].count, 2);
+    [[NSFileManager defaultManager] removeItemAtPath: dir error: nil];
+}
+
+- (NSArray<NSString*>*)generatedDomainsWithCount:(NSUInteger)count {
+    NSMutableArray<NSString*>* domains = [NSMutableArray arrayWithCapacity: count];
+    for (NSUInteger i = 0; i < count; i++) {
+        // a few really long names in there too, to exercise the per-line length cap
+        if (i % 1000 == 0) {
+            [domains addObject: [NSString stringWithFormat: @"%@%lu.example.com", [@"" stringByPaddingToLength: 240 withString: @"long" startingAtIndex: 0], (unsigned long)i]];
+        } else {
+            [domains addObject: [NSString stringWithFormat: @"site%lu.example.com", (unsigned long)i]];
+        }
+    }
+    return domains;
+}
+
+- (SCHostsDocument*)documentBlockingDomains:(NSArray<NSString*>*)domains compact:(BOOL)compact {
+    SCHostsDocument* doc = [[SCHostsDocument alloc] initWithString: kUserHosts];
+    [doc addBlockHeader];
+    [doc appendRuleData: [SCHostsDocument ruleDataBlockingDomains: domains compact: compact]];
+    [doc addBlockFooter];
+    return doc;
+}
+
+- (void)testCompactRulesFormat {
+    NSArray<NSString*>* domains = @[@"a.com", @"b.com", @"c.com", @"d.com", @"e.com", @"f.com", @"g.com", @"h.com", @"i.com", @"j.com"];
+    NSString* rules = [[NSString alloc] initWithData: [SCHostsDocument ruleDataBlockingDomains: domains compact: YES] encoding: NSUTF8StringEncoding];
+    XCTAssertEqualObjects(rules, @"0.0.0.0\ta.com b.com c.com d.com e.com f.com g.com h.com i.com\n"
+                                 "::\ta.com b.com c.com d.com e.com f.com g.com h.com i.com\n"
+                                 "0.0.0.0\tj.com\n"
+                                 "::\tj.com\n");
+    XCTAssertEqual([SCHostsDocument ruleDataBlockingDomains: @[] compact: YES].length, 0);
+}
+
+- (void)testCompactRulesShrinkLargeBlocks {
+    NSArray<NSString*>* domains = [self generatedDomainsWithCount: 50000];
+    SCHostsDocument* normal = [self documentBlockingDomains: domains compact: NO];
+    SCHostsDocument* compact = [self documentBlockingDomains: domains compact: YES];
+
+    NSArray<NSString*>* normalLines = [[normal blockSection] componentsSeparatedByString: @"\n"];
+    NSArray<NSString*>* compactLines = [[compact blockSection] componentsSeparatedByString: @"\n"];
+    NSLog(@"50k domains: %lu lines/%lu bytes normal, %lu lines/%lu bytes compact",
+          (unsigned long)normalLines.count, (unsigned long)normal.bodyLength, (unsigned long)compactLines.count, (unsigned long)compact.bodyLength);
+
+    // two lines per domain normally, two per group of up to 9 compacted (plus header, footer and the trailing split)
+    XCTAssertEqual(normalLines.count, domains.count * 2 + 3);
+    XCTAssertLessThanOrEqual(compactLines.count, (domains.count / 9 + 1) * 2 + 3 + (domains.count / 1000) * 2);
+    // each name still shows up twice, but without its own address prefix and tab: ~10 bytes saved per domain
+    XCTAssertLessThanOrEqual(compact.bodyLength, normal.bodyLength - domains.count * 9);
+
+    for (NSString* line in compactLines) {
+        XCTAssertLessThanOrEqual([line lengthOfBytesUsingEncoding: NSUTF8StringEncoding], 1000);
+        NSArray<NSString*>* fields = [line componentsSeparatedByCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
+        XCTAssertLessThanOrEqual(fields.count, 10);
+    }
+
+    // same names blocked either way
+    XCTAssertEqualObjects([compact blockedDomains], domains);
+    XCTAssertEqualObjects([normal blockedDomains], domains);
+}
+
+- (void)testCompactBlocksRoundTripAndRemoveCleanly {
+    NSArray<NSString*>* domains = [self generatedDomainsWithCount: 20000];
+    NSString* userFile = [kUserHosts stringByAppendingString: @"10.0.0.1\tafter\n"];
+
+    SCHostsDocument* doc = [[SCHostsDocument alloc] initWithString: userFile];
+    [doc addBlockHeader];
+    [doc appendRuleData: [SCHostsDocument ruleDataBlockingDomains: domains compact: YES]];
+    [doc addBlockFooter];
+
+    // parse it back in, like the next time the daemon reads the file
+    SCHostsDocument* reparsed = [[SCHostsDocument alloc] initWithString: [doc renderedString]];
+    XCTAssertTrue(reparsed.hasBlock);
+    XCTAssertTrue(reparsed.hasBlockFooter);
+    XCTAssertEqualObjects([reparsed renderedString], [doc renderedString]);
+    XCTAssertEqualObjects([reparsed blockedDomains], domains);
+
+    [reparsed removeBlock];
+    XCTAssertFalse(reparsed.hasBlock);
+    XCTAssertEqualObjects([reparsed renderedString], userFile);
+}
+
+- (void)testCompactHostFileBlockerRoundTrip {
+    NSString* dir = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSUUID UUID].UUIDString];
+    [[NSFileManager defaultManager] createDirectoryAtPath: dir withIntermediateDirectories: YES attributes: nil error: nil];
+    NSString* hostsPath = [dir stringByAppendingPathComponent: @"hosts"];
+    XCTAssertTrue([kUserHosts writeToFile: hostsPath atomically: YES encoding: NSUTF8StringEncoding error: nil]);
+
+    HostFileBlocker* blocker = [[HostFileBlocker alloc] initWithPath: hostsPath];
+    blocker.compactRules = YES;
+    [blocker addSelfControlBlockHeader];
+    for (NSString* domain in [self generatedDomainsWithCount: 5000]) {
+        [blocker addRuleBlockingDomain: domain];
+    }
+    [blocker addSelfControlBlockFooter];
+    XCTAssertTrue([blocker writeNewFileContents]);
+
+    HostFileBlocker* reader = [[HostFileBlocker alloc] initWithPath: hostsPath];
+    XCTAssertTrue([reader containsSelfControlBlock]);
+    [reader removeSelfControlBlock];
+    XCTAssertFalse([reader containsSelfControlBlock]);
+    XCTAssertTrue([reader writeNewFileContents]);
+    XCTAssertEqualObjects([NSString stringWithContentsOfFile: hostsPath encoding: NSUTF8StringEncoding error: nil], kUserHosts);
+
+    [[NSFileManager defaultManager] removeItemAtPath: dir error: nil];
+}
+
+- (void)testAppendingTenThousandDomainsToLiveBlock {
+    NSString* dir = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSUUID UUID].UUIDString];
+    [[NSFileManager defaultManager] createDirectoryAtPath: dir withIntermediateDirectories: YES attributes: nil error: nil];
+    NSString* hostsPath = [dir stringByAppendingPathComponent: @"hosts"];
+
+    // a live block that's already pretty big
+    NSMutableString* existing = [NSMutableString stringWithString: kUserHosts];
+    [existing appendString: @"\n# BEGIN SELFCONTROL BLOCK\n"];
+    for (int i = 0; i < 20000; i++) {
+        [existing appendFormat: @"0.0.0.0\texisting%d.com\n::\texisting%d.com\n", i, i];
+    }
+    [existing appendString: @"# END SELFCONTROL BLOCK\n"];
+
+    // timed (but not pass/fail) - only the appends and the write, not putting the big block in place
+    [self measureMetrics: [XCTestCase defaultPerformanceMetrics] automaticallyStartMeasuring: NO forBlock:^{
+        XCTAssertTrue([existing writeToFile: hostsPath atomically: YES encoding: NSUTF8StringEncoding error: nil]);
+        HostFileBlocker* blocker = [[HostFileBlocker alloc] initWithPath: hostsPath];
+
+        [self startMeasuring];
+        for (int i = 0; i < 10000; i++) {
+            [blocker appendExistingBlockWithRuleForDomain: [NSString stringWithFormat: @"new%05d.com", i]];
+        }
+        XCTAssertTrue([blocker writeNewFileContents]);
+        [self stopMeasuring];
+    }];
+
+    NSString* written = [NSString stringWithContentsOfFile: hostsPath encoding: NSUTF8StringEncoding error: nil];
+    XCTAssertTrue([written hasSuffix: @"0.0.0.0\tnew09999.com\n::\tnew09999.com\n# END SELFCONTROL BLOCK\n"]);
+    XCTAssertTrue([written containsString: @"::\texisting19999.com\n0.0.0.0\tnew00000.com\n"]);
+
+    [[NSFileManager defaultManager] removeItemAtPath: dir error: nil];
+}
+
+@end
@@ -0,0 +1,99 @@
+//
+//  SCIPPrefixSetTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCIPPrefixSet.h"
+
+@interface SCIPPrefixSetTests : XCTestCase
+
+@end
+
+@implementation SCIPPrefixSetTests
+
+- (SCIPPrefixSet*)setWithPrefixes:(NSArray<NSString*>*)prefixes {
+    SCIPPrefixSet* set = [SCIPPrefixSet new];
+    for (NSString* prefix in prefixes) {
+        [set addPrefixString: prefix];
+    }
+    return set;
+}
+
+- (void)testDuplicatesAndCoveredPrefixes {
+    SCIPPrefixSet* set = [self setWithPrefixes: @[@"8.8.4.0/24", @"8.8.4.0/24", @"8.8.4.8", @"8.8.4.0/26", @"8.8.4.77/24", @"10.1.2.3"]];
+
+    XCTAssertEqualObjects([set minimalPrefixStrings], (@[@"8.8.4.0/24", @"10.1.2.3"]));
+    XCTAssertEqual(set.inputCount, 6);
+    XCTAssertEqual(set.eliminatedCount, 4);
+
+    // a broader prefix added later swallows what's underneath it
+    [set addPrefixString: @"10.0.0.0/8"];
+    XCTAssertEqualObjects([set minimalPrefixStrings], (@[@"8.8.4.0/24", @"10.0.0.0/8"]));
+}
+
+- (void)testAdjacentPrefixesCollapse {
+    SCIPPrefixSet* set = [self setWithPrefixes: @[@"10.0.0.0", @"10.0.0.1", @"10.0.0.2", @"10.0.0.3", @"10.0.0.128/25"]];
+    XCTAssertEqualObjects([set minimalPrefixStrings], (@[@"10.0.0.0/30", @"10.0.0.128/25"]));
+
+    // collapsing cascades all the way up
+    [set addPrefixString: @"10.0.0.4/30"];
+    [set addPrefixString: @"10.0.0.8/29"];
+    [set addPrefixString: @"10.0.0.16/28"];
+    [set addPrefixString: @"10.0.0.32/27"];
+    [set addPrefixString: @"10.0.0.64/26"];
+    XCTAssertEqualObjects([set minimalPrefixStrings], (@[@"10.0.0.0/24"]));
+
+    // but non-siblings don't collapse, even if they're adjacent
+    SCIPPrefixSet* set2 = [self setWithPrefixes: @[@"10.0.0.1", @"10.0.0.2"]];
+    XCTAssertEqualObjects([set2 minimalPrefixStrings], (@[@"10.0.0.1", @"10.0.0.2"]));
+}
+
+- (void)testIPv6 {
+    SCIPPrefixSet* set = [self setWithPrefixes: @[@"2001:db8::1", @"2001:DB8::1", @"2001:db8::/127", @"2001:db8:0:1::/64", @"2001:db8::/64", @"2a03:2880::/32", @"10.0.0.1"]];
+
+    XCTAssertEqualObjects([set minimalPrefixStrings], (@[@"10.0.0.1", @"2001:db8::/63", @"2a03:2880::/32"]));
+    XCTAssertTrue([set containsPrefixString: @"2001:db8:0:1:abcd::5"]);
+    XCTAssertFalse([set containsPrefixString: @"2001:db8:0:2::1"]);
+}
+
+- (void)testContains {
+    SCIPPrefixSet* set = [self setWithPrefixes: @[@"157.240.0.0/16", @"31.13.24.0/21"]];
+
+    XCTAssertTrue([set containsPrefixString: @"157.240.3.35"]);
+    XCTAssertTrue([set containsPrefixString: @"157.240.128.0/17"]);
+    XCTAssertFalse([set containsPrefixString: @"157.0.0.0/8"]);
+    XCTAssertFalse([set containsPrefixString: @"31.13.32.1"]);
+}
+
+- (void)testMaskLenZeroMeansSingleAddress {
+    SCIPPrefixSet* set = [SCIPPrefixSet new];
+    [set addAddress: @"10.0.0.1" maskLen: 0];
+    [set addAddress: @"10.0.0.0" maskLen: 8];
+
+    XCTAssertEqualObjects([set minimalPrefixStrings], (@[@"10.0.0.0/8"]));
+}
+
+- (void)testUnparseableStringsPassThrough {
+    SCIPPrefixSet* set = [SCIPPrefixSet new];
+    XCTAssertFalse([set addPrefixString: @"not.an.ip"]);
+    XCTAssertFalse([set addPrefixString: @"10.0.0.0/33"]);
+    XCTAssertTrue([set addPrefixString: @"10.0.0.1"]);
+
+    XCTAssertEqualObjects([set minimalPrefixStrings], (@[@"10.0.0.1", @"not.an.ip", @"10.0.0.0/33"]));
+}
+
+- (void)testLargeCDNStyleList {
+    // lots of domains resolving into the same few /24s
+    SCIPPrefixSet* set = [SCIPPrefixSet new];
+    for (int i = 0; i < 10000; i++) {
+        [set addPrefixString: [NSString stringWithFormat: @"151.101.%d.%d", (i / 256) % 4, i % 256]];
+    }
+
+    XCTAssertEqualObjects([set minimalPrefixStrings], (@[@"151.101.0.0/22"]));
+    XCTAssertEqual(set.eliminatedCount, 9999);
+}
+
+@end
@@ -0,0 +1,168 @@
+//
+//  SCPacketFilterAppendTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "PacketFilter.h"
+#import "SCFakeSystemRoot.h"
+#import "SCSpanRecorder.h"
+
+// Runs PacketFilter's append mode against a fake system root, whose pfctl
+// just records its arguments.
+@interface SCPacketFilterAppendTests : XCTestCase
+
+@property (strong) SCFakeSystemRoot* root;
+@property (strong) NSString* anchorPath;
+
+@end
+
+@implementation SCPacketFilterAppendTests
+
+- (void)setUp {
+    self.root = [SCFakeSystemRoot rootWithName: @"SCPacketFilterAppendTests"];
+    self.anchorPath = [self newPacketFilter].anchorPath;
+}
+
+- (void)tearDown {
+    [self.root remove];
+}
+
+- (PacketFilter*)newPacketFilter {
+    return [[PacketFilter alloc] initAsAllowlist: NO rootPath: self.root.path];
+}
+
+- (NSArray<NSString*>*)invocations {
+    return [self.root pfctlInvocations];
+}
+
+- (void)writeInitialBlock {
+    PacketFilter* pf = [self newPacketFilter];
+    [pf addRuleWithIP: @"10.0.0.1" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"10.0.0.2" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"10.0.0.5" port: 443 maskLen: 0];
+    [pf writeConfiguration];
+}
+
+- (void)testAppendAddsToExistingTables {
+    [self writeInitialBlock];
+
+    PacketFilter* pf = [self newPacketFilter];
+    [pf enterAppendMode];
+    [pf addRuleWithIP: @"10.0.0.2" port: 0 maskLen: 0]; // already blocked
+    [pf addRuleWithIP: @"10.0.0.9" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"2001:db8::9" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"10.0.0.6" port: 443 maskLen: 0];
+    XCTAssertEqual([pf finishAppending], 0);
+
+    XCTAssertEqualObjects([self invocations], (@[
+        @"-a org.eyebeam -t org.eyebeam.block -T add 10.0.0.9 2001:db8::9",
+        @"-a org.eyebeam -t org.eyebeam.block.p443 -T add 10.0.0.6",
+        @"-k 0.0.0.0/0 -k 10.0.0.6",
+        @"-k 0.0.0.0/0 -k 10.0.0.9",
+        @"-k ::/0 -k 2001:db8::9"
+    ]));
+
+    // the anchor on disk should look exactly like we'd blocked everything from the start
+    PacketFilter* expected = [self newPacketFilter];
+    for (NSString* ip in @[@"10.0.0.1", @"10.0.0.2", @"10.0.0.9", @"2001:db8::9"]) {
+        [expected addRuleWithIP: ip port: 0 maskLen: 0];
+    }
+    [expected addRuleWithIP: @"10.0.0.5" port: 443 maskLen: 0];
+    [expected addRuleWithIP: @"10.0.0.6" port: 443 maskLen: 0];
+    NSString* anchor = [NSString stringWithContentsOfFile: self.anchorPath encoding: NSUTF8StringEncoding error: nil];
+    XCTAssertEqualObjects(anchor, [expected configurationString]);
+}
+
+- (void)testAppendWithNewTableReloadsOnlyAnchor {
+    [self writeInitialBlock];
+
+    PacketFilter* pf = [self newPacketFilter];
+    [pf enterAppendMode];
+    [pf addRuleWithIP: @"10.0.0.7" port: 8080 maskLen: 0];
+    [pf addRuleWithIP: nil port: 25 maskLen: 0];
+    XCTAssertEqual([pf finishAppending], 0);
+
+    NSArray<NSString*>* invocations = [self invocations];
+    XCTAssertEqualObjects(invocations.firstObject, ([NSString stringWithFormat: @"-a org.eyebeam -f %@", self.anchorPath]));
+    for (NSString* invocation in invocations) {
+        XCTAssertFalse([invocation containsString: @"-F"]);
+        XCTAssertFalse([invocation containsString: @"pf.conf"]);
+    }
+
+    NSString* anchor = [NSString stringWithContentsOfFile: self.anchorPath encoding: NSUTF8StringEncoding error: nil];
+    XCTAssertTrue([anchor containsString: @"table <org.eyebeam.block.p8080> persist { \\\n\t10.0.0.7 \\\n}\n"]);
+    XCTAssertTrue([anchor containsString: @"block return out proto tcp from any to <org.eyebeam.block.p8080> port 8080\n"]);
+    XCTAssertTrue([anchor hasSuffix: @"block return out proto udp from any to any port 25\n"]);
+}
+
+- (void)testFailedTableAddFallsBackToReload {
+    [self writeInitialBlock];
+    self.root.failTableAdds = YES;
+
+    PacketFilter* pf = [self newPacketFilter];
+    [pf enterAppendMode];
+    [pf addRuleWithIP: @"10.0.0.9" port: 0 maskLen: 0];
+    XCTAssertEqual([pf finishAppending], 0);
+
+    NSArray<NSString*>* invocations = [self invocations];
+    XCTAssertEqualObjects(invocations[0], @"-a org.eyebeam -t org.eyebeam.block -T add 10.0.0.9");
+    XCTAssertEqualObjects(invocations[1], ([NSString stringWithFormat: @"-a org.eyebeam -f %@", self.anchorPath]));
+}
+
+- (void)testFailedInstallLeavesConnectionsAlone {
+    [self writeInitialBlock];
+    self.root.failTableAdds = YES;
+    self.root.failReloads = YES;
+
+    PacketFilter* pf = [self newPacketFilter];
+    [pf enterAppendMode];
+    [pf addRuleWithIP: @"10.0.0.9" port: 0 maskLen: 0];
+    XCTAssertNotEqual([pf finishAppending], 0);
+
+    // nothing's blocking a reconnect, so no states should have been killed
+    for (NSString* invocation in [self invocations]) {
+        XCTAssertFalse([invocation hasPrefix: @"-k"], @"%@", invocation);
+    }
+}
+
+- (void)testAppendWithNothingNewDoesNothing {
+    [self writeInitialBlock];
+    NSString* originalAnchor = [NSString stringWithContentsOfFile: self.anchorPath encoding: NSUTF8StringEncoding error: nil];
+
+    PacketFilter* pf = [self newPacketFilter];
+    [pf enterAppendMode];
+    [pf addRuleWithIP: @"10.0.0.1" port: 0 maskLen: 0];
+    XCTAssertEqual([pf finishAppending], 0);
+
+    XCTAssertEqual([self invocations].count, 0);
+    XCTAssertEqualObjects([NSString stringWithContentsOfFile: self.anchorPath encoding: NSUTF8StringEncoding error: nil], originalAnchor);
+}
+
+- (void)testPfctlSpansLeaveOutAddressesAndToken {
+    [self writeInitialBlock];
+    SCSpanRecorder* recorder = [SCSpanRecorder sharedRecorder];
+    [recorder removeAllSpans];
+
+    PacketFilter* pf = [self newPacketFilter];
+    [pf enterAppendMode];
+    [pf addRuleWithIP: @"10.0.0.9" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"2001:db8::9" port: 0 maskLen: 0];
+    XCTAssertEqual([pf finishAppending], 0);
+    // the fake pfctl hands out a token, which stopping the block passes back with -X
+    [pf startBlock];
+    [pf stopBlock: NO];
+    XCTAssertTrue([[self invocations].lastObject hasPrefix: @"-X 1234567890 "]);
+
+    NSArray<NSDictionary*>* spans = [[recorder recentSpans] filteredArrayUsingPredicate: [NSPredicate predicateWithFormat: @"Name == 'pfctl'"]];
+    XCTAssertEqualObjects([spans valueForKeyPath: @"Attributes.Command"], (@[@"-a -t -T add", @"-k -k", @"-k -k", @"-E -f -F states", @"-X -f"]));
+    XCTAssertEqualObjects(spans[0][@"Attributes"][@"AddressCount"], @2);
+    NSString* spansDescription = [spans description];
+    for (NSString* secret in @[@"1234567890", @"10.0.0.9", @"2001:db8::9", self.root.path]) {
+        XCTAssertFalse([spansDescription containsString: secret], @"%@", secret);
+    }
+}
+
+@end
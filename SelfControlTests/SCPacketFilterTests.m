@@ -0,0 +1,82 @@
+//
+//  SCPacketFilterTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "PacketFilter.h"
+
+@interface SCPacketFilterTests : XCTestCase
+
+@end
+
+@implementation SCPacketFilterTests
+
+// golden files live in SelfControlTests/Golden, next to this file
+- (NSString*)goldenFileContents:(NSString*)name {
+    NSString* testsDir = [[NSString stringWithUTF8String: __FILE__] stringByDeletingLastPathComponent];
+    NSString* path = [[testsDir stringByAppendingPathComponent: @"Golden"] stringByAppendingPathComponent: name];
+    NSString* contents = [NSString stringWithContentsOfFile: path encoding: NSUTF8StringEncoding error: nil];
+    XCTAssertNotNil(contents, @"Couldn't read golden file %@", path);
+    return contents;
+}
+
+- (void)addSampleRulesToPacketFilter:(PacketFilter*)pf {
+    [pf addRuleWithIP: @"10.0.0.2" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"10.0.0.1" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"8.34.208.0" port: 0 maskLen: 20];
+    [pf addRuleWithIP: @"2001:db8::1" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"10.0.0.5" port: 443 maskLen: 0];
+    [pf addRuleWithIP: nil port: 25 maskLen: 0];
+    // duplicates only show up once in the tables
+    [pf addRuleWithIP: @"10.0.0.1" port: 0 maskLen: 0];
+}
+
+- (void)testBlocklistTables {
+    PacketFilter* pf = [[PacketFilter alloc] initAsAllowlist: NO];
+    [self addSampleRulesToPacketFilter: pf];
+
+    XCTAssertEqualObjects([pf configurationString], [self goldenFileContents: @"blocklist-tables.anchor"]);
+}
+
+- (void)testBlocklistPerRuleFallback {
+    PacketFilter* pf = [[PacketFilter alloc] initAsAllowlist: NO];
+    pf.useTables = NO;
+    [pf addRuleWithIP: @"10.0.0.2" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"10.0.0.1" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"8.34.208.0" port: 0 maskLen: 20];
+    [pf addRuleWithIP: @"2001:db8::1" port: 0 maskLen: 0];
+    [pf addRuleWithIP: @"10.0.0.5" port: 443 maskLen: 0];
+    [pf addRuleWithIP: nil port: 25 maskLen: 0];
+
+    XCTAssertEqualObjects([pf configurationString], [self goldenFileContents: @"blocklist-rules.anchor"]);
+}
+
+- (void)testAllowlistTables {
+    PacketFilter* pf = [[PacketFilter alloc] initAsAllowlist: YES];
+    [self addSampleRulesToPacketFilter: pf];
+
+    XCTAssertEqualObjects([pf configurationString], [self goldenFileContents: @"allowlist-tables.anchor"]);
+}
+
+- (void)testTableOutputIsStableUnderConcurrency {
+    PacketFilter* pf = [[PacketFilter alloc] initAsAllowlist: NO];
+    dispatch_apply(1000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        [pf addRuleWithIP: [NSString stringWithFormat: @"10.%zu.%zu.1", i / 256, i % 256] port: 0 maskLen: 0];
+    });
+
+    NSString* config = [pf configurationString];
+    // one table, 2 rules, no matter how many addresses
+    XCTAssertEqual([config componentsSeparatedByString: @"block return out"].count - 1, 2);
+    XCTAssertEqual([config componentsSeparatedByString: @"\t10."].count - 1, 1000);
+
+    PacketFilter* pf2 = [[PacketFilter alloc] initAsAllowlist: NO];
+    for (size_t i = 1000; i > 0; i--) {
+        [pf2 addRuleWithIP: [NSString stringWithFormat: @"10.%zu.%zu.1", (i - 1) / 256, (i - 1) % 256] port: 0 maskLen: 0];
+    }
+    XCTAssertEqualObjects([pf2 configurationString], config);
+}
+
+@end
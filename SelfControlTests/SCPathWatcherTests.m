@@ -0,0 +1,181 @@
+//
+//  SCPathWatcherTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCPathWatcher.h"
+
+// stands in for FSEvents/inotify, so tests can feed in exactly the events they want
+@interface SCManualPathWatcherBackend : NSObject <SCPathWatcherBackend>
+
+@property (strong) NSArray<NSString*>* watchedDirectories;
+@property (copy) SCPathWatcherBackendHandler handler;
+@property (strong) dispatch_queue_t queue;
+@property NSUInteger startCount;
+
+- (void)report:(NSArray<NSString*>*)paths;
+
+@end
+
+@implementation SCManualPathWatcherBackend
+
+- (BOOL)startWatchingDirectories:(NSArray<NSString*>*)directories queue:(dispatch_queue_t)queue handler:(SCPathWatcherBackendHandler)handler error:(NSError**)error {
+    self.watchedDirectories = directories;
+    self.queue = queue;
+    self.handler = handler;
+    self.startCount++;
+    return YES;
+}
+- (void)stopWatching {
+    self.watchedDirectories = nil;
+    self.handler = nil;
+}
+- (void)report:(NSArray<NSString*>*)paths {
+    SCPathWatcherBackendHandler handler = self.handler;
+    if (handler == nil) return;
+    dispatch_async(self.queue, ^{
+        handler(paths);
+    });
+}
+
+@end
+
+@interface SCPathWatcherTests : XCTestCase
+
+@property (strong) SCManualPathWatcherBackend* backend;
+@property (strong) SCPathWatcher* watcher;
+@property (strong) NSMutableArray<NSString*>* dispatchedPaths;
+
+@end
+
+@implementation SCPathWatcherTests
+
+- (void)setUp {
+    self.backend = [SCManualPathWatcherBackend new];
+    self.watcher = [[SCPathWatcher alloc] initWithBackend: self.backend handlerQueue: dispatch_queue_create("SCPathWatcherTests", DISPATCH_QUEUE_SERIAL)];
+    self.watcher.latency = 0.2;
+    self.dispatchedPaths = [NSMutableArray array];
+}
+
+- (void)tearDown {
+    [self.watcher stopWatching];
+}
+
+- (void)watchPaths:(NSArray<NSString*>*)paths {
+    for (NSString* path in paths) {
+        [self.watcher watchPath: path handler:^(NSString* changedPath) {
+            @synchronized (self.dispatchedPaths) {
+                [self.dispatchedPaths addObject: changedPath];
+            }
+        }];
+    }
+}
+
+- (NSArray<NSString*>*)dispatchedPathsAfterWaiting:(NSTimeInterval)seconds {
+    [[NSRunLoop currentRunLoop] runUntilDate: [NSDate dateWithTimeIntervalSinceNow: seconds]];
+    @synchronized (self.dispatchedPaths) {
+        return [self.dispatchedPaths copy];
+    }
+}
+
+- (void)testWatchesEachDirectoryOnce {
+    [self watchPaths: @[@"/etc/hosts", @"/etc/pf.conf", @"/etc/pf.anchors/org.eyebeam"]];
+    XCTAssertTrue([self.watcher startWatchingWithError: nil]);
+    XCTAssertEqualObjects(self.backend.watchedDirectories, (@[@"/etc", @"/etc/pf.anchors"]));
+
+    // a path in a directory we're already watching doesn't restart the backend
+    [self watchPaths: @[@"/etc/hosts.ac"]];
+    XCTAssertEqual(self.backend.startCount, 1);
+    [self watchPaths: @[@"/usr/local/etc/settings.plist"]];
+    XCTAssertEqual(self.backend.startCount, 2);
+    XCTAssertEqual(self.backend.watchedDirectories.count, 3);
+}
+
+- (void)testCoalescesEventsPerPath {
+    [self watchPaths: @[@"/etc/hosts", @"/etc/pf.conf"]];
+    XCTAssertTrue([self.watcher startWatchingWithError: nil]);
+
+    for (int i = 0; i < 20; i++) {
+        [self.backend report: @[@"/etc/hosts", @"/etc/hosts.tmp.1234"]];
+    }
+    [self.backend report: @[@"/etc/pf.conf"]];
+
+    NSArray<NSString*>* dispatched = [self dispatchedPathsAfterWaiting: 0.6];
+    XCTAssertEqual(dispatched.count, 2);
+    XCTAssertEqualObjects([NSSet setWithArray: dispatched], ([NSSet setWithArray: @[@"/etc/hosts", @"/etc/pf.conf"]]));
+    XCTAssertEqual([self.watcher.statistics[@"EventCount"] unsignedIntegerValue], 21);
+    XCTAssertEqual([self.watcher.statistics[@"DispatchCount"] unsignedIntegerValue], 2);
+
+    // a later change gets its own window
+    [self.backend report: @[@"/etc/hosts"]];
+    XCTAssertEqual([self dispatchedPathsAfterWaiting: 0.6].count, 3);
+}
+
+- (void)testWaitsForLatencyBeforeDispatching {
+    self.watcher.latency = 0.5;
+    [self watchPaths: @[@"/etc/hosts"]];
+    XCTAssertTrue([self.watcher startWatchingWithError: nil]);
+
+    [self.backend report: @[@"/etc/hosts"]];
+    XCTAssertEqual([self dispatchedPathsAfterWaiting: 0.2].count, 0);
+    XCTAssertEqual([self dispatchedPathsAfterWaiting: 0.6].count, 1);
+}
+
+- (void)testMatchesPrivateAndUnstandardizedPaths {
+    [self watchPaths: @[@"/etc/hosts"]];
+    XCTAssertTrue([self.watcher startWatchingWithError: nil]);
+
+    // i.e. FSEvents reporting a deleted /etc/hosts
+    [self.backend report: @[@"/private/etc/hosts"]];
+    [self.watcher pathsChanged: @[@"/etc//hosts"]];
+    [self.watcher pathsChanged: @[@"/private/etc/hosts.bak", @"/etc/hostsx"]];
+
+    XCTAssertEqualObjects([self dispatchedPathsAfterWaiting: 0.6], @[@"/etc/hosts"]);
+    XCTAssertEqual([self.watcher.statistics[@"EventCount"] unsignedIntegerValue], 2);
+}
+
+- (void)testStoppingDropsPendingEvents {
+    [self watchPaths: @[@"/etc/hosts"]];
+    XCTAssertTrue([self.watcher startWatchingWithError: nil]);
+
+    [self.watcher pathsChanged: @[@"/etc/hosts"]];
+    [self dispatchedPathsAfterWaiting: 0.05];
+    [self.watcher stopWatching];
+    XCTAssertNil(self.backend.handler);
+    XCTAssertEqual([self dispatchedPathsAfterWaiting: 0.5].count, 0);
+
+    [self.watcher unwatchPath: @"/etc/hosts"];
+    XCTAssertEqual([self.watcher.statistics[@"WatchedPathCount"] unsignedIntegerValue], 0);
+}
+
+- (void)testPlatformBackendSeesRealChanges {
+    NSString* dir = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSString stringWithFormat: @"SCPathWatcherTests-%@", [NSUUID UUID].UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtPath: dir withIntermediateDirectories: YES attributes: nil error: nil];
+    NSString* watchedFile = [dir stringByAppendingPathComponent: @"hosts"];
+    NSString* otherFile = [dir stringByAppendingPathComponent: @"other"];
+    [@"one" writeToFile: watchedFile atomically: YES encoding: NSUTF8StringEncoding error: nil];
+
+    SCPathWatcher* watcher = [[SCPathWatcher alloc] initWithBackend: [SCPathWatcher platformBackend] handlerQueue: dispatch_get_main_queue()];
+    watcher.latency = 0.2;
+    XCTestExpectation* changed = [self expectationWithDescription: @"watched file changed"];
+    changed.assertForOverFulfill = NO;
+    [watcher watchPath: watchedFile handler:^(NSString* path) {
+        XCTAssertEqualObjects(path, [watchedFile stringByStandardizingPath]);
+        [changed fulfill];
+    }];
+    NSError* startErr = nil;
+    XCTAssertTrue([watcher startWatchingWithError: &startErr], @"%@", startErr);
+
+    [@"unrelated" writeToFile: otherFile atomically: YES encoding: NSUTF8StringEncoding error: nil];
+    // atomically, i.e. by rename, the way most editors (and we) do it
+    [@"two" writeToFile: watchedFile atomically: YES encoding: NSUTF8StringEncoding error: nil];
+    [self waitForExpectationsWithTimeout: 5.0 handler: nil];
+
+    [watcher stopWatching];
+    [[NSFileManager defaultManager] removeItemAtPath: dir error: nil];
+}
+
+@end
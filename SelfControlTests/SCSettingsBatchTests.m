@@ -0,0 +1,116 @@
+//
+//  SCSettingsBatchTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCSettings.h"
+
+@interface SCSettingsBatchTests : XCTestCase
+
+@end
+
+@implementation SCSettingsBatchTests
+
++ (void)setUp {
+    // SCSettings shouldn't be readOnly during our tests
+    // so we can test changing values
+    [SCSettings sharedSettings].readOnly = NO;
+}
+
+- (int)versionNumber {
+    return [[[SCSettings sharedSettings] valueForKey: @"SettingsVersionNumber"] intValue];
+}
+
+- (void)testBatchIsOneUpdate {
+    SCSettings* settings = [SCSettings sharedSettings];
+    int startVersion = [self versionNumber];
+    NSDate* endDate = [NSDate dateWithTimeIntervalSinceNow: 300];
+
+    NSError* err = [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: @[ @"facebook.com", @"reddit.com" ] forKey: @"ActiveBlocklist"];
+        [batch setValue: endDate forKey: @"BlockEndDate"];
+        [batch setValue: @YES forKey: @"BlockIsRunning"];
+
+        // changes show up right away inside the batch
+        XCTAssertTrue([batch boolForKey: @"BlockIsRunning"]);
+    }];
+
+    XCTAssertNil(err);
+    XCTAssertEqual([self versionNumber], startVersion + 1);
+    XCTAssertEqualObjects([settings valueForKey: @"ActiveBlocklist"], (@[ @"facebook.com", @"reddit.com" ]));
+    XCTAssertEqualObjects([settings valueForKey: @"BlockEndDate"], endDate);
+    XCTAssertTrue([settings boolForKey: @"BlockIsRunning"]);
+
+    [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: @NO forKey: @"BlockIsRunning"];
+        [batch setValue: nil forKey: @"BlockEndDate"];
+        [batch setValue: nil forKey: @"ActiveBlocklist"];
+    }];
+    XCTAssertEqual([self versionNumber], startVersion + 2);
+    // removed values fall back to their defaults
+    XCTAssertEqualObjects([settings valueForKey: @"ActiveBlocklist"], @[]);
+    XCTAssertEqualObjects([settings valueForKey: @"BlockEndDate"], [NSDate distantPast]);
+}
+
+- (void)testNestedBatchesFoldIntoOne {
+    SCSettings* settings = [SCSettings sharedSettings];
+    int startVersion = [self versionNumber];
+
+    [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: @YES forKey: @"ClearCaches"];
+        [batch performBatchUpdates:^(SCSettings* innerBatch) {
+            [innerBatch setValue: @NO forKey: @"AllowLocalNetworks"];
+        }];
+        XCTAssertEqual([self versionNumber], startVersion);
+    }];
+
+    XCTAssertEqual([self versionNumber], startVersion + 1);
+    XCTAssertFalse([settings boolForKey: @"AllowLocalNetworks"]);
+    [settings setValue: @YES forKey: @"AllowLocalNetworks"];
+}
+
+- (void)testEmptyBatchChangesNothing {
+    int startVersion = [self versionNumber];
+    [[SCSettings sharedSettings] performBatchUpdates:^(SCSettings* batch) {}];
+    XCTAssertEqual([self versionNumber], startVersion);
+}
+
+- (void)testBatchPostsOneNotification {
+    SCSettings* settings = [SCSettings sharedSettings];
+    XCTestExpectation* notified = [self expectationWithDescription: @"change notification posted"];
+    notified.assertForOverFulfill = YES;
+
+    __block NSDictionary* userInfo = nil;
+    id observer = [[NSDistributedNotificationCenter defaultCenter] addObserverForName: @"org.eyebeam.SelfControl.SCSettingsValueChanged"
+                                                                               object: settings.description
+                                                                                queue: [NSOperationQueue mainQueue]
+                                                                           usingBlock:^(NSNotification* note) {
+        userInfo = note.userInfo;
+        [notified fulfill];
+    }];
+
+    [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: @YES forKey: @"CompactHostsFile"];
+        [batch setValue: @3 forKey: @"BlockSound"];
+        [batch setValue: nil forKey: @"ActiveBlockAsWhitelist"];
+    }];
+
+    // give any stragglers a chance to show up (and over-fulfill)
+    [self waitForExpectationsWithTimeout: 2.0 handler: nil];
+    [[NSRunLoop mainRunLoop] runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.25]];
+    [[NSDistributedNotificationCenter defaultCenter] removeObserver: observer];
+
+    XCTAssertEqualObjects(userInfo[@"changes"], (@{ @"CompactHostsFile": @YES, @"BlockSound": @3 }));
+    XCTAssertEqualObjects(userInfo[@"removedKeys"], @[ @"ActiveBlockAsWhitelist" ]);
+    XCTAssertEqual([userInfo[@"versionNumber"] intValue], [self versionNumber]);
+
+    [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: @NO forKey: @"CompactHostsFile"];
+        [batch setValue: @5 forKey: @"BlockSound"];
+    }];
+}
+
+@end
@@ -0,0 +1,236 @@
+//
+//  SCSettingsJournalTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCSettingsJournal.h"
+
+@interface SCSettingsJournalTests : XCTestCase
+
+@property (strong) NSString* scratchDir;
+@property (strong) SCSettingsJournal* journal;
+
+@end
+
+@implementation SCSettingsJournalTests
+
+- (void)setUp {
+    self.scratchDir = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSString stringWithFormat: @"SCSettingsJournalTests-%@", [NSUUID UUID].UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtPath: self.scratchDir withIntermediateDirectories: YES attributes: nil error: nil];
+    self.journal = [[SCSettingsJournal alloc] initWithSnapshotPath: [self.scratchDir stringByAppendingPathComponent: @"settings.plist"]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath: self.scratchDir error: nil];
+}
+
+- (NSMutableDictionary*)bigSettings {
+    NSMutableArray* blocklist = [NSMutableArray arrayWithCapacity: 50000];
+    for (int i = 0; i < 50000; i++) {
+        [blocklist addObject: [NSString stringWithFormat: @"site%d.example.com", i]];
+    }
+    return [@{
+        @"ActiveBlocklist": blocklist,
+        @"BlockEndDate": [NSDate dateWithTimeIntervalSinceReferenceDate: 800000000],
+        @"BlockIsRunning": @YES,
+        @"SettingsVersionNumber": @10
+    } mutableCopy];
+}
+
+- (unsigned long long)sizeOfFile:(NSString*)path {
+    return [[[NSFileManager defaultManager] attributesOfItemAtPath: path error: nil] fileSize];
+}
+
+- (void)testNoSnapshotMeansNoSettings {
+    XCTAssertNil([self.journal readSettings]);
+    XCTAssertTrue([self.journal needsSnapshot]);
+}
+
+- (void)testAppendsOnlyTheChange {
+    NSMutableDictionary* settings = [self bigSettings];
+    XCTAssertTrue([self.journal writeSnapshot: settings error: nil]);
+    XCTAssertFalse([self.journal needsSnapshot]);
+    unsigned long long snapshotSize = [self sizeOfFile: self.journal.snapshotPath];
+
+    settings[@"BlockIsRunning"] = @NO;
+    settings[@"SettingsVersionNumber"] = @11;
+    [settings removeObjectForKey: @"BlockEndDate"];
+    NSError* err = nil;
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithArray: @[@"BlockIsRunning", @"SettingsVersionNumber", @"BlockEndDate"]] fromSettings: settings error: &err], @"%@", err);
+
+    // the snapshot wasn't touched, and the journal is tiny next to it
+    XCTAssertEqual([self sizeOfFile: self.journal.snapshotPath], snapshotSize);
+    XCTAssertLessThan([self sizeOfFile: self.journal.journalPath], 256);
+    XCTAssertGreaterThan(snapshotSize, 500000);
+
+    SCSettingsJournal* reader = [[SCSettingsJournal alloc] initWithSnapshotPath: self.journal.snapshotPath];
+    XCTAssertEqualObjects([reader readSettings], settings);
+}
+
+- (void)testLaterRecordsWin {
+    XCTAssertTrue([self.journal writeSnapshot: @{ @"A": @1, @"B": @1 } error: nil]);
+    NSMutableDictionary* settings = [@{ @"A": @2, @"B": @1 } mutableCopy];
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"A"] fromSettings: settings error: nil]);
+    settings[@"A"] = @3;
+    [settings removeObjectForKey: @"B"];
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithArray: @[@"A", @"B"]] fromSettings: settings error: nil]);
+
+    XCTAssertEqualObjects([self.journal readSettings], (@{ @"A": @3 }));
+}
+
+- (void)testTornRecordIsDroppedAndOverwritten {
+    XCTAssertTrue([self.journal writeSnapshot: @{ @"A": @1 } error: nil]);
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"A"] fromSettings: @{ @"A": @2 } error: nil]);
+    unsigned long long goodLength = [self sizeOfFile: self.journal.journalPath];
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"A"] fromSettings: @{ @"A": @3 } error: nil]);
+
+    // chop the last record in half, like a crash mid-write
+    NSData* journalData = [NSData dataWithContentsOfFile: self.journal.journalPath];
+    NSUInteger tornLength = (NSUInteger)goodLength + (journalData.length - (NSUInteger)goodLength) / 2;
+    [[journalData subdataWithRange: NSMakeRange(0, tornLength)] writeToFile: self.journal.journalPath atomically: NO];
+
+    SCSettingsJournal* recovered = [[SCSettingsJournal alloc] initWithSnapshotPath: self.journal.snapshotPath];
+    XCTAssertEqualObjects([recovered readSettings], (@{ @"A": @2 }));
+
+    // the next append replaces the torn record rather than landing after it
+    XCTAssertTrue([recovered appendChangesForKeys: [NSSet setWithObject: @"A"] fromSettings: @{ @"A": @4 } error: nil]);
+    XCTAssertEqualObjects([[[SCSettingsJournal alloc] initWithSnapshotPath: self.journal.snapshotPath] readSettings], (@{ @"A": @4 }));
+}
+
+- (void)testCorruptRecordEndsTheJournal {
+    XCTAssertTrue([self.journal writeSnapshot: @{ @"A": @1 } error: nil]);
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"A"] fromSettings: @{ @"A": @2 } error: nil]);
+    unsigned long long goodLength = [self sizeOfFile: self.journal.journalPath];
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"A"] fromSettings: @{ @"A": @3 } error: nil]);
+
+    NSMutableData* journalData = [[NSData dataWithContentsOfFile: self.journal.journalPath] mutableCopy];
+    ((uint8_t*)journalData.mutableBytes)[journalData.length - 1] ^= 0xFF;
+    [journalData writeToFile: self.journal.journalPath atomically: NO];
+
+    XCTAssertEqualObjects([self.journal readSettings], (@{ @"A": @2 }));
+    XCTAssertGreaterThan(goodLength, 0);
+}
+
+- (void)testCompaction {
+    self.journal.compactionThreshold = 1024;
+    NSMutableDictionary* settings = [@{ @"Counter": @0 } mutableCopy];
+    XCTAssertTrue([self.journal writeSnapshot: settings error: nil]);
+
+    int appends = 0;
+    while (![self.journal needsSnapshot]) {
+        settings[@"Counter"] = @(++appends);
+        XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"Counter"] fromSettings: settings error: nil]);
+        XCTAssertLessThan(appends, 1000);
+    }
+    XCTAssertEqualObjects([self.journal readSettings], settings);
+
+    XCTAssertTrue([self.journal writeSnapshot: settings error: nil]);
+    // back to just the header
+    XCTAssertLessThan([self sizeOfFile: self.journal.journalPath], 64);
+    XCTAssertFalse([self.journal needsSnapshot]);
+    XCTAssertEqualObjects([self.journal readSettings], settings);
+}
+
+- (void)testStaleJournalIsNotReplayedOverANewerSnapshot {
+    XCTAssertTrue([self.journal writeSnapshot: @{ @"A": @1, @"B": @1 } error: nil]);
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"A"] fromSettings: @{ @"A": @2 } error: nil]);
+    NSData* staleJournal = [NSData dataWithContentsOfFile: self.journal.journalPath];
+
+    // i.e. we crashed after writing the snapshot, before starting its journal - and the
+    // snapshot has a newer value than the old journal does
+    XCTAssertTrue([self.journal writeSnapshot: @{ @"A": @3, @"B": @1 } error: nil]);
+    XCTAssertFalse([self.journal needsSnapshot]);
+    [staleJournal writeToFile: self.journal.journalPath atomically: NO];
+
+    XCTAssertEqualObjects([self.journal readSettings], (@{ @"A": @3, @"B": @1 }));
+    // and it won't be appended to either
+    XCTAssertTrue([self.journal needsSnapshot]);
+}
+
+- (void)testHeaderlessJournalOnlyCountsIfNewerThanTheSnapshot {
+    XCTAssertTrue([self.journal writeSnapshot: @{ @"A": @1 } error: nil]);
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"A"] fromSettings: @{ @"A": @2 } error: nil]);
+    // a journal from before there were headers is just the records
+    NSData* journal = [NSData dataWithContentsOfFile: self.journal.journalPath];
+    NSData* headerless = [journal subdataWithRange: NSMakeRange(36, journal.length - 36)];
+    [headerless writeToFile: self.journal.journalPath atomically: NO];
+
+    NSDate* now = [NSDate date];
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    [fileManager setAttributes: @{ NSFileModificationDate: [now dateByAddingTimeInterval: -60] } ofItemAtPath: self.journal.snapshotPath error: nil];
+    [fileManager setAttributes: @{ NSFileModificationDate: now } ofItemAtPath: self.journal.journalPath error: nil];
+    XCTAssertEqualObjects([self.journal readSettings], (@{ @"A": @2 }));
+    XCTAssertFalse([self.journal needsSnapshot]);
+
+    // but next to a fresher snapshot, it's left over from an older one
+    [fileManager setAttributes: @{ NSFileModificationDate: [now dateByAddingTimeInterval: 60] } ofItemAtPath: self.journal.snapshotPath error: nil];
+    XCTAssertEqualObjects([self.journal readSettings], (@{ @"A": @1 }));
+    XCTAssertTrue([self.journal needsSnapshot]);
+}
+
+- (void)testUnchangedJournalIsNotReread {
+    XCTAssertTrue([self.journal writeSnapshot: @{ @"A": @1 } error: nil]);
+    SCSettingsJournal* reader = [[SCSettingsJournal alloc] initWithSnapshotPath: self.journal.snapshotPath];
+
+    XCTAssertEqualObjects([reader readSettingsIfChanged], (@{ @"A": @1 }));
+    XCTAssertNil([reader readSettingsIfChanged]);
+    XCTAssertNil([reader readSettingsIfChanged]);
+    XCTAssertEqual([reader.statistics[@"UnchangedCount"] unsignedIntegerValue], 2);
+
+    // our own writes don't count as changes either
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"A"] fromSettings: @{ @"A": @2 } error: nil]);
+    XCTAssertNil([self.journal readSettingsIfChanged]);
+}
+
+- (void)testAppendedRecordsReuseTheParsedSnapshot {
+    NSMutableDictionary* settings = [self bigSettings];
+    XCTAssertTrue([self.journal writeSnapshot: settings error: nil]);
+    SCSettingsJournal* reader = [[SCSettingsJournal alloc] initWithSnapshotPath: self.journal.snapshotPath];
+    XCTAssertEqualObjects([reader readSettingsIfChanged], settings);
+    XCTAssertEqual([reader.statistics[@"SnapshotParseCount"] unsignedIntegerValue], 1);
+
+    settings[@"BlockIsRunning"] = @NO;
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"BlockIsRunning"] fromSettings: settings error: nil]);
+    XCTAssertEqualObjects([reader readSettingsIfChanged], settings);
+    XCTAssertEqual([reader.statistics[@"SnapshotParseCount"] unsignedIntegerValue], 1);
+
+    // a new snapshot comes with a new journal, so it gets noticed (and parsed) too
+    settings[@"SettingsVersionNumber"] = @11;
+    XCTAssertTrue([self.journal writeSnapshot: settings error: nil]);
+    XCTAssertEqualObjects([reader readSettingsIfChanged], settings);
+    XCTAssertEqual([reader.statistics[@"SnapshotParseCount"] unsignedIntegerValue], 2);
+}
+
+- (void)testFullReadNoticesAChangedSnapshot {
+    XCTAssertTrue([self.journal writeSnapshot: @{ @"A": @1 } error: nil]);
+    SCSettingsJournal* reader = [[SCSettingsJournal alloc] initWithSnapshotPath: self.journal.snapshotPath];
+    XCTAssertNotNil([reader readSettingsIfChanged]);
+
+    // someone swaps out the snapshot, and leaves the journal alone
+    [@{ @"A": @99 } writeToFile: self.journal.snapshotPath atomically: YES];
+
+    XCTAssertNil([reader readSettingsIfChanged]);
+    XCTAssertEqualObjects([reader readSettings], (@{ @"A": @99 }));
+}
+
+- (void)testIdleCheckCostsOneStat {
+    static NSUInteger const kIterations = 200;
+    XCTAssertTrue([self.journal writeSnapshot: [self bigSettings] error: nil]);
+    XCTAssertTrue([self.journal appendChangesForKeys: [NSSet setWithObject: @"BlockIsRunning"] fromSettings: @{ @"BlockIsRunning": @NO } error: nil]);
+
+    SCSettingsJournal* idleReader = [[SCSettingsJournal alloc] initWithSnapshotPath: self.journal.snapshotPath];
+    XCTAssertNotNil([idleReader readSettingsIfChanged]);
+    for (NSUInteger i = 0; i < kIterations; i++) {
+        XCTAssertNil([idleReader readSettingsIfChanged]);
+    }
+
+    // one stat per check, and nothing read or parsed past the first
+    XCTAssertEqual([idleReader.statistics[@"StatCount"] unsignedIntegerValue], kIterations + 1);
+    XCTAssertEqual([idleReader.statistics[@"UnchangedCount"] unsignedIntegerValue], kIterations);
+    XCTAssertEqual([idleReader.statistics[@"SnapshotParseCount"] unsignedIntegerValue], 1);
+}
+
+@end
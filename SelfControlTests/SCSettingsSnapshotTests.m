@@ -0,0 +1,97 @@
+//
+//  SCSettingsSnapshotTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCSettings.h"
+
+@interface SCSettingsSnapshotTests : XCTestCase
+
+@end
+
+@implementation SCSettingsSnapshotTests
+
++ (void)setUp {
+    // SCSettings shouldn't be readOnly during our tests
+    // so we can test changing values
+    [SCSettings sharedSettings].readOnly = NO;
+}
+
+- (void)testDefaultsAreFilledIn {
+    SCSettings* settings = [SCSettings sharedSettings];
+    [settings setValue: nil forKey: @"BlockSound"];
+
+    XCTAssertEqualObjects([settings valueForKey: @"BlockSound"], @5);
+    XCTAssertEqualObjects(settings.dictionaryRepresentation[@"BlockSound"], @5);
+    XCTAssertNil([settings valueForKey: @"NotARealSetting"]);
+}
+
+- (void)testSnapshotsDontChangeUnderneathYou {
+    SCSettings* settings = [SCSettings sharedSettings];
+    [settings setValue: @2 forKey: @"BlockSound"];
+    NSDictionary* before = settings.dictionaryRepresentation;
+
+    [settings setValue: @7 forKey: @"BlockSound"];
+
+    XCTAssertEqualObjects(before[@"BlockSound"], @2);
+    XCTAssertEqualObjects([settings valueForKey: @"BlockSound"], @7);
+    XCTAssertLessThan([before[@"SettingsVersionNumber"] intValue], [[settings valueForKey: @"SettingsVersionNumber"] intValue]);
+    XCTAssertFalse([before isKindOfClass: [NSMutableDictionary class]]);
+
+    [settings setValue: @5 forKey: @"BlockSound"];
+}
+
+- (void)testReadersSeeWholeBatches {
+    static NSUInteger const kWrites = 2000;
+    SCSettings* settings = [SCSettings sharedSettings];
+    // the snapshot only has the blocklist's count and hash, so vary the count along with BlockSound
+    NSArray* sites = @[ @"a.com", @"b.com", @"c.com", @"d.com", @"e.com" ];
+    [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: @0 forKey: @"BlockSound"];
+        [batch setValue: [sites subarrayWithRange: NSMakeRange(0, 1)] forKey: @"ActiveBlocklist"];
+    }];
+
+    __block BOOL writerDone = NO;
+    __block NSUInteger mismatches = 0;
+    __block NSUInteger reads = 0;
+    dispatch_group_t readers = dispatch_group_create();
+    for (int i = 0; i < 4; i++) {
+        dispatch_group_async(readers, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            NSUInteger localMismatches = 0, localReads = 0;
+            while (!writerDone) {
+                NSDictionary* snapshot = settings.dictionaryRepresentation;
+                NSUInteger expectedCount = [snapshot[@"BlockSound"] unsignedIntegerValue] % sites.count + 1;
+                if ([snapshot[@"ActiveBlocklistCount"] unsignedIntegerValue] != expectedCount) localMismatches++;
+                localReads++;
+            }
+            @synchronized (self) {
+                mismatches += localMismatches;
+                reads += localReads;
+            }
+        });
+    }
+
+    for (NSUInteger i = 1; i <= kWrites; i++) {
+        [settings performBatchUpdates:^(SCSettings* batch) {
+            [batch setValue: @(i) forKey: @"BlockSound"];
+            [batch setValue: [sites subarrayWithRange: NSMakeRange(0, i % sites.count + 1)] forKey: @"ActiveBlocklist"];
+        }];
+    }
+    writerDone = YES;
+    dispatch_group_wait(readers, DISPATCH_TIME_FOREVER);
+
+    NSLog(@"SCSettingsSnapshotTests: %lu lock-free reads during %lu batched writes", (unsigned long)reads, (unsigned long)kWrites);
+    XCTAssertEqualObjects([settings valueForKey: @"BlockSound"], @(kWrites));
+    XCTAssertGreaterThan(reads, 0);
+    XCTAssertEqual(mismatches, 0);
+
+    [settings performBatchUpdates:^(SCSettings* batch) {
+        [batch setValue: @5 forKey: @"BlockSound"];
+        [batch setValue: nil forKey: @"ActiveBlocklist"];
+    }];
+}
+
+@end
@@ -0,0 +1,147 @@
+//
+//  SCSpanRecorderTests.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <XCTest/XCTest.h>
+#import "SCSpanRecorder.h"
+
+@interface SCSpanRecorderTests : XCTestCase
+
+@end
+
+@implementation SCSpanRecorderTests
+
+- (void)testSpansOnlyShowUpOnceEnded {
+    SCSpanRecorder* recorder = [[SCSpanRecorder alloc] initWithCapacity: 8];
+    SCSpan* span = [recorder startSpan: @"pfctl" attributes: @{ @"Command": @"-E" }];
+    XCTAssertEqual([recorder recentSpans].count, 0);
+
+    usleep(10000);
+    [span endWithAttributes: @{ @"ExitStatus": @0 }];
+    // ending twice shouldn't record it twice
+    [span end];
+
+    NSArray<NSDictionary*>* spans = [recorder recentSpans];
+    XCTAssertEqual(spans.count, 1);
+    XCTAssertEqualObjects(spans[0][@"Name"], @"pfctl");
+    XCTAssertNil(spans[0][@"Operation"]);
+    XCTAssertGreaterThanOrEqual([spans[0][@"DurationSecs"] doubleValue], 0.01);
+    XCTAssertEqualObjects(spans[0][@"Attributes"], (@{ @"Command": @"-E", @"ExitStatus": @0 }));
+}
+
+- (void)testRingBufferKeepsNewestSpansInOrder {
+    SCSpanRecorder* recorder = [[SCSpanRecorder alloc] initWithCapacity: 4];
+    for (int i = 0; i < 10; i++) {
+        [[recorder startSpan: [NSString stringWithFormat: @"span%d", i]] end];
+    }
+
+    NSArray<NSString*>* names = [[recorder recentSpans] valueForKey: @"Name"];
+    XCTAssertEqualObjects(names, (@[@"span6", @"span7", @"span8", @"span9"]));
+
+    [recorder removeAllSpans];
+    XCTAssertEqual([recorder recentSpans].count, 0);
+}
+
+- (void)testSpansAreTaggedWithInnermostOperation {
+    SCSpanRecorder* recorder = [[SCSpanRecorder alloc] initWithCapacity: 16];
+    [recorder beginOperation: @"checkBlockIntegrity"];
+    [[recorder startSpan: @"integrity.check"] end];
+    [recorder beginOperation: @"removeBlock"];
+    [[recorder startSpan: @"block.clear"] end];
+    [recorder endOperation];
+    [[recorder startSpan: @"caches.clear.dns"] end];
+    [recorder endOperation];
+
+    NSArray<NSDictionary*>* spans = [recorder recentSpans];
+    XCTAssertEqualObjects([spans valueForKey: @"Name"], (@[@"block.clear", @"removeBlock", @"integrity.check", @"caches.clear.dns", @"checkBlockIntegrity"]));
+    XCTAssertEqualObjects([spans valueForKey: @"Operation"], (@[@"removeBlock", @"removeBlock", @"checkBlockIntegrity", @"checkBlockIntegrity", @"checkBlockIntegrity"]));
+    XCTAssertNotEqualObjects(spans[0][@"OperationID"], spans[2][@"OperationID"]);
+}
+
+- (void)testOperationsBelongToTheirThread {
+    SCSpanRecorder* recorder = [[SCSpanRecorder alloc] initWithCapacity: 16];
+    [recorder beginOperation: @"startBlock"];
+
+    // i.e. the refresher running pfctl while a block starts
+    XCTestExpectation* otherThreadDone = [self expectationWithDescription: @"other thread done"];
+    [NSThread detachNewThreadWithBlock:^{
+        [[recorder startSpan: @"pfctl"] end];
+        // and ending an operation on the wrong thread doesn't end ours
+        [recorder endOperation];
+        [otherThreadDone fulfill];
+    }];
+    [self waitForExpectations: @[otherThreadDone] timeout: 5.0];
+    [[recorder startSpan: @"pf.anchor.write"] end];
+    [recorder endOperation];
+
+    NSArray<NSDictionary*>* spans = [recorder recentSpans];
+    XCTAssertEqualObjects([spans valueForKey: @"Name"], (@[@"pfctl", @"pf.anchor.write", @"startBlock"]));
+    XCTAssertNil(spans[0][@"Operation"]);
+    XCTAssertEqualObjects(spans[1][@"Operation"], @"startBlock");
+}
+
+- (void)testOperationsCanBeCarriedToWorkers {
+    SCSpanRecorder* recorder = [[SCSpanRecorder alloc] initWithCapacity: 16];
+    XCTAssertNil([recorder currentOperation]);
+    [recorder beginOperation: @"startBlock"];
+    SCSpan* operation = [recorder currentOperation];
+    XCTAssertEqualObjects(operation.name, @"startBlock");
+
+    // i.e. HostFileBlockerSet writing every hosts file at once
+    dispatch_apply(4, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        [recorder performInOperation: operation block:^{
+            [[recorder startSpan: @"hosts.write"] end];
+        }];
+    });
+    XCTestExpectation* otherThreadDone = [self expectationWithDescription: @"other thread done"];
+    [NSThread detachNewThreadWithBlock:^{
+        [recorder performInOperation: operation block:^{}];
+        // once it's done, the worker's back to having no operation
+        [[recorder startSpan: @"pfctl"] end];
+        [otherThreadDone fulfill];
+    }];
+    [self waitForExpectations: @[otherThreadDone] timeout: 5.0];
+    // and the operation is still open where it started
+    XCTAssertEqual([recorder currentOperation], operation);
+    [recorder endOperation];
+
+    NSArray<NSDictionary*>* spans = [recorder recentSpans];
+    XCTAssertEqualObjects([spans valueForKey: @"Name"], (@[@"pfctl", @"hosts.write", @"hosts.write", @"hosts.write", @"hosts.write", @"startBlock"]));
+    XCTAssertNil(spans[0][@"Operation"]);
+    for (NSDictionary* span in [spans subarrayWithRange: NSMakeRange(1, 4)]) {
+        XCTAssertEqualObjects(span[@"Operation"], @"startBlock");
+        XCTAssertEqualObjects(span[@"OperationID"], @(operation.operationID));
+    }
+}
+
+- (void)testDiscardedOperationsLeaveNothingBehind {
+    SCSpanRecorder* recorder = [[SCSpanRecorder alloc] initWithCapacity: 16];
+    [[recorder startSpan: @"settings.sync"] end];
+
+    [recorder beginOperation: @"checkBlockIntegrity"];
+    [[recorder startSpan: @"integrity.check"] end];
+    SCSpan* straggler = [recorder startSpan: @"hosts.write"];
+    [recorder discardOperation];
+
+    XCTAssertEqualObjects([[recorder recentSpans] valueForKey: @"Name"], @[@"settings.sync"]);
+
+    // spans that outlive their operation still get recorded
+    [straggler end];
+    XCTAssertEqualObjects([[recorder recentSpans] valueForKey: @"Name"], (@[@"settings.sync", @"hosts.write"]));
+}
+
+- (void)testRecordedSpansKeepTheirOwnTimings {
+    SCSpanRecorder* recorder = [[SCSpanRecorder alloc] initWithCapacity: 4];
+    NSDate* startDate = [NSDate dateWithTimeIntervalSince1970: 1000];
+    [recorder recordSpan: @"dns.resolve" startDate: startDate duration: 2.5 attributes: @{ @"Count": @12 }];
+
+    NSDictionary* span = [recorder recentSpans].firstObject;
+    XCTAssertEqualObjects(span[@"StartDate"], startDate);
+    XCTAssertEqualWithAccuracy([span[@"DurationSecs"] doubleValue], 2.5, 0.0001);
+    XCTAssertEqualObjects(span[@"Attributes"][@"Count"], @12);
+}
+
+@end
@@ -0,0 +1,38 @@
+//
+//  SCStubDNSServer.h
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A tiny DNS server listening on 127.0.0.1 (UDP and TCP, same port) for tests.
+// It answers A/AAAA queries out of the records dictionary, never answers
+// anything in silentDomains (to simulate dead nameservers/domains), and returns
+// NXDOMAIN (with an SOA record) for everything else.
+@interface SCStubDNSServer : NSObject
+
+// domain -> array of IPv4 and/or IPv6 address strings
+@property (copy) NSDictionary<NSString*, NSArray<NSString*>*>* records;
+@property (copy) NSSet<NSString*>* silentDomains;
+// UDP answers for these have the TC bit set and no records; only TCP gets the real answer
+@property (copy) NSSet<NSString*>* truncatedDomains;
+@property uint32_t answerTTL;
+@property uint32_t negativeTTL;
+// how long to wait before sending each answer
+@property NSTimeInterval responseDelay;
+
+@property (readonly) uint16_t port;
+@property (readonly) NSUInteger queryCount;
+@property (readonly) NSUInteger tcpQueryCount;
+
+// returns nil if we couldn't bind the loopback sockets
+- (nullable instancetype)init;
+- (void)stop;
+
+@end
+
+NS_ASSUME_NONNULL_END
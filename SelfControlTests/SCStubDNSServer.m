@@ -0,0 +1,256 @@
+//
+//  SCStubDNSServer.m
+//  SelfControlTests
+//
+//  Created by Charlie Stigler on 10/17/26.
+//
+
+#import "SCStubDNSServer.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+@interface SCStubDNSServer () {
+    int _socket;
+    int _tcpSocket;
+    dispatch_queue_t _queue;
+    dispatch_source_t _readSource;
+    dispatch_source_t _acceptSource;
+    NSUInteger _queryCount;
+    NSUInteger _tcpQueryCount;
+}
+
+@end
+
+@implementation SCStubDNSServer
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _answerTTL = 60;
+        _negativeTTL = 120;
+        _records = @{};
+        _silentDomains = [NSSet set];
+        _truncatedDomains = [NSSet set];
+        _queue = dispatch_queue_create("org.eyebeam.SelfControlTests.SCStubDNSServer", DISPATCH_QUEUE_SERIAL);
+
+        _socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (_socket < 0) return nil;
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_len = sizeof(address);
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0; // let the OS pick
+        if (bind(_socket, (struct sockaddr*)&address, sizeof(address)) != 0) {
+            close(_socket);
+            return nil;
+        }
+        socklen_t addressLength = sizeof(address);
+        getsockname(_socket, (struct sockaddr*)&address, &addressLength);
+        _port = ntohs(address.sin_port);
+
+        // TCP on the same port, for clients retrying truncated answers
+        _tcpSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (_tcpSocket < 0 || bind(_tcpSocket, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(_tcpSocket, 8) != 0) {
+            if (_tcpSocket >= 0) close(_tcpSocket);
+            close(_socket);
+            return nil;
+        }
+        fcntl(_tcpSocket, F_SETFL, fcntl(_tcpSocket, F_GETFL, 0) | O_NONBLOCK);
+
+        fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL, 0) | O_NONBLOCK);
+
+        int fd = _socket;
+        _readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, _queue);
+        __weak SCStubDNSServer* weakSelf = self;
+        dispatch_source_set_event_handler(_readSource, ^{
+            [weakSelf readQueries];
+        });
+        dispatch_source_set_cancel_handler(_readSource, ^{
+            close(fd);
+        });
+        dispatch_resume(_readSource);
+
+        int tcpFD = _tcpSocket;
+        _acceptSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)tcpFD, 0, _queue);
+        dispatch_source_set_event_handler(_acceptSource, ^{
+            [weakSelf acceptConnections];
+        });
+        dispatch_source_set_cancel_handler(_acceptSource, ^{
+            close(tcpFD);
+        });
+        dispatch_resume(_acceptSource);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    [self stop];
+}
+
+- (void)stop {
+    if (_readSource != nil) {
+        dispatch_source_cancel(_readSource);
+        _readSource = nil;
+    }
+    if (_acceptSource != nil) {
+        dispatch_source_cancel(_acceptSource);
+        _acceptSource = nil;
+    }
+}
+
+- (NSUInteger)queryCount {
+    @synchronized (self) {
+        return _queryCount;
+    }
+}
+
+- (NSUInteger)tcpQueryCount {
+    @synchronized (self) {
+        return _tcpQueryCount;
+    }
+}
+
+- (void)readQueries {
+    uint8_t buffer[2048];
+    struct sockaddr_storage from;
+
+    while (YES) {
+        socklen_t fromLength = sizeof(from);
+        ssize_t received = recvfrom(_socket, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &fromLength);
+        if (received < 12) return;
+
+        @synchronized (self) {
+            _queryCount++;
+        }
+
+        NSData* response = [self responseToQuery: [NSData dataWithBytes: buffer length: (NSUInteger)received] overTCP: NO];
+        if (response == nil) continue;
+
+        NSData* fromData = [NSData dataWithBytes: &from length: fromLength];
+        int fd = _socket;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.responseDelay * NSEC_PER_SEC)), _queue, ^{
+            sendto(fd, response.bytes, response.length, 0, fromData.bytes, (socklen_t)fromData.length);
+        });
+    }
+}
+
+static void AppendUInt16(NSMutableData* data, uint16_t value) {
+    uint16_t networkValue = htons(value);
+    [data appendBytes: &networkValue length: 2];
+}
+
+static void AppendUInt32(NSMutableData* data, uint32_t value) {
+    uint32_t networkValue = htonl(value);
+    [data appendBytes: &networkValue length: 4];
+}
+
+- (void)acceptConnections {
+    while (YES) {
+        int fd = accept(_tcpSocket, NULL, NULL);
+        if (fd < 0) return;
+
+        // one query per connection is all the clients under test send
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+            struct timeval tv = { .tv_sec = 2, .tv_usec = 0 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+            uint8_t lengthBytes[2];
+            if (recv(fd, lengthBytes, 2, MSG_WAITALL) == 2) {
+                uint16_t length = (uint16_t)((lengthBytes[0] << 8) | lengthBytes[1]);
+                NSMutableData* query = [NSMutableData dataWithLength: length];
+                if (length >= 12 && recv(fd, query.mutableBytes, length, MSG_WAITALL) == length) {
+                    @synchronized (self) {
+                        self->_tcpQueryCount++;
+                    }
+
+                    NSData* response = [self responseToQuery: query overTCP: YES];
+                    if (response != nil) {
+                        [NSThread sleepForTimeInterval: self.responseDelay];
+                        NSMutableData* framed = [NSMutableData data];
+                        AppendUInt16(framed, (uint16_t)response.length);
+                        [framed appendData: response];
+                        send(fd, framed.bytes, framed.length, 0);
+                    }
+                }
+            }
+            close(fd);
+        });
+    }
+}
+
+- (nullable NSData*)responseToQuery:(NSData*)query overTCP:(BOOL)overTCP {
+    const uint8_t* bytes = query.bytes;
+
+    // we only support uncompressed question names, which is all a client ever sends
+    NSMutableArray<NSString*>* labels = [NSMutableArray array];
+    NSUInteger offset = 12;
+    while (offset < query.length && bytes[offset] != 0) {
+        uint8_t labelLength = bytes[offset];
+        if (offset + 1 + labelLength > query.length) return nil;
+        [labels addObject: [[NSString alloc] initWithBytes: bytes + offset + 1 length: labelLength encoding: NSASCIIStringEncoding]];
+        offset += 1 + labelLength;
+    }
+    NSUInteger questionEnd = offset + 1 + 4;
+    if (questionEnd > query.length) return nil;
+    uint16_t type = (uint16_t)((bytes[offset + 1] << 8) | bytes[offset + 2]);
+    NSString* domain = [[labels componentsJoinedByString: @"."] lowercaseString];
+
+    if ([self.silentDomains containsObject: domain]) return nil;
+
+    NSArray<NSString*>* domainRecords = self.records[domain];
+    BOOL truncated = !overTCP && [self.truncatedDomains containsObject: domain];
+    NSMutableArray<NSData*>* answers = [NSMutableArray array];
+    for (NSString* address in (truncated ? @[] : domainRecords)) {
+        BOOL isIPv6 = [address containsString: @":"];
+        if ((type == 1 && isIPv6) || (type == 28 && !isIPv6)) continue;
+
+        uint8_t addressBytes[16];
+        inet_pton(isIPv6 ? AF_INET6 : AF_INET, address.UTF8String, addressBytes);
+        [answers addObject: [NSData dataWithBytes: addressBytes length: isIPv6 ? 16 : 4]];
+    }
+
+    NSMutableData* response = [NSMutableData data];
+    [response appendBytes: bytes length: 2]; // same ID
+    uint8_t rcode = (domainRecords == nil) ? 3 : 0;
+    AppendUInt16(response, 0x8180 | (truncated ? 0x0200 : 0) | rcode);
+    AppendUInt16(response, 1);
+    AppendUInt16(response, (uint16_t)answers.count);
+    AppendUInt16(response, (answers.count == 0 && !truncated) ? 1 : 0);
+    AppendUInt16(response, 0);
+    [response appendBytes: bytes + 12 length: questionEnd - 12];
+
+    for (NSData* answer in answers) {
+        AppendUInt16(response, 0xC00C); // pointer to the question name
+        AppendUInt16(response, answer.length == 16 ? 28 : 1);
+        AppendUInt16(response, 1);
+        AppendUInt32(response, self.answerTTL);
+        AppendUInt16(response, (uint16_t)answer.length);
+        [response appendData: answer];
+    }
+
+    if (answers.count == 0 && !truncated) {
+        // SOA in the authority section so the client knows how long to cache the negative answer
+        AppendUInt16(response, 0xC00C);
+        AppendUInt16(response, 6);
+        AppendUInt16(response, 1);
+        AppendUInt32(response, self.negativeTTL);
+        AppendUInt16(response, 2 + 2 + 20);
+        AppendUInt16(response, 0xC00C); // MNAME
+        AppendUInt16(response, 0xC00C); // RNAME
+        AppendUInt32(response, 1); // serial
+        AppendUInt32(response, 3600); // refresh
+        AppendUInt32(response, 600); // retry
+        AppendUInt32(response, 86400); // expire
+        AppendUInt32(response, self.negativeTTL); // minimum
+    }
+
+    return response;
+}
+
+@end
@@ -164,6 +164,24 @@ NSDictionary* veryLongBlockLegacyDict; // year-long block, one day in
     XCTAssert([SCBlockUtilities currentBlockIsExpired]);
 }
 
+- (void) testBlockEndDateChanges {
+    NSDate* endDate = [NSDate dateWithTimeIntervalSinceNow: 3600];
+
+    XCTAssertNil([SCBlockUtilities errorForChangingBlockEndDate: endDate toDate: endDate]);
+    XCTAssertNil([SCBlockUtilities errorForChangingBlockEndDate: endDate toDate: [endDate dateByAddingTimeInterval: 600]]);
+    XCTAssertNil([SCBlockUtilities errorForChangingBlockEndDate: endDate toDate: [endDate dateByAddingTimeInterval: 86400]]);
+
+    // blocks can't be shortened
+    NSError* err = [SCBlockUtilities errorForChangingBlockEndDate: endDate toDate: [endDate dateByAddingTimeInterval: -60]];
+    XCTAssertEqual(err.code, 308);
+    err = [SCBlockUtilities errorForChangingBlockEndDate: endDate toDate: [NSDate date]];
+    XCTAssertEqual(err.code, 308);
+
+    // or extended by more than a day at once
+    err = [SCBlockUtilities errorForChangingBlockEndDate: endDate toDate: [endDate dateByAddingTimeInterval: 86401]];
+    XCTAssertEqual(err.code, 309);
+}
+
 - (void) testLegacyBlockDetection {
     // test blockIsRunningInLegacyDictionary
     // the block is "running" even if it's expired, since it hasn't been removed
@@ -24,6 +24,7 @@
 
 #import "TimerWindowController.h"
 #import "SCUIUtilities.h"
+#import "SCBlockState.h"
 
 @interface TimerWindowController ()
 
@@ -81,7 +82,7 @@
     extendDurationSlider_.maxDuration = [defaults integerForKey: @"MaxBlockLength"];
 
     if ([SCBlockUtilities modernBlockIsRunning]) {
-        blockEndingDate_ = [settings_ valueForKey: @"BlockEndDate"];
+        blockEndingDate_ = [self modernBlockEndDate];
     } else {
         // legacy block!
         blockEndingDate_ = [SCMigrationUtilities legacyBlockEndDate];
@@ -224,11 +225,26 @@
     
     // make sure add to list is disabled if it's an allowlist block
     // don't worry about it for a legacy block! the buttons are disabled anyway so it doesn't matter
-    if ([SCBlockUtilities modernBlockIsRunning]) {
+    // (this runs every second, so use the daemon's published state if we can)
+    SCBlockState* state = [SCBlockUtilities publishedBlockState];
+    if (state != nil) {
+        if (state.blockIsRunning) {
+            addToBlockButton_.enabled = !state.isAllowlist;
+        }
+    } else if ([SCBlockUtilities modernBlockIsRunning]) {
         addToBlockButton_.enabled = ![settings_ boolForKey: @"ActiveBlockAsWhitelist"];
     }
 }
 
+- (NSDate*)modernBlockEndDate {
+    SCBlockState* state = [SCBlockUtilities publishedBlockState];
+    if (state != nil) {
+        return state.blockEndDate;
+    }
+
+    return [settings_ valueForKey: @"BlockEndDate"];
+}
+
 - (void)windowShouldClose:(NSNotification *)notification {
 	// Hack to make the application terminate after the last window is closed, but
 	// INCLUDE the HUD-style timer window.
@@ -298,7 +314,7 @@
 
 - (void)configurationChanged {
     if ([SCBlockUtilities modernBlockIsRunning]) {
-        blockEndingDate_ = [settings_ valueForKey: @"BlockEndDate"];
+        blockEndingDate_ = [self modernBlockEndDate];
     } else {
         // legacy block!
         blockEndingDate_ = [SCMigrationUtilities legacyBlockEndDate];
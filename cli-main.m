@@ -25,8 +25,32 @@
 #import "SCSettings.h"
 #import "SCXPCClient.h"
 #import "SCBlockFileReaderWriter.h"
+#import "SCBlockFileStream.h"
 #import <sysexits.h>
 #import "XPMArguments.h"
+#import "BlockManager.h"
+#import "SCStaticResolver.h"
+#import "SCBlockState.h"
+
+// NSJSONSerialization can't handle dates, so swap them for ISO8601 strings (recursively)
+static id JSONSafeObject(id obj) {
+    if ([obj isKindOfClass: [NSDate class]]) {
+        return [[NSISO8601DateFormatter new] stringFromDate: obj];
+    } else if ([obj isKindOfClass: [NSDictionary class]]) {
+        NSMutableDictionary* safeDict = [NSMutableDictionary dictionaryWithCapacity: [obj count]];
+        for (id key in obj) {
+            safeDict[[key description]] = JSONSafeObject(obj[key]);
+        }
+        return safeDict;
+    } else if ([obj isKindOfClass: [NSArray class]]) {
+        NSMutableArray* safeArray = [NSMutableArray arrayWithCapacity: [obj count]];
+        for (id item in obj) {
+            [safeArray addObject: JSONSafeObject(item)];
+        }
+        return safeArray;
+    }
+    return obj;
+}
 
 // The main method which deals which most of the logic flow and execution of
 // the CLI tool.
@@ -43,8 +67,13 @@ int main(int argc, char* argv[]) {
           * removeSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[remove --remove]"],
           * printSettingsSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[print-settings --printsettings -p]"],
           * isRunningSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[is-running --isrunning -r]"],
-          * versionSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[version --version -v]"];
-        NSArray * signatures = @[controllingUIDSig, startSig, blocklistSig, blockEndDateSig, blockSettingsSig, removeSig, printSettingsSig, isRunningSig, versionSig];
+          * versionSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[version --version -v]"],
+          * compileSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[compile --compile]"],
+          * outDirSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[--out -o]="],
+          * resolutionsSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[--resolutions]="],
+          * liveDNSSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[--live-dns]"],
+          * timingsSig = [XPMArgumentSignature argumentSignatureWithFormat:@"[timings --timings]"];
+        NSArray * signatures = @[controllingUIDSig, startSig, blocklistSig, blockEndDateSig, blockSettingsSig, removeSig, printSettingsSig, isRunningSig, versionSig, compileSig, outDirSig, resolutionsSig, liveDNSSig, timingsSig];
         XPMArgumentPackage * arguments = [[NSProcessInfo processInfo] xpmargs_parseArgumentsWithSignatures:signatures];
         
         // We'll need the controlling UID to know what settings to read
@@ -110,10 +139,11 @@ int main(int argc, char* argv[]) {
             // if we got valid block arguments from the command-line, read in that file
             if (pathToBlocklistFile != nil && blockEndDateArg != nil && [blockEndDateArg timeIntervalSinceNow] >= 1) {
                 blockEndDate = blockEndDateArg;
-                NSDictionary* readProperties = [SCBlockFileReaderWriter readBlocklistFromFile: [NSURL fileURLWithPath: pathToBlocklistFile]];
+                NSError* readErr = nil;
+                NSDictionary* readProperties = [SCBlockFileReaderWriter readBlocklistFromFile: [NSURL fileURLWithPath: pathToBlocklistFile] error: &readErr];
                 
                 if (readProperties == nil) {
-                    NSLog(@"ERROR: Block could not be read from file %@", pathToBlocklistFile);
+                    NSLog(@"ERROR: Block could not be read from file %@: %@", pathToBlocklistFile, readErr.localizedDescription);
                     exit(EX_IOERR);
                 }
                 
@@ -134,6 +164,8 @@ int main(int argc, char* argv[]) {
                 @"AllowLocalNetworks": defaultsDict[@"AllowLocalNetworks"],
                 @"EvaluateCommonSubdomains": defaultsDict[@"EvaluateCommonSubdomains"],
                 @"IncludeLinkedDomains": defaultsDict[@"IncludeLinkedDomains"],
+                @"CompactHostsFile": defaultsDict[@"CompactHostsFile"],
+                @"DNSSinkholeEnabled": defaultsDict[@"DNSSinkholeEnabled"],
                 @"BlockSoundShouldPlay": defaultsDict[@"BlockSoundShouldPlay"],
                 @"BlockSound": defaultsDict[@"BlockSound"],
                 @"EnableErrorReporting": defaultsDict[@"EnableErrorReporting"]
@@ -217,6 +249,103 @@ int main(int argc, char* argv[]) {
                     [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate: [NSDate date]];
                 }
             }
+        } else if ([arguments booleanValueForSignature: compileSig]) {
+            [SCSentry addBreadcrumb: @"CLI method --compile called" category: @"cli"];
+
+            // compile renders a block into a directory without installing anything,
+            // so it doesn't need root, the daemon, or pfctl
+            NSString* pathToBlocklistFile = [arguments firstObjectForSignature: blocklistSig];
+            NSString* outDir = [arguments firstObjectForSignature: outDirSig];
+            if (pathToBlocklistFile == nil || outDir == nil) {
+                NSLog(@"ERROR: compile requires both --blocklist and --out");
+                exit(EX_USAGE);
+            }
+
+            // stream the file in, so a huge blocklist never has to be in memory twice
+            NSError* readErr = nil;
+            SCBlockFileReader* blockFileReader = [[SCBlockFileReader alloc] initWithFileURL: [NSURL fileURLWithPath: pathToBlocklistFile] error: &readErr];
+            if (blockFileReader == nil) {
+                NSLog(@"ERROR: Block could not be read from file %@ with error %@", pathToBlocklistFile, readErr);
+                exit(EX_IOERR);
+            }
+            BOOL blockAsWhitelist = blockFileReader.isAllowlist;
+
+            // linked domains are off by default, since finding them means fetching pages from the network
+            NSMutableDictionary* compileSettings = [@{
+                @"AllowLocalNetworks": @YES,
+                @"EvaluateCommonSubdomains": @YES,
+                @"IncludeLinkedDomains": @NO,
+                @"CompactHostsFile": @NO
+            } mutableCopy];
+            NSString* argSettingsString = [arguments firstObjectForSignature: blockSettingsSig];
+            if (argSettingsString != nil) {
+                NSError* jsonParseErr = nil;
+                NSDictionary* jsonSettings = [NSJSONSerialization JSONObjectWithData: [argSettingsString dataUsingEncoding: NSUTF8StringEncoding]
+                                                                             options: 0
+                                                                               error: &jsonParseErr];
+                if (![jsonSettings isKindOfClass: [NSDictionary class]]) {
+                    NSLog(@"ERROR: Failed to parse JSON settings string with error %@", jsonParseErr.localizedDescription);
+                    exit(EX_USAGE);
+                }
+                for (NSString* key in compileSettings.allKeys) {
+                    if (jsonSettings[key] != nil) {
+                        compileSettings[key] = jsonSettings[key];
+                    }
+                }
+            }
+
+            // by default nothing resolves, so the output only depends on the blocklist
+            id<SCDomainResolving> resolver = nil;
+            NSString* resolutionsPath = [arguments firstObjectForSignature: resolutionsSig];
+            if (resolutionsPath != nil) {
+                NSError* resolutionsErr = nil;
+                resolver = [SCStaticResolver resolverWithContentsOfFile: resolutionsPath error: &resolutionsErr];
+                if (resolver == nil) {
+                    NSLog(@"ERROR: Failed to read resolutions from %@ with error %@", resolutionsPath, resolutionsErr);
+                    exit(EX_IOERR);
+                }
+            } else if ([arguments booleanValueForSignature: liveDNSSig]) {
+                SCDNSResolver* dnsResolver = [SCDNSResolver new];
+                if (dnsResolver.nameservers.count == 0) {
+                    NSLog(@"ERROR: --live-dns was passed, but no nameservers could be found");
+                    exit(EX_UNAVAILABLE);
+                }
+                resolver = dnsResolver;
+            }
+
+            BlockManager* blockManager = [[BlockManager alloc] initForCompilingToRootPath: [outDir stringByStandardizingPath]
+                                                                                 resolver: resolver
+                                                                              asAllowlist: blockAsWhitelist
+                                                                               allowLocal: [compileSettings[@"AllowLocalNetworks"] boolValue]
+                                                                  includeCommonSubdomains: [compileSettings[@"EvaluateCommonSubdomains"] boolValue]
+                                                                     includeLinkedDomains: [compileSettings[@"IncludeLinkedDomains"] boolValue]];
+            blockManager.compactHostsRules = [compileSettings[@"CompactHostsFile"] boolValue];
+            [blockManager prepareToAddBlock];
+            BOOL readAllEntries = [blockFileReader enumerateEntriesStartingAt: 0 batchSize: 1000 usingBlock:^(NSArray<NSString*>* entries, BOOL* stop) {
+                // same cleanup the app does when entries are typed in, since blocklist files can be hand-edited
+                NSMutableArray<NSString*>* cleanedEntries = [NSMutableArray arrayWithCapacity: entries.count];
+                for (NSString* entry in entries) {
+                    [cleanedEntries addObjectsFromArray: [SCMiscUtilities cleanBlocklistEntry: entry]];
+                }
+                [blockManager addBlockEntriesFromStrings: cleanedEntries];
+            } error: &readErr];
+            if (!readAllEntries) {
+                NSLog(@"ERROR: Block could not be read from file %@ with error %@", pathToBlocklistFile, readErr);
+                exit(EX_IOERR);
+            }
+
+            NSError* compileErr = nil;
+            NSDictionary* manifest = [blockManager compileBlock: &compileErr];
+            if (manifest == nil) {
+                NSLog(@"ERROR: Failed to compile block with error %@", compileErr);
+                exit(EX_CANTCREAT);
+            }
+
+            NSLog(@"INFO: Compiled %@ entries (%lu domains resolved, %lu unresolved) into %@",
+                  manifest[@"EntryCount"],
+                  (unsigned long)[manifest[@"Resolutions"] count],
+                  (unsigned long)[manifest[@"UnresolvedDomains"] count],
+                  outDir);
         } else if([arguments booleanValueForSignature: removeSig]) {
             [SCSentry addBreadcrumb: @"CLI method --remove called" category: @"cli"];
 			// So you think you can rid yourself of SelfControl just like that?
@@ -224,12 +353,60 @@ int main(int argc, char* argv[]) {
             exit(EX_UNAVAILABLE);
         } else if ([arguments booleanValueForSignature: printSettingsSig]) {
             [SCSentry addBreadcrumb: @"CLI method --print-settings called" category: @"cli"];
+            SCBlockState* publishedState = [SCBlockUtilities publishedBlockState];
+            if (publishedState != nil) {
+                NSLog(@" - Block state published by the daemon: - ");
+                NSLog(@"%@", [publishedState dictionaryRepresentation]);
+            } else {
+                NSLog(@" - No block state published by the daemon - ");
+            }
             NSLog(@" - Printing SelfControl secured settings for debug: - ");
             NSLog(@"%@", [settings dictionaryRepresentation]);
+            // the settings only have the blocklist's hash and count, so print the list from its table
+            SCBlocklistTable* activeBlocklist = settings.activeBlocklistTable;
+            NSLog(@" - Active blocklist (%lu entries): - ", (unsigned long)activeBlocklist.count);
+            [activeBlocklist enumerateEntriesUsingBlock:^(NSString* entry, NSUInteger idx, BOOL* stop) {
+                NSLog(@"%@", entry);
+            }];
         } else if ([arguments booleanValueForSignature: isRunningSig]) {
             [SCSentry addBreadcrumb: @"CLI method --is-running called" category: @"cli"];
             BOOL blockIsRunning = [SCBlockUtilities anyBlockIsRunning];
             NSLog(@"%@", blockIsRunning ? @"YES" : @"NO");
+        } else if ([arguments booleanValueForSignature: timingsSig]) {
+            [SCSentry addBreadcrumb: @"CLI method --timings called" category: @"cli"];
+
+            SCXPCClient* xpc = [SCXPCClient new];
+            dispatch_semaphore_t timingsSema = dispatch_semaphore_create(0);
+            __block NSDictionary* timings = nil;
+
+            [xpc getBlockTimings:^(NSDictionary* _Nullable daemonTimings, NSError* _Nullable error) {
+                if (error != nil) {
+                    NSLog(@"ERROR: Failed to get block timings from daemon with error %@", error);
+                    exit(EX_UNAVAILABLE);
+                    return;
+                }
+                timings = daemonTimings;
+                dispatch_semaphore_signal(timingsSema);
+            }];
+
+            // same as start: the reply might come in on the main thread, so keep the run loop going
+            if (![NSThread isMainThread]) {
+                dispatch_semaphore_wait(timingsSema, DISPATCH_TIME_FOREVER);
+            } else {
+                while (dispatch_semaphore_wait(timingsSema, DISPATCH_TIME_NOW)) {
+                    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate: [NSDate date]];
+                }
+            }
+
+            NSError* jsonErr = nil;
+            NSData* jsonData = [NSJSONSerialization dataWithJSONObject: JSONSafeObject(timings ?: @{})
+                                                               options: NSJSONWritingPrettyPrinted | NSJSONWritingSortedKeys
+                                                                 error: &jsonErr];
+            if (jsonData == nil) {
+                NSLog(@"ERROR: Failed to serialize block timings with error %@", jsonErr);
+                exit(EX_SOFTWARE);
+            }
+            printf("%s\n", [[[NSString alloc] initWithData: jsonData encoding: NSUTF8StringEncoding] UTF8String]);
         } else if ([arguments booleanValueForSignature: versionSig]) {
             [SCSentry addBreadcrumb: @"CLI method --version called" category: @"cli"];
             NSLog(SELFCONTROL_VERSION_STRING);
@@ -245,6 +422,13 @@ int main(int argc, char* argv[]) {
             printf("\n    is-running --> prints YES if a SelfControl block is currently running, or NO otherwise\n");
             printf("\n    print-settings --> prints the SelfControl settings being used for the active block (for debug purposes)\n");
             printf("\n    version --> prints the version of the SelfControl CLI tool\n");
+            printf("\n    timings --> prints timings for recent block starts, updates and removals from the daemon, as JSON\n");
+            printf("\n    compile --> renders a block into a directory (hosts file, pf anchor and manifest.json) without installing it\n");
+            printf("        --blocklist <path to saved blocklist file>\n");
+            printf("        --out <directory to write the compiled block to>\n");
+            printf("        --settings <other block settings in JSON format>\n");
+            printf("        --resolutions <JSON or hosts-format file of addresses to use for domains>\n");
+            printf("        --live-dns (resolve domains over the network, instead of only from --resolutions)\n");
             printf("\n");
             printf("--uid argument MUST be specified and set to the controlling user ID if selfcontrol-cli is being run as root. Otherwise, it does not need to be set.\n\n");
             printf("Example start command: selfcontrol-cli start --blocklist /path/to/blocklist.selfcontrol --enddate 2021-02-12T06:53:00Z\n");